@@ -0,0 +1,65 @@
+#!/usr/bin/env ruby
+load './lib/mg.rb'
+
+require 'etc'
+
+# Runs one window with its own particle simulation per core, first on threads
+# that share the GVL and then on Ractors, and prints the throughput of each.
+#
+#   ./benchmark.rb [windows] [steps]
+
+module Simulation
+
+  PARTICLES = 2000
+  GRAVITY = -9.8
+  STEP = 1.0 / 60
+
+  def self.run(title, x, steps)
+    window = Mg::Window.new title, x, 0, 200, 200
+    window.show
+
+    positions = Array.new(PARTICLES) { |i| (i % 100).to_f }
+    velocities = Array.new(PARTICLES, 0.0)
+
+    steps.times do
+      dx, _ = window.pointer_delta
+      PARTICLES.times do |i|
+        velocities[i] += GRAVITY * STEP + dx * 0.001
+        positions[i] += velocities[i] * STEP
+        if positions[i] < 0
+          positions[i] = -positions[i]
+          velocities[i] = -velocities[i] * 0.9
+        end
+      end
+      break if window.key_down? :q
+    end
+
+    window.close
+    positions.sum
+  end
+
+end
+
+def measure(label, windows, steps)
+  start = Process.clock_gettime Process::CLOCK_MONOTONIC
+  yield
+  elapsed = Process.clock_gettime(Process::CLOCK_MONOTONIC) - start
+  puts format('%-8s %2d windows  %8.3f s  %10.1f steps/s', label, windows, elapsed, windows * steps / elapsed)
+end
+
+windows = (ARGV[0] || Etc.nprocessors).to_i
+steps = (ARGV[1] || 500).to_i
+
+measure 'threads', windows, steps do
+  windows.times.map do |n|
+    Thread.new { Simulation.run "Thread #{n}", n * 210, steps }
+  end.each(&:join)
+end
+
+measure 'ractors', windows, steps do
+  windows.times.map do |n|
+    Ractor.new n, steps do |n, steps|
+      Simulation.run "Ractor #{n}", n * 210, steps
+    end
+  end.each { |ractor| ractor.respond_to?(:value) ? ractor.value : ractor.take }
+end
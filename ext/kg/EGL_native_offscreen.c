@@ -0,0 +1,467 @@
+#include "EGL_native_offscreen.h"
+
+#include <ruby.h>
+
+#if defined(MG_HAVE_EGL)
+
+#include "extension.h"
+#include "image.h"
+#include "readback.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#include <ruby/thread.h>
+
+/* Data structures */
+
+typedef struct offscreen_struct {
+    EGLContext context; /** The OpenGL context, or EGL_NO_CONTEXT once closed. */
+    mg_gl_state * gl_state; /** Shadow copy of the context's state, or 0. */
+    EGLSurface surface; /** Pbuffer rendered into, or EGL_NO_SURFACE. */
+    GLuint framebuffer; /** Framebuffer object rendered into, or 0. */
+    GLuint color, depth; /** Renderbuffers attached to the framebuffer. */
+    unsigned int width, height;
+    mg_pixel_format format;
+    mg_readback * readback;
+} offscreen_t;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the offscreen target encapsulated by the Ruby object. Raises a Ruby
+ * exception if it was closed.
+ */
+static offscreen_t * offscreen_from(VALUE self);
+
+/**
+ * Destroys the context and frees the offscreen target.
+ */
+static void offscreen_free(void * p);
+
+/**
+ * Destroys the context, its surface and, if the context is current, the
+ * objects in it.
+ */
+static void destroy(offscreen_t * o);
+
+/**
+ * Opens and initializes the EGL display shared by every offscreen target.
+ */
+static void open_display(void);
+
+/**
+ * Returns the shared EGL display, or EGL_NO_DISPLAY if it's unavailable.
+ */
+static EGLDisplay get_display(void);
+
+/**
+ * Creates the framebuffer object rendered into when there is no surface.
+ */
+static int create_framebuffer(offscreen_t * o);
+
+/**
+ * Makes the context current on the calling thread and binds its framebuffer.
+ * Raises a Ruby exception on failure.
+ */
+static void make_current(offscreen_t * o);
+
+/**
+ * Makes the context current on the calling thread unless it already is.
+ */
+static void ensure_current(offscreen_t * o);
+
+/**
+ * Finishes the oldest pending read.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * finish_read(void * readback);
+
+/**
+ * Finishes the oldest pending read and wraps it in a Mg::Image.
+ */
+static VALUE finish(offscreen_t * o);
+
+/* Variable definitions */
+
+static pthread_once_t display_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Shared by every offscreen target and never terminated, since contexts may
+ * outlive each other on any thread.
+ */
+static EGLDisplay display = EGL_NO_DISPLAY;
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::Offscreen objects. Destroying a context only talks
+ * to the driver, so it's done during the sweep.
+ */
+static const rb_data_type_t offscreen_type = {
+    "Mg::Offscreen",
+    { 0, offscreen_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Native offscreen interface implementation */
+
+VALUE mg_native_offscreen_alloc(VALUE klass) {
+    offscreen_t * o = calloc(1, sizeof(offscreen_t));
+    if (o == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for offscreen target");
+    }
+    o->context = EGL_NO_CONTEXT;
+    o->surface = EGL_NO_SURFACE;
+    return TypedData_Wrap_Struct(klass, &offscreen_type, o);
+}
+
+void mg_native_offscreen_init(VALUE self,
+                              unsigned int width, unsigned int height,
+                              unsigned int buffers, mg_pixel_format format) {
+    offscreen_t * o = 0;
+    EGLDisplay egl = get_display();
+    EGLConfig config;
+    EGLint count = 0;
+    int surfaceless;
+    const char * error = 0;
+
+    TypedData_Get_Struct(self, offscreen_t, &offscreen_type, o);
+
+    if (o->context != EGL_NO_CONTEXT) {
+        rb_raise(rb_eRuntimeError, "offscreen target is already set up");
+    }
+
+    if (egl == EGL_NO_DISPLAY) {
+        rb_raise(rb_eRuntimeError, "could not open EGL display");
+    }
+
+    surfaceless = mg_has_extension(eglQueryString(egl, EGL_EXTENSIONS),
+                                "EGL_KHR_surfaceless_context");
+
+    {
+        const EGLint attributes[] = {
+            EGL_SURFACE_TYPE,    surfaceless ? 0 : EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+            EGL_RED_SIZE,        8,
+            EGL_GREEN_SIZE,      8,
+            EGL_BLUE_SIZE,       8,
+            EGL_ALPHA_SIZE,      8,
+            EGL_DEPTH_SIZE,      surfaceless ? 0 : 24,
+            EGL_NONE
+        };
+
+        if (!eglChooseConfig(egl, attributes, &config, 1, &count) || count < 1) {
+            rb_raise(rb_eRuntimeError, "no EGL configuration supports offscreen OpenGL");
+        }
+    }
+
+    /* Windows render with desktop OpenGL, and so do offscreen targets */
+    eglBindAPI(EGL_OPENGL_API);
+
+    o->context = eglCreateContext(egl, config, EGL_NO_CONTEXT, 0);
+    if (o->context == EGL_NO_CONTEXT) {
+        rb_raise(rb_eRuntimeError, "could not create OpenGL context");
+    }
+
+    o->gl_state = mg_gl_state_new(o->context);
+    o->width = width;
+    o->height = height;
+    o->format = format;
+
+    if (!surfaceless) {
+        const EGLint attributes[] = {
+            EGL_WIDTH,  (EGLint) width,
+            EGL_HEIGHT, (EGLint) height,
+            EGL_NONE
+        };
+
+        o->surface = eglCreatePbufferSurface(egl, config, attributes);
+        if (o->surface == EGL_NO_SURFACE) {
+            error = "could not create pbuffer";
+        }
+    }
+
+    if (error == 0 && !eglMakeCurrent(egl, o->surface, o->surface, o->context)) {
+        error = "could not make OpenGL context current";
+    }
+
+    if (error == 0 && surfaceless && !create_framebuffer(o)) {
+        error = "could not create framebuffer";
+    }
+
+    if (error == 0) {
+        glViewport(0, 0, width, height);
+        o->readback = mg_readback_new(width, height, buffers, format, &error);
+    }
+
+    if (error) {
+        destroy(o);
+        rb_raise(rb_eRuntimeError, "%s", error);
+    }
+}
+
+int mg_native_offscreen_gl_state_stats(VALUE self, mg_gl_state_stats * stats) {
+    offscreen_t * o = offscreen_from(self);
+    if (o->gl_state == 0) { return 0; }
+    mg_gl_state_get_stats(o->gl_state, stats);
+    return 1;
+}
+
+void mg_native_offscreen_make_current(VALUE self) {
+    make_current(offscreen_from(self));
+}
+
+unsigned int mg_native_offscreen_width(VALUE self) {
+    return offscreen_from(self)->width;
+}
+
+unsigned int mg_native_offscreen_height(VALUE self) {
+    return offscreen_from(self)->height;
+}
+
+int mg_native_offscreen_surfaceless(VALUE self) {
+    return offscreen_from(self)->surface == EGL_NO_SURFACE;
+}
+
+VALUE mg_native_offscreen_capture(VALUE self) {
+    offscreen_t * o = offscreen_from(self);
+    VALUE image = Qnil;
+
+    ensure_current(o);
+
+    /* The oldest read was started frames ago; it's usually done */
+    if (mg_readback_pending(o->readback) == mg_readback_count(o->readback)) {
+        image = finish(o);
+    }
+
+    mg_readback_start(o->readback);
+    return image;
+}
+
+VALUE mg_native_offscreen_drain(VALUE self) {
+    offscreen_t * o = offscreen_from(self);
+    VALUE images = rb_ary_new();
+
+    ensure_current(o);
+
+    while (mg_readback_pending(o->readback) > 0) {
+        rb_ary_push(images, finish(o));
+    }
+
+    return images;
+}
+
+VALUE mg_native_offscreen_read(VALUE self) {
+    offscreen_t * o = offscreen_from(self);
+    mg_image * image = 0;
+
+    ensure_current(o);
+
+    image = mg_readback_read(o->width, o->height, o->format);
+    if (image == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for image");
+    }
+
+    return mg_image_wrap(image);
+}
+
+void mg_native_offscreen_close(VALUE self) {
+    offscreen_t * o = 0;
+    TypedData_Get_Struct(self, offscreen_t, &offscreen_type, o);
+    destroy(o);
+}
+
+int mg_native_offscreen_closed(VALUE self) {
+    offscreen_t * o = 0;
+    TypedData_Get_Struct(self, offscreen_t, &offscreen_type, o);
+    return o->context == EGL_NO_CONTEXT;
+}
+
+/* Helper function implementation */
+
+static offscreen_t * offscreen_from(VALUE self) {
+    offscreen_t * o = 0;
+    TypedData_Get_Struct(self, offscreen_t, &offscreen_type, o);
+    if (o->context == EGL_NO_CONTEXT) {
+        rb_raise(rb_eRuntimeError, "offscreen target has been closed");
+    }
+    return o;
+}
+
+static void offscreen_free(void * p) {
+    offscreen_t * o = p;
+    destroy(o);
+    free(o);
+}
+
+static void destroy(offscreen_t * o) {
+    int current;
+
+    if (o->context == EGL_NO_CONTEXT) { return; }
+
+    current = eglGetCurrentContext() == o->context;
+
+    /* GL objects can only be deleted through the current context; otherwise
+     * they're destroyed along with it */
+    if (current) {
+        if (o->readback) { mg_readback_free(o->readback); }
+        if (o->framebuffer) {
+            glDeleteFramebuffers(1, &o->framebuffer);
+            glDeleteRenderbuffers(1, &o->color);
+            glDeleteRenderbuffers(1, &o->depth);
+        }
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    } else if (o->readback) {
+        mg_readback_discard(o->readback);
+    }
+
+    /* A context current on another thread is destroyed once it's released */
+    if (o->surface != EGL_NO_SURFACE) { eglDestroySurface(display, o->surface); }
+    eglDestroyContext(display, o->context);
+    mg_gl_state_free(o->gl_state);
+
+    o->gl_state = 0;
+    o->readback = 0;
+    o->framebuffer = o->color = o->depth = 0;
+    o->surface = EGL_NO_SURFACE;
+    o->context = EGL_NO_CONTEXT;
+}
+
+static void open_display(void) {
+    const char * extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+
+    /* Mesa can render without any display server or device node */
+    if (mg_has_extension(extensions, "EGL_MESA_platform_surfaceless")) {
+        PFNEGLGETPLATFORMDISPLAYEXTPROC get_platform_display =
+            (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (get_platform_display) {
+            display = get_platform_display(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+        }
+    }
+
+    if (display == EGL_NO_DISPLAY) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+
+    if (display != EGL_NO_DISPLAY && !eglInitialize(display, 0, 0)) {
+        display = EGL_NO_DISPLAY;
+    }
+}
+
+static EGLDisplay get_display(void) {
+    pthread_once(&display_once, open_display);
+    return display;
+}
+
+static int create_framebuffer(offscreen_t * o) {
+    glGenRenderbuffers(1, &o->color);
+    glBindRenderbuffer(GL_RENDERBUFFER, o->color);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, o->width, o->height);
+
+    glGenRenderbuffers(1, &o->depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, o->depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, o->width, o->height);
+
+    glGenFramebuffers(1, &o->framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, o->framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, o->color);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, o->depth);
+
+    return glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+}
+
+static void make_current(offscreen_t * o) {
+    if (!eglMakeCurrent(display, o->surface, o->surface, o->context)) {
+        rb_raise(rb_eRuntimeError, "could not make OpenGL context current");
+    }
+
+    if (o->framebuffer) {
+        glBindFramebuffer(GL_FRAMEBUFFER, o->framebuffer);
+    }
+}
+
+static void ensure_current(offscreen_t * o) {
+    if (eglGetCurrentContext() != o->context) { make_current(o); }
+}
+
+static void * finish_read(void * readback) {
+    return mg_readback_finish(readback);
+}
+
+static VALUE finish(offscreen_t * o) {
+    mg_image * image = rb_thread_call_without_gvl(finish_read, o->readback, 0, 0);
+    if (image == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for image");
+    }
+    return mg_image_wrap(image);
+}
+
+#else
+
+/**
+ * Raises NotImplementedError; offscreen targets can't be created without EGL.
+ */
+NORETURN(static void unsupported(void));
+
+/* Every stub but these raises, so they are declared as never returning */
+
+NORETURN(void mg_native_offscreen_init(VALUE self,
+                                       unsigned int width, unsigned int height,
+                                       unsigned int buffers, mg_pixel_format format));
+NORETURN(void mg_native_offscreen_make_current(VALUE self));
+NORETURN(unsigned int mg_native_offscreen_width(VALUE self));
+NORETURN(unsigned int mg_native_offscreen_height(VALUE self));
+NORETURN(int mg_native_offscreen_surfaceless(VALUE self));
+NORETURN(int mg_native_offscreen_gl_state_stats(VALUE self, mg_gl_state_stats * stats));
+NORETURN(VALUE mg_native_offscreen_capture(VALUE self));
+NORETURN(VALUE mg_native_offscreen_drain(VALUE self));
+NORETURN(VALUE mg_native_offscreen_read(VALUE self));
+
+static void unsupported(void) {
+    rb_raise(rb_eNotImpError, "offscreen rendering requires EGL");
+}
+
+/**
+ * Ruby data type of Mg::Offscreen objects, which hold nothing here.
+ */
+static const rb_data_type_t offscreen_type = {
+    "Mg::Offscreen",
+    { 0, 0, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+VALUE mg_native_offscreen_alloc(VALUE klass) {
+    return TypedData_Wrap_Struct(klass, &offscreen_type, 0);
+}
+
+void mg_native_offscreen_init(VALUE self,
+                              unsigned int width, unsigned int height,
+                              unsigned int buffers, mg_pixel_format format) {
+    unsupported();
+}
+
+void mg_native_offscreen_make_current(VALUE self) { unsupported(); }
+unsigned int mg_native_offscreen_width(VALUE self) { unsupported(); }
+unsigned int mg_native_offscreen_height(VALUE self) { unsupported(); }
+int mg_native_offscreen_surfaceless(VALUE self) { unsupported(); }
+int mg_native_offscreen_gl_state_stats(VALUE self, mg_gl_state_stats * stats) { unsupported(); }
+VALUE mg_native_offscreen_capture(VALUE self) { unsupported(); }
+VALUE mg_native_offscreen_drain(VALUE self) { unsupported(); }
+VALUE mg_native_offscreen_read(VALUE self) { unsupported(); }
+void mg_native_offscreen_close(VALUE self) {}
+int mg_native_offscreen_closed(VALUE self) { return 1; }
+
+#endif
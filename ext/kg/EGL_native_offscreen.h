@@ -0,0 +1,80 @@
+#ifndef MG_EGL_NATIVE_OFFSCREEN_H
+#define MG_EGL_NATIVE_OFFSCREEN_H
+
+#include "gl_state.h"
+#include "pixel_format.h"
+
+#include <ruby.h>
+
+/**
+ * Allocates memory for the offscreen target and stores it in the object.
+ */
+extern VALUE mg_native_offscreen_alloc(VALUE klass);
+
+/**
+ * Creates an OpenGL context that renders into a width by height framebuffer
+ * without a display server, and a ring of the given number of buffers to read
+ * it back through into images of the given format. Raises a Ruby exception on
+ * failure.
+ */
+extern void mg_native_offscreen_init(VALUE self,
+                                     unsigned int width, unsigned int height,
+                                     unsigned int buffers, mg_pixel_format format);
+
+/**
+ * Makes the offscreen context current on the calling thread, with its
+ * framebuffer bound.
+ */
+extern void mg_native_offscreen_make_current(VALUE self);
+
+/**
+ * Returns the width of the framebuffer.
+ */
+extern unsigned int mg_native_offscreen_width(VALUE self);
+
+/**
+ * Returns the height of the framebuffer.
+ */
+extern unsigned int mg_native_offscreen_height(VALUE self);
+
+/**
+ * Returns a non-zero value if rendering goes into a framebuffer object with
+ * no surface at all, zero if it goes into a pbuffer.
+ */
+extern int mg_native_offscreen_surfaceless(VALUE self);
+
+/**
+ * Stores the counters of the context's GL state cache. Returns zero if there
+ * is none.
+ */
+extern int mg_native_offscreen_gl_state_stats(VALUE self, mg_gl_state_stats * stats);
+
+/**
+ * Starts reading back what was rendered. If every buffer of the ring is in
+ * use, first finishes the oldest read and returns it as a Mg::Image; returns
+ * nil otherwise.
+ */
+extern VALUE mg_native_offscreen_capture(VALUE self);
+
+/**
+ * Finishes every pending read and returns the images in a Ruby array, oldest
+ * first.
+ */
+extern VALUE mg_native_offscreen_drain(VALUE self);
+
+/**
+ * Reads back what was rendered right away and returns it as a Mg::Image.
+ */
+extern VALUE mg_native_offscreen_read(VALUE self);
+
+/**
+ * Destroys the context and everything in it. Pending reads are discarded.
+ */
+extern void mg_native_offscreen_close(VALUE self);
+
+/**
+ * Returns a non-zero value if the offscreen target has been closed.
+ */
+extern int mg_native_offscreen_closed(VALUE self);
+
+#endif /* MG_EGL_NATIVE_OFFSCREEN_H */
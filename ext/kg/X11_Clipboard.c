@@ -0,0 +1,946 @@
+#include "X11_Clipboard.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <ruby.h>
+#include <ruby/encoding.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+
+/* Constant definitions */
+
+/**
+ * Largest chunk sent in a single property. Anything bigger goes through INCR.
+ */
+#define MAX_CHUNK (256 * 1024)
+
+/**
+ * Longest property read at once, in 32 bit units.
+ */
+#define MAX_PROPERTY_LENGTH 0x1FFFFFFFL
+
+/**
+ * Number of properties conversions move through as they are given up on, so
+ * that owners answering late write to one nobody reads.
+ */
+#define SPARE_PROPERTIES 8
+
+/* Data structures */
+
+struct X11_Clipboard_data {
+    unsigned int references;
+    size_t size;
+    int type_count; /** Number of types, TARGETS first. */
+    Atom * types;
+    unsigned char * bytes;
+};
+
+struct X11_Clipboard_send {
+    Window requestor; /** Window of the client receiving the selection. */
+    Atom property; /** Property the chunks are written to. */
+    Atom type; /** Type the client asked for. */
+    int selected; /** Whether events of the requestor were selected for the transfer. */
+    X11_Clipboard_data * data;
+    size_t offset; /** Bytes sent so far. */
+    X11_Clipboard_send * next;
+};
+
+/**
+ * Chunk of a conversion waiting to be written to a descriptor.
+ */
+typedef struct chunk_t {
+    struct chunk_t * next;
+    size_t size;
+    unsigned char bytes[];
+} chunk_t;
+
+/**
+ * Writes the chunks of a conversion to a descriptor from a thread of its own,
+ * so that a slow reader never blocks the event loop while it holds the
+ * display, nor any other transfer. The thread outlives the conversion until
+ * every chunk is written, then completes the future.
+ */
+typedef struct {
+    int fd; /** Duplicated descriptor. */
+    mg_future * future;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; /** Signalled when a chunk is queued or the last one was. */
+    chunk_t * chunks; /** Chunks not written yet, oldest first. */
+    chunk_t ** last;
+    int finished; /** Whether the conversion queued its last chunk. */
+    int empty; /** Whether it resolves to nil. */
+    const char * error; /** First error, after which chunks are dropped. */
+    size_t written;
+} writer_t;
+
+struct X11_Clipboard_receive {
+    int selection;
+    Atom type;
+    writer_t * writer; /** Writer of the chunks, or 0 to collect them in memory. */
+    int text; /** Whether the contents are UTF-8 text. */
+    int started; /** Whether the selection was asked for. */
+    int incremental; /** Whether the owner is streaming it through INCR. */
+    unsigned int timeout; /** Milliseconds the owner may stay silent. */
+    uint64_t deadline; /** When the owner must have answered, in nanoseconds. */
+    mg_future * future;
+    unsigned char * bytes;
+    size_t size, capacity;
+    X11_Clipboard_receive * next;
+};
+
+/**
+ * Result of a conversion, handed to the future.
+ */
+typedef struct {
+    int text;
+    int counted; /** Whether the bytes were written to a descriptor instead. */
+    size_t size;
+    unsigned char * bytes;
+} contents_t;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the index of the selection with the given atom, or -1.
+ */
+static int selection_index(X11_Display * d, Atom atom);
+
+/**
+ * Returns the largest number of bytes the server accepts in one property
+ * change, up to MAX_CHUNK.
+ */
+static size_t chunk_size(Display * display);
+
+/**
+ * Copies the bytes into new contents offered as the given types.
+ */
+static X11_Clipboard_data * data_new(X11_Display * d, const Atom * types, int type_count,
+                                     const void * bytes, size_t size);
+
+/**
+ * Returns whether the contents are offered as the type.
+ */
+static int data_offers(X11_Clipboard_data * data, Atom type);
+
+/**
+ * Releases a reference to the contents, freeing them when none are left.
+ */
+static void data_release(X11_Clipboard_data * data);
+
+/**
+ * Replies to a client asking for a selection the window owns.
+ */
+static void answer(X11_Clipboard * c, X11_Display * d, XSelectionRequestEvent * request);
+
+/**
+ * Announces an INCR transfer to the requestor. Returns zero if memory could
+ * not be allocated.
+ */
+static int start_send(X11_Clipboard * c, X11_Display * d, XSelectionRequestEvent * request,
+                      Atom property, X11_Clipboard_data * data);
+
+/**
+ * Writes the next chunk of an INCR transfer, or the empty one that ends it.
+ */
+static void send_chunk(X11_Clipboard * c, X11_Display * d, X11_Clipboard_send * send);
+
+/**
+ * Stops the transfer and frees it.
+ */
+static void remove_send(X11_Clipboard * c, X11_Display * d, X11_Clipboard_send * send);
+
+/**
+ * Returns the property conversions are stored in.
+ */
+static Atom receive_property_atom(X11_Clipboard * c, X11_Display * d);
+
+/**
+ * Asks the owner for the selection at the head of the queue.
+ */
+static void start_receive(X11_Clipboard * c, X11_Display * d, Window window);
+
+/**
+ * Moves later conversions to another property, since the owner of the one at
+ * the head of the queue, which is given up on, may still answer.
+ */
+static void abandon_receive(X11_Clipboard * c, X11_Display * d);
+
+/**
+ * Reads the property the owner stored the selection, or a chunk of it, in.
+ */
+static void receive_property(X11_Clipboard * c, X11_Display * d, Window window);
+
+/**
+ * Stores the bytes, or queues them for the writer. Returns an error message
+ * on failure.
+ */
+static const char * receive_append(X11_Clipboard_receive * r,
+                                   const unsigned char * bytes, size_t size);
+
+/**
+ * Completes the conversion at the head of the queue and starts the next one.
+ * It resolves to nil if empty is set, and fails with the error if there is
+ * one.
+ */
+static void finish_receive(X11_Clipboard * c, X11_Display * d, Window window,
+                           int empty, const char * error);
+
+/**
+ * Completes the conversion and frees it.
+ */
+static void complete(X11_Clipboard_receive * r, int empty, const char * error);
+
+/**
+ * Resolves the future with the bytes, which it takes, or rejects it with the
+ * error.
+ */
+static void settle(mg_future * future, int empty, const char * error,
+                   int text, int counted, unsigned char * bytes, size_t size);
+
+/**
+ * Creates a writer for the descriptor, which it takes, and starts its thread.
+ * Returns 0 if memory could not be allocated or the thread not started.
+ */
+static writer_t * writer_new(int fd, mg_future * future);
+
+/**
+ * Queues a copy of the bytes for the writer's thread. Returns an error message
+ * if writing already failed.
+ */
+static const char * writer_queue(writer_t * w, const unsigned char * bytes, size_t size);
+
+/**
+ * Marks the last chunk as queued. The writer's thread completes the future and
+ * frees the writer once the chunks are written out.
+ */
+static void writer_finish(writer_t * w, int empty, const char * error);
+
+/**
+ * Writer thread body. Writes the chunks out as they are queued until the last
+ * one is.
+ */
+static void * write_chunks(void * data);
+
+/**
+ * Completes the future with the number of bytes written and frees the writer.
+ */
+static void writer_complete(writer_t * w);
+
+/**
+ * Writes all of the bytes, waiting for non-blocking descriptors to drain.
+ * Returns zero on success, or an error number.
+ */
+static int write_all(int fd, const unsigned char * bytes, size_t size);
+
+/**
+ * Returns the time of CLOCK_MONOTONIC in nanoseconds.
+ */
+static uint64_t now(void);
+
+/**
+ * Converts the contents into a String, or the number of bytes written.
+ */
+static VALUE contents_to_ruby(void * result);
+
+/**
+ * Frees contents that were never converted.
+ */
+static void contents_free(void * result);
+
+/* X11_Clipboard interface implementation */
+
+int X11_Clipboard_set(X11_Clipboard * c, X11_Display * d, Window window,
+                      int selection, const Atom * types, int type_count,
+                      const void * bytes, size_t size) {
+    X11_Clipboard_data * data = data_new(d, types, type_count, bytes, size);
+    Atom atom = X11_Clipboard_selection_atom(d, selection);
+
+    if (data == 0) { return 0; }
+
+    XSetSelectionOwner(d->display, atom, window, CurrentTime);
+
+    if (XGetSelectionOwner(d->display, atom) != window) {
+        data_release(data);
+        return 0;
+    }
+
+    /* Transfers in progress keep sending what they started with */
+    data_release(c->owned[selection]);
+    c->owned[selection] = data;
+    return 1;
+}
+
+mg_future * X11_Clipboard_new_future(void) {
+    return mg_future_new(contents_to_ruby, contents_free);
+}
+
+int X11_Clipboard_get(X11_Clipboard * c, X11_Display * d, Window window,
+                      X11_Clipboard * owner, int selection, Atom type,
+                      int fd, int text, unsigned int timeout, mg_future * future) {
+    X11_Clipboard_receive * r = calloc(1, sizeof(X11_Clipboard_receive)), ** last;
+    X11_Clipboard_data * data;
+
+    if (r == 0) {
+        mg_future_reject(future, "unable to allocate memory for selection");
+        return 0;
+    }
+
+    if (fd >= 0 && (fd = dup(fd)) < 0) {
+        free(r);
+        mg_future_reject(future, strerror(errno));
+        return 0;
+    }
+
+    if (fd >= 0 && (r->writer = writer_new(fd, future)) == 0) {
+        close(fd);
+        free(r);
+        mg_future_reject(future, "could not start writing the selection");
+        return 0;
+    }
+
+    r->selection = selection;
+    r->type = type;
+    r->text = text;
+    r->timeout = timeout;
+    r->future = future;
+
+    /* Copy the contents straight out of a window of this process */
+    if (owner) {
+        data = owner->owned[selection];
+        if (data == 0 || !data_offers(data, type)) {
+            complete(r, 1, 0);
+        } else {
+            complete(r, 0, receive_append(r, data->bytes, data->size));
+        }
+        return 1;
+    }
+
+    for (last = &c->receives; *last; last = &(*last)->next);
+    *last = r;
+
+    if (c->receives == r) {
+        start_receive(c, d, window);
+    }
+
+    return 1;
+}
+
+int X11_Clipboard_expire(X11_Clipboard * c, X11_Display * d, Window window) {
+    X11_Clipboard_receive * r;
+    uint64_t time = now(), left;
+
+    while ((r = c->receives) && time >= r->deadline) {
+        abandon_receive(c, d);
+        finish_receive(c, d, window, 0, "selection owner did not answer in time");
+    }
+
+    if (r == 0) { return -1; }
+
+    /* Rounded up, so that waiting that long reaches the deadline */
+    left = (r->deadline - time + 999999) / 1000000;
+    return left < INT_MAX ? (int) left : INT_MAX;
+}
+
+Atom X11_Clipboard_selection_atom(X11_Display * d, int selection) {
+    return selection == X11_CLIPBOARD_PRIMARY ? XA_PRIMARY : d->atoms[X11_ATOM_CLIPBOARD];
+}
+
+int X11_Clipboard_handle_event(X11_Clipboard * c, X11_Display * d, Window window,
+                               XEvent * event) {
+    X11_Clipboard_send * send;
+
+    switch (event->type) {
+        case SelectionClear: {
+            XSelectionClearEvent * clear = &event->xselectionclear;
+            int index = selection_index(d, clear->selection);
+
+            /* The window may have taken the selection back since */
+            if (index >= 0 && clear->window == window &&
+                XGetSelectionOwner(d->display, clear->selection) != window) {
+                data_release(c->owned[index]);
+                c->owned[index] = 0;
+            }
+            return 1;
+        }
+        case SelectionRequest: {
+            answer(c, d, &event->xselectionrequest);
+            return 1;
+        }
+        case SelectionNotify: {
+            XSelectionEvent * notify = &event->xselection;
+            X11_Clipboard_receive * r = c->receives;
+
+            if (notify->requestor != window || r == 0 || !r->started || r->incremental) {
+                return 1;
+            }
+
+            /* Owners of conversions given up on may answer late */
+            if (notify->selection != X11_Clipboard_selection_atom(d, r->selection) ||
+                notify->target != r->type ||
+                (notify->property != None &&
+                 notify->property != receive_property_atom(c, d))) {
+                return 1;
+            }
+
+            /* The owner refused to convert it */
+            if (notify->property == None) {
+                finish_receive(c, d, window, 1, 0);
+            } else {
+                receive_property(c, d, window);
+            }
+            return 1;
+        }
+        case PropertyNotify: {
+            XPropertyEvent * property = &event->xproperty;
+
+            /* Owners streaming to the window store each chunk as a new value */
+            if (property->window == window) {
+                if (property->atom == receive_property_atom(c, d) &&
+                    property->state == PropertyNewValue &&
+                    c->receives && c->receives->incremental) {
+                    receive_property(c, d, window);
+                }
+                return 1;
+            }
+
+            /* Clients the window streams to delete each chunk they've read */
+            for (send = c->sends; send; send = send->next) {
+                if (send->requestor == property->window && send->property == property->atom) {
+                    if (property->state == PropertyDelete) {
+                        send_chunk(c, d, send);
+                    }
+                    return 1;
+                }
+            }
+            return 0;
+        }
+        case DestroyNotify: {
+            /* A client went away in the middle of a transfer */
+            for (send = c->sends; send; send = send->next) {
+                if (send->requestor == event->xdestroywindow.window) {
+                    send->selected = 0;
+                    remove_send(c, d, send);
+                    return 1;
+                }
+            }
+            return 0;
+        }
+    }
+
+    return 0;
+}
+
+int X11_Clipboard_sending_to(X11_Clipboard * c, Window requestor) {
+    X11_Clipboard_send * send;
+    for (send = c->sends; send; send = send->next) {
+        if (send->requestor == requestor) { return 1; }
+    }
+    return 0;
+}
+
+void X11_Clipboard_clear(X11_Clipboard * c, X11_Display * d) {
+    X11_Clipboard_receive * r;
+    int i;
+
+    while (c->sends) {
+        remove_send(c, d, c->sends);
+    }
+
+    for (i = 0; i < X11_CLIPBOARD_SELECTIONS; ++i) {
+        data_release(c->owned[i]);
+        c->owned[i] = 0;
+    }
+
+    while ((r = c->receives)) {
+        c->receives = r->next;
+        complete(r, 0, "window was closed");
+    }
+}
+
+/* Helper function implementation */
+
+static int selection_index(X11_Display * d, Atom atom) {
+    if (atom == XA_PRIMARY) { return X11_CLIPBOARD_PRIMARY; }
+    if (atom == d->atoms[X11_ATOM_CLIPBOARD]) { return X11_CLIPBOARD_CLIPBOARD; }
+    return -1;
+}
+
+static size_t chunk_size(Display * display) {
+    long max = XExtendedMaxRequestSize(display);
+    size_t size;
+
+    if (max == 0) { max = XMaxRequestSize(display); }
+
+    /* Leave room for the ChangeProperty request itself */
+    size = (size_t) max * 4 - 256;
+    return size < MAX_CHUNK ? size : MAX_CHUNK;
+}
+
+static X11_Clipboard_data * data_new(X11_Display * d, const Atom * types, int type_count,
+                                     const void * bytes, size_t size) {
+    X11_Clipboard_data * data = malloc(sizeof(X11_Clipboard_data) +
+                                       (type_count + 1) * sizeof(Atom) + size);
+
+    if (data == 0) { return 0; }
+
+    data->references = 1;
+    data->size = size;
+    data->type_count = type_count + 1;
+    data->types = (Atom *) (data + 1);
+    data->bytes = (unsigned char *) (data->types + data->type_count);
+
+    data->types[0] = d->atoms[X11_ATOM_TARGETS];
+    memcpy(data->types + 1, types, type_count * sizeof(Atom));
+    memcpy(data->bytes, bytes, size);
+
+    return data;
+}
+
+static int data_offers(X11_Clipboard_data * data, Atom type) {
+    int i;
+    for (i = 1; i < data->type_count; ++i) {
+        if (data->types[i] == type) { return 1; }
+    }
+    return 0;
+}
+
+static void data_release(X11_Clipboard_data * data) {
+    if (data && --data->references == 0) {
+        free(data);
+    }
+}
+
+static void answer(X11_Clipboard * c, X11_Display * d, XSelectionRequestEvent * request) {
+    int index = selection_index(d, request->selection);
+    X11_Clipboard_data * data = index >= 0 ? c->owned[index] : 0;
+    /* Obsolete clients leave the property to the owner */
+    Atom property = request->property != None ? request->property : request->target;
+    XSelectionEvent reply;
+
+    memset(&reply, 0, sizeof(reply));
+    reply.type = SelectionNotify;
+    reply.display = request->display;
+    reply.requestor = request->requestor;
+    reply.selection = request->selection;
+    reply.target = request->target;
+    reply.property = None;
+    reply.time = request->time;
+
+    /* The requestor belongs to another client and may vanish at any time */
+    X11_Display_trap_errors(d);
+
+    if (data && request->target == d->atoms[X11_ATOM_TARGETS]) {
+        XChangeProperty(d->display, request->requestor, property, XA_ATOM, 32,
+                        PropModeReplace, (unsigned char *) data->types, data->type_count);
+        reply.property = property;
+    } else if (data && data_offers(data, request->target)) {
+        if (data->size <= chunk_size(d->display)) {
+            XChangeProperty(d->display, request->requestor, property, request->target, 8,
+                            PropModeReplace, data->bytes, (int) data->size);
+            c->stats.sent += data->size;
+            reply.property = property;
+        } else if (start_send(c, d, request, property, data)) {
+            reply.property = property;
+        }
+    } else {
+        ++c->stats.refused;
+    }
+
+    XSendEvent(d->display, request->requestor, False, NoEventMask, (XEvent *) &reply);
+    X11_Display_untrap_errors(d);
+    XFlush(d->display);
+}
+
+static int start_send(X11_Clipboard * c, X11_Display * d, XSelectionRequestEvent * request,
+                      Atom property, X11_Clipboard_data * data) {
+    X11_Clipboard_send * send;
+    long size = (long) data->size;
+
+    /* A client asking again into the same property starts over */
+    for (send = c->sends; send; send = send->next) {
+        if (send->requestor == request->requestor && send->property == property) {
+            remove_send(c, d, send);
+            break;
+        }
+    }
+
+    if ((send = malloc(sizeof(X11_Clipboard_send))) == 0) { return 0; }
+
+    send->requestor = request->requestor;
+    send->property = property;
+    send->type = request->target;
+    send->data = data;
+    send->offset = 0;
+    ++data->references;
+
+    /* Windows of this process already report property changes */
+    send->selected = X11_Display_find_window(d, request->requestor) == 0;
+    if (send->selected) {
+        XSelectInput(d->display, request->requestor, PropertyChangeMask | StructureNotifyMask);
+    }
+
+    /* The client deletes the property to ask for the first chunk */
+    XChangeProperty(d->display, request->requestor, property, d->atoms[X11_ATOM_INCR], 32,
+                    PropModeReplace, (unsigned char *) &size, 1);
+
+    send->next = c->sends;
+    c->sends = send;
+    return 1;
+}
+
+static void send_chunk(X11_Clipboard * c, X11_Display * d, X11_Clipboard_send * send) {
+    size_t size = send->data->size - send->offset, chunk = chunk_size(d->display);
+
+    if (size > chunk) { size = chunk; }
+
+    X11_Display_trap_errors(d);
+    XChangeProperty(d->display, send->requestor, send->property, send->type, 8,
+                    PropModeReplace, send->data->bytes + send->offset, (int) size);
+    X11_Display_untrap_errors(d);
+    XFlush(d->display);
+
+    /* An empty chunk marks the end */
+    if (size == 0) {
+        remove_send(c, d, send);
+        return;
+    }
+
+    send->offset += size;
+    c->stats.sent += size;
+    ++c->stats.chunks;
+}
+
+static void remove_send(X11_Clipboard * c, X11_Display * d, X11_Clipboard_send * send) {
+    X11_Clipboard_send ** link;
+
+    for (link = &c->sends; *link != send; link = &(*link)->next);
+    *link = send->next;
+
+    if (send->selected) {
+        X11_Display_trap_errors(d);
+        XSelectInput(d->display, send->requestor, NoEventMask);
+        X11_Display_untrap_errors(d);
+    }
+
+    data_release(send->data);
+    free(send);
+}
+
+static Atom receive_property_atom(X11_Clipboard * c, X11_Display * d) {
+    return c->property != None ? c->property : d->atoms[X11_ATOM_MG_SELECTION];
+}
+
+static void start_receive(X11_Clipboard * c, X11_Display * d, Window window) {
+    X11_Clipboard_receive * r = c->receives;
+
+    XConvertSelection(d->display, X11_Clipboard_selection_atom(d, r->selection), r->type,
+                      receive_property_atom(c, d), window, CurrentTime);
+    XFlush(d->display);
+    r->started = 1;
+    r->deadline = now() + r->timeout * 1000000ULL;
+}
+
+static void abandon_receive(X11_Clipboard * c, X11_Display * d) {
+    char name[32];
+
+    /* Far apart enough that late owners have given up by the time it comes back */
+    snprintf(name, sizeof(name), "MG_SELECTION_%u", ++c->abandoned % SPARE_PROPERTIES);
+    c->property = XInternAtom(d->display, name, False);
+}
+
+static void receive_property(X11_Clipboard * c, X11_Display * d, Window window) {
+    X11_Clipboard_receive * r = c->receives;
+    unsigned char * value = 0;
+    unsigned long count = 0, after = 0, i;
+    const char * error;
+    size_t size;
+    int format = 0;
+    Atom type = None;
+
+    /* Deleting the property asks an INCR owner for the next chunk */
+    if (XGetWindowProperty(d->display, window, receive_property_atom(c, d),
+                           0, MAX_PROPERTY_LENGTH, True, AnyPropertyType,
+                           &type, &format, &count, &after, &value) != Success) {
+        finish_receive(c, d, window, 0, "could not read the selection");
+        return;
+    }
+
+    /* Every chunk gives the owner another timeout to send the next */
+    r->deadline = now() + r->timeout * 1000000ULL;
+
+    if (type == d->atoms[X11_ATOM_INCR]) {
+        r->incremental = 1;
+        XFree(value);
+        XFlush(d->display);
+        return;
+    }
+
+    /* Xlib hands 32 bit items over as longs */
+    if (format == 32) {
+        for (i = 0; i < count; ++i) {
+            ((uint32_t *) value)[i] = (uint32_t) ((unsigned long *) value)[i];
+        }
+    }
+    size = (size_t) count * (format / 8);
+
+    if (r->incremental) {
+        XFlush(d->display);
+        if (type == None) {
+            /* The property is gone; wait for the owner's next chunk */
+        } else if (size == 0) {
+            finish_receive(c, d, window, 0, 0);
+        } else if ((error = receive_append(r, value, size))) {
+            finish_receive(c, d, window, 0, error);
+        } else {
+            c->stats.received += size;
+            ++c->stats.chunks;
+        }
+    } else if (type == None) {
+        finish_receive(c, d, window, 1, 0);
+    } else {
+        error = receive_append(r, value, size);
+        c->stats.received += size;
+        finish_receive(c, d, window, 0, error);
+    }
+
+    if (value) { XFree(value); }
+}
+
+static const char * receive_append(X11_Clipboard_receive * r,
+                                   const unsigned char * bytes, size_t size) {
+    size_t capacity;
+    unsigned char * grown;
+
+    if (r->writer) {
+        return writer_queue(r->writer, bytes, size);
+    }
+
+    if (r->size + size > r->capacity) {
+        capacity = r->capacity ? r->capacity : 4096;
+        while (capacity < r->size + size) { capacity *= 2; }
+        if ((grown = realloc(r->bytes, capacity)) == 0) {
+            return "unable to allocate memory for selection";
+        }
+        r->bytes = grown;
+        r->capacity = capacity;
+    }
+
+    memcpy(r->bytes + r->size, bytes, size);
+    r->size += size;
+    return 0;
+}
+
+static void finish_receive(X11_Clipboard * c, X11_Display * d, Window window,
+                           int empty, const char * error) {
+    X11_Clipboard_receive * r = c->receives;
+
+    c->receives = r->next;
+    complete(r, empty, error);
+
+    if (c->receives) {
+        start_receive(c, d, window);
+    }
+}
+
+static void complete(X11_Clipboard_receive * r, int empty, const char * error) {
+    if (r->writer) {
+        writer_finish(r->writer, empty, error);
+    } else {
+        settle(r->future, empty, error, r->text, 0, r->bytes, r->size);
+    }
+
+    free(r);
+}
+
+static void settle(mg_future * future, int empty, const char * error,
+                   int text, int counted, unsigned char * bytes, size_t size) {
+    contents_t * contents = 0;
+
+    if (error == 0 && !empty) {
+        if ((contents = malloc(sizeof(contents_t))) == 0) {
+            error = "unable to allocate memory for selection";
+        } else {
+            contents->text = text;
+            contents->counted = counted;
+            contents->size = size;
+            contents->bytes = bytes;
+            bytes = 0;
+        }
+    }
+
+    if (error) {
+        mg_future_reject(future, error);
+    } else {
+        mg_future_resolve(future, contents);
+    }
+
+    free(bytes);
+}
+
+static writer_t * writer_new(int fd, mg_future * future) {
+    writer_t * w = calloc(1, sizeof(writer_t));
+    pthread_t thread;
+
+    if (w == 0) { return 0; }
+
+    w->fd = fd;
+    w->future = future;
+    w->last = &w->chunks;
+    pthread_mutex_init(&w->lock, 0);
+    pthread_cond_init(&w->wake, 0);
+
+    if (pthread_create(&thread, 0, write_chunks, w) != 0) {
+        pthread_cond_destroy(&w->wake);
+        pthread_mutex_destroy(&w->lock);
+        free(w);
+        return 0;
+    }
+
+    pthread_detach(thread);
+    return w;
+}
+
+static const char * writer_queue(writer_t * w, const unsigned char * bytes, size_t size) {
+    chunk_t * chunk = malloc(sizeof(chunk_t) + size);
+    const char * error;
+
+    if (chunk == 0) { return "unable to allocate memory for selection"; }
+
+    chunk->next = 0;
+    chunk->size = size;
+    memcpy(chunk->bytes, bytes, size);
+
+    pthread_mutex_lock(&w->lock);
+    if ((error = w->error) == 0) {
+        *w->last = chunk;
+        w->last = &chunk->next;
+        pthread_cond_signal(&w->wake);
+    }
+    pthread_mutex_unlock(&w->lock);
+
+    if (error) {
+        free(chunk);
+    }
+
+    return error;
+}
+
+static void writer_finish(writer_t * w, int empty, const char * error) {
+    pthread_mutex_lock(&w->lock);
+    w->finished = 1;
+    w->empty = empty;
+    if (w->error == 0) { w->error = error; }
+    pthread_cond_signal(&w->wake);
+    pthread_mutex_unlock(&w->lock);
+}
+
+static void * write_chunks(void * data) {
+    writer_t * w = data;
+    chunk_t * chunk;
+    int error;
+
+    pthread_mutex_lock(&w->lock);
+
+    for (;;) {
+        while (w->chunks == 0 && !w->finished) {
+            pthread_cond_wait(&w->wake, &w->lock);
+        }
+
+        /* Every chunk is queued before the conversion finishes */
+        if ((chunk = w->chunks) == 0) { break; }
+
+        if ((w->chunks = chunk->next) == 0) {
+            w->last = &w->chunks;
+        }
+
+        /* Chunks of a failed or abandoned conversion are dropped */
+        if (w->error == 0) {
+            pthread_mutex_unlock(&w->lock);
+            error = write_all(w->fd, chunk->bytes, chunk->size);
+            pthread_mutex_lock(&w->lock);
+
+            if (error == 0) {
+                w->written += chunk->size;
+            } else if (w->error == 0) {
+                w->error = strerror(error);
+            }
+        }
+
+        free(chunk);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+
+    writer_complete(w);
+    return 0;
+}
+
+static void writer_complete(writer_t * w) {
+    /* Closing first lets the reader see the end before the future resolves */
+    close(w->fd);
+    settle(w->future, w->empty, w->error, 0, 1, 0, w->written);
+    pthread_cond_destroy(&w->wake);
+    pthread_mutex_destroy(&w->lock);
+    free(w);
+}
+
+static int write_all(int fd, const unsigned char * bytes, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd writable = { fd, POLLOUT, 0 };
+                poll(&writable, 1, -1);
+                continue;
+            }
+            return errno;
+        }
+
+        bytes += written;
+        size -= (size_t) written;
+    }
+
+    return 0;
+}
+
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static VALUE contents_to_ruby(void * result) {
+    contents_t * contents = result;
+    VALUE value;
+
+    if (contents == 0) { return Qnil; }
+
+    if (contents->counted) {
+        value = SIZET2NUM(contents->size);
+    } else if (contents->text) {
+        value = rb_utf8_str_new((const char *) contents->bytes, (long) contents->size);
+    } else {
+        value = rb_str_new((const char *) contents->bytes, (long) contents->size);
+    }
+
+    contents_free(contents);
+    return value;
+}
+
+static void contents_free(void * result) {
+    contents_t * contents = result;
+    free(contents->bytes);
+    free(contents);
+}
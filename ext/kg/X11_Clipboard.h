@@ -0,0 +1,134 @@
+#ifndef MG_X11_X11_CLIPBOARD_H
+#define MG_X11_X11_CLIPBOARD_H
+
+#include "X11_Display.h"
+#include "future.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <X11/Xlib.h>
+
+/**
+ * Selections a window can own or read.
+ */
+enum {
+    X11_CLIPBOARD_PRIMARY,
+    X11_CLIPBOARD_CLIPBOARD,
+    X11_CLIPBOARD_SELECTIONS
+};
+
+/**
+ * Counters of a window's selection transfers.
+ */
+typedef struct {
+    uint64_t sent; /** Bytes handed to other clients. */
+    uint64_t received; /** Bytes read from selection owners. */
+    uint64_t chunks; /** INCR chunks sent and received. */
+    uint64_t refused; /** Requests for types the window didn't offer. */
+} X11_Clipboard_stats;
+
+/**
+ * Contents of a selection the window owns, shared by the transfers still
+ * sending them.
+ */
+typedef struct X11_Clipboard_data X11_Clipboard_data;
+
+/**
+ * Transfer of a selection the window owns to a client too large for a single
+ * property, streamed through the INCR protocol.
+ */
+typedef struct X11_Clipboard_send X11_Clipboard_send;
+
+/**
+ * Conversion of a selection the window asked for. Only the first of the queue
+ * is in progress, since all of them go through the same property; one whose
+ * owner stays silent for too long is given up on.
+ */
+typedef struct X11_Clipboard_receive X11_Clipboard_receive;
+
+/**
+ * A window's side of the selection protocol. Its events are handled in the
+ * event loop, WITHOUT the GVL; every function requires the display to be
+ * locked.
+ */
+typedef struct {
+    X11_Clipboard_data * owned[X11_CLIPBOARD_SELECTIONS]; /** Contents offered, or 0. */
+    X11_Clipboard_send * sends; /** INCR transfers in progress. */
+    X11_Clipboard_receive * receives; /** Queued conversions, in progress first. */
+    Atom property; /** Property conversions are stored in, or None for MG_SELECTION. */
+    unsigned int abandoned; /** Conversions given up on. */
+    X11_Clipboard_stats stats;
+} X11_Clipboard;
+
+/**
+ * Makes the window the owner of the selection, offering a copy of the bytes
+ * as each of the given types, already interned. Returns zero if memory could
+ * not be allocated or another client took the selection over.
+ */
+extern int X11_Clipboard_set(X11_Clipboard * c, X11_Display * d, Window window,
+                             int selection, const Atom * types, int type_count,
+                             const void * bytes, size_t size);
+
+/**
+ * Creates a future for X11_Clipboard_get to resolve.
+ */
+extern mg_future * X11_Clipboard_new_future(void);
+
+/**
+ * Asks for the selection as the given type, resolving the future once all of
+ * it arrived: with a String, or with nil if the selection is empty or not
+ * available as that type. With a file descriptor, which is duplicated, chunks
+ * are written to it as they arrive, by a thread of its own so that a slow
+ * reader never holds the display or other transfers up, and the future
+ * resolves with the number of bytes written once all of them are. Text is
+ * tagged as UTF-8.
+ *
+ * The future is rejected if the owner stays silent for timeout milliseconds,
+ * whether before answering or between chunks; X11_Clipboard_expire must be
+ * called to notice.
+ *
+ * If the selection is owned by a window of this process, its clipboard should
+ * be passed as the owner; the contents are then copied without a trip
+ * through the server.
+ *
+ * The caller's reference to the future is handed over. Returns zero if memory
+ * could not be allocated, in which case the future is rejected.
+ */
+extern int X11_Clipboard_get(X11_Clipboard * c, X11_Display * d, Window window,
+                             X11_Clipboard * owner, int selection, Atom type,
+                             int fd, int text, unsigned int timeout, mg_future * future);
+
+/**
+ * Gives up on the conversion in progress if its owner stayed silent past its
+ * timeout, rejecting its future and starting the next one. Returns the number
+ * of milliseconds until the conversion in progress times out, or -1 if there
+ * is none.
+ */
+extern int X11_Clipboard_expire(X11_Clipboard * c, X11_Display * d, Window window);
+
+/**
+ * Returns the atom of the selection.
+ */
+extern Atom X11_Clipboard_selection_atom(X11_Display * d, int selection);
+
+/**
+ * Handles selection and property events of the window and of the clients it
+ * is sending to. Returns zero if the event has nothing to do with selections.
+ */
+extern int X11_Clipboard_handle_event(X11_Clipboard * c, X11_Display * d, Window window,
+                                      XEvent * event);
+
+/**
+ * Returns whether the window is streaming a selection to the given client
+ * window, whose property events must then be routed to it.
+ */
+extern int X11_Clipboard_sending_to(X11_Clipboard * c, Window requestor);
+
+/**
+ * Drops the offered contents, stops all transfers and rejects the futures of
+ * conversions still in progress.
+ */
+extern void X11_Clipboard_clear(X11_Clipboard * c, X11_Display * d);
+
+#endif /* MG_X11_X11_CLIPBOARD_H */
@@ -0,0 +1,611 @@
+#include "X11_Display.h"
+
+#include "X11_requests.h"
+#include "extension.h"
+#include "hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xlibint.h>
+#include <X11/XKBlib.h>
+
+#include <GL/glx.h>
+
+#if defined(MG_HAVE_XINPUT2)
+    #include <X11/extensions/XInput2.h>
+#endif
+
+#if defined(MG_HAVE_XSHM)
+    #include <X11/extensions/XShm.h>
+#endif
+
+#if defined(MG_HAVE_XCURSOR)
+    #include <X11/Xcursor/Xcursor.h>
+#endif
+
+#if defined(MG_HAVE_XCB_PRESENT)
+    #include <X11/Xlib-xcb.h>
+    #include <xcb/xcb.h>
+    #include <xcb/present.h>
+    #include <xcb/xfixes.h>
+#endif
+
+/* Constant definitions */
+
+static int attribute_list[] = { GLX_RGBA, GLX_DOUBLEBUFFER,
+                                GLX_RED_SIZE,   8,
+                                GLX_GREEN_SIZE, 8,
+                                GLX_BLUE_SIZE,  8,
+                                GLX_DEPTH_SIZE, 24,
+                                None };
+
+static const char * atom_names[X11_ATOM_COUNT] = { "WM_DELETE_WINDOW",
+                                                    "_NET_WM_STATE",
+                                                    "_NET_WM_STATE_HIDDEN",
+                                                    "_NET_WM_STATE_MAXIMIZED_VERT",
+                                                    "_NET_WM_STATE_MAXIMIZED_HORZ",
+                                                    "_NET_WM_STATE_FULLSCREEN",
+                                                    "_NET_WM_NAME",
+                                                    "_NET_WM_ICON_NAME",
+                                                    "_NET_WM_ICON",
+                                                    "CLIPBOARD",
+                                                    "TARGETS",
+                                                    "INCR",
+                                                    "MG_SELECTION" };
+
+/* Shared display */
+
+static X11_Display * shared_display = 0;
+static pthread_mutex_t shared_display_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* Error handler that was installed before Mg's */
+
+static XErrorHandler previous_error_handler = 0;
+
+/* Event converters that were installed before Mg's, by event type */
+
+static Bool (*previous_converters[128])(Display *, XEvent *, xEvent *);
+
+#if defined(MG_HAVE_XINPUT2)
+static Bool (*previous_cookie_converter)(Display *, XGenericEventCookie *, xEvent *);
+#endif
+
+/* Helper function prototypes */
+
+/**
+ * Connects to the X Server and looks up everything windows will need.
+ */
+static X11_Display * open_display(const char ** error);
+
+/**
+ * Frees everything looked up and closes the connection.
+ */
+static void close_display(X11_Display * d);
+
+/**
+ * Ignores errors of trapped requests on the shared display and passes the
+ * others on to the previous handler.
+ */
+static int handle_error(Display * display, XErrorEvent * error);
+
+/**
+ * Wraps the display's event converters so that every event read into the
+ * queue, whichever thread reads it, wakes the event loops up.
+ */
+static void watch_events(X11_Display * d);
+
+/**
+ * Converts the event with the previous converter, waking the event loops if
+ * it's queued. Called by Xlib with the display locked.
+ */
+static Bool convert_event(Display * display, XEvent * event, xEvent * wire);
+
+#if defined(MG_HAVE_XINPUT2)
+
+/**
+ * Converts an XInput2 event with the previous converter and wakes the event
+ * loops. Called by Xlib with the display locked.
+ */
+static Bool convert_cookie(Display * display, XGenericEventCookie * cookie, xEvent * wire);
+
+#endif
+
+/**
+ * Writes to every waiter not already woken up.
+ */
+static void wake_waiters(Display * display);
+
+/**
+ * Selects XInput2 raw motion events on the root window.
+ */
+static void select_raw_motion(X11_Display * d);
+
+/**
+ * Checks for MIT-SHM, the Present extension and the GLX extensions that
+ * present partial frames or schedule them.
+ */
+static void query_presentation(X11_Display * d);
+
+#if defined(MG_HAVE_XCB_PRESENT)
+
+/**
+ * Returns whether the server supports Present 1.0 and XFixes 2.0 regions.
+ */
+static int query_present(xcb_connection_t * connection);
+
+#endif
+
+#if defined(MG_HAVE_XCURSOR)
+
+/**
+ * Converts the pixels to the premultiplied ARGB words Xcursor expects and
+ * creates a cursor from them. Returns None on failure.
+ */
+static Cursor create_cursor(Display * display, const unsigned char * pixels,
+                            mg_pixel_format format,
+                            unsigned int width, unsigned int height,
+                            unsigned int x, unsigned int y);
+
+#endif
+
+/* X11_Display interface implementation */
+
+X11_Display * X11_Display_acquire(const char ** error) {
+    X11_Display * d;
+
+    pthread_mutex_lock(&shared_display_lock);
+
+    if (shared_display == 0) {
+        shared_display = open_display(error);
+    }
+
+    d = shared_display;
+    if (d) { ++d->references; }
+
+    pthread_mutex_unlock(&shared_display_lock);
+
+    return d;
+}
+
+void X11_Display_release(X11_Display * d) {
+    int last;
+
+    pthread_mutex_lock(&shared_display_lock);
+    last = --d->references == 0;
+    if (last) { shared_display = 0; }
+    pthread_mutex_unlock(&shared_display_lock);
+
+    if (last) { close_display(d); }
+}
+
+int X11_Display_add_window(X11_Display * d, Window window, void * data) {
+    if (d->window_count == d->window_capacity) {
+        size_t capacity = d->window_capacity ? d->window_capacity * 2 : 8;
+        X11_Display_window * windows = realloc(d->windows, capacity * sizeof(X11_Display_window));
+        if (windows == 0) { return 0; }
+        d->windows = windows;
+        d->window_capacity = capacity;
+    }
+    d->windows[d->window_count].window = window;
+    d->windows[d->window_count].data = data;
+    ++d->window_count;
+    return 1;
+}
+
+void X11_Display_remove_window(X11_Display * d, Window window) {
+    size_t i;
+    for (i = 0; i < d->window_count; ++i) {
+        if (d->windows[i].window == window) {
+            d->windows[i] = d->windows[--d->window_count];
+            return;
+        }
+    }
+}
+
+void * X11_Display_find_window(X11_Display * d, Window window) {
+    size_t i;
+    for (i = 0; i < d->window_count; ++i) {
+        if (d->windows[i].window == window) { return d->windows[i].data; }
+    }
+    return 0;
+}
+
+int X11_Display_add_waiter(X11_Display * d, int fd) {
+    if (d->waiter_count == d->waiter_capacity) {
+        size_t capacity = d->waiter_capacity ? d->waiter_capacity * 2 : 8;
+        X11_Display_waiter * waiters = realloc(d->waiters, capacity * sizeof(X11_Display_waiter));
+        if (waiters == 0) { return 0; }
+        d->waiters = waiters;
+        d->waiter_capacity = capacity;
+    }
+    d->waiters[d->waiter_count].fd = fd;
+    d->waiters[d->waiter_count].signalled = 0;
+    ++d->waiter_count;
+    return 1;
+}
+
+void X11_Display_remove_waiter(X11_Display * d, int fd) {
+    size_t i;
+    for (i = 0; i < d->waiter_count; ++i) {
+        if (d->waiters[i].fd == fd) {
+            d->waiters[i] = d->waiters[--d->waiter_count];
+            return;
+        }
+    }
+}
+
+void X11_Display_reset_waiter(X11_Display * d, int fd) {
+    eventfd_t count;
+    size_t i;
+
+    for (i = 0; i < d->waiter_count; ++i) {
+        if (d->waiters[i].fd == fd && d->waiters[i].signalled) {
+            /* Nonblocking; the counter may also have been set to stop the loop */
+            if (eventfd_read(fd, &count) < 0) { count = 0; }
+            d->waiters[i].signalled = 0;
+            return;
+        }
+    }
+}
+
+void X11_Display_wake_waiters(X11_Display * d) {
+    size_t i;
+
+    for (i = 0; i < d->waiter_count; ++i) {
+        if (!d->waiters[i].signalled) {
+            d->waiters[i].signalled = 1;
+            /* Only fails if the counter would overflow, which still wakes the loop */
+            eventfd_write(d->waiters[i].fd, 1);
+        }
+    }
+}
+
+void X11_Display_trap_errors(X11_Display * d) {
+    unsigned long * trap = d->error_traps[d->error_trap];
+    trap[0] = trap[1] = NextRequest(d->display);
+    d->error_trap_hits[d->error_trap] = 0;
+}
+
+void X11_Display_untrap_errors(X11_Display * d) {
+    d->error_traps[d->error_trap][1] = NextRequest(d->display);
+    d->error_trap = (d->error_trap + 1) % X11_DISPLAY_ERROR_TRAPS;
+}
+
+unsigned int X11_Display_trapped_errors(X11_Display * d) {
+    XSync(d->display, False);
+    return d->error_trap_hits[(d->error_trap + X11_DISPLAY_ERROR_TRAPS - 1) % X11_DISPLAY_ERROR_TRAPS];
+}
+
+Cursor X11_Display_load_cursor(X11_Display * d, const unsigned char * pixels,
+                               mg_pixel_format format,
+                               unsigned int width, unsigned int height,
+                               unsigned int x, unsigned int y) {
+#if defined(MG_HAVE_XCURSOR)
+    uint32_t header[5] = { width, height, x, y, format };
+    uint64_t key = mg_hash64(pixels, (size_t) width * height * 4,
+                             mg_hash64(header, sizeof(header), 0));
+    X11_Display_cursor * entry = 0;
+    Cursor cursor;
+    size_t i;
+
+    ++d->cursor_tick;
+
+    for (i = 0; i < d->cursor_count; ++i) {
+        if (d->cursors[i].key == key) {
+            d->cursors[i].used = d->cursor_tick;
+            return d->cursors[i].cursor;
+        }
+    }
+
+    cursor = create_cursor(d->display, pixels, format, width, height, x, y);
+    if (cursor == None) { return None; }
+
+    if (d->cursor_count < X11_DISPLAY_CURSORS) {
+        entry = &d->cursors[d->cursor_count++];
+    } else {
+        entry = &d->cursors[0];
+        for (i = 1; i < d->cursor_count; ++i) {
+            if (d->cursors[i].used < entry->used) { entry = &d->cursors[i]; }
+        }
+        /* The server keeps the cursor alive for windows still showing it */
+        XFreeCursor(d->display, entry->cursor);
+    }
+
+    entry->key = key;
+    entry->cursor = cursor;
+    entry->used = d->cursor_tick;
+    return cursor;
+#else
+    (void) d; (void) pixels; (void) format;
+    (void) width; (void) height; (void) x; (void) y;
+    return None;
+#endif
+}
+
+/* Helper function implementation */
+
+static X11_Display * open_display(const char ** error) {
+    X11_Display * d = calloc(1, sizeof(X11_Display));
+    Bool supported = 0;
+
+    if (d == 0) {
+        *error = "unable to allocate memory for display";
+        return 0;
+    }
+
+    /* Connect to the X11 Display Server */
+    d->display = XOpenDisplay(0);
+
+    /* If a connection could not be established... */
+    if (d->display == 0) {
+        free(d);
+        *error = "could not connect to the X Server";
+        return 0;
+    }
+
+    /* Ensure exclusive access to the Display */
+    XLockDisplay(d->display);
+
+    /* If OpenGL isn't supported... */
+    if (!glXQueryExtension(d->display, 0, 0)) {
+        *error = "OpenGL is not supported by this X Server";
+        goto fail;
+    }
+
+    /* Windows will be created on the default screen */
+    d->screen = XDefaultScreen(d->display);
+
+    /* Choose best visual that supports double buffering */
+    d->visual_info = glXChooseVisual(d->display, d->screen, attribute_list);
+
+    /* If no visual was chosen, rendering with the given specifications is impossible */
+    if (d->visual_info == 0) {
+        *error = "Rendering not supported";
+        goto fail;
+    }
+
+    /* Obtain the value of the white color for this display and screen */
+    d->white = XWhitePixel(d->display, d->visual_info->screen);
+
+    /* Create color map shared by all windows */
+    d->colormap = XCreateColormap(d->display,
+                                  RootWindow(d->display, d->screen),
+                                  d->visual_info->visual, AllocNone);
+
+    /* Errors of requests sent to other clients' windows must not exit */
+    if (previous_error_handler == 0) {
+        previous_error_handler = XSetErrorHandler(handle_error);
+    }
+
+    /* Obtain the close event atom, the _NET_WM and selection atoms in one go */
+    X11_intern_atoms(d->display, atom_names, X11_ATOM_COUNT, d->atoms);
+
+    /* Report held keys as repeated presses instead of release and press pairs */
+    if (XkbSetDetectableAutoRepeat(d->display, 1, &supported)) {
+        d->detectable_auto_repeat = supported;
+    }
+
+    /* Ask for unaccelerated pointer motion */
+    select_raw_motion(d);
+
+    /* Find out how much of a frame can be presented */
+    query_presentation(d);
+
+    /* Wake the event loops up whenever events are read */
+    watch_events(d);
+
+    /* Release the Display */
+    XUnlockDisplay(d->display);
+
+    return d;
+
+fail:
+    XUnlockDisplay(d->display);
+    XCloseDisplay(d->display);
+    free(d);
+    return 0;
+}
+
+static void close_display(X11_Display * d) {
+    size_t i;
+
+    for (i = 0; i < d->cursor_count; ++i) {
+        XFreeCursor(d->display, d->cursors[i].cursor);
+    }
+    if (d->colormap) { XFreeColormap(d->display, d->colormap); }
+    XFree(d->visual_info);
+    XCloseDisplay(d->display);
+    free(d->windows);
+    free(d->waiters);
+    free(d);
+}
+
+static int handle_error(Display * display, XErrorEvent * error) {
+    X11_Display * d = __atomic_load_n(&shared_display, __ATOMIC_ACQUIRE);
+    unsigned int i;
+
+    if (d && d->display == display) {
+        for (i = 0; i < X11_DISPLAY_ERROR_TRAPS; ++i) {
+            if (error->serial >= d->error_traps[i][0] && error->serial < d->error_traps[i][1]) {
+                ++d->error_trap_hits[i];
+                return 0;
+            }
+        }
+    }
+
+    return previous_error_handler ? previous_error_handler(display, error) : 0;
+}
+
+static void watch_events(X11_Display * d) {
+    int type;
+
+    /* Types 0 and 1 are errors and replies */
+    for (type = 2; type < 128; ++type) {
+        previous_converters[type] = XESetWireToEvent(d->display, type, convert_event);
+    }
+
+#if defined(MG_HAVE_XINPUT2)
+    if (d->xinput_opcode) {
+        previous_cookie_converter = XESetWireToEventCookie(d->display, d->xinput_opcode,
+                                                           convert_cookie);
+    }
+#endif
+}
+
+static Bool convert_event(Display * display, XEvent * event, xEvent * wire) {
+    Bool queued = previous_converters[wire->u.u.type & 0x7F](display, event, wire);
+    if (queued) { wake_waiters(display); }
+    return queued;
+}
+
+#if defined(MG_HAVE_XINPUT2)
+
+static Bool convert_cookie(Display * display, XGenericEventCookie * cookie, xEvent * wire) {
+    /* Xlib queues cookies whatever this returns */
+    Bool converted = previous_cookie_converter ? previous_cookie_converter(display, cookie, wire) : False;
+    wake_waiters(display);
+    return converted;
+}
+
+#endif
+
+static void wake_waiters(Display * display) {
+    X11_Display * d = __atomic_load_n(&shared_display, __ATOMIC_ACQUIRE);
+
+    /* Events read while the display is being opened have no loop to wake */
+    if (d == 0 || d->display != display) { return; }
+
+    X11_Display_wake_waiters(d);
+}
+
+static void select_raw_motion(X11_Display * d) {
+#if defined(MG_HAVE_XINPUT2)
+    unsigned char mask[XIMaskLen(XI_LASTEVENT)];
+    XIEventMask event_mask;
+    int opcode, event, error, major = 2, minor = 0;
+
+    /* Check for XInput 2.0 or later */
+    if (!XQueryExtension(d->display, "XInputExtension", &opcode, &event, &error) ||
+        XIQueryVersion(d->display, &major, &minor) != Success) {
+        return;
+    }
+
+    event_mask.deviceid = XIAllMasterDevices;
+    event_mask.mask_len = sizeof(mask);
+    event_mask.mask = mask;
+
+    /* Raw events are only delivered to the root window */
+    memset(mask, 0, sizeof(mask));
+    XISetMask(mask, XI_RawMotion);
+    XISelectEvents(d->display, DefaultRootWindow(d->display), &event_mask, 1);
+
+    d->xinput_opcode = opcode;
+#endif
+}
+
+static void query_presentation(X11_Display * d) {
+    const char * extensions = glXQueryExtensionsString(d->display, d->screen);
+
+#if defined(MG_HAVE_XSHM)
+    {
+        /* Attaching fails on remote servers, and Xlib's default error
+         * handler would end the process */
+        const char * name = XDisplayString(d->display);
+        int local = name[0] == ':' || strncmp(name, "unix:", 5) == 0;
+        int major, minor;
+        Bool pixmaps = 0;
+
+        d->shm = local && XShmQueryExtension(d->display);
+
+        /* Pixmaps only help if they hold the pixels the way the images do */
+        d->shm_pixmaps = d->shm &&
+                         XShmQueryVersion(d->display, &major, &minor, &pixmaps) &&
+                         pixmaps && XShmPixmapFormat(d->display) == ZPixmap;
+    }
+#endif
+
+#if defined(MG_HAVE_XCB_PRESENT)
+    d->present = query_present(XGetXCBConnection(d->display));
+#endif
+
+    d->buffer_age = mg_has_extension(extensions, "GLX_EXT_buffer_age");
+
+    if (mg_has_extension(extensions, "GLX_MESA_copy_sub_buffer")) {
+        d->copy_sub_buffer = (void (*)(Display *, GLXDrawable, int, int, int, int))
+            glXGetProcAddress((const GLubyte *) "glXCopySubBufferMESA");
+    }
+
+    if (mg_has_extension(extensions, "GLX_OML_sync_control")) {
+        d->swap_buffers_msc = (int64_t (*)(Display *, GLXDrawable, int64_t, int64_t, int64_t))
+            glXGetProcAddress((const GLubyte *) "glXSwapBuffersMscOML");
+    }
+}
+
+#if defined(MG_HAVE_XCB_PRESENT)
+
+static int query_present(xcb_connection_t * connection) {
+    const xcb_query_extension_reply_t * present, * xfixes;
+    xcb_present_query_version_cookie_t present_cookie;
+    xcb_xfixes_query_version_cookie_t xfixes_cookie;
+    xcb_present_query_version_reply_t * present_version;
+    xcb_xfixes_query_version_reply_t * xfixes_version;
+    int supported;
+
+    /* Querying a missing extension's version would be an error */
+    present = xcb_get_extension_data(connection, &xcb_present_id);
+    xfixes = xcb_get_extension_data(connection, &xcb_xfixes_id);
+    if (present == 0 || !present->present || xfixes == 0 || !xfixes->present) { return 0; }
+
+    /* XFixes must be told which version the client speaks before regions work */
+    present_cookie = xcb_present_query_version(connection, 1, 0);
+    xfixes_cookie = xcb_xfixes_query_version(connection, 5, 0);
+
+    present_version = xcb_present_query_version_reply(connection, present_cookie, 0);
+    xfixes_version = xcb_xfixes_query_version_reply(connection, xfixes_cookie, 0);
+
+    supported = present_version != 0 && xfixes_version != 0 && xfixes_version->major_version >= 2;
+
+    free(present_version);
+    free(xfixes_version);
+    return supported;
+}
+
+#endif
+
+#if defined(MG_HAVE_XCURSOR)
+
+static Cursor create_cursor(Display * display, const unsigned char * pixels,
+                            mg_pixel_format format,
+                            unsigned int width, unsigned int height,
+                            unsigned int x, unsigned int y) {
+    mg_pixel_layout layout = mg_pixel_format_layout(format);
+    XcursorImage * image = XcursorImageCreate((int) width, (int) height);
+    Cursor cursor;
+    size_t i, count = (size_t) width * height;
+
+    if (image == 0) { return None; }
+
+    image->xhot = x;
+    image->yhot = y;
+
+    for (i = 0; i < count; ++i, pixels += 4) {
+        unsigned int a = pixels[layout.a];
+        unsigned int r = (pixels[layout.r] * a + 127) / 255;
+        unsigned int g = (pixels[layout.g] * a + 127) / 255;
+        unsigned int b = (pixels[layout.b] * a + 127) / 255;
+        image->pixels[i] = (XcursorPixel) (a << 24 | r << 16 | g << 8 | b);
+    }
+
+    cursor = XcursorImageLoadCursor(display, image);
+    XcursorImageDestroy(image);
+    return cursor;
+}
+
+#endif
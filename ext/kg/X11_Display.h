@@ -0,0 +1,196 @@
+#ifndef MG_X11_X11_DISPLAY_H
+#define MG_X11_X11_DISPLAY_H
+
+#include "pixel_format.h"
+
+#include <stdint.h>
+
+#include <X11/Xlib.h>
+
+#include <GL/glx.h>
+
+/**
+ * Atoms interned when the display is opened.
+ */
+enum {
+    X11_ATOM_WM_DELETE_WINDOW,
+    X11_ATOM_NET_WM_STATE,
+    X11_ATOM_NET_WM_STATE_HIDDEN,
+    X11_ATOM_NET_WM_STATE_MAXIMIZED_VERT,
+    X11_ATOM_NET_WM_STATE_MAXIMIZED_HORZ,
+    X11_ATOM_NET_WM_STATE_FULLSCREEN,
+    X11_ATOM_NET_WM_NAME,
+    X11_ATOM_NET_WM_ICON_NAME,
+    X11_ATOM_NET_WM_ICON,
+    X11_ATOM_CLIPBOARD,
+    X11_ATOM_TARGETS,
+    X11_ATOM_INCR,
+    X11_ATOM_MG_SELECTION,
+    X11_ATOM_COUNT
+};
+
+/**
+ * Associates a window with the data of its owner.
+ */
+typedef struct {
+    Window window;
+    void * data;
+} X11_Display_window;
+
+/**
+ * Maximum number of cursors created from images kept on the server.
+ */
+#define X11_DISPLAY_CURSORS 32
+
+/**
+ * Number of request ranges whose errors can be ignored at the same time.
+ */
+#define X11_DISPLAY_ERROR_TRAPS 32
+
+/**
+ * Cursor created from an image, keyed by a hash of its contents.
+ */
+typedef struct {
+    uint64_t key; /** Hash of the pixels, their format, size and hotspot. */
+    Cursor cursor;
+    uint64_t used; /** Tick of the last lookup, for evicting the least recently used. */
+} X11_Display_cursor;
+
+/**
+ * Event loop that sleeps until events arrive.
+ */
+typedef struct {
+    int fd; /** eventfd the loop polls along with the connection. */
+    int signalled; /** Whether fd was written since the loop last reset it. */
+} X11_Display_waiter;
+
+/**
+ * Connection to the X Server shared by all windows, along with everything
+ * window creation needs that only has to be looked up once per display and
+ * screen.
+ */
+typedef struct X11_Display {
+    Display * display; /** Pointer to the display connection. */
+    int screen; /** Default screen. */
+    unsigned int references; /** Number of users of the connection. */
+    XVisualInfo * visual_info; /** Double buffered visual chosen through GLX. */
+    Colormap colormap; /** Colormap for the visual, or None. */
+    unsigned long white; /** White pixel of the screen. */
+    Atom atoms[X11_ATOM_COUNT]; /** Interned atoms. */
+    int detectable_auto_repeat; /** Whether held keys repeat without fake releases. */
+    int xinput_opcode; /** Major opcode of XInput2 events, zero if unavailable. */
+    int shm; /** Whether images can be shared with the server through MIT-SHM. */
+    int buffer_age; /** Whether GLX reports the age of back buffers. */
+    void (*copy_sub_buffer)(Display *, GLXDrawable, int, int, int, int); /** Presents part of the back buffer, or 0. */
+    int shm_pixmaps; /** Whether pixmaps can be created over shared memory. */
+    int present; /** Whether the Present extension and XFixes regions are available. */
+    int64_t (*swap_buffers_msc)(Display *, GLXDrawable, int64_t, int64_t, int64_t); /** Swaps at a retrace count, or 0. */
+    void * focus; /** X11_Window that has the input focus, if any. */
+    X11_Display_window * windows; /** Windows created on the display. */
+    size_t window_count;
+    size_t window_capacity;
+    X11_Display_waiter * waiters; /** Event loops woken whenever events are queued. */
+    size_t waiter_count;
+    size_t waiter_capacity;
+    X11_Display_cursor cursors[X11_DISPLAY_CURSORS]; /** Cursors created from images. */
+    size_t cursor_count;
+    uint64_t cursor_tick; /** Incremented on every cursor lookup. */
+    unsigned long error_traps[X11_DISPLAY_ERROR_TRAPS][2]; /** Serials whose errors are ignored, end exclusive. */
+    unsigned int error_trap_hits[X11_DISPLAY_ERROR_TRAPS]; /** Errors ignored in each range. */
+    unsigned int error_trap; /** Next range to overwrite. */
+} X11_Display;
+
+/**
+ * Acquires a reference to the shared display, connecting to the X Server and
+ * setting up GLX on first use.
+ *
+ * Returns zero and sets the error message on failure.
+ */
+extern X11_Display * X11_Display_acquire(const char ** error);
+
+/**
+ * Releases a reference to the display, closing the connection when the last
+ * one goes away.
+ */
+extern void X11_Display_release(X11_Display * d);
+
+/**
+ * Registers the window so that events without a window field, such as those
+ * of XInput2, can be routed to it. The display must be locked.
+ *
+ * Returns zero if memory could not be allocated.
+ */
+extern int X11_Display_add_window(X11_Display * d, Window window, void * data);
+
+/**
+ * Unregisters the window. The display must be locked.
+ */
+extern void X11_Display_remove_window(X11_Display * d, Window window);
+
+/**
+ * Returns the data registered for the window, or zero. The display must be
+ * locked.
+ */
+extern void * X11_Display_find_window(X11_Display * d, Window window);
+
+/**
+ * Registers an event loop's eventfd, which is written to whenever events are
+ * read into the queue, by any thread. The display must be locked.
+ *
+ * Returns zero if memory could not be allocated.
+ */
+extern int X11_Display_add_waiter(X11_Display * d, int fd);
+
+/**
+ * Unregisters the eventfd. The display must be locked.
+ */
+extern void X11_Display_remove_waiter(X11_Display * d, int fd);
+
+/**
+ * Consumes the eventfd's wake up, so that the next events queued write to it
+ * again. Events already queued must be looked at before unlocking the
+ * display, which must be locked.
+ */
+extern void X11_Display_reset_waiter(X11_Display * d, int fd);
+
+/**
+ * Wakes every registered event loop up as if events had been queued, so that
+ * they look at state changed outside of them. The display must be locked.
+ */
+extern void X11_Display_wake_waiters(X11_Display * d);
+
+/**
+ * Starts ignoring errors caused by the requests that follow, such as those
+ * sent to windows of other clients which may be destroyed at any time.
+ * Without this, Xlib's default handler exits the process. The display must be
+ * locked until X11_Display_untrap_errors.
+ */
+extern void X11_Display_trap_errors(X11_Display * d);
+
+/**
+ * Stops ignoring errors of requests sent from now on. Errors of the requests
+ * sent since X11_Display_trap_errors are still ignored when they arrive.
+ */
+extern void X11_Display_untrap_errors(X11_Display * d);
+
+/**
+ * Waits for the server to process every request sent so far and returns the
+ * number of errors ignored for those of the last X11_Display_trap_errors.
+ * The display must be locked since then.
+ */
+extern unsigned int X11_Display_trapped_errors(X11_Display * d);
+
+/**
+ * Returns a cursor showing the width by height image, its pixels in the given
+ * format, with the hotspot at x, y. Cursors are cached by contents, so asking
+ * for the same image again creates nothing on the server; when the cache is
+ * full the least recently used one is freed, which windows still showing it
+ * don't notice. Returns None if the cursor could not be created or Xcursor
+ * isn't available. The display must be locked.
+ */
+extern Cursor X11_Display_load_cursor(X11_Display * d, const unsigned char * pixels,
+                                      mg_pixel_format format,
+                                      unsigned int width, unsigned int height,
+                                      unsigned int x, unsigned int y);
+
+#endif /* MG_X11_X11_DISPLAY_H */
@@ -0,0 +1,170 @@
+#include "X11_Framebuffer.h"
+
+#include <stdlib.h>
+
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+#if defined(MG_HAVE_XSHM)
+    #include <sys/ipc.h>
+    #include <sys/shm.h>
+#endif
+
+/* Helper function prototypes */
+
+/**
+ * Creates the image in a shared memory segment. Returns zero on failure.
+ */
+static int create_shared(X11_Framebuffer * fb, X11_Display * d,
+                         unsigned int width, unsigned int height);
+
+/**
+ * Creates the image in client memory. Returns zero on failure.
+ */
+static int create_unshared(X11_Framebuffer * fb, X11_Display * d,
+                           unsigned int width, unsigned int height);
+
+/* X11_Framebuffer interface implementation */
+
+const char * X11_Framebuffer_create(X11_Framebuffer * fb, X11_Display * d, Window window,
+                                    unsigned int width, unsigned int height) {
+    XVisualInfo * visual_info = d->visual_info;
+
+    fb->image = 0;
+    fb->gc = 0;
+    fb->shared = 0;
+
+    if (visual_info->class != TrueColor || visual_info->depth < 24) {
+        return "visual doesn't use 32 bit true color pixels";
+    }
+
+    if (!(d->shm && create_shared(fb, d, width, height)) &&
+        !create_unshared(fb, d, width, height)) {
+        return "unable to allocate memory for framebuffer";
+    }
+
+    if (fb->image->bits_per_pixel != 32) {
+        X11_Framebuffer_destroy(fb, d->display);
+        return "visual doesn't use 32 bit true color pixels";
+    }
+
+    fb->gc = XCreateGC(d->display, window, 0, 0);
+    return 0;
+}
+
+void X11_Framebuffer_destroy(X11_Framebuffer * fb, Display * display) {
+    if (fb->image == 0) { return; }
+
+#if defined(MG_HAVE_XSHM)
+    if (fb->shared) {
+        XShmDetach(display, &fb->segment);
+        XSync(display, False);
+        shmdt(fb->segment.shmaddr);
+        fb->image->data = 0;
+    }
+#endif
+
+    /* Frees the pixels too, unless they were shared */
+    XDestroyImage(fb->image);
+    if (fb->gc) { XFreeGC(display, fb->gc); }
+
+    fb->image = 0;
+    fb->gc = 0;
+    fb->shared = 0;
+}
+
+uint64_t X11_Framebuffer_put(X11_Framebuffer * fb, Display * display, Window window,
+                             const mg_damage * damage) {
+    uint64_t bytes = 0;
+    unsigned int i;
+
+    for (i = 0; i < damage->count; ++i) {
+        const mg_rect * r = &damage->rects[i];
+
+#if defined(MG_HAVE_XSHM)
+        if (fb->shared) {
+            XShmPutImage(display, window, fb->gc, fb->image,
+                         r->x, r->y, r->x, r->y, r->width, r->height, False);
+        } else
+#endif
+        {
+            XPutImage(display, window, fb->gc, fb->image,
+                      r->x, r->y, r->x, r->y, r->width, r->height);
+        }
+
+        bytes += (uint64_t) r->width * r->height * 4;
+    }
+
+    /* The server reads shared pixels asynchronously */
+    if (bytes) { XSync(display, False); }
+
+    return bytes;
+}
+
+/* Helper function implementation */
+
+static int create_shared(X11_Framebuffer * fb, X11_Display * d,
+                         unsigned int width, unsigned int height) {
+#if defined(MG_HAVE_XSHM)
+    XVisualInfo * visual_info = d->visual_info;
+    int attached = 0;
+
+    fb->image = XShmCreateImage(d->display, visual_info->visual, visual_info->depth,
+                                ZPixmap, 0, &fb->segment, width, height);
+    if (fb->image == 0) { return 0; }
+
+    fb->segment.shmid = shmget(IPC_PRIVATE, (size_t) fb->image->bytes_per_line * height,
+                               IPC_CREAT | 0600);
+    if (fb->segment.shmid < 0) {
+        XDestroyImage(fb->image);
+        fb->image = 0;
+        return 0;
+    }
+
+    fb->segment.shmaddr = fb->image->data = shmat(fb->segment.shmid, 0, 0);
+    fb->segment.readOnly = False;
+
+    /* Servers that can't map the segment, such as remote ones, refuse it */
+    if (fb->segment.shmaddr != (char *) -1) {
+        X11_Display_trap_errors(d);
+        attached = XShmAttach(d->display, &fb->segment);
+        X11_Display_untrap_errors(d);
+        if (X11_Display_trapped_errors(d)) { attached = 0; }
+    }
+
+    if (!attached) {
+        if (fb->segment.shmaddr != (char *) -1) { shmdt(fb->segment.shmaddr); }
+        shmctl(fb->segment.shmid, IPC_RMID, 0);
+        fb->image->data = 0;
+        XDestroyImage(fb->image);
+        fb->image = 0;
+        return 0;
+    }
+
+    /* Both sides are attached, so the segment goes away with them */
+    shmctl(fb->segment.shmid, IPC_RMID, 0);
+
+    fb->shared = 1;
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+static int create_unshared(X11_Framebuffer * fb, X11_Display * d,
+                           unsigned int width, unsigned int height) {
+    XVisualInfo * visual_info = d->visual_info;
+    char * pixels = calloc((size_t) width * height, 4);
+
+    if (pixels == 0) { return 0; }
+
+    fb->image = XCreateImage(d->display, visual_info->visual, visual_info->depth,
+                             ZPixmap, 0, pixels, width, height, 32, 0);
+    if (fb->image == 0) {
+        free(pixels);
+        return 0;
+    }
+
+    fb->shared = 0;
+    return 1;
+}
@@ -0,0 +1,54 @@
+#ifndef MG_X11_X11_FRAMEBUFFER_H
+#define MG_X11_X11_FRAMEBUFFER_H
+
+#include "X11_Display.h"
+#include "damage.h"
+
+#include <stdint.h>
+
+#include <X11/Xlib.h>
+
+#if defined(MG_HAVE_XSHM)
+    #include <X11/extensions/XShm.h>
+#endif
+
+/**
+ * Pixels drawn by the CPU and pushed to a window. When the server supports
+ * MIT-SHM, they live in memory shared with it and pushing them copies
+ * nothing over the connection.
+ */
+typedef struct {
+    XImage * image; /** Image holding the pixels, 32 bits each. */
+    GC gc; /** Graphics context used to push the image. */
+    int shared; /** Whether the pixels are in a shared memory segment. */
+#if defined(MG_HAVE_XSHM)
+    XShmSegmentInfo segment; /** The shared memory segment. */
+#endif
+} X11_Framebuffer;
+
+/**
+ * Creates a width by height framebuffer for the window, in the pixel layout
+ * of the display's visual, overwriting whatever fb held. The display must be
+ * locked.
+ *
+ * Returns zero on success or an error message on failure.
+ */
+extern const char * X11_Framebuffer_create(X11_Framebuffer * fb, X11_Display * d, Window window,
+                                           unsigned int width, unsigned int height);
+
+/**
+ * Frees the framebuffer's pixels. The display must be locked.
+ */
+extern void X11_Framebuffer_destroy(X11_Framebuffer * fb, Display * display);
+
+/**
+ * Pushes the damaged rectangles to the window and waits until the server has
+ * read them, so that the pixels can be drawn over again. The display must be
+ * locked.
+ *
+ * Returns the number of bytes pushed.
+ */
+extern uint64_t X11_Framebuffer_put(X11_Framebuffer * fb, Display * display, Window window,
+                                    const mg_damage * damage);
+
+#endif /* MG_X11_X11_FRAMEBUFFER_H */
@@ -0,0 +1,433 @@
+#include "X11_Present.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+
+#if defined(MG_HAVE_XSHM)
+    #include <X11/extensions/XShm.h>
+#endif
+
+#if defined(MG_HAVE_XCB_PRESENT)
+    #include <X11/Xlib-xcb.h>
+    #include <xcb/xcb.h>
+    #include <xcb/present.h>
+    #include <xcb/xfixes.h>
+#endif
+
+/* Constant definitions */
+
+/**
+ * First serial number used. The window's other clients, the OpenGL driver
+ * among them, count their own presentations from one, and their events reach
+ * every selection on the window.
+ */
+#define FIRST_SERIAL 0x80000000u
+
+/**
+ * Serial number of the completions that wake waiting threads up. Never used
+ * by frames, since serials only count up from FIRST_SERIAL.
+ */
+#define WAKE_SERIAL 0x7FFFFFFFu
+
+/* Helper function prototypes */
+
+#if defined(MG_HAVE_XCB_PRESENT)
+
+/**
+ * Records a frame's completion or notes that a pixmap is idle, ignoring
+ * other events.
+ */
+static void record(X11_Present * p, const xcb_present_generic_event_t * event);
+
+/**
+ * Handles the window's events until the completion with the serial number
+ * arrives, and returns it. Returns 0 if the connection broke or the wait was
+ * interrupted.
+ */
+static xcb_present_complete_notify_event_t * wait_for_completion(X11_Present * p,
+                                                                 xcb_connection_t * connection,
+                                                                 uint32_t serial,
+                                                                 const int * interrupted);
+
+#if defined(MG_HAVE_XSHM)
+
+/**
+ * Handles the window's events until the server is done with the buffer's
+ * pixmap. Returns zero if the connection broke or the wait was interrupted.
+ */
+static int wait_for_idle(X11_Present * p, xcb_connection_t * connection,
+                         X11_Present_buffer * b, const int * interrupted);
+
+/**
+ * Makes the buffer's copy the size of the framebuffer, creating its pixmap.
+ * Returns zero if it could not be put in shared memory. The display must be
+ * locked.
+ */
+static int prepare(X11_Present_buffer * b, X11_Display * d, Window window,
+                   X11_Framebuffer * fb);
+
+#endif
+
+/**
+ * Frees the buffer's pixmap and copy. The display must be locked.
+ */
+static void discard(X11_Present_buffer * b, Display * display);
+
+#endif
+
+/* X11_Present interface implementation */
+
+#if defined(MG_HAVE_XCB_PRESENT)
+
+int X11_Present_start(X11_Present * p, X11_Display * d, Window window) {
+    xcb_connection_t * connection;
+
+    if (p->events) { return 1; }
+    if (!d->present) { return 0; }
+
+    connection = XGetXCBConnection(d->display);
+
+    pthread_mutex_init(&p->lock, 0);
+    p->serial = FIRST_SERIAL;
+    p->first = p->count = 0;
+    memset(p->buffers, 0, sizeof(p->buffers));
+    p->next = 0;
+    p->region = 0;
+    p->window = window;
+
+    p->eid = xcb_generate_id(connection);
+    p->events = xcb_register_for_special_xge(connection, &xcb_present_id, p->eid, 0);
+    xcb_present_select_input(connection, p->eid, window,
+                             XCB_PRESENT_EVENT_MASK_COMPLETE_NOTIFY |
+                             XCB_PRESENT_EVENT_MASK_IDLE_NOTIFY);
+    xcb_flush(connection);
+
+    return 1;
+}
+
+void X11_Present_stop(X11_Present * p, Display * display) {
+    xcb_connection_t * connection = XGetXCBConnection(display);
+
+    unsigned int i;
+
+    if (p->events == 0) { return; }
+
+    for (i = 0; i < X11_PRESENT_BUFFERS; ++i) {
+        discard(&p->buffers[i], display);
+    }
+    if (p->region) { xcb_xfixes_destroy_region(connection, p->region); }
+
+    xcb_unregister_for_special_event(connection, p->events);
+    pthread_mutex_destroy(&p->lock);
+
+    p->events = 0;
+    p->region = 0;
+}
+
+uint64_t X11_Present_pixmap(X11_Present * p, X11_Display * d, Window window,
+                            X11_Framebuffer * fb, const mg_damage * damage,
+                            uint64_t target_msc, const int * interrupted) {
+#if defined(MG_HAVE_XSHM)
+    xcb_connection_t * connection = XGetXCBConnection(d->display);
+    xcb_rectangle_t rectangles[MG_DAMAGE_MAX_RECTS];
+    X11_Present_buffer * b = &p->buffers[p->next];
+    uint64_t bytes = 0;
+    unsigned int i, j;
+
+    if (p->events == 0 || !fb->shared || !d->shm_pixmaps) { return 0; }
+
+    /* The pixmap was presented a whole ring ago, so it's usually idle by now */
+    if (b->busy && !wait_for_idle(p, connection, b, interrupted)) { return 0; }
+
+    XLockDisplay(d->display);
+
+    if (!prepare(b, d, window, fb)) {
+        XUnlockDisplay(d->display);
+        return 0;
+    }
+
+    /* Every copy misses this frame's changes until its turn comes */
+    for (i = 0; i < X11_PRESENT_BUFFERS; ++i) {
+        for (j = 0; j < damage->count; ++j) {
+            const mg_rect * r = &damage->rects[j];
+            mg_damage_add(&p->buffers[i].stale, r->x, r->y, r->width, r->height);
+        }
+    }
+
+    /* Bring this copy up to date; rows are the same size in both images */
+    for (i = 0; i < b->stale.count; ++i) {
+        const mg_rect * r = &b->stale.rects[i];
+        size_t offset = (size_t) r->y * fb->image->bytes_per_line + (size_t) r->x * 4;
+        for (j = 0; j < (unsigned int) r->height; ++j) {
+            memcpy(b->copy.image->data + offset, fb->image->data + offset, (size_t) r->width * 4);
+            offset += fb->image->bytes_per_line;
+        }
+    }
+    mg_damage_reset(&b->stale, fb->image->width, fb->image->height);
+
+    for (i = 0; i < damage->count; ++i) {
+        const mg_rect * r = &damage->rects[i];
+        rectangles[i].x = r->x;
+        rectangles[i].y = r->y;
+        rectangles[i].width = r->width;
+        rectangles[i].height = r->height;
+        bytes += (uint64_t) r->width * r->height * 4;
+    }
+
+    /* Only the damage is copied */
+    if (p->region == 0) {
+        p->region = xcb_generate_id(connection);
+        xcb_xfixes_create_region(connection, p->region, damage->count, rectangles);
+    } else {
+        xcb_xfixes_set_region(connection, p->region, damage->count, rectangles);
+    }
+
+    /* The server may copy the pixmap or flip to it; either way it's left
+     * alone until it's idle again, a frame or more later */
+    ++p->serial;
+    xcb_present_pixmap(connection, window, b->pixmap, p->serial,
+                       0, mg_damage_full(damage) ? 0 : p->region,
+                       0, 0, 0, 0, 0, XCB_PRESENT_OPTION_NONE,
+                       target_msc, 0, 0, 0, 0);
+    xcb_flush(connection);
+    b->busy = 1;
+    p->next = (p->next + 1) % X11_PRESENT_BUFFERS;
+
+    XUnlockDisplay(d->display);
+
+    return bytes;
+#else
+    return 0;
+#endif
+}
+
+void X11_Present_wait_msc(X11_Present * p, Display * display, Window window,
+                          uint64_t target_msc, mg_present_feedback * reached,
+                          const int * interrupted) {
+    xcb_connection_t * connection = XGetXCBConnection(display);
+    xcb_present_complete_notify_event_t * complete;
+    uint32_t serial;
+
+    memset(reached, 0, sizeof(mg_present_feedback));
+    if (p->events == 0) { return; }
+
+    XLockDisplay(display);
+    serial = ++p->serial;
+    /* With no target, the next retrace is the first to pass the current one */
+    xcb_present_notify_msc(connection, window, serial, target_msc,
+                           target_msc ? 0 : 1, 0);
+    xcb_flush(connection);
+    XUnlockDisplay(display);
+
+    complete = wait_for_completion(p, connection, serial, interrupted);
+
+    if (complete) {
+        reached->serial = serial;
+        reached->ust = complete->ust;
+        reached->msc = complete->msc;
+        reached->mode = MG_PRESENT_MODE_COPY;
+        free(complete);
+    }
+}
+
+void X11_Present_wake(X11_Present * p, Display * display) {
+    xcb_connection_t * connection = XGetXCBConnection(display);
+
+    if (p->events == 0) { return; }
+
+    /* XCB serializes this with the requests of other threads by itself */
+    xcb_present_notify_msc(connection, p->window, WAKE_SERIAL, 0, 0, 0);
+    xcb_flush(connection);
+}
+
+void X11_Present_collect(X11_Present * p, Display * display) {
+    xcb_connection_t * connection = XGetXCBConnection(display);
+    xcb_generic_event_t * event;
+
+    if (p->events == 0) { return; }
+
+    while ((event = xcb_poll_for_special_event(connection, p->events)) != 0) {
+        record(p, (xcb_present_generic_event_t *) event);
+        free(event);
+    }
+}
+
+unsigned int X11_Present_take_feedback(X11_Present * p,
+                                       mg_present_feedback * feedback, unsigned int max) {
+    unsigned int taken = 0;
+
+    if (p->events == 0) { return 0; }
+
+    pthread_mutex_lock(&p->lock);
+    while (taken < max && p->count > 0) {
+        feedback[taken++] = p->feedback[p->first];
+        p->first = (p->first + 1) % MG_PRESENT_FEEDBACK_CAPACITY;
+        --p->count;
+    }
+    pthread_mutex_unlock(&p->lock);
+
+    return taken;
+}
+
+#else
+
+int X11_Present_start(X11_Present * p, X11_Display * d, Window window) {
+    return 0;
+}
+
+void X11_Present_stop(X11_Present * p, Display * display) {
+}
+
+uint64_t X11_Present_pixmap(X11_Present * p, X11_Display * d, Window window,
+                            X11_Framebuffer * fb, const mg_damage * damage,
+                            uint64_t target_msc, const int * interrupted) {
+    return 0;
+}
+
+void X11_Present_wait_msc(X11_Present * p, Display * display, Window window,
+                          uint64_t target_msc, mg_present_feedback * reached,
+                          const int * interrupted) {
+    memset(reached, 0, sizeof(mg_present_feedback));
+}
+
+void X11_Present_wake(X11_Present * p, Display * display) {
+}
+
+void X11_Present_collect(X11_Present * p, Display * display) {
+}
+
+unsigned int X11_Present_take_feedback(X11_Present * p,
+                                       mg_present_feedback * feedback, unsigned int max) {
+    return 0;
+}
+
+#endif
+
+/* Helper function implementation */
+
+#if defined(MG_HAVE_XCB_PRESENT)
+
+static void record(X11_Present * p, const xcb_present_generic_event_t * event) {
+    const xcb_present_complete_notify_event_t * complete;
+    const xcb_present_idle_notify_event_t * idle;
+    mg_present_feedback * f;
+    unsigned int i;
+
+    /* Idle notifications of the driver's pixmaps reach this selection too */
+    if (event->evtype == XCB_PRESENT_EVENT_IDLE_NOTIFY) {
+        idle = (const xcb_present_idle_notify_event_t *) event;
+        for (i = 0; i < X11_PRESENT_BUFFERS; ++i) {
+            if (p->buffers[i].pixmap != None && p->buffers[i].pixmap == idle->pixmap) {
+                p->buffers[i].busy = 0;
+            }
+        }
+        return;
+    }
+
+    if (event->evtype != XCB_PRESENT_EVENT_COMPLETE_NOTIFY) { return; }
+
+    complete = (const xcb_present_complete_notify_event_t *) event;
+    if (complete->kind != XCB_PRESENT_COMPLETE_KIND_PIXMAP) { return; }
+
+    pthread_mutex_lock(&p->lock);
+
+    /* When nobody asks, the oldest frames are forgotten */
+    if (p->count == MG_PRESENT_FEEDBACK_CAPACITY) {
+        p->first = (p->first + 1) % MG_PRESENT_FEEDBACK_CAPACITY;
+        --p->count;
+    }
+
+    f = &p->feedback[(p->first + p->count++) % MG_PRESENT_FEEDBACK_CAPACITY];
+    f->serial = complete->serial;
+    f->ust = complete->ust;
+    f->msc = complete->msc;
+
+    switch (complete->mode) {
+    case XCB_PRESENT_COMPLETE_MODE_FLIP:            f->mode = MG_PRESENT_MODE_FLIP; break;
+    case XCB_PRESENT_COMPLETE_MODE_SKIP:            f->mode = MG_PRESENT_MODE_SKIP; break;
+    case XCB_PRESENT_COMPLETE_MODE_SUBOPTIMAL_COPY: f->mode = MG_PRESENT_MODE_SUBOPTIMAL_COPY; break;
+    default:                                        f->mode = MG_PRESENT_MODE_COPY; break;
+    }
+
+    pthread_mutex_unlock(&p->lock);
+}
+
+static xcb_present_complete_notify_event_t * wait_for_completion(X11_Present * p,
+                                                                 xcb_connection_t * connection,
+                                                                 uint32_t serial,
+                                                                 const int * interrupted) {
+    xcb_generic_event_t * event;
+
+    while (!*interrupted && (event = xcb_wait_for_special_event(connection, p->events)) != 0) {
+        xcb_present_generic_event_t * present = (xcb_present_generic_event_t *) event;
+
+        record(p, present);
+
+        if (present->evtype == XCB_PRESENT_EVENT_COMPLETE_NOTIFY &&
+            ((xcb_present_complete_notify_event_t *) event)->serial == serial) {
+            return (xcb_present_complete_notify_event_t *) event;
+        }
+
+        free(event);
+    }
+
+    return 0;
+}
+
+#if defined(MG_HAVE_XSHM)
+
+static int wait_for_idle(X11_Present * p, xcb_connection_t * connection,
+                         X11_Present_buffer * b, const int * interrupted) {
+    xcb_generic_event_t * event;
+
+    while (b->busy && !*interrupted) {
+        if ((event = xcb_wait_for_special_event(connection, p->events)) == 0) { return 0; }
+        record(p, (xcb_present_generic_event_t *) event);
+        free(event);
+    }
+
+    return !b->busy;
+}
+
+static int prepare(X11_Present_buffer * b, X11_Display * d, Window window,
+                   X11_Framebuffer * fb) {
+    XImage * image = fb->image;
+
+    if (b->pixmap != None &&
+        b->copy.image->width == image->width && b->copy.image->height == image->height) {
+        return 1;
+    }
+
+    discard(b, d->display);
+
+    if (X11_Framebuffer_create(&b->copy, d, window, image->width, image->height) != 0) {
+        return 0;
+    }
+
+    /* Rows must line up with the framebuffer's to be copied over */
+    if (!b->copy.shared || b->copy.image->bytes_per_line != image->bytes_per_line) {
+        X11_Framebuffer_destroy(&b->copy, d->display);
+        return 0;
+    }
+
+    b->pixmap = XShmCreatePixmap(d->display, window, b->copy.image->data, &b->copy.segment,
+                                 image->width, image->height, image->depth);
+
+    /* Nothing has been copied yet */
+    mg_damage_reset(&b->stale, image->width, image->height);
+    mg_damage_add_all(&b->stale);
+    return 1;
+}
+
+#endif
+
+static void discard(X11_Present_buffer * b, Display * display) {
+    if (b->pixmap != None) { XFreePixmap(display, b->pixmap); }
+    X11_Framebuffer_destroy(&b->copy, display);
+    b->pixmap = None;
+    b->busy = 0;
+}
+
+#endif
@@ -0,0 +1,104 @@
+#ifndef MG_X11_X11_PRESENT_H
+#define MG_X11_X11_PRESENT_H
+
+#include "X11_Display.h"
+#include "X11_Framebuffer.h"
+#include "damage.h"
+#include "present.h"
+
+#include <stdint.h>
+
+#include <pthread.h>
+
+#include <X11/Xlib.h>
+
+/**
+ * Number of pixmaps framebuffer frames are presented from, so that the server
+ * can show one, or flip to it, while the next is being filled.
+ */
+#define X11_PRESENT_BUFFERS 2
+
+/**
+ * Shared memory pixmap a framebuffer frame is presented from.
+ */
+typedef struct {
+    X11_Framebuffer copy; /** Copy of the framebuffer pixels the pixmap is created over. */
+    Pixmap pixmap; /** The pixmap, or None. */
+    mg_damage stale; /** Parts of the framebuffer that changed since the copy was updated. */
+    int busy; /** Whether the server may still read the pixmap. */
+} X11_Present_buffer;
+
+/**
+ * A window's use of the Present extension. Its events go to a queue of their
+ * own, away from the Xlib event loop, so they can be waited for right where
+ * frames are presented.
+ */
+typedef struct {
+    void * events; /** Special event queue of the window's Present events, or 0. */
+    uint32_t eid; /** Identifier the events were selected with. */
+    Window window; /** Window the events were selected on. */
+    X11_Present_buffer buffers[X11_PRESENT_BUFFERS];
+    unsigned int next; /** Buffer the next frame is presented from. */
+    uint32_t region; /** XFixes region the damage is presented through, or 0. */
+    uint32_t serial; /** Serial number of the last request. */
+    pthread_mutex_t lock; /** Guards the feedback, which Ruby may read from any thread. */
+    mg_present_feedback feedback[MG_PRESENT_FEEDBACK_CAPACITY];
+    unsigned int first, count;
+} X11_Present;
+
+/**
+ * Selects the window's Present events. Returns zero if the extension isn't
+ * available.
+ */
+extern int X11_Present_start(X11_Present * p, X11_Display * d, Window window);
+
+/**
+ * Stops listening for the window's Present events and frees the pixmaps. The
+ * display must be locked.
+ */
+extern void X11_Present_stop(X11_Present * p, Display * display);
+
+/**
+ * Presents the damaged parts of the framebuffer, or all of it, at the given
+ * vertical retrace count or as soon as possible if it's zero. What changed is
+ * copied into the next pixmap of the ring, once the server is done with it,
+ * so the framebuffer can be drawn over right away. The framebuffer must be in
+ * shared memory. The display must NOT be locked.
+ *
+ * Returns the number of bytes presented, or zero if the pixmap could not be
+ * created or the wait for it was interrupted.
+ */
+extern uint64_t X11_Present_pixmap(X11_Present * p, X11_Display * d, Window window,
+                                   X11_Framebuffer * fb, const mg_damage * damage,
+                                   uint64_t target_msc, const int * interrupted);
+
+/**
+ * Waits until the vertical retrace count reaches the target, or for the next
+ * retrace if it's zero, and stores the time and count reached. Stops early,
+ * leaving them zero, once interrupted is set. The display must NOT be locked.
+ */
+extern void X11_Present_wait_msc(X11_Present * p, Display * display, Window window,
+                                 uint64_t target_msc, mg_present_feedback * reached,
+                                 const int * interrupted);
+
+/**
+ * Wakes up a thread waiting for the window's Present events, which checks
+ * whether it was interrupted. The waiting thread can't be woken any other
+ * way, so this asks the server for a completion that arrives right away.
+ * Called from unblocking functions; the display need not be locked.
+ */
+extern void X11_Present_wake(X11_Present * p, Display * display);
+
+/**
+ * Records the completions that have arrived, without waiting.
+ */
+extern void X11_Present_collect(X11_Present * p, Display * display);
+
+/**
+ * Moves up to max recorded completions into the array, oldest first, and
+ * returns how many were moved.
+ */
+extern unsigned int X11_Present_take_feedback(X11_Present * p,
+                                              mg_present_feedback * feedback, unsigned int max);
+
+#endif /* MG_X11_X11_PRESENT_H */
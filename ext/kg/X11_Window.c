@@ -1,19 +1,38 @@
 #include "X11_Window.h"
 
+#include "X11_requests.h"
 #include "event.h"
 
 #include <stdlib.h>
+#include <string.h>
+
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
 
 #include <ruby.h>
+#include <ruby/ractor.h>
+#include <ruby/thread.h>
 
 #include <X11/Xlib.h>
 #include <X11/Xatom.h>
+#include <X11/XKBlib.h>
 #include <X11/keysym.h>
 
+#if defined(MG_HAVE_XINPUT2)
+    #include <X11/extensions/XInput2.h>
+#endif
+
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <GL/glx.h>
 
+#ifndef GLX_BACK_BUFFER_AGE_EXT
+    #define GLX_BACK_BUFFER_AGE_EXT 0x20F4
+#endif
+
 /**
  * Motif window hints
  */
@@ -43,12 +62,10 @@ Atom _NET_WM_ICON;
 
 /* Constant definitions */
 
-static int attribute_list[] = { GLX_RGBA, GLX_DOUBLEBUFFER,
-                                GLX_RED_SIZE,   8,
-                                GLX_GREEN_SIZE, 8,
-                                GLX_BLUE_SIZE,  8,
-                                GLX_DEPTH_SIZE, 24,
-                                None };
+/**
+ * Largest number of windows the pool can hold.
+ */
+#define POOL_CAPACITY 16
 
 static const unsigned long event_mask = FocusChangeMask     |
                                         ButtonPressMask     |
@@ -58,15 +75,162 @@ static const unsigned long event_mask = FocusChangeMask     |
                                         KeyPressMask        |
                                         KeyReleaseMask      |
                                         StructureNotifyMask |
+                                        PropertyChangeMask  |
                                         EnterWindowMask     |
                                         LeaveWindowMask;
 
+/* Data structures */
+
+/**
+ * Windows created ahead of time by a background thread.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int started; /** Whether the refill thread is running. */
+    unsigned int size; /** Number of windows to keep ready. */
+    unsigned int count; /** Number of windows ready. */
+    X11_Window * windows[POOL_CAPACITY];
+} pool_t;
+
+static pool_t pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+/**
+ * Windows waiting to be freed by the reaper thread.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    int started; /** Whether the reaper thread is running. */
+    X11_Window ** windows;
+    size_t count, capacity;
+} reaper_t;
+
+static reaper_t reaper = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER };
+
+/**
+ * Reference to the shared display held on behalf of Mg.display_io and
+ * Mg.dispatch_pending. Never released.
+ */
+static X11_Display * dispatcher;
+static pthread_mutex_t dispatcher_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Numbers the Ractors that create windows, so that each only dispatches
+ * events of its own. Numbers are kept in Ractor-local storage and never
+ * reused.
+ */
+static rb_ractor_local_key_t ractor_key;
+static uintptr_t ractor_count;
+
+/**
+ * Window creation request, carried across the GVL release.
+ */
+typedef struct {
+    X11_Window * w;
+    int x, y;
+    unsigned int width, height;
+    const char * error; /** Why the window could not be created. */
+    int created; /** Whether the window was created. */
+    int interrupted; /** Set by the unblocking function. */
+} creation_t;
+
+/**
+ * Window attributes request, carried across the GVL release.
+ */
+typedef struct {
+    X11_Window * w;
+    XWindowAttributes attributes;
+    int success; /** Whether the attributes could be retrieved. */
+} attributes_t;
+
+/**
+ * Window name request, carried across the GVL release.
+ */
+typedef struct {
+    X11_Window * w;
+    char * name;
+} name_t;
+
+/**
+ * Framebuffer request, carried across the GVL release.
+ */
+typedef struct {
+    X11_Window * w;
+    unsigned int width, height;
+    const char * error;
+} framebuffer_t;
+
+/**
+ * Frame presentation request, carried across the GVL release.
+ */
+typedef struct {
+    X11_Window * w;
+    uint64_t target_msc; /** Vertical retrace count to present at, or zero. */
+    int interrupted; /** Set by the unblocking function. */
+} frame_t;
+
+/**
+ * Vertical retrace wait request, carried across the GVL release.
+ */
+typedef struct {
+    X11_Window * w;
+    uint64_t target_msc;
+    mg_present_feedback reached;
+    int interrupted; /** Set by the unblocking function. */
+} msc_wait_t;
+
+/**
+ * Capture stop request, carried across the GVL release.
+ */
+typedef struct {
+    X11_Window * w;
+    mg_capture_stats * stats;
+} capture_stop_t;
+
+/**
+ * Selection offered or asked for WITHOUT the GVL.
+ */
+typedef struct {
+    X11_Window * w;
+    int selection;
+    const char ** types;
+    int type_count;
+    const void * bytes;
+    size_t size;
+    int fd;
+    int text;
+    unsigned int timeout; /** Milliseconds the owner may stay silent. */
+    mg_future * future;
+    int done;
+} selection_t;
+
+/**
+ * Search of the event queue for events Mg.dispatch_pending should handle.
+ */
+typedef struct {
+    X11_Display * shared;
+    uintptr_t ractor; /** Number of the Ractor dispatching. */
+} dispatch_t;
+
+/**
+ * Search of the event queue for the press that follows a key release.
+ */
+typedef struct {
+    const XKeyEvent * release;
+    int found;
+} repeat_search_t;
+
 /* Helper function prototypes */
 
 typedef struct event_struct {
+    X11_Window * w;
     VALUE self;
     XEvent xevent;
     Atom close_event_atom;
+    int repeat; /** Whether a key press was caused by the key being held down. */
+    int wake; /** eventfd written when events are queued or the loop is stopped. */
+    int timeout; /** Milliseconds until a selection conversion times out, or -1. */
 } event_t;
 
 /**
@@ -75,8 +239,9 @@ typedef struct event_struct {
  * This function is called WITHOUT the Ruby GVL.
  *
  * data should point to the Window Ruby object whose events are to be processed.
+ * Returns nonzero if the loop could not be registered for wake ups.
  */
-static void process_events(void * data);
+static void * process_events(void * data);
 
 /**
  * Unblocking function that stops the event loop. Called by the Ruby runtime if
@@ -87,17 +252,159 @@ static void process_events(void * data);
  */
 static void stop_processing_events(void * data);
 
+/**
+ * Waits until the display connection has data to read, another thread reads
+ * events into the queue, the event loop is stopped or a selection conversion
+ * times out.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void wait_for_events(event_t * event);
+
+/**
+ * Discards queued events no window will ever take: events of windows that
+ * were closed, extension events nobody selected and keyboard mapping
+ * changes, which are applied first. The display must be locked.
+ */
+static void discard_stray_events(X11_Display * shared);
+
+/**
+ * Selects the events discard_stray_events removes.
+ */
+static Bool is_stray(Display * display, XEvent * event, XPointer shared);
+
+/**
+ * Updates the window's key and button state. Returns zero if the event is a
+ * fake key release generated by auto repeat, which should be dropped.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static int track_input(X11_Window * w, event_t * event);
+
+/**
+ * Creates the window and its OpenGL context on the shared display, using the
+ * visual, colormap and atoms looked up when it was opened. Does not make the
+ * context current.
+ *
+ * Returns zero on success or a static error message on failure.
+ */
+static const char * create(X11_Window * w, X11_Display * shared,
+                           int x, int y, unsigned int width, unsigned int height);
+
+/**
+ * Acquires the dispatcher's reference to the shared display. Runs WITHOUT the
+ * GVL.
+ *
+ * Returns zero on success or an error message on failure.
+ */
+static void * acquire_dispatcher(void * unused);
+
+/**
+ * Returns the dispatcher's display, acquiring it if needed. Raises a Ruby
+ * exception on failure.
+ */
+static X11_Display * get_dispatcher(void);
+
+/**
+ * Returns the number of the current Ractor, handing out a new one on first
+ * use.
+ */
+static uintptr_t current_ractor(void);
+
+/**
+ * Selects events that Mg.dispatch_pending should handle: those for windows of
+ * the dispatching Ractor whose event loop isn't running.
+ */
+static Bool is_dispatchable(Display * display, XEvent * event, XPointer dispatch);
+
+/**
+ * Returns the window an event is for: the one it was reported on, the one
+ * streaming a selection to the client window it was reported on or, for
+ * extension events, the focused one or else any. Only windows created by the
+ * given Ractor are returned, unless it's zero; events for other Ractors'
+ * windows are theirs to dispatch. Returns zero if there is none. The display
+ * must be locked.
+ */
+static X11_Window * find_target(X11_Display * shared, XEvent * event, uintptr_t ractor);
+
+/**
+ * Reaper thread body. Frees queued windows, waiting for more when there are
+ * none.
+ */
+static void * reap_windows(void * data);
+
+/**
+ * Takes a window from the pool or creates one, then makes its context current.
+ * Runs WITHOUT the GVL.
+ *
+ * On failure, sets the error message. Stops between round trips if
+ * interrupted, leaving the window uncreated and the error unset.
+ */
+static void * create_window(void * data);
+
+/**
+ * Unblocking function for create_window. A round trip that's already under
+ * way can't be cut short; the interruption takes effect once it completes.
+ */
+static void interrupt_creation(void * data);
+
+/**
+ * Retrieves the window's attributes. Runs WITHOUT the GVL.
+ */
+static void * get_attributes(void * data);
+
+/**
+ * Retrieves the window's name. Runs WITHOUT the GVL.
+ */
+static void * fetch_name(void * data);
+
+/**
+ * Moves a window out of the pool into w. Returns zero if the pool is empty.
+ */
+static int take_pooled_window(X11_Window * w);
+
+/**
+ * Pool refill thread body. Creates windows until the pool is full, then waits
+ * for windows to be taken.
+ */
+static void * refill_pool(void * data);
+
+/**
+ * Selects XInput2 subpixel motion events for the window. Raw motion is
+ * selected on the root window when the display is opened. Core motion events
+ * are used if the server doesn't support XInput2.
+ */
+static void select_xinput_events(X11_Window * w);
+
+/**
+ * Accumulates pointer motion from core or XInput2 events.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void track_pointer(X11_Window * w, XEvent * xevent);
+
+/**
+ * Records the pointer's position, adding the distance moved to the delta
+ * when relative is non-zero.
+ */
+static void move_pointer(X11_Window * w, double x, double y, int relative);
+
+/**
+ * Returns the index of the key, or -1 if its state isn't tracked.
+ */
+static int X11_key_index(XKeyEvent * event);
+
 /**
  * Handles the event and calls the appropriate callbacks on the Ruby object.
  *
  * This function is called WITH the Ruby GVL.
  */
-static void handle_event(event_t * event_data);
+static void * handle_event(void * data);
 
 /**
  * Get the Ruby event handler arguments for the passed key event.
  */
-static VALUE get_args_for_key(XKeyEvent event);
+static VALUE get_args_for_key(XKeyEvent event, int repeat);
 
 /**
  * Converts the given key to its corresponding Ruby symbol.
@@ -105,101 +412,1136 @@ static VALUE get_args_for_key(XKeyEvent event);
 static ID X11_key_to_ruby_symbol(KeySym key);
 
 /**
- * Returns whether the event originated from the window.
+ * Returns whether the event originated from the window, is one of its XInput2
+ * events or concerns a client it's streaming a selection to.
  */
 static Bool is_from(Display * display, XEvent * event, XPointer window);
 
-/**
- * Applies all changes made to the Window.
- */
-static inline void flush(X11_Window *);
+/**
+ * Notes whether a queued event is the press of an auto repeat that follows
+ * the release, without taking any event out of the queue.
+ */
+static Bool is_repeat_press(Display * display, XEvent * event, XPointer search);
+
+/**
+ * Offers the selection. Runs WITHOUT the GVL.
+ */
+static void * set_selection(void * data);
+
+/**
+ * Asks for the selection. Runs WITHOUT the GVL.
+ */
+static void * get_selection(void * data);
+
+
+/**
+ * Captures the frame, if a capture is running, and swaps the buffers.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * swap_buffers(void * data);
+
+/**
+ * Creates the framebuffer, retiring any of a different size. Retired pixels
+ * stay valid until the next time, so that Ruby can stop using them first.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * create_framebuffer(void * data);
+
+/**
+ * Pushes the damaged parts of the framebuffer.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * push_framebuffer(void * data);
+
+/**
+ * Unblocking function that makes a frame stop waiting for the vertical
+ * retrace or for a pixmap, and be presented right away.
+ */
+static void interrupt_frame(void * data);
+
+/**
+ * Waits for the vertical retrace count to reach the target.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * wait_msc(void * data);
+
+/**
+ * Unblocking function that stops waiting for the vertical retrace.
+ */
+static void interrupt_msc_wait(void * data);
+
+/**
+ * Records a presented frame of the given size in the window's counters.
+ */
+static void count_frame(X11_Window * w, uint64_t bytes, int partial);
+
+/**
+ * Stops the capture and stores its final counters.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * stop_capture(void * data);
+
+/**
+ * Applies all changes made to the Window.
+ */
+static inline void flush(X11_Window *);
+
+/* X11_Window interface implementation */
+
+void X11_Window_system_init(void) {
+    ractor_key = rb_ractor_local_storage_ptr_newkey(0);
+}
+
+X11_Window * X11_Window_new(void) {
+    X11_Window * w = calloc(1, sizeof(X11_Window));
+
+    /* Pooled windows have no object until they're handed out */
+    if (w) { w->object = Qnil; }
+
+    return w;
+}
+
+void X11_Window_close(X11_Window * w) {
+    /* The window may never have been created */
+    if (w->shared) {
+        /* Frames still being encoded are written out before the context goes */
+        if (w->capture) {
+            if (glXGetCurrentContext() == w->context) {
+                mg_capture_stop(w->capture);
+            } else {
+                mg_capture_discard(w->capture);
+            }
+            w->capture = 0;
+        }
+        if (w->stream) {
+            if (glXGetCurrentContext() == w->context) {
+                mg_stream_buffer_free(w->stream);
+            } else {
+                mg_stream_buffer_discard(w->stream);
+            }
+            w->stream = 0;
+        }
+        XLockDisplay(w->display);
+        X11_Present_stop(&w->present, w->display);
+        X11_Clipboard_clear(&w->clipboard, w->shared);
+        X11_Framebuffer_destroy(&w->framebuffer, w->display);
+        X11_Framebuffer_destroy(&w->retired, w->display);
+        if (w->shared->focus == w) {
+            w->shared->focus = 0;
+        }
+        X11_Display_remove_window(w->shared, w->window);
+        if (w->context) {
+            if (glXGetCurrentContext() == w->context) {
+                glXMakeCurrent(w->display, None, 0);
+            }
+            glXDestroyContext(w->display, w->context);
+        }
+        mg_gl_state_free(w->gl_state);
+        w->gl_state = 0;
+        XDestroyWindow(w->display, w->window);
+        XUnlockDisplay(w->display);
+        X11_Display_release(w->shared);
+        w->shared = 0;
+    }
+}
+
+void X11_Window_free(void * p) {
+    X11_Window * w = (X11_Window *) p;
+    X11_Window_close(w);
+    free(w);
+}
+
+void X11_Window_free_later(void * p) {
+    X11_Window * w = (X11_Window *) p;
+    X11_Window ** windows;
+    size_t capacity;
+    pthread_t thread;
+
+    /* The window no longer has an object to dispatch events to */
+    w->object = Qnil;
+
+    /* Nothing to talk to the X server about */
+    if (w->shared == 0) {
+        free(w);
+        return;
+    }
+
+    pthread_mutex_lock(&reaper.lock);
+
+    /* Start the reaper when the first window is queued */
+    if (!reaper.started && pthread_create(&thread, 0, reap_windows, 0) == 0) {
+        pthread_detach(thread);
+        reaper.started = 1;
+    }
+
+    /* Make room for the window */
+    if (reaper.started && reaper.count == reaper.capacity) {
+        capacity = reaper.capacity ? reaper.capacity * 2 : 8;
+        windows = realloc(reaper.windows, capacity * sizeof(X11_Window *));
+        if (windows) {
+            reaper.windows = windows;
+            reaper.capacity = capacity;
+        }
+    }
+
+    if (reaper.started && reaper.count < reaper.capacity) {
+        reaper.windows[reaper.count++] = w;
+        w = 0;
+        pthread_cond_signal(&reaper.wake);
+    }
+
+    pthread_mutex_unlock(&reaper.lock);
+
+    /* The window couldn't be queued; free it here after all */
+    if (w) { X11_Window_free(w); }
+}
+
+void X11_Window_create(X11_Window * w,
+                       int x, int y,
+                       unsigned int width, unsigned int height) {
+    creation_t creation = { w, x, y, width, height };
+
+    /* Events are routed by Ractor as soon as the window is registered */
+    w->ractor = current_ractor();
+
+    /* Talk to the X Server without blocking other threads, handling
+     * interrupts as they come */
+    for (;;) {
+        creation.interrupted = 0;
+        rb_thread_call_without_gvl(create_window,      &creation,
+                                   interrupt_creation, &creation);
+        if (creation.created || creation.error) { break; }
+        rb_thread_check_ints();
+    }
+
+    /* If the window could not be created, raise an error */
+    if (!creation.created) {
+        rb_raise(rb_eRuntimeError, "%s", creation.error);
+    }
+
+    mg_damage_reset(&w->damage, width, height);
+}
+
+void X11_Window_set_pool_size(unsigned int size) {
+    X11_Window * removed[POOL_CAPACITY];
+    unsigned int count = 0;
+    pthread_t thread;
+
+    if (size > POOL_CAPACITY) { size = POOL_CAPACITY; }
+
+    pthread_mutex_lock(&pool.lock);
+
+    pool.size = size;
+
+    /* Take out the windows that no longer fit */
+    while (pool.count > size) {
+        removed[count++] = pool.windows[--pool.count];
+    }
+
+    /* Start the refill thread when the pool is first used */
+    if (size > 0 && !pool.started &&
+        pthread_create(&thread, 0, refill_pool, 0) == 0) {
+        pthread_detach(thread);
+        pool.started = 1;
+    }
+
+    pthread_cond_signal(&pool.wake);
+    pthread_mutex_unlock(&pool.lock);
+
+    while (count > 0) {
+        X11_Window_free(removed[--count]);
+    }
+}
+
+unsigned int X11_Window_pool_size(void) {
+    unsigned int size;
+    pthread_mutex_lock(&pool.lock);
+    size = pool.size;
+    pthread_mutex_unlock(&pool.lock);
+    return size;
+}
+
+unsigned int X11_Window_pooled(void) {
+    unsigned int count;
+    pthread_mutex_lock(&pool.lock);
+    count = pool.count;
+    pthread_mutex_unlock(&pool.lock);
+    return count;
+}
+
+XWindowAttributes X11_Window_get_attributes(X11_Window * w) {
+    attributes_t request = { w };
+    rb_thread_call_without_gvl(get_attributes, &request, RUBY_UBF_IO, 0);
+
+    if (!request.success) {
+        rb_raise(rb_eRuntimeError, "could not get the window's attributes");
+    }
+
+    return request.attributes;
+}
+
+const char * X11_Window_name(X11_Window * w) {
+    name_t request = { w, 0 };
+    rb_thread_call_without_gvl(fetch_name, &request, RUBY_UBF_IO, 0);
+    return request.name;
+}
+
+void X11_Window_set_name(X11_Window * w, const char * name) {
+    XLockDisplay(w->display);
+    XStoreName(w->display, w->window, name);
+    flush(w);
+    XUnlockDisplay(w->display);
+}
+
+void X11_Window_set_pos(X11_Window * w, int x, int y) {
+    XLockDisplay(w->display);
+    XMoveWindow(w->display, w->window, x, y);
+    flush(w);
+    XUnlockDisplay(w->display);
+}
+
+void X11_Window_set_size(X11_Window * w, unsigned int width, unsigned int height) {
+    XLockDisplay(w->display);
+    XResizeWindow(w->display, w->window, width, height);
+    flush(w);
+    XUnlockDisplay(w->display);
+}
+
+void X11_Window_set_area(X11_Window * w, int x, int y, unsigned int width, unsigned int height) {
+    XLockDisplay(w->display);
+    XMoveResizeWindow(w->display, w->window, x, y, width, height);
+    flush(w);
+    XUnlockDisplay(w->display);
+}
+
+void X11_Window_set_visible(X11_Window * w, int visible) {
+    XLockDisplay(w->display);
+    if (visible) {
+        XMapWindow(w->display, w->window);
+    } else {
+        XUnmapWindow(w->display, w->window);
+    }
+    flush(w);
+    XUnlockDisplay(w->display);
+}
+
+int X11_Window_visible(X11_Window * w) {
+    return X11_Window_get_attributes(w).map_state != IsUnmapped;
+}
+
+int X11_Window_pixel_format(X11_Window * w, mg_pixel_format * format) {
+    XWindowAttributes attributes = X11_Window_get_attributes(w);
+    Visual * visual = attributes.visual;
+
+    /* Only 32 bit true color pixels can be described by a pixel format; the
+     * visual may not have been found among the screen's */
+    if (visual == 0 || visual->class != TrueColor || attributes.depth < 24) { return 0; }
+
+    return mg_pixel_format_from_masks(visual->red_mask,
+                                      visual->green_mask,
+                                      visual->blue_mask,
+                                      ImageByteOrder(w->display) == MSBFirst,
+                                      format);
+}
+
+int X11_Window_key_down(X11_Window * w, int key) {
+    return (__atomic_load_n(&w->keys_down, __ATOMIC_RELAXED) >> key) & 1;
+}
+
+int X11_Window_button_down(X11_Window * w, int button) {
+    return (__atomic_load_n(&w->buttons_down, __ATOMIC_RELAXED) >> button) & 1;
+}
+
+void X11_Window_pointer_position(X11_Window * w, double * x, double * y) {
+    uint64_t position = __atomic_load_n(&w->pointer_position, __ATOMIC_RELAXED);
+    *x = (int32_t) (uint32_t) (position >> 32) / (double) (1 << X11_WINDOW_POINTER_FRACTION_BITS);
+    *y = (int32_t) (uint32_t) position / (double) (1 << X11_WINDOW_POINTER_FRACTION_BITS);
+}
+
+void X11_Window_pointer_delta(X11_Window * w, double * x, double * y) {
+    *x = __atomic_exchange_n(&w->pointer_delta_x, 0, __ATOMIC_RELAXED) /
+         (double) (1 << X11_WINDOW_POINTER_FRACTION_BITS);
+    *y = __atomic_exchange_n(&w->pointer_delta_y, 0, __ATOMIC_RELAXED) /
+         (double) (1 << X11_WINDOW_POINTER_FRACTION_BITS);
+}
+
+int X11_Window_raw_pointer(X11_Window * w) {
+    return w->xinput_opcode != 0;
+}
+
+void X11_Window_set_fullscreen(X11_Window * w, int fs) {
+    XLockDisplay(w->display);
+    if (X11_Window_visible(w)) {
+        
+    } else {
+        Hints h;
+        Atom property;
+        memset(&h, 0, sizeof(Hints));
+        h.flags = 2;
+        property = XInternAtom(w->display, "_MOTIF_WM_HINTS", True);
+        if (property != 0) {
+            XChangeProperty(w->display, w->window, property, property, 32,
+                            PropModeReplace, (unsigned char *) &h, 5);
+        } else {
+            // Failed
+        }
+    }
+    XUnlockDisplay(w->display);
+}
+
+void X11_Window_set_fs(X11_Window * w, int fs) {
+    XLockDisplay(w->display);
+    if (X11_Window_visible(w)) {
+        XEvent e;
+        memset(&e, 0, sizeof(XEvent));
+        e.xany.type = ClientMessage;
+        e.xclient.message_type = _NET_WM_STATE;
+        e.xclient.format = 32;
+        e.xclient.window = w->window;
+        e.xclient.data.l[0] = fs ? _NET_WM_STATE_ADD : _NET_WM_STATE_REMOVE;
+        e.xclient.data.l[1] = _NET_WM_STATE_FULLSCREEN;
+        e.xclient.data.l[3] = 0L;
+        XSendEvent(w->display, RootWindow(w->display, w->screen),
+                   0, SubstructureNotifyMask | SubstructureRedirectMask, &e);
+    } else {
+        int count = 0;
+        Atom atoms[1];
+        if (fs) {
+            atoms[count++] = _NET_WM_STATE_FULLSCREEN;
+        }
+        if (count > 0) {
+            XChangeProperty(w->display, w->window, _NET_WM_STATE, XA_ATOM, 32,
+                            PropModeReplace, (unsigned char *) atoms, count);
+        } else {
+            XDeleteProperty(w->display, w->window, _NET_WM_STATE);
+        }
+        flush(w);
+    }
+    XUnlockDisplay(w->display);
+}
+
+#if !defined(MG_HAVE_XCURSOR)
+/* Without Xcursor it always raises */
+NORETURN(void X11_Window_set_cursor(X11_Window * w, const unsigned char * pixels,
+                                    mg_pixel_format format,
+                                    unsigned int width, unsigned int height,
+                                    unsigned int x, unsigned int y));
+#endif
+
+void X11_Window_set_cursor(X11_Window * w, const unsigned char * pixels,
+                           mg_pixel_format format,
+                           unsigned int width, unsigned int height,
+                           unsigned int x, unsigned int y) {
+#if defined(MG_HAVE_XCURSOR)
+    Cursor cursor;
+
+    XLockDisplay(w->display);
+    cursor = X11_Display_load_cursor(w->shared, pixels, format, width, height, x, y);
+    /* Animated cursors set the same few images every frame */
+    if (cursor != None && cursor != w->cursor) {
+        XDefineCursor(w->display, w->window, cursor);
+        w->cursor = cursor;
+        flush(w);
+    }
+    XUnlockDisplay(w->display);
+
+    if (cursor == None) {
+        rb_raise(rb_eRuntimeError, "could not create cursor");
+    }
+#else
+    rb_raise(rb_eNotImpError, "cursor images require Xcursor");
+#endif
+}
+
+void X11_Window_reset_cursor(X11_Window * w) {
+    XLockDisplay(w->display);
+    if (w->cursor != None) {
+        XUndefineCursor(w->display, w->window);
+        w->cursor = None;
+        flush(w);
+    }
+    XUnlockDisplay(w->display);
+}
+
+void X11_Window_set_selection(X11_Window * w, int selection,
+                              const char ** types, int type_count,
+                              const void * bytes, size_t size) {
+    selection_t request = { w, selection, types, type_count, bytes, size };
+
+    rb_thread_call_without_gvl(set_selection, &request, 0, 0);
+
+    if (!request.done) {
+        rb_raise(rb_eRuntimeError, "could not take the selection over");
+    }
+}
+
+VALUE X11_Window_get_selection(X11_Window * w, int selection, const char * type,
+                               int fd, int text, unsigned int timeout) {
+    selection_t request = { w, selection, &type, 1 };
+    VALUE future;
+
+    request.fd = fd;
+    request.text = text;
+    request.timeout = timeout;
+    request.future = X11_Clipboard_new_future();
+
+    if (request.future == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for future");
+    }
+
+    /* Wrap it before the event loop can complete it */
+    future = mg_future_wrap(request.future);
+    rb_thread_call_without_gvl(get_selection, &request, 0, 0);
+    return future;
+}
+
+void X11_Window_selection_stats(X11_Window * w, X11_Clipboard_stats * stats) {
+    XLockDisplay(w->display);
+    *stats = w->clipboard.stats;
+    XUnlockDisplay(w->display);
+}
+
+int X11_Window_connection_number(void) {
+    return ConnectionNumber(get_dispatcher()->display);
+}
+
+unsigned int X11_Window_dispatch_pending(void) {
+    X11_Display * shared = get_dispatcher();
+    dispatch_t search = { shared, current_ractor() };
+    unsigned int count = 0;
+    int queued, dispatch;
+    X11_Window * w;
+    event_t event;
+    size_t i;
+
+    /* Read whatever arrived without waiting for more; events that arrive
+     * while handling these are left for the next call */
+    XLockDisplay(shared->display);
+    queued = XEventsQueued(shared->display, QueuedAfterReading);
+
+    /* Without event loops, conversions time out as the Ractor dispatches */
+    for (i = 0; i < shared->window_count; ++i) {
+        w = shared->windows[i].data;
+        if (w->ractor == search.ractor) {
+            X11_Clipboard_expire(&w->clipboard, shared, w->window);
+        }
+    }
+    XUnlockDisplay(shared->display);
+
+    while (count < (unsigned int) queued) {
+        /* Ensure exclusive access to the Display */
+        XLockDisplay(shared->display);
+
+        discard_stray_events(shared);
+
+        if (!XCheckIfEvent(shared->display, &event.xevent, is_dispatchable, (XPointer) &search)) {
+            XUnlockDisplay(shared->display);
+            break;
+        }
+
+        w = find_target(shared, &event.xevent, search.ractor);
+
+        dispatch = w && track_input(w, &event) && RTEST(w->object);
+
+        if (dispatch) {
+            event.w = w;
+            event.self = w->object;
+            event.close_event_atom = w->close_event_atom;
+        }
+
+        /* Release the Display */
+        XUnlockDisplay(shared->display);
+
+        /* The GVL is already held */
+        if (dispatch) {
+            handle_event(&event);
+        }
+
+        ++count;
+    }
+
+    return count;
+}
+
+void X11_Window_event_filter(X11_Window * w, VALUE self) {
+    event_t event;
+    void * failed;
+    event.w = w;
+    event.self = self;
+    event.wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (event.wake < 0) {
+        rb_sys_fail("eventfd");
+    }
+    failed = rb_thread_call_without_gvl(process_events,         &event,
+                                        stop_processing_events, &event);
+    close(event.wake);
+    if (failed) {
+        rb_memerror();
+    }
+}
+
+void X11_Window_swap_buffers(X11_Window * w, uint64_t target_msc) {
+    frame_t request = { w, target_msc, 0 };
+
+    if (w->capture && glXGetCurrentContext() != w->context) {
+        rb_raise(rb_eRuntimeError, "window's OpenGL context isn't current on this thread");
+    }
+
+    /* Swapping may wait for the vertical retrace; interrupts swap right away */
+    rb_thread_call_without_gvl(swap_buffers, &request, interrupt_frame, &request);
+}
+
+unsigned char * X11_Window_framebuffer(X11_Window * w,
+                                       unsigned int * width, unsigned int * height,
+                                       int * recreated) {
+    XWindowAttributes attributes = X11_Window_get_attributes(w);
+    framebuffer_t request = { w, attributes.width, attributes.height, 0 };
+    XImage * image = w->framebuffer.image;
+
+    *recreated = image == 0 ||
+                 (unsigned int) image->width != request.width ||
+                 (unsigned int) image->height != request.height;
+
+    if (*recreated) {
+        rb_thread_call_without_gvl(create_framebuffer, &request, RUBY_UBF_IO, 0);
+        if (request.error) {
+            rb_raise(rb_eRuntimeError, "%s", request.error);
+        }
+    }
+
+    *width = w->framebuffer.image->width;
+    *height = w->framebuffer.image->height;
+    return (unsigned char *) w->framebuffer.image->data;
+}
+
+void X11_Window_damage(X11_Window * w, int x, int y, int width, int height) {
+    mg_damage_add(&w->damage, x, y, width, height);
+}
+
+void X11_Window_damage_all(X11_Window * w) {
+    mg_damage_add_all(&w->damage);
+}
+
+uint64_t X11_Window_present(X11_Window * w, uint64_t target_msc) {
+    frame_t request = { w, target_msc, 0 };
+
+    if (w->framebuffer.image == 0) {
+        rb_raise(rb_eRuntimeError, "window has no framebuffer");
+    }
+
+    rb_thread_call_without_gvl(push_framebuffer, &request, interrupt_frame, &request);
+    return w->present_stats.last_bytes;
+}
+
+unsigned int X11_Window_present_feedback(X11_Window * w,
+                                         mg_present_feedback * feedback, unsigned int max) {
+    return X11_Present_take_feedback(&w->present, feedback, max);
+}
+
+void X11_Window_wait_msc(X11_Window * w, uint64_t target_msc,
+                         mg_present_feedback * reached) {
+    msc_wait_t request = { w, target_msc };
+
+    if (!w->shared->present) {
+        rb_raise(rb_eNotImpError, "the X Server does not support the Present extension");
+    }
+
+    /* Keep waiting after handling interrupts that don't raise */
+    for (;;) {
+        request.interrupted = 0;
+        rb_thread_call_without_gvl(wait_msc,           &request,
+                                   interrupt_msc_wait, &request);
+        if (!request.interrupted) { break; }
+        rb_thread_check_ints();
+    }
+
+    *reached = request.reached;
+}
+
+int X11_Window_buffer_age(X11_Window * w) {
+    unsigned int age = 0;
+
+    /* Copying left the back buffer as it was drawn */
+    if (w->copied) { return 1; }
+
+    if (w->shared->buffer_age) {
+        XLockDisplay(w->display);
+        glXQueryDrawable(w->display, w->window, GLX_BACK_BUFFER_AGE_EXT, &age);
+        XUnlockDisplay(w->display);
+    }
+
+    return (int) age;
+}
+
+void X11_Window_start_capture(X11_Window * w, mg_capture_options * options) {
+    XWindowAttributes attributes;
+    const char * error = 0;
+
+    if (w->capture) {
+        rb_raise(rb_eRuntimeError, "window is already being captured");
+    }
+
+    if (glXGetCurrentContext() != w->context) {
+        rb_raise(rb_eRuntimeError, "window's OpenGL context isn't current on this thread");
+    }
+
+    attributes = X11_Window_get_attributes(w);
+    options->width = attributes.width;
+    options->height = attributes.height;
+
+    w->capture = mg_capture_new(options, &error);
+    if (w->capture == 0) {
+        rb_raise(rb_eRuntimeError, "%s", error);
+    }
+}
+
+int X11_Window_stop_capture(X11_Window * w, mg_capture_stats * stats) {
+    capture_stop_t request = { w, stats };
+
+    if (w->capture == 0) { return 0; }
+
+    if (glXGetCurrentContext() != w->context) {
+        rb_raise(rb_eRuntimeError, "window's OpenGL context isn't current on this thread");
+    }
+
+    rb_thread_call_without_gvl(stop_capture, &request, 0, 0);
+    return 1;
+}
+
+int X11_Window_capture_stats(X11_Window * w, mg_capture_stats * stats) {
+    if (w->capture == 0) { return 0; }
+    *stats = mg_capture_get_stats(w->capture);
+    return 1;
+}
+
+void X11_Window_create_stream_buffer(X11_Window * w, size_t size, unsigned int frames) {
+    mg_stream_buffer * stream;
+    const char * error = 0;
+
+    if (glXGetCurrentContext() != w->context) {
+        rb_raise(rb_eRuntimeError, "window's OpenGL context isn't current on this thread");
+    }
+
+    stream = mg_stream_buffer_new(size, frames, &error);
+    if (stream == 0) {
+        rb_raise(rb_eRuntimeError, "%s", error);
+    }
+
+    if (w->stream) { mg_stream_buffer_free(w->stream); }
+    w->stream = stream;
+}
+
+mg_stream_buffer * X11_Window_stream_buffer(X11_Window * w) {
+    if (w->stream == 0) {
+        rb_raise(rb_eRuntimeError, "window has no stream buffer");
+    }
+
+    if (glXGetCurrentContext() != w->context) {
+        rb_raise(rb_eRuntimeError, "window's OpenGL context isn't current on this thread");
+    }
+
+    return w->stream;
+}
+
+int X11_Window_stream_stats(X11_Window * w, mg_stream_buffer_stats * stats) {
+    if (w->stream == 0) { return 0; }
+    mg_stream_buffer_get_stats(w->stream, stats);
+    return 1;
+}
+
+int X11_Window_gl_state_stats(X11_Window * w, mg_gl_state_stats * stats) {
+    if (w->gl_state == 0) { return 0; }
+    mg_gl_state_get_stats(w->gl_state, stats);
+    return 1;
+}
+
+void X11_Window_invalidate_gl_state(X11_Window * w) {
+    mg_gl_state_invalidate(w->gl_state);
+}
+
+/* Helper function implementation */
+
+static void * process_events(void * data) {
+    event_t * event = data;
+    X11_Window * w = event->w;
+    int found, dispatch;
+
+    event->close_event_atom = w->close_event_atom;
+
+    /* Have whoever reads events into the queue wake this loop up */
+    XLockDisplay(w->display);
+    if (!X11_Display_add_waiter(w->shared, event->wake)) {
+        XUnlockDisplay(w->display);
+        return event;
+    }
+    XUnlockDisplay(w->display);
+
+    /* Start the event loop by setting its condition variable to true */
+    w->event_loop_running = 1;
+
+    /* While the event loop is running... */
+    while (w->event_loop_running) {
+
+        /* Ensure exclusive access to the Display */
+        XLockDisplay(w->display);
+
+        /* Events queued from now on wake the loop up again */
+        X11_Display_reset_waiter(w->shared, event->wake);
+
+        event->timeout = X11_Clipboard_expire(&w->clipboard, w->shared, w->window);
+
+        discard_stray_events(w->shared);
+
+        /* Handle only events that originated from the window */
+        found = XCheckIfEvent(w->display, &event->xevent, is_from, (XPointer) w);
+        dispatch = found && track_input(w, event);
+
+        /* Release the Display; Ruby code may need it, and other windows too */
+        XUnlockDisplay(w->display);
+
+        if (dispatch) {
+            rb_thread_call_with_gvl(handle_event, event);
+        } else if (!found) {
+            wait_for_events(event);
+        }
+    }
+
+    XLockDisplay(w->display);
+    X11_Display_remove_waiter(w->shared, event->wake);
+    XUnlockDisplay(w->display);
+
+    /* A callback closed the window; it's no longer in use */
+    if (w->closed) {
+        X11_Window_close(w);
+    }
+
+    return 0;
+}
+
+static void stop_processing_events(void * data) {
+    event_t * event = data;
+
+    /* Stop the event loop by setting its condition variable to false */
+    event->w->event_loop_running = 0;
+
+    /* The counter is only read once the loop is back in the queue */
+    eventfd_write(event->wake, 1);
+}
+
+static void wait_for_events(event_t * event) {
+    struct pollfd fds[2] = { { ConnectionNumber(event->w->display), POLLIN, 0 },
+                             { event->wake, POLLIN, 0 } };
+
+    /* Every loop wakes up when data arrives; whichever locks the display first
+     * reads all of it into the queue, which wakes the others up to find their
+     * events there. Events read during other threads' round trips do too */
+    poll(fds, 2, event->timeout);
+}
+
+static void discard_stray_events(X11_Display * shared) {
+    XEvent event;
+
+    while (XCheckIfEvent(shared->display, &event, is_stray, (XPointer) shared)) {
+        if (event.type == MappingNotify) {
+            XRefreshKeyboardMapping(&event.xmapping);
+        }
+    }
+}
+
+static Bool is_stray(Display * display, XEvent * event, XPointer arg) {
+    X11_Display * shared = (X11_Display *) arg;
+
+    if (event->type == MappingNotify) { return True; }
+
+    if (event->type == GenericEvent &&
+        (shared->xinput_opcode == 0 || event->xcookie.extension != shared->xinput_opcode)) {
+        return True;
+    }
+
+    return find_target(shared, event, 0) == 0;
+}
+
+static int track_input(X11_Window * w, event_t * event) {
+    XEvent * xevent = &event->xevent, next;
+    unsigned int keycode = xevent->xkey.keycode;
+    const unsigned int bits = 8 * sizeof(unsigned long);
+    unsigned long keycode_bit = 1UL << (keycode % bits);
+    unsigned long * keycodes = &w->keycodes_down[keycode / bits];
+    int key;
+
+    /* Selection transfers are handled right here, without Ruby */
+    if (X11_Clipboard_handle_event(&w->clipboard, w->shared, w->window, xevent)) {
+        return 0;
+    }
+
+    switch (xevent->type) {
+        case KeyPress: {
+            /* A press of a key that's already down is a repeat */
+            event->repeat = (*keycodes & keycode_bit) != 0;
+            *keycodes |= keycode_bit;
+            if ((key = X11_key_index(&xevent->xkey)) >= 0) {
+                __atomic_or_fetch(&w->keys_down, 1UL << key, __ATOMIC_RELAXED);
+            }
+            break;
+        }
+        case KeyRelease: {
+            /* Without detectable auto repeat, the server sends a release
+             * immediately followed by a press with the same time stamp. Other
+             * windows' events may be queued in between, so the whole queue is
+             * searched, leaving it as it is */
+            if (!w->detectable_auto_repeat) {
+                repeat_search_t search = { &xevent->xkey, 0 };
+                XCheckIfEvent(w->display, &next, is_repeat_press, (XPointer) &search);
+                if (search.found) { return 0; }
+            }
+            *keycodes &= ~keycode_bit;
+            if ((key = X11_key_index(&xevent->xkey)) >= 0) {
+                __atomic_and_fetch(&w->keys_down, ~(1UL << key), __ATOMIC_RELAXED);
+            }
+            break;
+        }
+        case ButtonPress: {
+            if (xevent->xbutton.button < bits) {
+                __atomic_or_fetch(&w->buttons_down, 1UL << xevent->xbutton.button,
+                                  __ATOMIC_RELAXED);
+            }
+            break;
+        }
+        case ButtonRelease: {
+            if (xevent->xbutton.button < bits) {
+                __atomic_and_fetch(&w->buttons_down, ~(1UL << xevent->xbutton.button),
+                                   __ATOMIC_RELAXED);
+            }
+            break;
+        }
+        case MotionNotify:
+        case GenericEvent: {
+            /* Motion isn't dispatched to Ruby; it's accumulated instead */
+            track_pointer(w, xevent);
+            return 0;
+        }
+        case FocusIn: {
+            w->shared->focus = w;
+            break;
+        }
+        /* Releases go to the focused window, so forget everything held */
+        case FocusOut: {
+            if (w->shared->focus == w) { w->shared->focus = 0; }
+            memset(w->keycodes_down, 0, sizeof(w->keycodes_down));
+            __atomic_store_n(&w->keys_down, 0, __ATOMIC_RELAXED);
+            __atomic_store_n(&w->buttons_down, 0, __ATOMIC_RELAXED);
+            break;
+        }
+    }
+
+    return 1;
+}
+
+static void * acquire_dispatcher(void * unused) {
+    const char * error = 0;
+
+    pthread_mutex_lock(&dispatcher_lock);
+    if (dispatcher == 0) {
+        dispatcher = X11_Display_acquire(&error);
+    }
+    pthread_mutex_unlock(&dispatcher_lock);
+
+    return (void *) error;
+}
+
+static X11_Display * get_dispatcher(void) {
+    const char * error;
+
+    if (__atomic_load_n(&dispatcher, __ATOMIC_ACQUIRE)) { return dispatcher; }
+
+    error = rb_thread_call_without_gvl(acquire_dispatcher, 0, RUBY_UBF_IO, 0);
+
+    if (error) {
+        rb_raise(rb_eRuntimeError, "%s", error);
+    }
+
+    return dispatcher;
+}
+
+static uintptr_t current_ractor(void) {
+    uintptr_t ractor = (uintptr_t) rb_ractor_local_storage_ptr(ractor_key);
+
+    if (ractor == 0) {
+        ractor = __atomic_add_fetch(&ractor_count, 1, __ATOMIC_RELAXED);
+        rb_ractor_local_storage_ptr_set(ractor_key, (void *) ractor);
+    }
+
+    return ractor;
+}
+
+static Bool is_dispatchable(Display * display, XEvent * event, XPointer arg) {
+    dispatch_t * search = (dispatch_t *) arg;
+    X11_Window * w;
+
+    /* Other extensions' events are discarded as strays */
+    if (event->type == GenericEvent &&
+        (search->shared->xinput_opcode == 0 ||
+         event->xcookie.extension != search->shared->xinput_opcode)) {
+        return False;
+    }
+
+    w = find_target(search->shared, event, search->ractor);
+    return w && !w->event_loop_running;
+}
+
+static X11_Window * find_target(X11_Display * shared, XEvent * event, uintptr_t ractor) {
+    X11_Window * w;
+    size_t i;
+
+    /* Extension events have no window; the focused one takes them, waiting
+     * for its own Ractor if need be, and otherwise any window can */
+    if (event->type == GenericEvent) {
+        if ((w = shared->focus)) {
+            return ractor == 0 || w->ractor == ractor ? w : 0;
+        }
+        for (i = 0; i < shared->window_count; ++i) {
+            w = shared->windows[i].data;
+            if (ractor == 0 || w->ractor == ractor) { return w; }
+        }
+        return 0;
+    }
+
+    w = X11_Display_find_window(shared, event->xany.window);
 
-/* X11_Window interface implementation */
+    /* Clients receiving a selection report their progress on their own windows */
+    if (w == 0 && (event->type == PropertyNotify || event->type == DestroyNotify)) {
+        for (i = 0; i < shared->window_count && w == 0; ++i) {
+            w = shared->windows[i].data;
+            if (!X11_Clipboard_sending_to(&w->clipboard, event->xany.window)) { w = 0; }
+        }
+    }
 
-X11_Window * X11_Window_new(void) {
-    return malloc(sizeof(X11_Window));
+    return w && (ractor == 0 || w->ractor == ractor) ? w : 0;
 }
 
-void X11_Window_free(void * p) {
-    X11_Window * w = (X11_Window *) p;
-    XLockDisplay(w->display);
-    if (w->context) {
-        if (glXGetCurrentContext() == w->context) {
-            glXMakeCurrent(w->display, None, 0);
+static void * reap_windows(void * data) {
+    X11_Window * w;
+
+    for (;;) {
+        /* Wait for a window to free */
+        pthread_mutex_lock(&reaper.lock);
+        while (reaper.count == 0) {
+            pthread_cond_wait(&reaper.wake, &reaper.lock);
         }
-        glXDestroyContext(w->display, w->context);
+        w = reaper.windows[--reaper.count];
+        pthread_mutex_unlock(&reaper.lock);
+
+        X11_Window_free(w);
     }
-    XDestroyWindow(w->display, w->window);
-    XUnlockDisplay(w->display);
-    XCloseDisplay(w->display);
-    free(w);
+
+    return 0;
 }
 
-void X11_Window_create(X11_Window * w,
-                       int x, int y,
-                       unsigned int width, unsigned int height) {
-    Colormap colormap;
-    XSetWindowAttributes attributes;
-    XVisualInfo * visual_info = 0;
-    unsigned long attribute_value_mask = 0, white = 0;
+static void * create_window(void * data) {
+    creation_t * creation = data;
+    X11_Window * w = creation->w;
+    X11_Display * shared;
+
+    /* Hand out a window created ahead of time if one is ready */
+    if (take_pooled_window(w)) {
+        X11_Window_set_area(w, creation->x, creation->y,
+                               creation->width, creation->height);
+    } else {
+        /* Connect to the X Server, or share the existing connection */
+        shared = X11_Display_acquire(&creation->error);
 
-    /* Connect to the X11 Display Server */
-    w->display = XOpenDisplay(0);
+        /* Fail if a connection could not be established */
+        if (shared == 0) { return 0; }
 
-    /* If a connection could not be established... */
-    if (w->display == 0) {
-        /* Raise an error */
-        rb_raise(rb_eRuntimeError, "could not connect to the X Server");
+        if (creation->interrupted) {
+            X11_Display_release(shared);
+            return 0;
+        }
+
+        /* Create the window */
+        creation->error = create(w, shared, creation->x, creation->y,
+                                 creation->width, creation->height);
+
+        if (creation->error) {
+            X11_Display_release(shared);
+            return 0;
+        }
     }
 
-    /* Ensure exclusive access to the Display */
+    /* Connect the OpenGL context to the window
+     * Multiple Windows: maybe move this line to before rendering is done in
+     * each window?
+     */
     XLockDisplay(w->display);
+    glXMakeCurrent(w->display, w->window, w->context);
+    XUnlockDisplay(w->display);
 
-    /* If OpenGL isn't supported... */
-    if (!glXQueryExtension(w->display, 0, 0)) {
-        /* Close the connection to the X11 Display Server ... */
-        XCloseDisplay(w->display);
-        /* ... and raise an error */
-        rb_raise(rb_eRuntimeError, "OpenGL is not supported by this X Server");
-    }
+    creation->created = 1;
+    return 0;
+}
 
-    /* The window will be created on the default screen */
-    w->screen = XDefaultScreen(w->display);
+static void interrupt_creation(void * data) {
+    ((creation_t *) data)->interrupted = 1;
+}
 
-    /* Choose best visual that supports double buffering */
-    visual_info = glXChooseVisual(w->display, w->screen, attribute_list);
+static void * get_attributes(void * data) {
+    attributes_t * request = data;
+    request->success = X11_get_window_attributes(request->w->display, request->w->window,
+                                                 &request->attributes);
+    return 0;
+}
 
-    /* If no visual was chosen... */
-    if (visual_info == 0) {
-        /* Rendering with the given specifications is impossible. */
-        XCloseDisplay(w->display);
-        rb_raise(rb_eRuntimeError, "Rendering not supported");
-    }
+static void * fetch_name(void * data) {
+    name_t * request = data;
+    XLockDisplay(request->w->display);
+    XFetchName(request->w->display, request->w->window, &request->name);
+    XUnlockDisplay(request->w->display);
+    return 0;
+}
+
+static const char * create(X11_Window * w, X11_Display * shared,
+                           int x, int y, unsigned int width, unsigned int height) {
+    XSetWindowAttributes attributes;
+    XVisualInfo * visual_info = shared->visual_info;
+    unsigned long attribute_value_mask = 0;
+
+    w->shared = shared;
+    w->display = shared->display;
+    w->screen = shared->screen;
+
+    /* Ensure exclusive access to the Display */
+    XLockDisplay(w->display);
 
     /* Create the OpenGL context */
     w->context = glXCreateContext(w->display, visual_info, 0, 1);
 
-    /* Obtain the value of the white color for this display and screen */
-    white = XWhitePixel(w->display, visual_info->screen);
+    if (w->context == 0) {
+        XUnlockDisplay(w->display);
+        w->shared = 0;
+        return "could not create OpenGL context";
+    }
+
+    /* Mg's renderer finds it through the current context */
+    w->gl_state = mg_gl_state_new(w->context);
 
     /* Set the window attributes */
     attributes.event_mask = event_mask;
-    attributes.border_pixel = attributes.background_pixel = white;
+    attributes.border_pixel = attributes.background_pixel = shared->white;
 
     /* Indicate which attributes have been set */
     attribute_value_mask = CWEventMask   |
                            CWBorderPixel |
                            CWBackPixel;
 
-    /* Create color map */
-    colormap = XCreateColormap(w->display,
-                               RootWindow(w->display, w->screen),
-                               visual_info->visual, AllocNone);
-
-    /* If the color map has been successfully created... */
-    if (colormap) {
+    /* If the display's color map was successfully created... */
+    if (shared->colormap) {
         /* Set the appropriate attribute */
-        attributes.colormap = colormap;
+        attributes.colormap = shared->colormap;
 
         /* Indicate that it has been set */
         attribute_value_mask |= CWColormap;
@@ -215,185 +1557,202 @@ void X11_Window_create(X11_Window * w,
                               attribute_value_mask,
                               &attributes);
 
-    /* Obtain the close event atom */
-    w->close_event_atom = XInternAtom(w->display, "WM_DELETE_WINDOW", 0);
+    /* Let events without a window field find the window */
+    if (!X11_Display_add_window(shared, w->window, w)) {
+        XDestroyWindow(w->display, w->window);
+        glXDestroyContext(w->display, w->context);
+        mg_gl_state_free(w->gl_state);
+        w->gl_state = 0;
+        w->context = 0;
+        XUnlockDisplay(w->display);
+        w->shared = 0;
+        return "unable to allocate memory for window";
+    }
 
-    /* Configure the window to use it */
+    /* Configure the window to use the close event atom */
+    w->close_event_atom = shared->atoms[X11_ATOM_WM_DELETE_WINDOW];
     XSetWMProtocols(w->display, w->window, &w->close_event_atom, 1);
 
-    /* Connect the OpenGL context to the window
-     * Multiple Windows: maybe move this line to before rendering is done in
-     * each window?
-     */
-    glXMakeCurrent(w->display, w->window, w->context);
+    /* Ask for subpixel pointer motion */
+    select_xinput_events(w);
+
+    w->detectable_auto_repeat = shared->detectable_auto_repeat;
 
     /* Release the Display */
     XUnlockDisplay(w->display);
 
-    /* Free the visual info */
-    XFree(visual_info);
-}
-
-XWindowAttributes X11_Window_get_attributes(X11_Window * w) {
-    XWindowAttributes attributes;
-    XLockDisplay(w->display);
-    XGetWindowAttributes(w->display, w->window, &attributes);
-    XUnlockDisplay(w->display);
-    return attributes;
-}
+    _NET_WM_STATE                = shared->atoms[X11_ATOM_NET_WM_STATE];
+    _NET_WM_STATE_HIDDEN         = shared->atoms[X11_ATOM_NET_WM_STATE_HIDDEN];
+    _NET_WM_STATE_MAXIMIZED_VERT = shared->atoms[X11_ATOM_NET_WM_STATE_MAXIMIZED_VERT];
+    _NET_WM_STATE_MAXIMIZED_HORZ = shared->atoms[X11_ATOM_NET_WM_STATE_MAXIMIZED_HORZ];
+    _NET_WM_STATE_FULLSCREEN     = shared->atoms[X11_ATOM_NET_WM_STATE_FULLSCREEN];
+    _NET_WM_NAME                 = shared->atoms[X11_ATOM_NET_WM_NAME];
+    _NET_WM_ICON_NAME            = shared->atoms[X11_ATOM_NET_WM_ICON_NAME];
+    _NET_WM_ICON                 = shared->atoms[X11_ATOM_NET_WM_ICON];
 
-const char * X11_Window_name(X11_Window * w) {
-    char * name;
-    XLockDisplay(w->display);
-    XFetchName(w->display, w->window, &name);
-    XUnlockDisplay(w->display);
-    return name;
+    return 0;
 }
 
-void X11_Window_set_name(X11_Window * w, const char * name) {
-    XLockDisplay(w->display);
-    XStoreName(w->display, w->window, name);
-    flush(w);
-    XUnlockDisplay(w->display);
-}
+static int take_pooled_window(X11_Window * w) {
+    X11_Window * pooled = 0;
+    VALUE object = w->object;
 
-void X11_Window_set_pos(X11_Window * w, int x, int y) {
-    XLockDisplay(w->display);
-    XMoveWindow(w->display, w->window, x, y);
-    flush(w);
-    XUnlockDisplay(w->display);
-}
+    pthread_mutex_lock(&pool.lock);
+    if (pool.count > 0) {
+        pooled = pool.windows[--pool.count];
 
-void X11_Window_set_size(X11_Window * w, unsigned int width, unsigned int height) {
-    XLockDisplay(w->display);
-    XResizeWindow(w->display, w->window, width, height);
-    flush(w);
-    XUnlockDisplay(w->display);
-}
+        /* Have the refill thread replace it */
+        pthread_cond_signal(&pool.wake);
+    }
+    pthread_mutex_unlock(&pool.lock);
 
-void X11_Window_set_area(X11_Window * w, int x, int y, unsigned int width, unsigned int height) {
-    XLockDisplay(w->display);
-    XMoveResizeWindow(w->display, w->window, x, y, width, height);
-    flush(w);
-    XUnlockDisplay(w->display);
-}
+    if (pooled == 0) { return 0; }
 
-void X11_Window_set_visible(X11_Window * w, int visible) {
+    /* Take over the pooled window; the registration must follow the data */
+    *w = *pooled;
+    w->object = object;
     XLockDisplay(w->display);
-    if (visible) {
-        XMapWindow(w->display, w->window);
-    } else {
-        XUnmapWindow(w->display, w->window);
-    }
-    flush(w);
+    X11_Display_remove_window(w->shared, w->window);
+    X11_Display_add_window(w->shared, w->window, w);
     XUnlockDisplay(w->display);
+    free(pooled);
+    return 1;
 }
 
-int X11_Window_visible(X11_Window * w) {
-    return X11_Window_get_attributes(w).map_state != IsUnmapped;
-}
+static void * refill_pool(void * data) {
+    for (;;) {
+        X11_Display * shared;
+        X11_Window * w;
+        const char * error = 0;
 
-void X11_Window_set_fullscreen(X11_Window * w, int fs) {
-    XLockDisplay(w->display);
-    if (X11_Window_visible(w)) {
-        
-    } else {
-        Hints h;
-        Atom property;
-        memset(&h, 0, sizeof(Hints));
-        h.flags = 2;
-        property = XInternAtom(w->display, "_MOTIF_WM_HINTS", True);
-        if (property != 0) {
-            XChangeProperty(w->display, w->window, property, property, 32,
-                            PropModeReplace, (unsigned char *) &h, 5);
-        } else {
-            // Failed
+        /* Wait until the pool needs another window */
+        pthread_mutex_lock(&pool.lock);
+        while (pool.count >= pool.size) {
+            pthread_cond_wait(&pool.wake, &pool.lock);
         }
-    }
-    XUnlockDisplay(w->display);
-}
-
-void X11_Window_set_fs(X11_Window * w, int fs) {
-    XLockDisplay(w->display);
-    if (X11_Window_visible(w)) {
-        XEvent e;
-        memset(&e, 0, sizeof(XEvent));
-        e.xany.type = ClientMessage;
-        e.xclient.message_type = _NET_WM_STATE;
-        e.xclient.format = 32;
-        e.xclient.window = w->window;
-        e.xclient.data.l[0] = fs ? _NET_WM_STATE_ADD : _NET_WM_STATE_REMOVE;
-        e.xclient.data.l[1] = _NET_WM_STATE_FULLSCREEN;
-        e.xclient.data.l[3] = 0L;
-        XSendEvent(w->display, RootWindow(w->display, w->screen),
-                   0, SubstructureNotifyMask | SubstructureRedirectMask, &e);
-    } else {
-        int count = 0;
-        Atom atoms[1];
-        if (fs) {
-            atoms[count++] = _NET_WM_STATE_FULLSCREEN;
+        pthread_mutex_unlock(&pool.lock);
+
+        /* Create an unmapped window with its context */
+        w = X11_Window_new();
+        shared = w ? X11_Display_acquire(&error) : 0;
+
+        if (shared == 0 || create(w, shared, 0, 0, 1, 1) != 0) {
+            /* Windows can't be created right now; stop trying */
+            if (shared) { X11_Display_release(shared); }
+            free(w);
+            pthread_mutex_lock(&pool.lock);
+            pool.size = pool.count;
+            pthread_mutex_unlock(&pool.lock);
+            continue;
         }
-        if (count > 0) {
-            XChangeProperty(w->display, w->window, _NET_WM_STATE, XA_ATOM, 32,
-                            PropModeReplace, (unsigned char *) atoms, count);
-        } else {
-            XDeleteProperty(w->display, w->window, _NET_WM_STATE);
+
+        pthread_mutex_lock(&pool.lock);
+        if (pool.count < pool.size) {
+            pool.windows[pool.count++] = w;
+            w = 0;
         }
-        flush(w);
+        pthread_mutex_unlock(&pool.lock);
+
+        /* The pool shrank while the window was being created */
+        if (w) { X11_Window_free(w); }
     }
-    XUnlockDisplay(w->display);
-}
 
-void X11_Window_event_filter(VALUE self) {
-    rb_thread_call_without_gvl(process_events,         (void *) &self,
-                               stop_processing_events, (void *) &self);
+    return 0;
 }
 
-/* Helper function implementation */
-
-static void process_events(void * data) {
-    event_t event;
-    X11_Window * w = 0;
-
-    /* Get our Window object */
-    event.self = *((VALUE *) data);
+static void select_xinput_events(X11_Window * w) {
+#if defined(MG_HAVE_XINPUT2)
+    unsigned char mask[XIMaskLen(XI_LASTEVENT)];
+    XIEventMask event_mask;
 
-    /* Retrieve the window data from the Ruby object */
-    Data_Get_Struct(event.self, X11_Window, w);
+    w->xinput_opcode = w->shared->xinput_opcode;
+    if (w->xinput_opcode == 0) { return; }
 
-    event.close_event_atom = w->close_event_atom;
-
-    /* Start the event loop by setting its condition variable to true */
-    w->event_loop_running = 1;
+    event_mask.deviceid = XIAllMasterDevices;
+    event_mask.mask_len = sizeof(mask);
+    event_mask.mask = mask;
 
-    /* While the event loop is running... */
-    while (w->event_loop_running) {
+    /* Subpixel motion within the window */
+    memset(mask, 0, sizeof(mask));
+    XISetMask(mask, XI_Motion);
+    XISelectEvents(w->display, w->window, &event_mask, 1);
+#endif
+}
 
-        /* Ensure exclusive access to the Display */
-        XLockDisplay(w->display);
+static void track_pointer(X11_Window * w, XEvent * xevent) {
+    if (xevent->type == MotionNotify) {
+        /* Core events: whole pixels, accelerated and clipped to the window */
+        move_pointer(w, xevent->xmotion.x, xevent->xmotion.y, w->xinput_opcode == 0);
+        return;
+    }
 
-        /* Handle only events that originated from the window */
-        while (XCheckIfEvent(w->display, &event.xevent, is_from, (XPointer) w->window)) {
-            rb_thread_call_with_gvl(handle_event, &event);
+#if defined(MG_HAVE_XINPUT2)
+    X11_Window * target;
+
+    if (xevent->xcookie.extension == w->xinput_opcode &&
+        XGetEventData(w->display, &xevent->xcookie)) {
+        switch (xevent->xcookie.evtype) {
+            case XI_RawMotion: {
+                XIRawEvent * raw = xevent->xcookie.data;
+                const double * value = raw->raw_values;
+                double delta[2] = { 0, 0 };
+                int i;
+
+                /* Values are only present for the valuators in the mask */
+                for (i = 0; i < raw->valuators.mask_len * 8 && i < 2; ++i) {
+                    if (XIMaskIsSet(raw->valuators.mask, i)) { delta[i] = *value++; }
+                }
+
+                /* Raw motion is reported anywhere on the screen; it goes to
+                 * the focused window, whichever loop picked it up */
+                if ((target = w->shared->focus)) {
+                    __atomic_add_fetch(&target->pointer_delta_x,
+                                       (int64_t) (delta[0] * (1 << X11_WINDOW_POINTER_FRACTION_BITS)),
+                                       __ATOMIC_RELAXED);
+                    __atomic_add_fetch(&target->pointer_delta_y,
+                                       (int64_t) (delta[1] * (1 << X11_WINDOW_POINTER_FRACTION_BITS)),
+                                       __ATOMIC_RELAXED);
+                }
+                break;
+            }
+            case XI_Motion: {
+                XIDeviceEvent * device = xevent->xcookie.data;
+                if ((target = X11_Display_find_window(w->shared, device->event))) {
+                    move_pointer(target, device->event_x, device->event_y, 0);
+                }
+                break;
+            }
         }
-
-        /* Release the Display */
-        XUnlockDisplay(w->display);
+        XFreeEventData(w->display, &xevent->xcookie);
     }
+#endif
 }
 
-static void stop_processing_events(void * data) {
-    X11_Window * w = 0;
-    VALUE self = *((VALUE *) data);
-
-    /* Retrieve the window data from the Ruby object */
-    Data_Get_Struct(self, X11_Window, w);
+static void move_pointer(X11_Window * w, double x, double y, int relative) {
+    const double scale = 1 << X11_WINDOW_POINTER_FRACTION_BITS;
+    int32_t fx = (int32_t) (x * scale), fy = (int32_t) (y * scale);
+    uint64_t previous = __atomic_exchange_n(&w->pointer_position,
+                                            (uint64_t) (uint32_t) fx << 32 | (uint32_t) fy,
+                                            __ATOMIC_RELAXED);
+
+    if (relative) {
+        __atomic_add_fetch(&w->pointer_delta_x, fx - (int32_t) (uint32_t) (previous >> 32),
+                           __ATOMIC_RELAXED);
+        __atomic_add_fetch(&w->pointer_delta_y, fy - (int32_t) (uint32_t) previous,
+                           __ATOMIC_RELAXED);
+    }
+}
 
-    /* Stop the event loop by setting its condition variable to false */
-    w->event_loop_running = 0;
+static int X11_key_index(XKeyEvent * event) {
+    /* Unshifted key symbols of letters are lower case */
+    KeySym key = XLookupKeysym(event, 0);
+    if (key >= XK_a && key <= XK_z) { return (int) (key - XK_a); }
+    return -1;
 }
 
-static void handle_event(event_t * event) {
+static void * handle_event(void * data) {
+    event_t * event = data;
+
     /* Process each kind of event and call the appropriate handler */
     switch (event->xevent.type) {
         /* Window is about to be destroyed by X */
@@ -411,19 +1770,22 @@ static void handle_event(event_t * event) {
         /* Key was pressed */
         case KeyPress: {
             mg_event_call_key_press_handler(event->self,
-                                            get_args_for_key(event->xevent.xkey));
+                                            get_args_for_key(event->xevent.xkey,
+                                                             event->repeat));
             break;
         }
         /* Key was released */
         case KeyRelease: {
             mg_event_call_key_release_handler(event->self,
-                                              get_args_for_key(event->xevent.xkey));
+                                              get_args_for_key(event->xevent.xkey, -1));
             break;
         }
     }
+
+    return 0;
 }
 
-static VALUE get_args_for_key(XKeyEvent event) {
+static VALUE get_args_for_key(XKeyEvent event, int repeat) {
     static const int buffer_size = 32;
     char buffer[buffer_size];
     KeySym key;
@@ -438,6 +1800,11 @@ static VALUE get_args_for_key(XKeyEvent event) {
     /* Get the key's Ruby symbol and push it into the array */
     rb_ary_push(args, X11_key_to_ruby_symbol(key));
 
+    /* Key presses also tell whether the key is being held down */
+    if (repeat >= 0) {
+        rb_ary_push(args, repeat ? Qtrue : Qfalse);
+    }
+
     /* Return the argument list */
     return args;
 }
@@ -488,9 +1855,226 @@ static VALUE X11_key_to_ruby_symbol(KeySym key) {
 #undef X_KEY_CASE
 
 static Bool is_from(Display * display, XEvent * event, XPointer arg) {
-    return event->xany.window == (Window) arg;
+    X11_Window * w = (X11_Window *) arg;
+
+    /* Extension events don't have a window field; they're routed like
+     * Mg.dispatch_pending does, so that other Ractors' windows get theirs */
+    if (event->type == GenericEvent) {
+        return w->xinput_opcode != 0 && event->xcookie.extension == w->xinput_opcode &&
+               find_target(w->shared, event, 0) == w;
+    }
+
+    if (event->xany.window == w->window) { return True; }
+
+    return (event->type == PropertyNotify || event->type == DestroyNotify) &&
+           X11_Clipboard_sending_to(&w->clipboard, event->xany.window);
+}
+
+static Bool is_repeat_press(Display * display, XEvent * event, XPointer arg) {
+    repeat_search_t * search = (repeat_search_t *) arg;
+
+    if (event->type == KeyPress &&
+        event->xkey.window == search->release->window &&
+        event->xkey.keycode == search->release->keycode &&
+        event->xkey.time == search->release->time) {
+        search->found = 1;
+    }
+
+    /* Never taken out; the press is dispatched as a repeat in turn */
+    return False;
+}
+
+static void * set_selection(void * data) {
+    selection_t * request = data;
+    X11_Window * w = request->w;
+    Atom * types = malloc(request->type_count * sizeof(Atom));
+
+    if (types == 0) { return 0; }
+
+    if (X11_intern_atoms(w->display, request->types, request->type_count, types)) {
+        XLockDisplay(w->display);
+        request->done = X11_Clipboard_set(&w->clipboard, w->shared, w->window,
+                                          request->selection,
+                                          types, request->type_count,
+                                          request->bytes, request->size);
+        XUnlockDisplay(w->display);
+    }
+
+    free(types);
+    return 0;
+}
+
+static void * get_selection(void * data) {
+    selection_t * request = data;
+    X11_Window * w = request->w;
+    X11_Window * owner;
+    Atom type;
+
+    if (!X11_intern_atoms(w->display, request->types, 1, &type)) {
+        mg_future_reject(request->future, "could not intern the selection type");
+        return 0;
+    }
+
+    XLockDisplay(w->display);
+    owner = X11_Display_find_window(w->shared,
+                                    XGetSelectionOwner(w->display,
+                                                       X11_Clipboard_selection_atom(w->shared,
+                                                                                    request->selection)));
+    X11_Clipboard_get(&w->clipboard, w->shared, w->window,
+                      owner ? &owner->clipboard : 0,
+                      request->selection, type, request->fd, request->text,
+                      request->timeout, request->future);
+
+    /* The event loop must learn when the conversion times out */
+    X11_Display_wake_waiters(w->shared);
+    XUnlockDisplay(w->display);
+    return 0;
 }
 
 static inline void flush(X11_Window * w) {
     XFlush(w->display);
 }
+
+static void * swap_buffers(void * data) {
+    frame_t * request = data;
+    X11_Window * w = request->w;
+    X11_Display * d = w->shared;
+    mg_damage * damage = &w->damage;
+    unsigned int width = 0, height = 0, i;
+    int partial;
+
+    /* Completions of the driver's presentations reach every selection */
+    X11_Present_start(&w->present, d, w->window);
+
+    /* The back buffer is read before it's swapped out */
+    if (w->capture) { mg_capture_frame(w->capture); }
+
+    XLockDisplay(w->display);
+
+    glXQueryDrawable(w->display, w->window, GLX_WIDTH, &width);
+    glXQueryDrawable(w->display, w->window, GLX_HEIGHT, &height);
+
+    /* Damage recorded for another size says nothing about this frame */
+    partial = d->copy_sub_buffer && damage->count > 0 && !mg_damage_full(damage) &&
+              (int) width == damage->width && (int) height == damage->height;
+
+    /* Without OML_sync_control, swap at the retrace before the one targeted */
+    if (request->target_msc && (partial || d->swap_buffers_msc == 0)) {
+        mg_present_feedback reached;
+        XUnlockDisplay(w->display);
+        X11_Present_wait_msc(&w->present, w->display, w->window, request->target_msc - 1,
+                             &reached, &request->interrupted);
+        XLockDisplay(w->display);
+    }
+
+    if (partial) {
+        /* GL rows go bottom up */
+        for (i = 0; i < damage->count; ++i) {
+            mg_rect * r = &damage->rects[i];
+            d->copy_sub_buffer(w->display, w->window,
+                               r->x, height - r->y - r->height, r->width, r->height);
+        }
+    } else if (request->target_msc && d->swap_buffers_msc) {
+        d->swap_buffers_msc(w->display, w->window, request->target_msc, 0, 0);
+    } else {
+        glXSwapBuffers(w->display, w->window);
+    }
+
+    XUnlockDisplay(w->display);
+
+    /* Whatever this frame streamed is submitted; fence it and move on */
+    if (w->stream) { mg_stream_buffer_next_frame(w->stream); }
+
+    X11_Present_collect(&w->present, w->display);
+
+    w->copied = partial;
+    count_frame(w, partial ? mg_damage_area(damage) * 4 : (uint64_t) width * height * 4, partial);
+    mg_damage_reset(damage, width, height);
+    return 0;
+}
+
+static void * create_framebuffer(void * data) {
+    framebuffer_t * request = data;
+    X11_Window * w = request->w;
+
+    XLockDisplay(w->display);
+    X11_Framebuffer_destroy(&w->retired, w->display);
+    w->retired = w->framebuffer;
+    request->error = X11_Framebuffer_create(&w->framebuffer, w->shared, w->window,
+                                            request->width, request->height);
+    XUnlockDisplay(w->display);
+
+    /* Nothing of the new framebuffer has been presented */
+    mg_damage_reset(&w->damage, request->width, request->height);
+    return 0;
+}
+
+static void * push_framebuffer(void * data) {
+    frame_t * request = data;
+    X11_Window * w = request->w;
+    X11_Display * d = w->shared;
+    int partial;
+    uint64_t bytes;
+
+    /* Without damage, the whole frame is presented */
+    if (w->damage.count == 0) { mg_damage_add_all(&w->damage); }
+    partial = !mg_damage_full(&w->damage);
+
+    X11_Present_start(&w->present, d, w->window);
+
+    /* The server shows the pixmap at the retrace and reports how */
+    bytes = X11_Present_pixmap(&w->present, d, w->window, &w->framebuffer, &w->damage,
+                               request->target_msc, &request->interrupted);
+
+    if (bytes == 0) {
+        if (request->target_msc && d->present) {
+            mg_present_feedback reached;
+            X11_Present_wait_msc(&w->present, w->display, w->window, request->target_msc,
+                                 &reached, &request->interrupted);
+        }
+
+        XLockDisplay(w->display);
+        bytes = X11_Framebuffer_put(&w->framebuffer, w->display, w->window, &w->damage);
+        XUnlockDisplay(w->display);
+    }
+
+    count_frame(w, bytes, partial);
+    mg_damage_reset(&w->damage, w->framebuffer.image->width, w->framebuffer.image->height);
+    return 0;
+}
+
+static void interrupt_frame(void * data) {
+    frame_t * request = data;
+    request->interrupted = 1;
+    X11_Present_wake(&request->w->present, request->w->display);
+}
+
+static void * wait_msc(void * data) {
+    msc_wait_t * request = data;
+    X11_Window * w = request->w;
+
+    X11_Present_start(&w->present, w->shared, w->window);
+    X11_Present_wait_msc(&w->present, w->display, w->window,
+                         request->target_msc, &request->reached, &request->interrupted);
+    return 0;
+}
+
+static void interrupt_msc_wait(void * data) {
+    msc_wait_t * request = data;
+    request->interrupted = 1;
+    X11_Present_wake(&request->w->present, request->w->display);
+}
+
+static void count_frame(X11_Window * w, uint64_t bytes, int partial) {
+    ++w->present_stats.frames;
+    if (partial) { ++w->present_stats.partial_frames; }
+    w->present_stats.bytes += bytes;
+    w->present_stats.last_bytes = bytes;
+}
+
+static void * stop_capture(void * data) {
+    capture_stop_t * request = data;
+    *request->stats = mg_capture_stop(request->w->capture);
+    request->w->capture = 0;
+    return 0;
+}
@@ -1,6 +1,19 @@
 #ifndef MG_X11_X11_WINDOW_H
 #define MG_X11_X11_WINDOW_H
 
+#include "X11_Clipboard.h"
+#include "X11_Display.h"
+#include "X11_Framebuffer.h"
+#include "X11_Present.h"
+#include "capture.h"
+#include "damage.h"
+#include "gl_state.h"
+#include "present.h"
+#include "pixel_format.h"
+#include "stream_buffer.h"
+
+#include <stdint.h>
+
 #include <ruby.h>
 
 #include <X11/Xlib.h>
@@ -13,14 +26,49 @@
  * Contains data for a X11 window.
  */
 typedef struct {
+    X11_Display * shared; /** Shared display the window was created on. */
+    VALUE object; /** Ruby object wrapping the window; false or nil if there is none. */
     Display * display; /** Pointer to the display connection. */
     int screen; /** Window's screen. */
     Window window; /** The window. */
     GLXContext context; /** The OpenGL context. */
+    mg_gl_state * gl_state; /** Shadow copy of the context's state, or 0 if out of memory. */
     Atom close_event_atom; /** Atom that identifies the window close event. */
+    uintptr_t ractor; /** Number of the Ractor that created the window, which dispatches its events. */
     int event_loop_running; /** Whether this window's event loop is running. */
+    int closed; /** Whether the window was closed from Ruby. */
+    int detectable_auto_repeat; /** Whether held keys repeat without fake releases. */
+    unsigned long keycodes_down[256 / (8 * sizeof(unsigned long))]; /** Pressed keycodes. */
+    unsigned long keys_down; /** Pressed keys, by key index. Updated atomically. */
+    unsigned long buttons_down; /** Pressed mouse buttons, by number. Updated atomically. */
+    int xinput_opcode; /** Major opcode of XInput2 events, zero if unavailable. */
+    uint64_t pointer_position; /** Packed subpixel pointer position. Updated atomically. */
+    int64_t pointer_delta_x; /** Motion accumulated since last read. Updated atomically. */
+    int64_t pointer_delta_y;
+    mg_capture * capture; /** Records frames as they're swapped, or 0. */
+    X11_Framebuffer framebuffer; /** Pixels drawn by the CPU, if any were asked for. */
+    X11_Framebuffer retired; /** Previous framebuffer, kept until Ruby lets go of it. */
+    mg_damage damage; /** What changed since the last frame was presented. */
+    int copied; /** Whether the last frame was copied out of the back buffer instead of swapped. */
+    mg_present_stats present_stats;
+    X11_Present present; /** Present extension events, selected once the first frame is presented. */
+    mg_stream_buffer * stream; /** Per-frame vertex and uniform data, or 0. */
+    Cursor cursor; /** Cursor defined for the window, or None for the parent's. */
+    X11_Clipboard clipboard; /** Selections owned and being read. Guarded by the display lock. */
 } X11_Window;
 
+/**
+ * Pointer coordinates and deltas are stored in fixed point with this many
+ * fractional bits, so that they can be updated atomically.
+ */
+#define X11_WINDOW_POINTER_FRACTION_BITS 8
+
+
+/**
+ * Sets up what windows need before the first is created. Called once, by the
+ * main Ractor.
+ */
+extern void X11_Window_system_init(void);
 
 /**
  * Returns a pointer to newly allocated memory for a X11_Window.
@@ -28,23 +76,54 @@ typedef struct {
 extern X11_Window * X11_Window_new(void);
 
 /**
- * Creates a new display window.
+ * Creates a new display window, talking to the X server WITHOUT the GVL.
+ * Raises a Ruby exception if the window could not be created.
  */
 extern void X11_Window_create(X11_Window * w,
                               int x, int y, unsigned int width, unsigned int height);
 
+/**
+ * Sets the number of unmapped windows kept ready for X11_Window_create to
+ * hand out. A background thread creates them; zero disables the pool.
+ */
+extern void X11_Window_set_pool_size(unsigned int size);
+
+/**
+ * Returns the number of windows the pool tries to keep ready.
+ */
+extern unsigned int X11_Window_pool_size(void);
+
+/**
+ * Returns the number of windows ready in the pool.
+ */
+extern unsigned int X11_Window_pooled(void);
+
+/**
+ * Destroys the window, its OpenGL context and releases the display. The
+ * structure itself stays allocated.
+ */
+extern void X11_Window_close(X11_Window * w);
+
 /**
  * Frees resources and deallocates memory.
  */
 extern void X11_Window_free(void * p);
 
 /**
- * Retrieves the attributes of the X11_Window.
+ * Hands the window to a background thread that frees it, so that the X
+ * server round trips stay out of the garbage collector. Safe to call while
+ * the GC is sweeping.
+ */
+extern void X11_Window_free_later(void * p);
+
+/**
+ * Retrieves the attributes of the X11_Window WITHOUT the GVL. Raises a Ruby
+ * exception if the server couldn't report them.
  */
 extern XWindowAttributes X11_Window_get_attributes(X11_Window * w);
 
 /**
- * Returns the name of the window.
+ * Returns the name of the window, fetched WITHOUT the GVL.
  */
 extern const char * X11_Window_name(X11_Window * w);
 
@@ -79,6 +158,39 @@ extern void X11_Window_set_visible(X11_Window * w, int visible);
  */
 extern int X11_Window_visible(X11_Window * w);
 
+/**
+ * Finds the layout of the pixels of the window's visual. Returns a non-zero
+ * value on success, zero if the visual doesn't use 32 bit true color pixels.
+ */
+extern int X11_Window_pixel_format(X11_Window * w, mg_pixel_format * format);
+
+/**
+ * Returns whether the key with the given index is being held down.
+ */
+extern int X11_Window_key_down(X11_Window * w, int key);
+
+/**
+ * Returns whether the mouse button with the given number is being held down.
+ */
+extern int X11_Window_button_down(X11_Window * w, int button);
+
+/**
+ * Retrieves the position of the pointer within the window, with subpixel
+ * precision when XInput2 is available.
+ */
+extern void X11_Window_pointer_position(X11_Window * w, double * x, double * y);
+
+/**
+ * Retrieves the pointer motion accumulated since the last call and resets it.
+ * With XInput2, motion is unaccelerated and isn't clipped to the window.
+ */
+extern void X11_Window_pointer_delta(X11_Window * w, double * x, double * y);
+
+/**
+ * Returns whether pointer motion comes from XInput2 raw events.
+ */
+extern int X11_Window_raw_pointer(X11_Window * w);
+
 /**
  * Make the window span the entire screen.
  */
@@ -89,9 +201,171 @@ extern void X11_Window_set_fullscreen(X11_Window * w, int fs);
  */
 extern void X11_Window_set_fs(X11_Window * w, int fs);
 
+/**
+ * Shows the width by height image as the pointer over the window, with the
+ * hotspot at x, y. The server draws and moves it. Raises a Ruby exception if
+ * the cursor can't be created or Xcursor isn't available.
+ */
+extern void X11_Window_set_cursor(X11_Window * w, const unsigned char * pixels,
+                                  mg_pixel_format format,
+                                  unsigned int width, unsigned int height,
+                                  unsigned int x, unsigned int y);
+
+/**
+ * Goes back to the cursor of the parent window.
+ */
+extern void X11_Window_reset_cursor(X11_Window * w);
+
+/**
+ * Captures the frame if a capture is running, then presents it WITHOUT the
+ * GVL. When only part of the window was damaged and GLX can copy part of the
+ * back buffer, only that part is presented; otherwise the buffers are
+ * swapped. A non-zero target_msc delays the frame until the vertical retrace
+ * count reaches it; a Ruby interrupt swaps right away.
+ */
+extern void X11_Window_swap_buffers(X11_Window * w, uint64_t target_msc);
+
+/**
+ * Returns the window's framebuffer pixels, creating or resizing them WITHOUT
+ * the GVL to match the window. Pixels are 32 bits wide in the window's pixel
+ * format, tightly packed, top row first. Sets recreated to non-zero if the
+ * pixels moved. Raises a Ruby exception on failure.
+ */
+extern unsigned char * X11_Window_framebuffer(X11_Window * w,
+                                              unsigned int * width, unsigned int * height,
+                                              int * recreated);
+
+/**
+ * Marks the rectangle as changed since the last frame was presented.
+ */
+extern void X11_Window_damage(X11_Window * w, int x, int y, int width, int height);
+
+/**
+ * Marks the whole window as changed.
+ */
+extern void X11_Window_damage_all(X11_Window * w);
+
+/**
+ * Pushes the damaged parts of the framebuffer to the window WITHOUT the GVL,
+ * or all of it if nothing was marked. With the Present extension and shared
+ * memory pixmaps, the server copies or flips the pixels at the next vertical
+ * retrace, or at target_msc if it's non-zero. A Ruby interrupt makes the
+ * frame be pushed right away. Returns the number of bytes pushed. Raises a Ruby exception if the window has no framebuffer.
+ */
+extern uint64_t X11_Window_present(X11_Window * w, uint64_t target_msc);
+
+/**
+ * Moves up to max completed frames into the array, oldest first, and returns
+ * how many were moved.
+ */
+extern unsigned int X11_Window_present_feedback(X11_Window * w,
+                                                mg_present_feedback * feedback, unsigned int max);
+
+/**
+ * Waits WITHOUT the GVL until the vertical retrace count reaches the target,
+ * or for the next retrace if it's zero. Stores the time and count reached.
+ * Raises a Ruby exception if the Present extension isn't available.
+ */
+extern void X11_Window_wait_msc(X11_Window * w, uint64_t target_msc,
+                                mg_present_feedback * reached);
+
+/**
+ * Returns how many frames ago the back buffer's contents were presented, or
+ * zero if they're unknown and everything must be drawn again.
+ */
+extern int X11_Window_buffer_age(X11_Window * w);
+
+/**
+ * Starts capturing every frame swapped. The window's context must be current
+ * on the calling thread. Raises a Ruby exception on failure.
+ */
+extern void X11_Window_start_capture(X11_Window * w, mg_capture_options * options);
+
+/**
+ * Stops the capture, waiting WITHOUT the GVL for the frames still being
+ * read back or encoded. Returns zero if no capture was running.
+ */
+extern int X11_Window_stop_capture(X11_Window * w, mg_capture_stats * stats);
+
+/**
+ * Retrieves the counters of the running capture. Returns zero if no capture
+ * is running.
+ */
+extern int X11_Window_capture_stats(X11_Window * w, mg_capture_stats * stats);
+
+/**
+ * Creates the buffer per-frame data is streamed through, replacing the
+ * previous one. Its regions move on as buffers are swapped. The window's
+ * context must be current on the calling thread.
+ */
+extern void X11_Window_create_stream_buffer(X11_Window * w, size_t size, unsigned int frames);
+
+/**
+ * Returns the stream buffer. Raises a Ruby exception if there is none or the
+ * window's context isn't current on the calling thread.
+ */
+extern mg_stream_buffer * X11_Window_stream_buffer(X11_Window * w);
+
+/**
+ * Stores the counters of the stream buffer. Returns zero if there is none.
+ */
+extern int X11_Window_stream_stats(X11_Window * w, mg_stream_buffer_stats * stats);
+
+/**
+ * Stores the counters of the context's state cache. Returns zero if there is
+ * none.
+ */
+extern int X11_Window_gl_state_stats(X11_Window * w, mg_gl_state_stats * stats);
+
+/**
+ * Forgets the state cached for the context, after GL calls made behind its
+ * back.
+ */
+extern void X11_Window_invalidate_gl_state(X11_Window * w);
+
+/**
+ * Makes the window the owner of the selection, offering a copy of the bytes
+ * as each of the named types. Requests are answered in the event loop. Raises
+ * a Ruby exception if another client took the selection over.
+ */
+extern void X11_Window_set_selection(X11_Window * w, int selection,
+                                     const char ** types, int type_count,
+                                     const void * bytes, size_t size);
+
+/**
+ * Asks for the selection as the named type and returns a Mg::Future of it,
+ * streamed in by the event loop, which gives up after timeout milliseconds of
+ * silence from the owner. See X11_Clipboard_get.
+ */
+extern VALUE X11_Window_get_selection(X11_Window * w, int selection, const char * type,
+                                      int fd, int text, unsigned int timeout);
+
+/**
+ * Stores the counters of the window's selection transfers.
+ */
+extern void X11_Window_selection_stats(X11_Window * w, X11_Clipboard_stats * stats);
+
+/**
+ * Returns the file descriptor of the display connection shared by all
+ * windows, opening it WITHOUT the GVL if needed. The connection stays open
+ * for the life of the process. Raises a Ruby exception on failure.
+ */
+extern int X11_Window_connection_number(void);
+
+/**
+ * Handles the events already queued on the shared display, or readable from
+ * its connection without blocking, for windows whose event loop isn't
+ * running. Returns the number of events handled. Raises a Ruby exception if
+ * the display can't be opened.
+ */
+extern unsigned int X11_Window_dispatch_pending(void);
+
 /**
  * Filters X11 window events and calls appropriate callbacks.
+ *
+ * If the window is closed by one of the callbacks, the event loop stops and
+ * the window is destroyed on its way out.
  */
-extern void X11_Window_event_filter(VALUE self);
+extern void X11_Window_event_filter(X11_Window * w, VALUE self);
 
 #endif /* MG_X11_X11_WINDOW_H */
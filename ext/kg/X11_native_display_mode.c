@@ -1,20 +1,35 @@
 #include "X11_native_display_mode.h"
 
+#include "X11_requests.h"
 #include "display_mode.h"
 
+#include <stdlib.h>
+
 #include <ruby.h>
+#include <ruby/thread.h>
 
 #include <X11/Xlib.h>
-#include <X11/extensions/Xrandr.h>
 
 /* DisplayData structure definition */
 
 struct DisplayData {
     Display * display;
     int screen;
-    XRRScreenConfiguration * screen_configuration;
+    X11_screen_size * sizes; /** Screen sizes offered by RandR. */
+    int size_count;
+    int current_size; /** Index of the size currently in use. */
+    const char * error; /** Why the configuration couldn't be retrieved. */
+    int interrupted; /** Set by the unblocking function. */
 };
 
+/**
+ * Function given to with_current_screen_configuration, passed through rb_ensure.
+ */
+typedef struct {
+    VALUE (*f)(struct DisplayData *);
+    struct DisplayData * data;
+} call_t;
+
 /* Function prototypes */
 
 /**
@@ -72,33 +87,49 @@ static struct DisplayData * DisplayData_new();
 static void check_display_data(struct DisplayData *);
 
 /**
- * Checks if the display is valid. Raises a Ruby exception if it isn't.
+ * Opens the display and retrieves the screen configuration, pipelining the
+ * RandR requests when XCB is available. Runs WITHOUT the GVL.
+ *
+ * On failure, closes the display and sets the error message. Stops between
+ * round trips if interrupted, leaving both the display and the error unset.
  */
-static void check_display(struct DisplayData *);
+static void * open_screen_configuration(void *);
 
 /**
- * Checks if the Xrandr extension is present on the X Server to which the
- * display is connected to. Closes the connection and raises a Ruby exception if
- * the extension isn't present.
- *
- * This method assumes that the Display is valid.
+ * Unblocking function for open_screen_configuration. A round trip that's
+ * already under way can't be cut short; the interruption takes effect once it
+ * completes.
  */
-static void look_for_Xrandr(struct DisplayData *);
+static void interrupt_open(void *);
 
 /**
- * Checks if the screen configuration is valid. Closes the display and raises a
- * Ruby exception if it isn't.
- *
- * This method assumes that both the Display is valid and that Xrandr extension
- * is present.
+ * Handles pending interrupts, which may raise.
  */
-static void check_screen_configuration(struct DisplayData *);
+static VALUE check_interrupts(VALUE);
+
+/**
+ * Calls the function given to with_current_screen_configuration.
+ */
+static VALUE call_with_configuration(VALUE);
+
+/**
+ * Closes the display WITHOUT the GVL and frees the display data. Runs even if
+ * the function raised.
+ */
+static VALUE close_screen_configuration(VALUE);
+
+/**
+ * Closes the connection to the display server.
+ */
+static void * close_display(void *);
 
 /* Helper function implementation */
 
 static VALUE with_current_screen_configuration(VALUE (*f)(struct DisplayData *)) {
-    VALUE value = Qnil;
     struct DisplayData * data = 0;
+    const char * error = 0;
+    int state = 0;
+    call_t call;
 
     /* Allocate memory for the display data */
     data = DisplayData_new();
@@ -106,57 +137,43 @@ static VALUE with_current_screen_configuration(VALUE (*f)(struct DisplayData *))
     /* Raise if memory could not be allocated */
     check_display_data(data);
 
-    /* Open connection to the X Display Server */
-    data->display = XOpenDisplay(0);
-
-    /* Raise if a connection to the X Server could not be established */
-    check_display(data);
-
-    /* Raise if Xrandr is not present */
-    look_for_Xrandr(data);
-
-    /* Get the default screen identifier for this display */
-    data->screen = XDefaultScreen(data->display);
-
-    /* Get screen information */
-    data->screen_configuration = XRRGetScreenInfo(data->display,
-                                                  RootWindow(data->display,
-                                                             data->screen));
-
-    /* Raise if the screen configuration is invalid */
-    check_screen_configuration(data);
-
-    /* Call the function and store its result */
-    value = f(data);
-
-    /* Free the screen information structure */
-    XRRFreeScreenConfigInfo(data->screen_configuration);
-
-    /* Close the connection to the display server */
-    XCloseDisplay(data->display);
+    /* Talk to the X Server without blocking other threads, handling
+     * interrupts as they come */
+    for (;;) {
+        data->interrupted = 0;
+        rb_thread_call_without_gvl(open_screen_configuration, data,
+                                   interrupt_open,            data);
+        if (data->display || data->error) { break; }
+
+        /* Let Ruby raise or run trap handlers; free the data if it raises */
+        rb_protect(check_interrupts, Qnil, &state);
+        if (state) {
+            free(data);
+            rb_jump_tag(state);
+        }
+    }
 
-    /* Free display data */
-    free(data);
+    /* Raise if the configuration could not be retrieved */
+    if (data->display == 0) {
+        error = data->error;
+        free(data);
+        rb_raise(rb_eRuntimeError, "%s", error);
+    }
 
-    /* Return the result of the function */
-    return value;
+    /* Call the function, closing the display even if it raises */
+    call.f = f;
+    call.data = data;
+    return rb_ensure(call_with_configuration,    (VALUE) &call,
+                     close_screen_configuration, (VALUE) data);
 }
 
 static VALUE find_current_display_mode(struct DisplayData * data) {
     VALUE mode = Qnil;
-    XRRScreenSize * sizes = 0;
-    Rotation currentRotation;
-    int numSizes = 0, currentMode = 0;
+    X11_screen_size * sizes = data->sizes;
+    int numSizes = data->size_count, currentMode = data->current_size;
 
-    /* Get current display configuration */
-    currentMode = XRRConfigCurrentConfiguration(data->screen_configuration,
-                                                &currentRotation);
-
-    /* Get all avaliable screen dimensions */
-    sizes = XRRConfigSizes(data->screen_configuration, &numSizes);
-
-    /* If at least one screen size could be retrieved... */
-    if (numSizes > 0) {
+    /* If the current screen size is known... */
+    if (currentMode >= 0 && currentMode < numSizes) {
 
         /*
          * Create a new Mg::DisplayMode containing the width and height of the
@@ -174,13 +191,9 @@ static VALUE find_current_display_mode(struct DisplayData * data) {
 
 static VALUE find_all_display_modes(struct DisplayData * data) {
     VALUE mode = Qnil, modes = Qnil;
-    XRRScreenSize * sizes = 0;
+    X11_screen_size * sizes = data->sizes;
     int * depths = 0;
-    int i, j, numSizes = 0, numDepths = 0;
-
-    /* Retrieve screen size */
-    numSizes = 0;
-    sizes = XRRConfigSizes(data->screen_configuration, &numSizes);
+    int i, j, numSizes = data->size_count, numDepths = 0;
 
     /* If at least one screen configuration could be retrieved... */
     if (numSizes > 0) {
@@ -230,27 +243,79 @@ static void check_display_data(struct DisplayData * data) {
     }
 }
 
-static void check_display(struct DisplayData * data) {
-    if (data->display == 0) {
-        rb_raise(rb_eRuntimeError, "could not open Display");
+static void * open_screen_configuration(void * p) {
+    struct DisplayData * data = p;
+    Display * display;
+
+    /* Open connection to the X Display Server */
+    display = XOpenDisplay(0);
+
+    /* Fail if a connection to the X Server could not be established */
+    if (display == 0) {
+        data->error = "could not open Display";
+        return 0;
     }
-}
 
-static void look_for_Xrandr(struct DisplayData * data) {
-    int check;
-    if (!XQueryExtension(data->display, "RANDR", &check, &check, &check)) {
-        XCloseDisplay(data->display);
-        rb_raise(rb_eRuntimeError, "Xrandr is not present");
+    if (data->interrupted) {
+        XCloseDisplay(display);
+        return 0;
+    }
+
+    /* Get the default screen identifier for this display */
+    data->screen = XDefaultScreen(display);
+
+    /* Get screen information, failing if Xrandr is not present */
+    if (!X11_get_screen_sizes(display, data->screen,
+                              &data->sizes, &data->size_count, &data->current_size)) {
+        XCloseDisplay(display);
+        data->error = "could not retrieve screen configuration; is Xrandr present?";
+        return 0;
     }
-}
 
-static void check_screen_configuration(struct DisplayData * data) {
-    if (data->screen_configuration == 0) {
-        XCloseDisplay(data->display);
-        rb_raise(rb_eRuntimeError, "could not retrieve screen configuration");
+    if (data->interrupted) {
+        free(data->sizes);
+        XCloseDisplay(display);
+        return 0;
     }
+
+    data->display = display;
+    return 0;
+}
+
+static void interrupt_open(void * data) {
+    ((struct DisplayData *) data)->interrupted = 1;
+}
+
+static VALUE check_interrupts(VALUE unused) {
+    rb_thread_check_ints();
+    return Qnil;
+}
+
+static VALUE call_with_configuration(VALUE p) {
+    call_t * call = (call_t *) p;
+    return call->f(call->data);
+}
+
+static VALUE close_screen_configuration(VALUE p) {
+    struct DisplayData * data = (struct DisplayData *) p;
+
+    /* Free the screen sizes */
+    free(data->sizes);
+
+    /* Close the connection to the display server */
+    rb_thread_call_without_gvl(close_display, data->display, RUBY_UBF_IO, 0);
+
+    /* Free display data */
+    free(data);
+
+    return Qnil;
+}
+
+static void * close_display(void * display) {
+    XCloseDisplay(display);
+    return 0;
 }
 
 static struct DisplayData * DisplayData_new() {
-    return malloc(sizeof(struct DisplayData));
+    return calloc(1, sizeof(struct DisplayData));
 }
@@ -0,0 +1,574 @@
+#include "X11_native_screen_capture.h"
+
+#include <ruby.h>
+
+#if defined(MG_HAVE_XCB_SHM)
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+#include <xcb/xcb.h>
+#include <xcb/shm.h>
+
+#if defined(MG_HAVE_XCB_DAMAGE)
+    #include <xcb/damage.h>
+    #include <xcb/xfixes.h>
+#endif
+
+#include <ruby/thread.h>
+
+/* Data structures */
+
+typedef struct {
+    xcb_shm_seg_t id; /** Server side name of the segment, or 0. */
+    unsigned char * pixels; /** Attached memory, or 0. */
+} segment_t;
+
+typedef struct screen_capture_struct {
+    pthread_mutex_t lock; /** Held while capturing, which happens without the GVL. */
+    xcb_connection_t * connection; /** Own connection, or 0 once closed. */
+    xcb_window_t window;
+    int x, y;
+    unsigned int width, height;
+    segment_t * segments; /** Shared memory the server writes frames into. */
+    unsigned int buffers, next; /** Number of segments and the one written next. */
+#if defined(MG_HAVE_XCB_DAMAGE)
+    xcb_damage_damage_t damage; /** Damage accumulated on the window, or 0. */
+    xcb_xfixes_region_t region; /** Receives the damage at each capture. */
+#endif
+    int captured; /** Whether a frame was captured yet. */
+    mg_native_screen_capture_stats stats;
+} screen_capture_t;
+
+typedef struct {
+    screen_capture_t * capture;
+    uint32_t window;
+    int x, y;
+    unsigned int width, height, buffers;
+    int damage;
+    const char * error;
+} setup_t;
+
+typedef struct {
+    screen_capture_t * capture;
+    int index; /** Segment the frame was written into, or -1 if unchanged. */
+    const char * error;
+} frame_t;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the screen capture encapsulated by the Ruby object. Raises a Ruby
+ * exception if it was closed.
+ */
+static screen_capture_t * screen_capture_from(VALUE self);
+
+/**
+ * Connects to the display and creates the segments. Called WITHOUT the GVL.
+ */
+static void * setup(void * data);
+
+/**
+ * Checks the window's geometry and pixel layout and settles the area.
+ * Returns zero on success or an error message on failure.
+ */
+static const char * check_area(screen_capture_t * c, const xcb_setup_t * x_setup,
+                               unsigned int width, unsigned int height);
+
+/**
+ * Creates a shared memory segment and attaches both sides to it. Returns
+ * zero on failure.
+ */
+static int attach_segment(screen_capture_t * c, segment_t * segment);
+
+/**
+ * Starts tracking the window's damage, if the server supports it.
+ */
+static void track_damage(screen_capture_t * c);
+
+/**
+ * Returns whether the captured area was damaged since the last call.
+ */
+static int take_damage(screen_capture_t * c);
+
+/**
+ * Captures a frame into the next segment. Called WITHOUT the GVL.
+ */
+static void * capture_frame(void * data);
+
+/**
+ * Detaches and frees the segments and disconnects. Safe to call repeatedly.
+ */
+static void destroy(screen_capture_t * c);
+
+/**
+ * Closes the screen capture and frees it.
+ */
+static void screen_capture_free(void * p);
+
+/**
+ * Returns the monotonic time in nanoseconds.
+ */
+static uint64_t now(void);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::ScreenCapture objects.
+ */
+static const rb_data_type_t screen_capture_type = {
+    "Mg::ScreenCapture",
+    { 0, screen_capture_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Native screen capture interface implementation */
+
+VALUE mg_native_screen_capture_alloc(VALUE klass) {
+    screen_capture_t * c = calloc(1, sizeof(screen_capture_t));
+
+    if (c == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for screen capture");
+    }
+
+    pthread_mutex_init(&c->lock, 0);
+    return TypedData_Wrap_Struct(klass, &screen_capture_type, c);
+}
+
+void mg_native_screen_capture_init(VALUE self, uint32_t window, int x, int y,
+                                   unsigned int width, unsigned int height,
+                                   unsigned int buffers, int damage) {
+    setup_t s = { 0, window, x, y, width, height, buffers, damage, 0 };
+    TypedData_Get_Struct(self, screen_capture_t, &screen_capture_type, s.capture);
+
+    if (s.capture->connection) {
+        rb_raise(rb_eRuntimeError, "screen capture is already set up");
+    }
+
+    rb_thread_call_without_gvl(setup, &s, RUBY_UBF_IO, 0);
+
+    if (s.error) {
+        rb_raise(rb_eRuntimeError, "%s", s.error);
+    }
+}
+
+int mg_native_screen_capture_capture(VALUE self, unsigned char ** pixels) {
+    frame_t frame = { screen_capture_from(self), -1, 0 };
+
+    rb_thread_call_without_gvl(capture_frame, &frame, RUBY_UBF_IO, 0);
+
+    if (frame.error) {
+        rb_raise(rb_eRuntimeError, "%s", frame.error);
+    }
+
+    if (frame.index >= 0) {
+        *pixels = frame.capture->segments[frame.index].pixels;
+    }
+
+    return frame.index;
+}
+
+unsigned int mg_native_screen_capture_width(VALUE self) {
+    return screen_capture_from(self)->width;
+}
+
+unsigned int mg_native_screen_capture_height(VALUE self) {
+    return screen_capture_from(self)->height;
+}
+
+uint32_t mg_native_screen_capture_window(VALUE self) {
+    return screen_capture_from(self)->window;
+}
+
+int mg_native_screen_capture_damage(VALUE self) {
+#if defined(MG_HAVE_XCB_DAMAGE)
+    return screen_capture_from(self)->damage != 0;
+#else
+    screen_capture_from(self);
+    return 0;
+#endif
+}
+
+void mg_native_screen_capture_get_stats(VALUE self, mg_native_screen_capture_stats * stats) {
+    *stats = screen_capture_from(self)->stats;
+}
+
+void mg_native_screen_capture_close(VALUE self) {
+    screen_capture_t * c = 0;
+    TypedData_Get_Struct(self, screen_capture_t, &screen_capture_type, c);
+
+    /* Waits for a capture running on another thread */
+    pthread_mutex_lock(&c->lock);
+    destroy(c);
+    pthread_mutex_unlock(&c->lock);
+}
+
+int mg_native_screen_capture_closed(VALUE self) {
+    screen_capture_t * c = 0;
+    TypedData_Get_Struct(self, screen_capture_t, &screen_capture_type, c);
+    return c->connection == 0;
+}
+
+/* Helper function implementation */
+
+static screen_capture_t * screen_capture_from(VALUE self) {
+    screen_capture_t * c = 0;
+    TypedData_Get_Struct(self, screen_capture_t, &screen_capture_type, c);
+
+    if (c->connection == 0) {
+        rb_raise(rb_eRuntimeError, "screen capture is closed");
+    }
+
+    return c;
+}
+
+static void * setup(void * data) {
+    setup_t * s = data;
+    screen_capture_t * c = s->capture;
+    const xcb_query_extension_reply_t * shm;
+    const xcb_setup_t * x_setup;
+    int screen_number = 0;
+    unsigned int i;
+
+    c->connection = xcb_connect(0, &screen_number);
+
+    if (xcb_connection_has_error(c->connection)) {
+        xcb_disconnect(c->connection);
+        c->connection = 0;
+        s->error = "could not open display";
+        return 0;
+    }
+
+    shm = xcb_get_extension_data(c->connection, &xcb_shm_id);
+    if (shm == 0 || !shm->present) {
+        destroy(c);
+        s->error = "display server doesn't support MIT-SHM";
+        return 0;
+    }
+
+    x_setup = xcb_get_setup(c->connection);
+    c->window = s->window;
+    c->x = s->x;
+    c->y = s->y;
+
+    if (c->window == 0) {
+        xcb_screen_iterator_t screens = xcb_setup_roots_iterator(x_setup);
+        for (i = 0; i < (unsigned int) screen_number && screens.rem > 1; ++i) {
+            xcb_screen_next(&screens);
+        }
+        c->window = screens.data->root;
+    }
+
+    s->error = check_area(c, x_setup, s->width, s->height);
+    if (s->error) {
+        destroy(c);
+        return 0;
+    }
+
+    c->segments = calloc(s->buffers, sizeof(segment_t));
+    if (c->segments == 0) {
+        destroy(c);
+        s->error = "unable to allocate memory for screen capture";
+        return 0;
+    }
+
+    c->buffers = s->buffers;
+    for (i = 0; i < c->buffers; ++i) {
+        if (!attach_segment(c, &c->segments[i])) {
+            destroy(c);
+            s->error = "could not share memory with the display server; is it remote?";
+            return 0;
+        }
+    }
+
+    if (s->damage) { track_damage(c); }
+
+    return 0;
+}
+
+static const char * check_area(screen_capture_t * c, const xcb_setup_t * x_setup,
+                               unsigned int width, unsigned int height) {
+    xcb_get_geometry_reply_t * geometry;
+    xcb_format_iterator_t formats;
+    int bits_per_pixel = 0;
+
+    geometry = xcb_get_geometry_reply(c->connection,
+                                      xcb_get_geometry(c->connection, c->window), 0);
+    if (geometry == 0) { return "no such window"; }
+
+    /* Areas extend to the window's edge unless given */
+    if (width == 0 && c->x < geometry->width) { width = geometry->width - c->x; }
+    if (height == 0 && c->y < geometry->height) { height = geometry->height - c->y; }
+
+    for (formats = xcb_setup_pixmap_formats_iterator(x_setup); formats.rem; xcb_format_next(&formats)) {
+        if (formats.data->depth == geometry->depth) {
+            bits_per_pixel = formats.data->bits_per_pixel;
+        }
+    }
+
+    if (c->x < 0 || c->y < 0 || width == 0 || height == 0 ||
+        c->x + width > geometry->width || c->y + height > geometry->height) {
+        free(geometry);
+        return "capture area is outside the window";
+    }
+
+    if (geometry->depth < 24 || bits_per_pixel != 32) {
+        free(geometry);
+        return "window doesn't use 32 bit true color pixels";
+    }
+
+    c->width = width;
+    c->height = height;
+    free(geometry);
+    return 0;
+}
+
+static int attach_segment(screen_capture_t * c, segment_t * segment) {
+    xcb_generic_error_t * error;
+    void * pixels;
+    int id;
+
+    id = shmget(IPC_PRIVATE, (size_t) c->width * c->height * 4, IPC_CREAT | 0600);
+    if (id < 0) { return 0; }
+
+    pixels = shmat(id, 0, 0);
+    if (pixels == (void *) -1) {
+        shmctl(id, IPC_RMID, 0);
+        return 0;
+    }
+
+    segment->id = xcb_generate_id(c->connection);
+    error = xcb_request_check(c->connection,
+                              xcb_shm_attach_checked(c->connection, segment->id, id, 0));
+
+    /* Once both sides are attached, the segment goes away with them */
+    shmctl(id, IPC_RMID, 0);
+
+    if (error) {
+        free(error);
+        shmdt(pixels);
+        segment->id = 0;
+        return 0;
+    }
+
+    segment->pixels = pixels;
+    return 1;
+}
+
+static void track_damage(screen_capture_t * c) {
+#if defined(MG_HAVE_XCB_DAMAGE)
+    const xcb_query_extension_reply_t * damage, * xfixes;
+    xcb_damage_query_version_reply_t * damage_version;
+    xcb_xfixes_query_version_reply_t * xfixes_version;
+    xcb_damage_query_version_cookie_t damage_cookie;
+    xcb_xfixes_query_version_cookie_t xfixes_cookie;
+
+    damage = xcb_get_extension_data(c->connection, &xcb_damage_id);
+    xfixes = xcb_get_extension_data(c->connection, &xcb_xfixes_id);
+    if (damage == 0 || !damage->present || xfixes == 0 || !xfixes->present) { return; }
+
+    /* Both must be told which version the client speaks before they work */
+    damage_cookie = xcb_damage_query_version(c->connection, 1, 1);
+    xfixes_cookie = xcb_xfixes_query_version(c->connection, 5, 0);
+    damage_version = xcb_damage_query_version_reply(c->connection, damage_cookie, 0);
+    xfixes_version = xcb_xfixes_query_version_reply(c->connection, xfixes_cookie, 0);
+
+    if (damage_version && xfixes_version && xfixes_version->major_version >= 2) {
+        c->region = xcb_generate_id(c->connection);
+        xcb_xfixes_create_region(c->connection, c->region, 0, 0);
+
+        /* Only one event is sent until the damage is taken, and it's ignored */
+        c->damage = xcb_generate_id(c->connection);
+        xcb_damage_create(c->connection, c->damage, c->window,
+                          XCB_DAMAGE_REPORT_LEVEL_NON_EMPTY);
+    }
+
+    free(damage_version);
+    free(xfixes_version);
+#endif
+}
+
+static int take_damage(screen_capture_t * c) {
+#if defined(MG_HAVE_XCB_DAMAGE)
+    xcb_xfixes_fetch_region_reply_t * reply;
+    xcb_rectangle_t * rects;
+    int i, count, damaged = 0;
+
+    if (c->damage == 0) { return 1; }
+
+    /* Moves the damage into the region, so changes from now on are caught next time */
+    xcb_damage_subtract(c->connection, c->damage, XCB_NONE, c->region);
+    reply = xcb_xfixes_fetch_region_reply(c->connection,
+                                          xcb_xfixes_fetch_region(c->connection, c->region), 0);
+    if (reply == 0) { return 1; }
+
+    rects = xcb_xfixes_fetch_region_rectangles(reply);
+    count = xcb_xfixes_fetch_region_rectangles_length(reply);
+
+    for (i = 0; i < count && !damaged; ++i) {
+        damaged = rects[i].x < c->x + (int) c->width && rects[i].x + rects[i].width > c->x &&
+                  rects[i].y < c->y + (int) c->height && rects[i].y + rects[i].height > c->y;
+    }
+
+    free(reply);
+    return damaged;
+#else
+    return 1;
+#endif
+}
+
+static void * capture_frame(void * data) {
+    frame_t * frame = data;
+    screen_capture_t * c = frame->capture;
+    xcb_shm_get_image_reply_t * reply;
+    xcb_generic_event_t * event;
+    segment_t * segment;
+    uint64_t start;
+
+    pthread_mutex_lock(&c->lock);
+
+    if (c->connection == 0) {
+        pthread_mutex_unlock(&c->lock);
+        frame->error = "screen capture is closed";
+        return 0;
+    }
+
+    if (take_damage(c) || !c->captured) {
+        segment = &c->segments[c->next];
+        start = now();
+
+        reply = xcb_shm_get_image_reply(c->connection,
+                                        xcb_shm_get_image(c->connection, c->window,
+                                                          c->x, c->y, c->width, c->height,
+                                                          ~0u, XCB_IMAGE_FORMAT_Z_PIXMAP,
+                                                          segment->id, 0),
+                                        0);
+
+        c->stats.capture_time += now() - start;
+
+        if (reply) {
+            frame->index = c->next;
+            c->next = (c->next + 1) % c->buffers;
+            c->captured = 1;
+            ++c->stats.frames;
+            c->stats.bytes += reply->size;
+            free(reply);
+        } else {
+            frame->error = "could not capture the window; was it resized, unmapped or destroyed?";
+        }
+    } else {
+        ++c->stats.unchanged;
+    }
+
+    /* Damage notifications and errors are of no further use */
+    while ((event = xcb_poll_for_event(c->connection)) != 0) {
+        free(event);
+    }
+
+    pthread_mutex_unlock(&c->lock);
+    return 0;
+}
+
+static void destroy(screen_capture_t * c) {
+    unsigned int i;
+
+    if (c->connection == 0) { return; }
+
+#if defined(MG_HAVE_XCB_DAMAGE)
+    if (c->damage) {
+        xcb_damage_destroy(c->connection, c->damage);
+        xcb_xfixes_destroy_region(c->connection, c->region);
+        c->damage = c->region = 0;
+    }
+#endif
+
+    for (i = 0; c->segments && i < c->buffers; ++i) {
+        if (c->segments[i].id) { xcb_shm_detach(c->connection, c->segments[i].id); }
+    }
+
+    /* The server must let go of the segments before they're unmapped here */
+    free(xcb_get_input_focus_reply(c->connection, xcb_get_input_focus(c->connection), 0));
+
+    for (i = 0; c->segments && i < c->buffers; ++i) {
+        if (c->segments[i].pixels) { shmdt(c->segments[i].pixels); }
+    }
+
+    xcb_disconnect(c->connection);
+    free(c->segments);
+
+    c->connection = 0;
+    c->segments = 0;
+    c->buffers = c->next = 0;
+}
+
+static void screen_capture_free(void * p) {
+    screen_capture_t * c = p;
+    destroy(c);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+#else
+
+/**
+ * Raises NotImplementedError; screen capture requires MIT-SHM through XCB.
+ */
+NORETURN(static void unsupported(void));
+
+/* Every stub but these raises, so they are declared as never returning */
+
+NORETURN(void mg_native_screen_capture_init(VALUE self, uint32_t window, int x, int y,
+                                            unsigned int width, unsigned int height,
+                                            unsigned int buffers, int damage));
+NORETURN(int mg_native_screen_capture_capture(VALUE self, unsigned char ** pixels));
+NORETURN(unsigned int mg_native_screen_capture_width(VALUE self));
+NORETURN(unsigned int mg_native_screen_capture_height(VALUE self));
+NORETURN(uint32_t mg_native_screen_capture_window(VALUE self));
+NORETURN(int mg_native_screen_capture_damage(VALUE self));
+NORETURN(void mg_native_screen_capture_get_stats(VALUE self, mg_native_screen_capture_stats * stats));
+
+static void unsupported(void) {
+    rb_raise(rb_eNotImpError, "screen capture requires xcb-shm");
+}
+
+/**
+ * Ruby data type of Mg::ScreenCapture objects, which hold nothing here.
+ */
+static const rb_data_type_t screen_capture_type = {
+    "Mg::ScreenCapture",
+    { 0, 0, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+VALUE mg_native_screen_capture_alloc(VALUE klass) {
+    return TypedData_Wrap_Struct(klass, &screen_capture_type, 0);
+}
+
+void mg_native_screen_capture_init(VALUE self, uint32_t window, int x, int y,
+                                   unsigned int width, unsigned int height,
+                                   unsigned int buffers, int damage) {
+    unsupported();
+}
+
+int mg_native_screen_capture_capture(VALUE self, unsigned char ** pixels) { unsupported(); }
+unsigned int mg_native_screen_capture_width(VALUE self) { unsupported(); }
+unsigned int mg_native_screen_capture_height(VALUE self) { unsupported(); }
+uint32_t mg_native_screen_capture_window(VALUE self) { unsupported(); }
+int mg_native_screen_capture_damage(VALUE self) { unsupported(); }
+void mg_native_screen_capture_get_stats(VALUE self, mg_native_screen_capture_stats * stats) { unsupported(); }
+void mg_native_screen_capture_close(VALUE self) {}
+int mg_native_screen_capture_closed(VALUE self) { return 1; }
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef MG_X11_NATIVE_SCREEN_CAPTURE_H
+#define MG_X11_NATIVE_SCREEN_CAPTURE_H
+
+#include <stdint.h>
+
+#include <ruby.h>
+
+/**
+ * Counters of a screen capture.
+ */
+typedef struct {
+    uint64_t frames; /** Frames captured. */
+    uint64_t unchanged; /** Captures skipped because nothing was damaged. */
+    uint64_t bytes; /** Bytes written into shared memory by the server. */
+    uint64_t capture_time; /** Nanoseconds spent waiting for the server. */
+} mg_native_screen_capture_stats;
+
+/**
+ * Allocates memory for the screen capture and stores it in the object.
+ */
+extern VALUE mg_native_screen_capture_alloc(VALUE klass);
+
+/**
+ * Connects to the display and sets up buffers shared memory segments, each
+ * large enough for a width by height area of the window at x, y. A window of
+ * zero means the root window; a width or height of zero extends the area to
+ * the window's edge. With damage, captures of unchanged contents are skipped
+ * if the server supports the DAMAGE extension. Raises a Ruby exception on
+ * failure.
+ */
+extern void mg_native_screen_capture_init(VALUE self, uint32_t window, int x, int y,
+                                          unsigned int width, unsigned int height,
+                                          unsigned int buffers, int damage);
+
+/**
+ * Captures the area into the next shared memory segment, WITHOUT the GVL,
+ * and stores its pixels. Returns the index of the segment, or -1 if the
+ * contents didn't change since the last capture. Raises a Ruby exception if
+ * the area can't be captured any more.
+ */
+extern int mg_native_screen_capture_capture(VALUE self, unsigned char ** pixels);
+
+/**
+ * Returns the width of the captured area.
+ */
+extern unsigned int mg_native_screen_capture_width(VALUE self);
+
+/**
+ * Returns the height of the captured area.
+ */
+extern unsigned int mg_native_screen_capture_height(VALUE self);
+
+/**
+ * Returns the identifier of the captured window.
+ */
+extern uint32_t mg_native_screen_capture_window(VALUE self);
+
+/**
+ * Returns a non-zero value if unchanged contents are skipped.
+ */
+extern int mg_native_screen_capture_damage(VALUE self);
+
+/**
+ * Stores the counters of the screen capture.
+ */
+extern void mg_native_screen_capture_get_stats(VALUE self, mg_native_screen_capture_stats * stats);
+
+/**
+ * Frees the shared memory segments and disconnects from the display.
+ */
+extern void mg_native_screen_capture_close(VALUE self);
+
+/**
+ * Returns a non-zero value if the screen capture was closed.
+ */
+extern int mg_native_screen_capture_closed(VALUE self);
+
+#endif /* MG_X11_NATIVE_SCREEN_CAPTURE_H */
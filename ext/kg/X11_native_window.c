@@ -1,8 +1,10 @@
 #include "X11_native_window.h"
 
 #include "X11_Window.h"
+#include "pixel_format.h"
 
 #include <ruby.h>
+#include <ruby/thread.h>
 
 /* Helper function prototypes */
 
@@ -14,16 +16,43 @@
 static VALUE mg_native_window_event_filter(void * data);
 
 /**
- * Returns the encapsulated X11_Window structure from the Ruby object.
+ * Returns the encapsulated X11_Window structure from the Ruby object. Raises a
+ * Ruby exception if the window was closed.
  */
 static X11_Window * X11_Window_from(VALUE obj);
 
+/**
+ * Returns the memory used by the X11_Window, for ObjectSpace.memsize_of.
+ */
+static size_t window_memsize(const void * w);
+
+/**
+ * Destroys the window. Called WITHOUT the GVL.
+ */
+static void * close_window(void * w);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::Window objects. Windows hold no Ruby objects, and
+ * freeing them only queues their teardown, so it's done during the sweep.
+ */
+static const rb_data_type_t window_type = {
+    "Mg::Window",
+    { 0, X11_Window_free_later, window_memsize },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
 /* Native window interface implementation */
 
 VALUE mg_native_window_alloc(VALUE klass) {
     X11_Window * w = X11_Window_new();
     // Wrap X11_Window into Ruby VALUE
-    return Data_Wrap_Struct(klass, 0, X11_Window_free, w);
+    VALUE object = TypedData_Wrap_Struct(klass, &window_type, w);
+    // Let events be dispatched to the object
+    w->object = object;
+    return object;
 }
 
 void mg_native_window_init(VALUE self,
@@ -59,6 +88,58 @@ int mg_native_window_visible(VALUE self) {
     return X11_Window_visible(X11_Window_from(self));
 }
 
+VALUE mg_native_window_pixel_format(VALUE self) {
+    mg_pixel_format format;
+    if (X11_Window_pixel_format(X11_Window_from(self), &format)) {
+        return mg_pixel_format_to_symbol(format);
+    }
+    return Qnil;
+}
+
+int mg_native_window_key_down(VALUE self, int key) {
+    return X11_Window_key_down(X11_Window_from(self), key);
+}
+
+int mg_native_window_button_down(VALUE self, int button) {
+    return X11_Window_button_down(X11_Window_from(self), button);
+}
+
+VALUE mg_native_window_pointer_position(VALUE self) {
+    double x, y;
+    X11_Window_pointer_position(X11_Window_from(self), &x, &y);
+    return rb_assoc_new(DBL2NUM(x), DBL2NUM(y));
+}
+
+VALUE mg_native_window_pointer_delta(VALUE self) {
+    double x, y;
+    X11_Window_pointer_delta(X11_Window_from(self), &x, &y);
+    return rb_assoc_new(DBL2NUM(x), DBL2NUM(y));
+}
+
+int mg_native_window_raw_pointer(VALUE self) {
+    return X11_Window_raw_pointer(X11_Window_from(self));
+}
+
+int mg_native_window_connection_number(void) {
+    return X11_Window_connection_number();
+}
+
+unsigned int mg_native_window_dispatch_pending(void) {
+    return X11_Window_dispatch_pending();
+}
+
+void mg_native_window_set_pool_size(unsigned int size) {
+    X11_Window_set_pool_size(size);
+}
+
+unsigned int mg_native_window_pool_size(void) {
+    return X11_Window_pool_size();
+}
+
+unsigned int mg_native_window_pooled(void) {
+    return X11_Window_pooled();
+}
+
 void mg_native_window_set_pos(VALUE self, int x, int y) {
     X11_Window_set_pos(X11_Window_from(self), x, y);
 }
@@ -101,6 +182,138 @@ void mg_native_window_set_fullscreen(VALUE self, int fullscreen) {
     X11_Window_set_fullscreen(X11_Window_from(self), fullscreen);
 }
 
+void mg_native_window_close(VALUE self, int from_event_loop) {
+    X11_Window * w = X11_Window_from(self);
+
+    w->closed = 1;
+
+    if (from_event_loop) {
+        /* Let the loop finish handling the current event */
+        w->event_loop_running = 0;
+    } else {
+        rb_thread_call_without_gvl(close_window, w, RUBY_UBF_IO, 0);
+    }
+}
+
+int mg_native_window_closed(VALUE self) {
+    X11_Window * w = 0;
+    TypedData_Get_Struct(self, X11_Window, &window_type, w);
+    return w->closed;
+}
+
+void mg_native_window_swap_buffers(VALUE self, uint64_t target_msc) {
+    X11_Window_swap_buffers(X11_Window_from(self), target_msc);
+}
+
+unsigned char * mg_native_window_framebuffer(VALUE self,
+                                             unsigned int * width, unsigned int * height,
+                                             int * recreated) {
+    return X11_Window_framebuffer(X11_Window_from(self), width, height, recreated);
+}
+
+void mg_native_window_damage(VALUE self, int x, int y, int width, int height) {
+    X11_Window_damage(X11_Window_from(self), x, y, width, height);
+}
+
+void mg_native_window_damage_all(VALUE self) {
+    X11_Window_damage_all(X11_Window_from(self));
+}
+
+uint64_t mg_native_window_present(VALUE self, uint64_t target_msc) {
+    return X11_Window_present(X11_Window_from(self), target_msc);
+}
+
+unsigned int mg_native_window_present_feedback(VALUE self,
+                                               mg_present_feedback * feedback,
+                                               unsigned int max) {
+    return X11_Window_present_feedback(X11_Window_from(self), feedback, max);
+}
+
+void mg_native_window_wait_msc(VALUE self, uint64_t target_msc,
+                               mg_present_feedback * reached) {
+    X11_Window_wait_msc(X11_Window_from(self), target_msc, reached);
+}
+
+int mg_native_window_buffer_age(VALUE self) {
+    return X11_Window_buffer_age(X11_Window_from(self));
+}
+
+mg_present_stats mg_native_window_present_stats(VALUE self) {
+    return X11_Window_from(self)->present_stats;
+}
+
+void mg_native_window_start_capture(VALUE self, mg_capture_options * options) {
+    X11_Window_start_capture(X11_Window_from(self), options);
+}
+
+int mg_native_window_stop_capture(VALUE self, mg_capture_stats * stats) {
+    return X11_Window_stop_capture(X11_Window_from(self), stats);
+}
+
+int mg_native_window_capture_stats(VALUE self, mg_capture_stats * stats) {
+    return X11_Window_capture_stats(X11_Window_from(self), stats);
+}
+
+void mg_native_window_create_stream_buffer(VALUE self, size_t size, unsigned int frames) {
+    X11_Window_create_stream_buffer(X11_Window_from(self), size, frames);
+}
+
+mg_stream_buffer * mg_native_window_stream_buffer(VALUE self) {
+    return X11_Window_stream_buffer(X11_Window_from(self));
+}
+
+int mg_native_window_stream_stats(VALUE self, mg_stream_buffer_stats * stats) {
+    return X11_Window_stream_stats(X11_Window_from(self), stats);
+}
+
+int mg_native_window_gl_state_stats(VALUE self, mg_gl_state_stats * stats) {
+    return X11_Window_gl_state_stats(X11_Window_from(self), stats);
+}
+
+unsigned long mg_native_window_xid(VALUE self) {
+    return X11_Window_from(self)->window;
+}
+
+void mg_native_window_invalidate_gl_state(VALUE self) {
+    X11_Window_invalidate_gl_state(X11_Window_from(self));
+}
+
+void mg_native_window_set_cursor(VALUE self, const unsigned char * pixels,
+                                 mg_pixel_format format,
+                                 unsigned int width, unsigned int height,
+                                 unsigned int x, unsigned int y) {
+    X11_Window_set_cursor(X11_Window_from(self), pixels, format, width, height, x, y);
+}
+
+void mg_native_window_reset_cursor(VALUE self) {
+    X11_Window_reset_cursor(X11_Window_from(self));
+}
+
+void mg_native_window_set_clipboard(VALUE self, int primary,
+                                    const char ** types, int type_count,
+                                    const void * bytes, size_t size) {
+    X11_Window_set_selection(X11_Window_from(self),
+                             primary ? X11_CLIPBOARD_PRIMARY : X11_CLIPBOARD_CLIPBOARD,
+                             types, type_count, bytes, size);
+}
+
+VALUE mg_native_window_get_clipboard(VALUE self, int primary, const char * type,
+                                     int fd, int text, unsigned int timeout) {
+    return X11_Window_get_selection(X11_Window_from(self),
+                                    primary ? X11_CLIPBOARD_PRIMARY : X11_CLIPBOARD_CLIPBOARD,
+                                    type, fd, text, timeout);
+}
+
+void mg_native_window_clipboard_stats(VALUE self, mg_clipboard_stats * stats) {
+    X11_Clipboard_stats counters;
+
+    X11_Window_selection_stats(X11_Window_from(self), &counters);
+    stats->sent = counters.sent;
+    stats->received = counters.received;
+    stats->chunks = counters.chunks;
+    stats->refused = counters.refused;
+}
+
 VALUE mg_native_window_start_event_thread(VALUE self) {
     /* Implementation note:
      *
@@ -121,6 +334,7 @@ void mg_native_window_system_init(void) {
     if(!XInitThreads()) {
         rb_raise(rb_eRuntimeError, "could not enable X11 thread support");
     }
+    X11_Window_system_init();
 }
 
 /* Helper function implementation */
@@ -128,12 +342,24 @@ void mg_native_window_system_init(void) {
 static VALUE mg_native_window_event_filter(void * data) {
     /* Void pointer cast to VALUE: see note above */
     VALUE self = (VALUE) data;
-    X11_Window_event_filter(self);
+    X11_Window_event_filter(X11_Window_from(self), self);
     return Qnil;
 }
 
 static X11_Window * X11_Window_from(VALUE obj) {
     X11_Window * w = 0;
-    Data_Get_Struct(obj, X11_Window, w);
+    TypedData_Get_Struct(obj, X11_Window, &window_type, w);
+    if (w->closed) {
+        rb_raise(rb_eRuntimeError, "window has been closed");
+    }
     return w;
 }
+
+static size_t window_memsize(const void * w) {
+    return sizeof(X11_Window);
+}
+
+static void * close_window(void * w) {
+    X11_Window_close(w);
+    return 0;
+}
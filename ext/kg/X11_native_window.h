@@ -1,8 +1,27 @@
 #ifndef MG_X11_NATIVE_WINDOW_H
 #define MG_X11_NATIVE_WINDOW_H
 
+#include "capture.h"
+#include "stream_buffer.h"
+#include "gl_state.h"
+#include "present.h"
+#include "pixel_format.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
 #include <ruby.h>
 
+/**
+ * Counters of a window's clipboard transfers.
+ */
+typedef struct {
+    uint64_t sent; /** Bytes handed to other clients. */
+    uint64_t received; /** Bytes read from other clients. */
+    uint64_t chunks; /** Incremental chunks sent and received. */
+    uint64_t refused; /** Requests for types the window didn't offer. */
+} mg_clipboard_stats;
+
 /**
  * Allocates memory for X11_Window and stores it in the object.
  */
@@ -46,6 +65,40 @@ extern const char * mg_native_window_title(VALUE self);
  */
 extern int mg_native_window_visible(VALUE self);
 
+/**
+ * Returns the pixel format symbol of the window's visual, or nil if its
+ * pixels can't be described by one.
+ */
+extern VALUE mg_native_window_pixel_format(VALUE self);
+
+/**
+ * Returns a non-zero value if the key with the given index is held down.
+ */
+extern int mg_native_window_key_down(VALUE self, int key);
+
+/**
+ * Returns a non-zero value if the mouse button with the given number is held
+ * down.
+ */
+extern int mg_native_window_button_down(VALUE self, int button);
+
+/**
+ * Returns the position of the pointer within the window as an array of two
+ * floats.
+ */
+extern VALUE mg_native_window_pointer_position(VALUE self);
+
+/**
+ * Returns the pointer motion accumulated since the last call as an array of
+ * two floats, and resets it.
+ */
+extern VALUE mg_native_window_pointer_delta(VALUE self);
+
+/**
+ * Returns a non-zero value if pointer motion is unaccelerated raw input.
+ */
+extern int mg_native_window_raw_pointer(VALUE self);
+
 /**
  * Sets the position of the window on the screen.
  */
@@ -98,11 +151,190 @@ extern void mg_native_window_set_name(VALUE self, const char * name);
  */
 extern void mg_native_window_set_fullscreen(VALUE self, int fs);
 
+/**
+ * Destroys the window. If called from the window's event loop, the window is
+ * destroyed once the loop exits; otherwise, the event loop must not be running
+ * and the window is destroyed WITHOUT the GVL before this function returns.
+ */
+extern void mg_native_window_close(VALUE self, int from_event_loop);
+
+/**
+ * Returns a non-zero value if the window was closed.
+ */
+extern int mg_native_window_closed(VALUE self);
+
+/**
+ * Swaps the window's buffers, capturing the frame first if a capture is
+ * running. A non-zero target_msc delays the swap until that vertical retrace.
+ */
+extern void mg_native_window_swap_buffers(VALUE self, uint64_t target_msc);
+
+/**
+ * Returns the window's framebuffer pixels, creating or resizing them to match
+ * the window. Sets recreated to non-zero if the pixels moved.
+ */
+extern unsigned char * mg_native_window_framebuffer(VALUE self,
+                                                    unsigned int * width, unsigned int * height,
+                                                    int * recreated);
+
+/**
+ * Marks the rectangle as changed since the last frame was presented.
+ */
+extern void mg_native_window_damage(VALUE self, int x, int y, int width, int height);
+
+/**
+ * Marks the whole window as changed.
+ */
+extern void mg_native_window_damage_all(VALUE self);
+
+/**
+ * Pushes the damaged parts of the framebuffer to the window, at the vertical
+ * retrace target_msc if it's non-zero, and returns the number of bytes
+ * pushed.
+ */
+extern uint64_t mg_native_window_present(VALUE self, uint64_t target_msc);
+
+/**
+ * Moves up to max completed frames into the array, oldest first, and returns
+ * how many were moved.
+ */
+extern unsigned int mg_native_window_present_feedback(VALUE self,
+                                                      mg_present_feedback * feedback,
+                                                      unsigned int max);
+
+/**
+ * Waits until the vertical retrace count reaches the target, or for the next
+ * retrace if it's zero, and stores the time and count reached.
+ */
+extern void mg_native_window_wait_msc(VALUE self, uint64_t target_msc,
+                                      mg_present_feedback * reached);
+
+/**
+ * Returns the age of the back buffer, zero if unknown.
+ */
+extern int mg_native_window_buffer_age(VALUE self);
+
+/**
+ * Returns the counters of frames presented.
+ */
+extern mg_present_stats mg_native_window_present_stats(VALUE self);
+
+/**
+ * Starts capturing the frames swapped with the given options; the size is
+ * taken from the window.
+ */
+extern void mg_native_window_start_capture(VALUE self, mg_capture_options * options);
+
+/**
+ * Stops the capture and stores its final counters. Returns zero if the window
+ * wasn't being captured.
+ */
+extern int mg_native_window_stop_capture(VALUE self, mg_capture_stats * stats);
+
+/**
+ * Stores the counters of the running capture. Returns zero if the window
+ * isn't being captured.
+ */
+extern int mg_native_window_capture_stats(VALUE self, mg_capture_stats * stats);
+
+/**
+ * Creates the buffer the window's per-frame data is streamed through.
+ */
+extern void mg_native_window_create_stream_buffer(VALUE self, size_t size, unsigned int frames);
+
+/**
+ * Returns the window's stream buffer, ready to be used in the current context.
+ */
+extern mg_stream_buffer * mg_native_window_stream_buffer(VALUE self);
+
+/**
+ * Stores the counters of the stream buffer. Returns zero if there is none.
+ */
+extern int mg_native_window_stream_stats(VALUE self, mg_stream_buffer_stats * stats);
+
+/**
+ * Stores the counters of the window's GL state cache. Returns zero if there
+ * is none.
+ */
+extern int mg_native_window_gl_state_stats(VALUE self, mg_gl_state_stats * stats);
+
+/**
+ * Returns the X identifier of the window.
+ */
+extern unsigned long mg_native_window_xid(VALUE self);
+
+/**
+ * Forgets the GL state cached for the window's context.
+ */
+extern void mg_native_window_invalidate_gl_state(VALUE self);
+
+/**
+ * Shows the width by height image as the pointer over the window, with the
+ * hotspot at x, y.
+ */
+extern void mg_native_window_set_cursor(VALUE self, const unsigned char * pixels,
+                                        mg_pixel_format format,
+                                        unsigned int width, unsigned int height,
+                                        unsigned int x, unsigned int y);
+
+/**
+ * Goes back to the default pointer.
+ */
+extern void mg_native_window_reset_cursor(VALUE self);
+
+/**
+ * Puts a copy of the bytes on the clipboard, or the primary selection if
+ * primary is set, offered as each of the named types.
+ */
+extern void mg_native_window_set_clipboard(VALUE self, int primary,
+                                           const char ** types, int type_count,
+                                           const void * bytes, size_t size);
+
+/**
+ * Asks for the clipboard, or the primary selection, as the named type and
+ * returns a Mg::Future of its contents. With a file descriptor other than -1,
+ * the contents are written to it and the future resolves with their size. The
+ * future is rejected if the owner stays silent for timeout milliseconds.
+ */
+extern VALUE mg_native_window_get_clipboard(VALUE self, int primary, const char * type,
+                                            int fd, int text, unsigned int timeout);
+
+/**
+ * Stores the counters of the window's clipboard transfers.
+ */
+extern void mg_native_window_clipboard_stats(VALUE self, mg_clipboard_stats * stats);
+
 /**
  * Starts a Ruby thread that runs this Window's event loop and returns it.
  */
 extern VALUE mg_native_window_start_event_thread(VALUE self);
 
+/**
+ * Returns the file descriptor of the display connection.
+ */
+extern int mg_native_window_connection_number(void);
+
+/**
+ * Handles pending events for windows without event threads without blocking.
+ * Returns the number of events handled.
+ */
+extern unsigned int mg_native_window_dispatch_pending(void);
+
+/**
+ * Sets the number of windows created ahead of time.
+ */
+extern void mg_native_window_set_pool_size(unsigned int size);
+
+/**
+ * Returns the number of windows created ahead of time.
+ */
+extern unsigned int mg_native_window_pool_size(void);
+
+/**
+ * Returns the number of windows ready to be handed out.
+ */
+extern unsigned int mg_native_window_pooled(void);
+
 /**
  * Initializes the X11 Display Server for threading.
  */
@@ -0,0 +1,219 @@
+#include "X11_requests.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <X11/Xlib.h>
+
+#if defined(MG_HAVE_XCB)
+    #include <X11/Xlib-xcb.h>
+    #include <xcb/xcb.h>
+#endif
+
+#if defined(MG_HAVE_XCB_RANDR)
+    #include <xcb/randr.h>
+#else
+    #include <X11/extensions/Xrandr.h>
+#endif
+
+/* Helper function prototypes */
+
+#if defined(MG_HAVE_XCB)
+
+/**
+ * Finds the Xlib visual with the given identifier on the screen.
+ */
+static Visual * find_visual(Screen * screen, VisualID id);
+
+/**
+ * Finds the Xlib screen whose root window is the given window.
+ */
+static Screen * find_screen(Display * display, Window root);
+
+#endif
+
+/* X requests implementation */
+
+int X11_intern_atoms(Display * display, const char ** names, int count, Atom * atoms) {
+#if defined(MG_HAVE_XCB)
+    xcb_connection_t * connection = XGetXCBConnection(display);
+    xcb_intern_atom_cookie_t * cookies = malloc(count * sizeof(xcb_intern_atom_cookie_t));
+    int i, interned = 1;
+
+    if (cookies == 0) { return 0; }
+
+    /* Send every request first... */
+    for (i = 0; i < count; ++i) {
+        cookies[i] = xcb_intern_atom(connection, 0, strlen(names[i]), names[i]);
+    }
+
+    /* ... then collect the replies */
+    for (i = 0; i < count; ++i) {
+        xcb_intern_atom_reply_t * reply = xcb_intern_atom_reply(connection, cookies[i], 0);
+        atoms[i] = reply ? reply->atom : None;
+        interned = interned && reply != 0;
+        free(reply);
+    }
+
+    free(cookies);
+    return interned;
+#else
+    return XInternAtoms(display, (char **) names, count, 0, atoms) != 0;
+#endif
+}
+
+int X11_get_window_attributes(Display * display, Window window,
+                              XWindowAttributes * attributes) {
+#if defined(MG_HAVE_XCB)
+    xcb_connection_t * connection = XGetXCBConnection(display);
+    xcb_get_window_attributes_cookie_t attributes_cookie;
+    xcb_get_geometry_cookie_t geometry_cookie;
+    xcb_get_window_attributes_reply_t * a;
+    xcb_get_geometry_reply_t * g;
+
+    /* Both requests travel together; Xlib sends one after the other's reply */
+    attributes_cookie = xcb_get_window_attributes(connection, window);
+    geometry_cookie = xcb_get_geometry(connection, window);
+
+    a = xcb_get_window_attributes_reply(connection, attributes_cookie, 0);
+    g = xcb_get_geometry_reply(connection, geometry_cookie, 0);
+
+    if (a == 0 || g == 0) {
+        free(a);
+        free(g);
+        return 0;
+    }
+
+    attributes->x = g->x;
+    attributes->y = g->y;
+    attributes->width = g->width;
+    attributes->height = g->height;
+    attributes->border_width = g->border_width;
+    attributes->depth = g->depth;
+    attributes->root = g->root;
+    attributes->screen = find_screen(display, g->root);
+    attributes->visual = attributes->screen ? find_visual(attributes->screen, a->visual) : 0;
+    attributes->class = a->_class;
+    attributes->bit_gravity = a->bit_gravity;
+    attributes->win_gravity = a->win_gravity;
+    attributes->backing_store = a->backing_store;
+    attributes->backing_planes = a->backing_planes;
+    attributes->backing_pixel = a->backing_pixel;
+    attributes->save_under = a->save_under;
+    attributes->colormap = a->colormap;
+    attributes->map_installed = a->map_is_installed;
+    attributes->map_state = a->map_state;
+    attributes->all_event_masks = a->all_event_masks;
+    attributes->your_event_mask = a->your_event_mask;
+    attributes->do_not_propagate_mask = a->do_not_propagate_mask;
+    attributes->override_redirect = a->override_redirect;
+
+    free(a);
+    free(g);
+    return 1;
+#else
+    int success;
+    XLockDisplay(display);
+    success = XGetWindowAttributes(display, window, attributes) != 0;
+    XUnlockDisplay(display);
+    return success;
+#endif
+}
+
+int X11_get_screen_sizes(Display * display, int screen,
+                         X11_screen_size ** sizes, int * count, int * current) {
+#if defined(MG_HAVE_XCB_RANDR)
+    xcb_connection_t * connection = XGetXCBConnection(display);
+    xcb_randr_query_version_cookie_t version_cookie;
+    xcb_randr_get_screen_info_cookie_t info_cookie;
+    xcb_randr_query_version_reply_t * version;
+    xcb_randr_get_screen_info_reply_t * info;
+    xcb_randr_screen_size_t * screen_sizes;
+    const xcb_query_extension_reply_t * extension;
+    int i;
+
+    /* The extension's presence is cached by XCB after the first query */
+    extension = xcb_get_extension_data(connection, &xcb_randr_id);
+    if (extension == 0 || !extension->present) { return 0; }
+
+    /* Announce the version we speak and query the screen in one go */
+    version_cookie = xcb_randr_query_version(connection, 1, 1);
+    info_cookie = xcb_randr_get_screen_info(connection, RootWindow(display, screen));
+
+    version = xcb_randr_query_version_reply(connection, version_cookie, 0);
+    info = xcb_randr_get_screen_info_reply(connection, info_cookie, 0);
+    free(version);
+
+    if (info == 0) { return 0; }
+
+    *count = xcb_randr_get_screen_info_sizes_length(info);
+    *current = info->sizeID;
+    *sizes = malloc((*count > 0 ? *count : 1) * sizeof(X11_screen_size));
+
+    if (*sizes == 0) {
+        free(info);
+        return 0;
+    }
+
+    screen_sizes = xcb_randr_get_screen_info_sizes(info);
+    for (i = 0; i < *count; ++i) {
+        (*sizes)[i].width = screen_sizes[i].width;
+        (*sizes)[i].height = screen_sizes[i].height;
+    }
+
+    free(info);
+    return 1;
+#else
+    XRRScreenConfiguration * configuration;
+    XRRScreenSize * screen_sizes;
+    Rotation rotation;
+    int i, check;
+
+    if (!XQueryExtension(display, "RANDR", &check, &check, &check)) { return 0; }
+
+    configuration = XRRGetScreenInfo(display, RootWindow(display, screen));
+    if (configuration == 0) { return 0; }
+
+    *current = XRRConfigCurrentConfiguration(configuration, &rotation);
+    screen_sizes = XRRConfigSizes(configuration, count);
+    *sizes = malloc((*count > 0 ? *count : 1) * sizeof(X11_screen_size));
+
+    if (*sizes == 0) {
+        XRRFreeScreenConfigInfo(configuration);
+        return 0;
+    }
+
+    for (i = 0; i < *count; ++i) {
+        (*sizes)[i].width = screen_sizes[i].width;
+        (*sizes)[i].height = screen_sizes[i].height;
+    }
+
+    XRRFreeScreenConfigInfo(configuration);
+    return 1;
+#endif
+}
+
+/* Helper function implementation */
+
+#if defined(MG_HAVE_XCB)
+
+static Visual * find_visual(Screen * screen, VisualID id) {
+    int i, j;
+    for (i = 0; i < screen->ndepths; ++i) {
+        Depth * depth = &screen->depths[i];
+        for (j = 0; j < depth->nvisuals; ++j) {
+            if (depth->visuals[j].visualid == id) { return &depth->visuals[j]; }
+        }
+    }
+    return 0;
+}
+
+static Screen * find_screen(Display * display, Window root) {
+    int i;
+    for (i = 0; i < ScreenCount(display); ++i) {
+        if (RootWindow(display, i) == root) { return ScreenOfDisplay(display, i); }
+    }
+    return 0;
+}
+
+#endif
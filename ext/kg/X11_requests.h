@@ -0,0 +1,42 @@
+#ifndef MG_X11_X11_REQUESTS_H
+#define MG_X11_X11_REQUESTS_H
+
+#include <X11/Xlib.h>
+
+/**
+ * Size of a screen configuration offered by RandR.
+ */
+typedef struct {
+    int width;
+    int height;
+} X11_screen_size;
+
+/**
+ * Interns the atoms with the given names, storing them in the array.
+ *
+ * With XCB, all requests are sent before any reply is awaited, costing a
+ * single round trip. Returns a non-zero value on success.
+ */
+extern int X11_intern_atoms(Display * display, const char ** names, int count, Atom * atoms);
+
+/**
+ * Retrieves the attributes and geometry of the window.
+ *
+ * With XCB, both requests are pipelined into a single round trip and the
+ * global Xlib display lock isn't taken, and the visual is left null if the
+ * screen doesn't list it. Returns a non-zero value on success.
+ */
+extern int X11_get_window_attributes(Display * display, Window window,
+                                     XWindowAttributes * attributes);
+
+/**
+ * Retrieves the screen sizes offered by RandR and the index of the current
+ * one. The array must be freed.
+ *
+ * With XCB, the RandR version and screen information requests are pipelined.
+ * Returns a non-zero value on success, zero if RandR is unavailable.
+ */
+extern int X11_get_screen_sizes(Display * display, int screen,
+                                X11_screen_size ** sizes, int * count, int * current);
+
+#endif /* MG_X11_X11_REQUESTS_H */
@@ -0,0 +1,641 @@
+#include "asset_cache.h"
+
+#include "future.h"
+#include "gl_state.h"
+#include "hash.h"
+#include "image_decoder.h"
+#include "mapped_file.h"
+#include "pixel_format.h"
+#include "pixel_store.h"
+#include "texture_encoder.h"
+#include "worker_pool.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <ruby.h>
+#include <ruby/thread.h>
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+VALUE mg_asset_cache_class;
+VALUE mg_asset_cache_entry_class;
+
+/* Constant definitions */
+
+static const char magic[4] = { 'M', 'g', 'T', 'C' };
+static const uint32_t version = 1;
+static const size_t alignment = 16;
+
+#define MAX_LEVELS 32
+
+/* Cache file layout */
+
+/**
+ * Cache file header. Followed by level_count level descriptors and the
+ * texture data of every level.
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t format; /** mg_pixel_format of uncompressed levels. */
+    uint32_t compression; /** mg_texture_compression of every level. */
+    uint32_t width;
+    uint32_t height;
+    uint32_t level_count;
+    uint32_t reserved;
+    uint64_t key; /** Hash of the source file contents and conversion options. */
+} header_t;
+
+/**
+ * Describes one level of the mip chain.
+ */
+typedef struct {
+    uint32_t width;
+    uint32_t height;
+    uint64_t offset; /** Offset of the level's data from the start of the file. */
+    uint64_t size; /** Size of the level's data in bytes. */
+} level_t;
+
+/* Data structures */
+
+/**
+ * Requested compression. Automatic S3TC picks DXT1 for opaque images and
+ * DXT5 for the rest.
+ */
+typedef enum {
+    COMPRESSION_NONE,
+    COMPRESSION_S3TC,
+    COMPRESSION_DXT1,
+    COMPRESSION_DXT5
+} compression_t;
+
+typedef struct entry_struct {
+    mg_mapped_file file; /** Mapping of the cache file, on a hit. */
+    unsigned char * buffer; /** Freshly converted contents, on a miss. */
+    const unsigned char * data; /** Contents of the cache file. */
+    size_t size; /** Size of the contents in bytes. */
+    int hit; /** Whether the entry was found in the cache. */
+} entry_t;
+
+typedef struct fetch_struct {
+    char * directory;
+    char * path;
+    mg_pixel_format format;
+    int mipmaps;
+    compression_t compression;
+    entry_t * entry; /** Resulting entry, on success. */
+    const char * error; /** Static error message, on failure. */
+    int error_number; /** Value of errno if the source could not be mapped. */
+    mg_future * future; /** Future to complete, for asynchronous fetches. */
+} fetch_t;
+
+/* Helper function prototypes */
+
+/**
+ * Creates a fetch job from the Ruby arguments.
+ */
+static fetch_t * fetch_new(VALUE directory, VALUE path, VALUE format,
+                           VALUE mipmaps, VALUE compression);
+
+/**
+ * Frees the fetch job, but not its entry.
+ */
+static void fetch_free(fetch_t * fetch);
+
+/**
+ * Computes the cache key, then either maps the cached entry or converts the
+ * source image and stores it.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * fetch_entry(void * data);
+
+/**
+ * Worker pool job that fetches the entry and completes the job's future.
+ */
+static void fetch_entry_async(void * data);
+
+/**
+ * Maps the cache file and checks that it holds a valid entry for the key.
+ */
+static entry_t * load_entry(const char * cache_path, uint64_t key);
+
+/**
+ * Decodes the source image, builds its mip chain, compresses every level and
+ * serializes the result into a new entry.
+ */
+static entry_t * convert_entry(fetch_t * fetch, const mg_mapped_file * source, uint64_t key);
+
+/**
+ * Writes the entry to a temporary file and atomically renames it into place.
+ * Failures are ignored; the cache is only an optimization.
+ */
+static void store_entry(const entry_t * entry, const char * directory, const char * cache_path);
+
+/**
+ * Frees the entry and its mapping or buffer.
+ */
+static void entry_free(void * p);
+
+/**
+ * Future converter that wraps the entry.
+ */
+static VALUE entry_to_ruby(void * result);
+
+/**
+ * Returns the entry encapsulated by the Ruby object.
+ */
+static entry_t * entry_from(VALUE self);
+
+/**
+ * Accessors for the entry's header and level descriptors.
+ */
+static inline const header_t * header_of(const entry_t * entry) {
+    return (const header_t *) entry->data;
+}
+
+static inline const level_t * levels_of(const entry_t * entry) {
+    return (const level_t *) (entry->data + sizeof(header_t));
+}
+
+/**
+ * Rounds the offset up to the data alignment.
+ */
+static inline size_t align(size_t offset) {
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+/* Ruby data types */
+
+/**
+ * Ruby data type of asset cache entries, which unmap their file when freed.
+ */
+static const rb_data_type_t entry_type = {
+    "Mg::AssetCache::Entry",
+    { 0, entry_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Asset cache interface implementation */
+
+VALUE mg_asset_cache_fetch_entry(VALUE klass, VALUE directory, VALUE path,
+                                 VALUE format, VALUE mipmaps, VALUE compression) {
+    fetch_t * fetch = fetch_new(directory, path, format, mipmaps, compression);
+    entry_t * entry;
+
+    rb_thread_call_without_gvl(fetch_entry, fetch, 0, 0);
+
+    entry = fetch->entry;
+
+    if (entry == 0) {
+        VALUE source = rb_str_new_cstr(fetch->path);
+        const char * error = fetch->error;
+        int error_number = fetch->error_number;
+        fetch_free(fetch);
+        if (error_number) {
+            rb_syserr_fail_str(error_number, source);
+        }
+        rb_raise(rb_eRuntimeError, "%s: %s", error, StringValueCStr(source));
+    }
+
+    fetch_free(fetch);
+    return entry_to_ruby(entry);
+}
+
+VALUE mg_asset_cache_fetch_entry_async(VALUE klass, VALUE directory, VALUE path,
+                                       VALUE format, VALUE mipmaps, VALUE compression) {
+    fetch_t * fetch = fetch_new(directory, path, format, mipmaps, compression);
+    VALUE future;
+
+    fetch->future = mg_future_new(entry_to_ruby, entry_free);
+
+    if (fetch->future == 0) {
+        fetch_free(fetch);
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for future");
+    }
+
+    future = mg_future_wrap(fetch->future);
+
+    if (!mg_worker_pool_submit(fetch_entry_async, fetch)) {
+        mg_future_reject(fetch->future, "could not start the worker pool");
+        fetch_free(fetch);
+    }
+
+    return future;
+}
+
+VALUE mg_asset_cache_entry_width(VALUE self) {
+    return UINT2NUM(header_of(entry_from(self))->width);
+}
+
+VALUE mg_asset_cache_entry_height(VALUE self) {
+    return UINT2NUM(header_of(entry_from(self))->height);
+}
+
+VALUE mg_asset_cache_entry_format(VALUE self) {
+    return mg_pixel_format_to_symbol(header_of(entry_from(self))->format);
+}
+
+VALUE mg_asset_cache_entry_compression(VALUE self) {
+    switch (header_of(entry_from(self))->compression) {
+        case MG_TEXTURE_COMPRESSION_DXT1: return ID2SYM(rb_intern("dxt1"));
+        case MG_TEXTURE_COMPRESSION_DXT5: return ID2SYM(rb_intern("dxt5"));
+        default: return Qnil;
+    }
+}
+
+VALUE mg_asset_cache_entry_levels(VALUE self) {
+    return UINT2NUM(header_of(entry_from(self))->level_count);
+}
+
+VALUE mg_asset_cache_entry_bytesize(VALUE self) {
+    entry_t * entry = entry_from(self);
+    const level_t * levels = levels_of(entry);
+    uint32_t i, count = header_of(entry)->level_count;
+    size_t size = 0;
+    for (i = 0; i < count; ++i) { size += levels[i].size; }
+    return SIZET2NUM(size);
+}
+
+VALUE mg_asset_cache_entry_hit(VALUE self) {
+    return entry_from(self)->hit ? Qtrue : Qfalse;
+}
+
+VALUE mg_asset_cache_entry_upload(VALUE self) {
+    entry_t * entry = entry_from(self);
+    const header_t * header = header_of(entry);
+    const level_t * levels = levels_of(entry);
+    GLenum format = GL_RGBA, type = GL_UNSIGNED_BYTE, internal_format = 0;
+    mg_gl_state * state;
+    mg_pixel_store_state store;
+    GLint previous = 0;
+    GLuint texture = 0;
+    uint32_t i;
+
+    /* Describe the pixel layout to GL; packed types assume a little endian host */
+    switch (header->compression) {
+        case MG_TEXTURE_COMPRESSION_DXT1: internal_format = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;  break;
+        case MG_TEXTURE_COMPRESSION_DXT5: internal_format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT; break;
+        default: {
+            switch (header->format) {
+                case MG_PIXEL_FORMAT_RGBA: format = GL_RGBA; type = GL_UNSIGNED_BYTE;        break;
+                case MG_PIXEL_FORMAT_BGRA: format = GL_BGRA; type = GL_UNSIGNED_BYTE;        break;
+                case MG_PIXEL_FORMAT_ARGB: format = GL_BGRA; type = GL_UNSIGNED_INT_8_8_8_8; break;
+                case MG_PIXEL_FORMAT_ABGR: format = GL_RGBA; type = GL_UNSIGNED_INT_8_8_8_8; break;
+            }
+        }
+    }
+
+    glGenTextures(1, &texture);
+
+    if (texture == 0) {
+        rb_raise(rb_eRuntimeError, "could not create texture; is a GL context current?");
+    }
+
+    /* The caller's texture is bound again once the levels are in */
+    state = mg_gl_state_current();
+    glGetIntegerv(GL_TEXTURE_BINDING_2D, &previous);
+    mg_gl_bind_texture(state, GL_TEXTURE_2D, texture);
+    mg_pixel_store_push(&store);
+
+    /* Hand every level straight from the mapping to the driver */
+    for (i = 0; i < header->level_count; ++i) {
+        const unsigned char * pixels = entry->data + levels[i].offset;
+        if (internal_format) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, internal_format,
+                                   levels[i].width, levels[i].height, 0,
+                                   levels[i].size, pixels);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8,
+                         levels[i].width, levels[i].height, 0,
+                         format, type, pixels);
+        }
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->level_count - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER,
+                    header->level_count > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+
+    mg_pixel_store_pop(&store);
+    mg_gl_bind_texture(state, GL_TEXTURE_2D, (GLuint) previous);
+    return UINT2NUM(texture);
+}
+
+void init_mg_asset_cache_class_under(VALUE module) {
+    mg_asset_cache_class = rb_define_class_under(module, "AssetCache", rb_cObject);
+    rb_define_singleton_method(mg_asset_cache_class, "fetch_entry",
+                               mg_asset_cache_fetch_entry, 5);
+    rb_define_singleton_method(mg_asset_cache_class, "fetch_entry_async",
+                               mg_asset_cache_fetch_entry_async, 5);
+
+    mg_asset_cache_entry_class = rb_define_class_under(mg_asset_cache_class, "Entry", rb_cObject);
+    rb_undef_alloc_func(mg_asset_cache_entry_class);
+    rb_define_method(mg_asset_cache_entry_class, "width",       mg_asset_cache_entry_width,       0);
+    rb_define_method(mg_asset_cache_entry_class, "height",      mg_asset_cache_entry_height,      0);
+    rb_define_method(mg_asset_cache_entry_class, "format",      mg_asset_cache_entry_format,      0);
+    rb_define_method(mg_asset_cache_entry_class, "compression", mg_asset_cache_entry_compression, 0);
+    rb_define_method(mg_asset_cache_entry_class, "levels",      mg_asset_cache_entry_levels,      0);
+    rb_define_method(mg_asset_cache_entry_class, "bytesize",    mg_asset_cache_entry_bytesize,    0);
+    rb_define_method(mg_asset_cache_entry_class, "hit?",        mg_asset_cache_entry_hit,         0);
+    rb_define_method(mg_asset_cache_entry_class, "upload",      mg_asset_cache_entry_upload,      0);
+}
+
+/* Helper function implementation */
+
+static fetch_t * fetch_new(VALUE directory, VALUE path, VALUE format,
+                           VALUE mipmaps, VALUE compression) {
+    fetch_t * fetch;
+    compression_t requested = COMPRESSION_NONE;
+    mg_pixel_format pixel_format = MG_PIXEL_FORMAT_BGRA;
+
+    FilePathValue(directory);
+    FilePathValue(path);
+
+    if (!NIL_P(format)) {
+        pixel_format = mg_pixel_format_from_symbol(format);
+    }
+
+    if (!NIL_P(compression)) {
+        ID id;
+        Check_Type(compression, T_SYMBOL);
+        id = SYM2ID(compression);
+        if      (id == rb_intern("s3tc")) { requested = COMPRESSION_S3TC; }
+        else if (id == rb_intern("dxt1")) { requested = COMPRESSION_DXT1; }
+        else if (id == rb_intern("dxt5")) { requested = COMPRESSION_DXT5; }
+        else {
+            rb_raise(rb_eArgError, "unsupported texture compression: %s", rb_id2name(id));
+        }
+    }
+
+    fetch = calloc(1, sizeof(fetch_t));
+
+    if (fetch == 0 ||
+        (fetch->directory = strdup(StringValueCStr(directory))) == 0 ||
+        (fetch->path = strdup(StringValueCStr(path))) == 0) {
+        if (fetch) { fetch_free(fetch); }
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for asset fetch");
+    }
+
+    fetch->format = pixel_format;
+    fetch->mipmaps = RTEST(mipmaps);
+    fetch->compression = requested;
+    return fetch;
+}
+
+static void fetch_free(fetch_t * fetch) {
+    free(fetch->directory);
+    free(fetch->path);
+    free(fetch);
+}
+
+static void * fetch_entry(void * data) {
+    fetch_t * fetch = data;
+    mg_mapped_file source;
+    uint32_t options[4];
+    uint64_t key;
+    char * cache_path;
+    size_t length;
+
+    if (!mg_mapped_file_open(&source, fetch->path)) {
+        fetch->error = "could not map asset file";
+        fetch->error_number = errno ? errno : EINVAL;
+        return 0;
+    }
+
+    /* The key covers the source contents and everything that affects the output */
+    options[0] = version;
+    options[1] = fetch->format;
+    options[2] = fetch->mipmaps;
+    options[3] = fetch->compression;
+    key = mg_hash64(source.data, source.size, 0);
+    key = mg_hash64(options, sizeof(options), key);
+
+    length = strlen(fetch->directory) + 32;
+    cache_path = malloc(length);
+
+    if (cache_path == 0) {
+        fetch->error = "unable to allocate memory for asset fetch";
+        mg_mapped_file_close(&source);
+        return 0;
+    }
+
+    snprintf(cache_path, length, "%s/%016llx.mgtc", fetch->directory, (unsigned long long) key);
+
+    /* Use the cached entry if there is one; convert and store it otherwise */
+    fetch->entry = load_entry(cache_path, key);
+
+    if (fetch->entry == 0) {
+        fetch->entry = convert_entry(fetch, &source, key);
+        if (fetch->entry) {
+            store_entry(fetch->entry, fetch->directory, cache_path);
+        }
+    }
+
+    free(cache_path);
+    mg_mapped_file_close(&source);
+    return 0;
+}
+
+static void fetch_entry_async(void * data) {
+    fetch_t * fetch = data;
+
+    fetch_entry(fetch);
+
+    if (fetch->entry) {
+        mg_future_resolve(fetch->future, fetch->entry);
+    } else {
+        char message[512];
+        snprintf(message, sizeof(message), "%s: %s",
+                 fetch->error_number ? strerror(fetch->error_number) : fetch->error,
+                 fetch->path);
+        mg_future_reject(fetch->future, message);
+    }
+
+    fetch_free(fetch);
+}
+
+static entry_t * load_entry(const char * cache_path, uint64_t key) {
+    const header_t * header;
+    const level_t * levels;
+    entry_t * entry;
+    uint32_t i;
+
+    entry = calloc(1, sizeof(entry_t));
+
+    if (entry == 0) { return 0; }
+
+    if (!mg_mapped_file_open(&entry->file, cache_path)) {
+        free(entry);
+        return 0;
+    }
+
+    entry->data = entry->file.data;
+    entry->size = entry->file.size;
+    entry->hit = 1;
+
+    header = header_of(entry);
+    levels = levels_of(entry);
+
+    /* Anything that doesn't look exactly right is treated as a miss */
+    if (entry->size < sizeof(header_t) ||
+        memcmp(header->magic, magic, sizeof(magic)) != 0 ||
+        header->version != version ||
+        header->key != key ||
+        header->format > MG_PIXEL_FORMAT_ABGR ||
+        header->compression > MG_TEXTURE_COMPRESSION_DXT5 ||
+        header->level_count == 0 || header->level_count > MAX_LEVELS ||
+        sizeof(header_t) + header->level_count * sizeof(level_t) > entry->size) {
+        entry_free(entry);
+        return 0;
+    }
+
+    for (i = 0; i < header->level_count; ++i) {
+        if (levels[i].offset > entry->size ||
+            levels[i].size > entry->size - levels[i].offset ||
+            levels[i].size != mg_texture_size(header->compression,
+                                              levels[i].width, levels[i].height)) {
+            entry_free(entry);
+            return 0;
+        }
+    }
+
+    return entry;
+}
+
+static entry_t * convert_entry(fetch_t * fetch, const mg_mapped_file * source, uint64_t key) {
+    mg_image images[MAX_LEVELS];
+    mg_texture_compression compression = MG_TEXTURE_COMPRESSION_NONE;
+    header_t * header;
+    level_t * levels;
+    entry_t * entry = 0;
+    size_t offset, size;
+    uint32_t i, count = 0;
+
+    /* Decode the base level */
+    fetch->error = mg_image_decode(source->data, source->size, fetch->format, &images[0]);
+    if (fetch->error) { return 0; }
+    count = 1;
+
+    /* Build the rest of the mip chain down to 1x1 */
+    while (fetch->mipmaps && count < MAX_LEVELS &&
+           (images[count - 1].width > 1 || images[count - 1].height > 1)) {
+        fetch->error = mg_image_downsample(&images[count - 1], &images[count]);
+        if (fetch->error) { goto cleanup; }
+        ++count;
+    }
+
+    switch (fetch->compression) {
+        case COMPRESSION_S3TC: {
+            compression = mg_image_is_opaque(&images[0]) ? MG_TEXTURE_COMPRESSION_DXT1
+                                                         : MG_TEXTURE_COMPRESSION_DXT5;
+            break;
+        }
+        case COMPRESSION_DXT1: compression = MG_TEXTURE_COMPRESSION_DXT1; break;
+        case COMPRESSION_DXT5: compression = MG_TEXTURE_COMPRESSION_DXT5; break;
+        default: break;
+    }
+
+    /* Lay out the file */
+    offset = align(sizeof(header_t) + count * sizeof(level_t));
+    size = offset;
+    for (i = 0; i < count; ++i) {
+        size = align(size + mg_texture_size(compression, images[i].width, images[i].height));
+    }
+
+    entry = calloc(1, sizeof(entry_t));
+
+    if (entry == 0 || (entry->buffer = calloc(1, size)) == 0) {
+        free(entry);
+        entry = 0;
+        fetch->error = "unable to allocate memory for texture data";
+        goto cleanup;
+    }
+
+    entry->data = entry->buffer;
+    entry->size = size;
+
+    header = (header_t *) entry->buffer;
+    memcpy(header->magic, magic, sizeof(magic));
+    header->version = version;
+    header->format = fetch->format;
+    header->compression = compression;
+    header->width = images[0].width;
+    header->height = images[0].height;
+    header->level_count = count;
+    header->key = key;
+
+    /* Convert every level into place */
+    levels = (level_t *) (entry->buffer + sizeof(header_t));
+    for (i = 0; i < count; ++i) {
+        levels[i].width = images[i].width;
+        levels[i].height = images[i].height;
+        levels[i].offset = offset;
+        levels[i].size = mg_texture_size(compression, images[i].width, images[i].height);
+        mg_texture_compress(&images[i], compression, entry->buffer + offset);
+        offset = align(offset + levels[i].size);
+    }
+
+cleanup:
+    for (i = 0; i < count; ++i) {
+        mg_image_free(&images[i]);
+    }
+
+    return entry;
+}
+
+static void store_entry(const entry_t * entry, const char * directory, const char * cache_path) {
+    size_t length = strlen(directory) + 32, written = 0;
+    char * temporary_path = malloc(length);
+    int fd;
+
+    if (temporary_path == 0) { return; }
+
+    /* Concurrent fetches of the same asset each write their own file */
+    snprintf(temporary_path, length, "%s/.mgtc.XXXXXX", directory);
+    fd = mkstemp(temporary_path);
+
+    if (fd < 0) {
+        free(temporary_path);
+        return;
+    }
+
+    while (written < entry->size) {
+        ssize_t n = write(fd, entry->data + written, entry->size - written);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        written += n;
+    }
+
+    if (close(fd) != 0 || written != entry->size || rename(temporary_path, cache_path) != 0) {
+        unlink(temporary_path);
+    }
+
+    free(temporary_path);
+}
+
+static void entry_free(void * p) {
+    entry_t * entry = p;
+    mg_mapped_file_close(&entry->file);
+    free(entry->buffer);
+    free(entry);
+}
+
+static VALUE entry_to_ruby(void * result) {
+    return TypedData_Wrap_Struct(mg_asset_cache_entry_class, &entry_type, result);
+}
+
+static entry_t * entry_from(VALUE self) {
+    entry_t * entry = 0;
+    TypedData_Get_Struct(self, entry_t, &entry_type, entry);
+    return entry;
+}
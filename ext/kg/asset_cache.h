@@ -0,0 +1,80 @@
+#ifndef MG_ASSET_CACHE_H
+#define MG_ASSET_CACHE_H
+
+#include <ruby.h>
+
+/**
+ * Mg::AssetCache class.
+ */
+extern VALUE mg_asset_cache_class;
+
+/**
+ * Mg::AssetCache::Entry class.
+ */
+extern VALUE mg_asset_cache_entry_class;
+
+/**
+ * Looks up the texture data for the image at the given path in the cache
+ * directory, converting the image and storing the result on a miss. Runs
+ * WITHOUT the GVL and returns a Mg::AssetCache::Entry.
+ *
+ * Arguments: directory, path, pixel format, whether to build mipmaps and the
+ * compression symbol (nil, :s3tc, :dxt1 or :dxt5).
+ */
+extern VALUE mg_asset_cache_fetch_entry(VALUE klass, VALUE directory, VALUE path,
+                                        VALUE format, VALUE mipmaps, VALUE compression);
+
+/**
+ * Same as mg_asset_cache_fetch_entry, but runs on the worker pool and returns a
+ * Mg::Future for the entry.
+ */
+extern VALUE mg_asset_cache_fetch_entry_async(VALUE klass, VALUE directory, VALUE path,
+                                              VALUE format, VALUE mipmaps, VALUE compression);
+
+/**
+ * Returns the width of the entry's base level.
+ */
+extern VALUE mg_asset_cache_entry_width(VALUE self);
+
+/**
+ * Returns the height of the entry's base level.
+ */
+extern VALUE mg_asset_cache_entry_height(VALUE self);
+
+/**
+ * Returns the pixel format of uncompressed entries.
+ */
+extern VALUE mg_asset_cache_entry_format(VALUE self);
+
+/**
+ * Returns the compression of the entry as a symbol, or nil.
+ */
+extern VALUE mg_asset_cache_entry_compression(VALUE self);
+
+/**
+ * Returns the number of levels in the entry's mip chain.
+ */
+extern VALUE mg_asset_cache_entry_levels(VALUE self);
+
+/**
+ * Returns the number of bytes of texture data in the entry.
+ */
+extern VALUE mg_asset_cache_entry_bytesize(VALUE self);
+
+/**
+ * Returns whether the entry was found in the cache rather than converted.
+ */
+extern VALUE mg_asset_cache_entry_hit(VALUE self);
+
+/**
+ * Uploads every level of the entry into a new 2D texture of the GL context
+ * that's current on the calling thread and returns the texture name.
+ */
+extern VALUE mg_asset_cache_entry_upload(VALUE self);
+
+/**
+ * Initializes the AssetCache class.
+ */
+extern void init_mg_asset_cache_class_under(VALUE module);
+
+#endif /* MG_ASSET_CACHE_H */
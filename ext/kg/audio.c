@@ -0,0 +1,600 @@
+#include "audio.h"
+
+#include "audio_mixer.h"
+#include "audio_sink.h"
+#include "mapped_file.h"
+#include "wave.h"
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <ruby.h>
+#include <ruby/thread.h>
+
+VALUE mg_audio_class;
+VALUE mg_audio_sound_class;
+VALUE mg_audio_stream_class;
+
+/* Data structures */
+
+typedef struct audio_struct {
+    mg_audio_mixer * mixer; /** Running mixer, or zero once closed. */
+    mg_audio_streamer * streamer; /** Decodes streams; started with the first one. */
+    unsigned int rate; /** Output sample rate. */
+    unsigned int period; /** Frames mixed at a time. */
+    unsigned int next_voice; /** Identifier of the next voice to be played. */
+} audio_t;
+
+typedef struct sound_load_struct {
+    const char * path;
+    mg_audio_sound * sound; /** Loaded sound, on success. */
+    const char * error; /** Static error message, on failure. */
+    int error_number; /** Value of errno if the file could not be mapped. */
+} sound_load_t;
+
+typedef struct stream_open_struct {
+    const char * path;
+    unsigned int rate;
+    unsigned int period;
+    unsigned int buffers;
+    int loop;
+    mg_audio_stream * stream; /** Opened stream, on success. */
+    const char * error; /** Static error message, on failure. */
+    int error_number; /** Value of errno if the file could not be mapped. */
+} stream_open_t;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the audio data encapsulated by the Ruby object, raising an error if
+ * the mixer has been closed.
+ */
+static audio_t * audio_from(VALUE self);
+
+/**
+ * Returns the sound encapsulated by the Ruby object.
+ */
+static mg_audio_sound * sound_from(VALUE self);
+
+/**
+ * Returns the stream encapsulated by the Ruby object.
+ */
+static mg_audio_stream * stream_from(VALUE self);
+
+/**
+ * Sends a command that only refers to a voice and some parameters.
+ */
+static VALUE send_voice_command(VALUE self, mg_audio_command_type type,
+                                VALUE voice, float gain, float pan, float rate);
+
+/**
+ * Stops the mixer. Called WITHOUT the GVL, since it waits for the audio
+ * threads to finish.
+ */
+static void * close_mixer(void * mixer);
+
+/**
+ * Stops the streamer. Called WITHOUT the GVL, since it waits for the streamer
+ * thread to finish.
+ */
+static void * close_streamer(void * streamer);
+
+/**
+ * Frees the audio data, stopping the mixer if it's still running.
+ */
+static void audio_free(void * p);
+
+/**
+ * Maps and converts the WAVE file.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * load_sound(void * data);
+
+/**
+ * Releases the Ruby object's reference to the sound.
+ */
+static void sound_free(void * p);
+
+/**
+ * Opens the stream, decoding its first periods.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * open_stream(void * data);
+
+/**
+ * Releases the Ruby object's reference to the stream.
+ */
+static void stream_free(void * p);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::Audio objects. Freeing one joins the mixing and
+ * streaming threads, which never wait for Ruby.
+ */
+static const rb_data_type_t audio_type = {
+    "Mg::Audio",
+    { 0, audio_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/**
+ * Ruby data type of Mg::Audio::Sound objects.
+ */
+static const rb_data_type_t sound_type = {
+    "Mg::Audio::Sound",
+    { 0, sound_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/**
+ * Ruby data type of Mg::Audio::Stream objects.
+ */
+static const rb_data_type_t stream_type = {
+    "Mg::Audio::Stream",
+    { 0, stream_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Audio interface implementation */
+
+VALUE mg_audio_alloc(VALUE klass) {
+    audio_t * audio = calloc(1, sizeof(audio_t));
+    if (audio == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for audio");
+    }
+    return TypedData_Wrap_Struct(klass, &audio_type, audio);
+}
+
+VALUE mg_audio_start(VALUE self, VALUE sink, VALUE target, VALUE rate,
+                     VALUE period, VALUE voices, VALUE paced) {
+    audio_t * audio = 0;
+    mg_audio_sink * output = 0;
+    const char * error = 0;
+    ID kind;
+
+    TypedData_Get_Struct(self, audio_t, &audio_type, audio);
+
+    Check_Type(sink,   T_SYMBOL);
+    Check_Type(rate,   T_FIXNUM);
+    Check_Type(period, T_FIXNUM);
+    Check_Type(voices, T_FIXNUM);
+
+    if (audio->mixer) {
+        rb_raise(rb_eRuntimeError, "audio has already been started");
+    }
+
+    if (FIX2INT(rate) <= 0 || FIX2INT(period) <= 0 || FIX2INT(voices) <= 0) {
+        rb_raise(rb_eArgError, "rate, period and voices must be positive");
+    }
+
+    /* Open the requested sink */
+    kind = SYM2ID(sink);
+    if (kind == rb_intern("null")) {
+        output = mg_audio_sink_open_null(FIX2INT(rate), RTEST(paced));
+    } else if (kind == rb_intern("wav")) {
+        FilePathValue(target);
+        output = mg_audio_sink_open_wav(StringValueCStr(target), FIX2INT(rate), RTEST(paced));
+    } else if (kind == rb_intern("alsa")) {
+        output = mg_audio_sink_open_alsa(NIL_P(target) ? "default" : StringValueCStr(target),
+                                         FIX2INT(rate), FIX2INT(period), 4);
+    } else {
+        rb_raise(rb_eArgError, "unsupported audio sink: %s", rb_id2name(kind));
+    }
+
+    if (output == 0) {
+        rb_raise(rb_eRuntimeError, "could not open audio sink %s", rb_id2name(kind));
+    }
+
+    /* Start mixing */
+    audio->mixer = mg_audio_mixer_new(output, FIX2INT(rate), FIX2INT(period),
+                                      FIX2INT(voices), &error);
+
+    if (audio->mixer == 0) {
+        rb_raise(rb_eRuntimeError, "%s", error);
+    }
+
+    audio->rate = FIX2INT(rate);
+    audio->period = FIX2INT(period);
+    audio->next_voice = 1;
+    return self;
+}
+
+VALUE mg_audio_play_sound(VALUE self, VALUE sound, VALUE gain, VALUE pan,
+                          VALUE rate, VALUE loop) {
+    audio_t * audio = audio_from(self);
+    mg_audio_command command;
+
+    if (!rb_obj_is_kind_of(sound, mg_audio_sound_class)) {
+        rb_raise(rb_eTypeError, "expected a Mg::Audio::Sound");
+    }
+
+    command.type = MG_AUDIO_COMMAND_PLAY;
+    command.voice = audio->next_voice;
+    command.sound = mg_audio_sound_retain(sound_from(sound));
+    command.stream = 0;
+    command.gain = (float) NUM2DBL(gain);
+    command.pan = (float) NUM2DBL(pan);
+    command.rate = (float) NUM2DBL(rate);
+    command.loop = RTEST(loop);
+
+    if (!mg_audio_mixer_send(audio->mixer, &command)) {
+        mg_audio_sound_release(command.sound);
+        return Qnil;
+    }
+
+    /* Zero identifies free voices, so skip it when wrapping around */
+    if (++audio->next_voice == 0) { audio->next_voice = 1; }
+
+    return UINT2NUM(command.voice);
+}
+
+VALUE mg_audio_open_stream(VALUE self, VALUE path, VALUE buffers, VALUE loop) {
+    audio_t * audio = audio_from(self);
+    stream_open_t open = { 0, 0, 0, 0, 0, 0, 0, 0 };
+
+    FilePathValue(path);
+    Check_Type(buffers, T_FIXNUM);
+
+    if (FIX2INT(buffers) < 2) {
+        rb_raise(rb_eArgError, "streams need at least 2 buffers");
+    }
+
+    /* The streamer thread is only started when streams are used */
+    if (audio->streamer == 0) {
+        audio->streamer = mg_audio_streamer_new(audio->rate, audio->period);
+        if (audio->streamer == 0) {
+            rb_raise(rb_eRuntimeError, "could not start audio streamer thread");
+        }
+    }
+
+    open.path = StringValueCStr(path);
+    open.rate = audio->rate;
+    open.period = audio->period;
+    open.buffers = FIX2INT(buffers);
+    open.loop = RTEST(loop);
+
+    rb_thread_call_without_gvl(open_stream, &open, 0, 0);
+
+    if (open.stream == 0) {
+        if (open.error_number) {
+            rb_syserr_fail_str(open.error_number, path);
+        }
+        rb_raise(rb_eRuntimeError, "%s: %s", open.error, open.path);
+    }
+
+    if (!mg_audio_streamer_add(audio->streamer, open.stream)) {
+        mg_audio_stream_release(open.stream);
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for audio stream");
+    }
+
+    return TypedData_Wrap_Struct(mg_audio_stream_class, &stream_type, open.stream);
+}
+
+VALUE mg_audio_play_stream(VALUE self, VALUE stream, VALUE gain, VALUE pan) {
+    audio_t * audio = audio_from(self);
+    mg_audio_command command;
+
+    if (!rb_obj_is_kind_of(stream, mg_audio_stream_class)) {
+        rb_raise(rb_eTypeError, "expected a Mg::Audio::Stream");
+    }
+
+    command.type = MG_AUDIO_COMMAND_PLAY;
+    command.voice = audio->next_voice;
+    command.sound = 0;
+    command.stream = stream_from(stream);
+    command.gain = (float) NUM2DBL(gain);
+    command.pan = (float) NUM2DBL(pan);
+    command.rate = 1.0f;
+    command.loop = 0;
+
+    if (!mg_audio_stream_start(command.stream)) {
+        rb_raise(rb_eRuntimeError, "stream has already been played");
+    }
+
+    if (!mg_audio_mixer_send(audio->mixer, &command)) {
+        mg_audio_stream_cancel(command.stream);
+        return Qnil;
+    }
+
+    /* Zero identifies free voices, so skip it when wrapping around */
+    if (++audio->next_voice == 0) { audio->next_voice = 1; }
+
+    return UINT2NUM(command.voice);
+}
+
+VALUE mg_audio_stop(VALUE self, VALUE voice) {
+    return send_voice_command(self, MG_AUDIO_COMMAND_STOP, voice, 0, 0, 0);
+}
+
+VALUE mg_audio_stop_all(VALUE self) {
+    return send_voice_command(self, MG_AUDIO_COMMAND_STOP_ALL, INT2FIX(0), 0, 0, 0);
+}
+
+VALUE mg_audio_set_volume(VALUE self, VALUE voice, VALUE gain) {
+    return send_voice_command(self, MG_AUDIO_COMMAND_GAIN, voice, (float) NUM2DBL(gain), 0, 0);
+}
+
+VALUE mg_audio_set_pan(VALUE self, VALUE voice, VALUE pan) {
+    return send_voice_command(self, MG_AUDIO_COMMAND_PAN, voice, 0, (float) NUM2DBL(pan), 0);
+}
+
+VALUE mg_audio_set_rate(VALUE self, VALUE voice, VALUE rate) {
+    return send_voice_command(self, MG_AUDIO_COMMAND_RATE, voice, 0, 0, (float) NUM2DBL(rate));
+}
+
+VALUE mg_audio_set_master_volume(VALUE self, VALUE gain) {
+    return send_voice_command(self, MG_AUDIO_COMMAND_MASTER_GAIN, INT2FIX(0),
+                              (float) NUM2DBL(gain), 0, 0);
+}
+
+VALUE mg_audio_playing(VALUE self, VALUE voice) {
+    return mg_audio_mixer_playing(audio_from(self)->mixer, NUM2UINT(voice)) ? Qtrue : Qfalse;
+}
+
+VALUE mg_audio_stats(VALUE self) {
+    audio_t * audio = audio_from(self);
+    mg_audio_statistics stats;
+    VALUE hash = rb_hash_new();
+    double period = 0;
+
+    mg_audio_mixer_stats(audio->mixer, &stats);
+
+    /* Times are reported in seconds, like Process.clock_gettime */
+    rb_hash_aset(hash, ID2SYM(rb_intern("buffers")),          ULL2NUM(stats.buffers));
+    rb_hash_aset(hash, ID2SYM(rb_intern("mix_time_total")),   DBL2NUM(stats.mix_time_total / 1e9));
+    rb_hash_aset(hash, ID2SYM(rb_intern("mix_time_max")),     DBL2NUM(stats.mix_time_max / 1e9));
+    rb_hash_aset(hash, ID2SYM(rb_intern("mix_time_last")),    DBL2NUM(stats.mix_time_last / 1e9));
+    if (stats.buffers > 0) {
+        period = (double) stats.mix_time_total / stats.buffers / 1e9;
+    }
+    rb_hash_aset(hash, ID2SYM(rb_intern("mix_time_average")), DBL2NUM(period));
+    rb_hash_aset(hash, ID2SYM(rb_intern("active_voices")),    UINT2NUM(stats.active_voices));
+    rb_hash_aset(hash, ID2SYM(rb_intern("dropped_commands")), ULL2NUM(stats.dropped_commands));
+    rb_hash_aset(hash, ID2SYM(rb_intern("underruns")),        ULONG2NUM(stats.underruns));
+    rb_hash_aset(hash, ID2SYM(rb_intern("stream_underruns")), ULL2NUM(stats.stream_underruns));
+    return hash;
+}
+
+VALUE mg_audio_close(VALUE self) {
+    audio_t * audio = 0;
+    mg_audio_mixer * mixer;
+    mg_audio_streamer * streamer;
+
+    TypedData_Get_Struct(self, audio_t, &audio_type, audio);
+
+    mixer = audio->mixer;
+    streamer = audio->streamer;
+    audio->mixer = 0;
+    audio->streamer = 0;
+
+    /* The mixer reads from the streams, so it goes first */
+    if (mixer) {
+        rb_thread_call_without_gvl(close_mixer, mixer, 0, 0);
+    }
+    if (streamer) {
+        rb_thread_call_without_gvl(close_streamer, streamer, 0, 0);
+    }
+
+    return Qnil;
+}
+
+VALUE mg_audio_sound_load(VALUE klass, VALUE path) {
+    sound_load_t load = { 0, 0, 0, 0 };
+
+    FilePathValue(path);
+    load.path = StringValueCStr(path);
+
+    rb_thread_call_without_gvl(load_sound, &load, 0, 0);
+
+    if (load.sound == 0) {
+        if (load.error_number) {
+            rb_syserr_fail_str(load.error_number, path);
+        }
+        rb_raise(rb_eRuntimeError, "%s: %s", load.error, load.path);
+    }
+
+    return TypedData_Wrap_Struct(klass, &sound_type, load.sound);
+}
+
+VALUE mg_audio_sound_frames(VALUE self) {
+    return SIZET2NUM(sound_from(self)->frames);
+}
+
+VALUE mg_audio_sound_rate(VALUE self) {
+    return UINT2NUM(sound_from(self)->rate);
+}
+
+VALUE mg_audio_stream_frames(VALUE self) {
+    mg_audio_stream_statistics stats;
+    mg_audio_stream_stats(stream_from(self), &stats);
+    return SIZET2NUM(stats.frames);
+}
+
+VALUE mg_audio_stream_rate(VALUE self) {
+    mg_audio_stream_statistics stats;
+    mg_audio_stream_stats(stream_from(self), &stats);
+    return UINT2NUM(stats.rate);
+}
+
+VALUE mg_audio_stream_buffered(VALUE self) {
+    mg_audio_stream_statistics stats;
+    mg_audio_stream_stats(stream_from(self), &stats);
+    return SIZET2NUM(stats.buffered);
+}
+
+VALUE mg_audio_stream_underruns(VALUE self) {
+    mg_audio_stream_statistics stats;
+    mg_audio_stream_stats(stream_from(self), &stats);
+    return ULONG2NUM(stats.underruns);
+}
+
+VALUE mg_audio_stream_bytesize(VALUE self) {
+    mg_audio_stream_statistics stats;
+    mg_audio_stream_stats(stream_from(self), &stats);
+    return SIZET2NUM(stats.bytesize);
+}
+
+VALUE mg_audio_stream_started(VALUE self) {
+    mg_audio_stream_statistics stats;
+    mg_audio_stream_stats(stream_from(self), &stats);
+    return stats.started ? Qtrue : Qfalse;
+}
+
+VALUE mg_audio_stream_finished(VALUE self) {
+    mg_audio_stream_statistics stats;
+    mg_audio_stream_stats(stream_from(self), &stats);
+    return stats.finished ? Qtrue : Qfalse;
+}
+
+void init_mg_audio_class_under(VALUE module) {
+    mg_audio_class = rb_define_class_under(module, "Audio", rb_cObject);
+    rb_define_alloc_func(mg_audio_class, mg_audio_alloc);
+    rb_define_private_method(mg_audio_class, "start",         mg_audio_start,      6);
+    rb_define_private_method(mg_audio_class, "play_sound",    mg_audio_play_sound, 5);
+    rb_define_private_method(mg_audio_class, "open_stream",   mg_audio_open_stream, 3);
+    rb_define_private_method(mg_audio_class, "play_stream",   mg_audio_play_stream, 3);
+    rb_define_method(mg_audio_class, "stop",           mg_audio_stop,              1);
+    rb_define_method(mg_audio_class, "stop_all",       mg_audio_stop_all,          0);
+    rb_define_method(mg_audio_class, "set_volume",     mg_audio_set_volume,        2);
+    rb_define_method(mg_audio_class, "set_pan",        mg_audio_set_pan,           2);
+    rb_define_method(mg_audio_class, "set_rate",       mg_audio_set_rate,          2);
+    rb_define_method(mg_audio_class, "master_volume=", mg_audio_set_master_volume, 1);
+    rb_define_method(mg_audio_class, "playing?",       mg_audio_playing,           1);
+    rb_define_method(mg_audio_class, "stats",          mg_audio_stats,             0);
+    rb_define_method(mg_audio_class, "close",          mg_audio_close,             0);
+
+    mg_audio_sound_class = rb_define_class_under(mg_audio_class, "Sound", rb_cObject);
+    rb_undef_alloc_func(mg_audio_sound_class);
+    rb_define_singleton_method(mg_audio_sound_class, "load", mg_audio_sound_load, 1);
+    rb_define_method(mg_audio_sound_class, "frames", mg_audio_sound_frames, 0);
+    rb_define_method(mg_audio_sound_class, "rate",   mg_audio_sound_rate,   0);
+
+    mg_audio_stream_class = rb_define_class_under(mg_audio_class, "Stream", rb_cObject);
+    rb_undef_alloc_func(mg_audio_stream_class);
+    rb_define_method(mg_audio_stream_class, "frames",    mg_audio_stream_frames,     0);
+    rb_define_method(mg_audio_stream_class, "rate",      mg_audio_stream_rate,       0);
+    rb_define_method(mg_audio_stream_class, "buffered",  mg_audio_stream_buffered,   0);
+    rb_define_method(mg_audio_stream_class, "underruns", mg_audio_stream_underruns,  0);
+    rb_define_method(mg_audio_stream_class, "bytesize",  mg_audio_stream_bytesize,   0);
+    rb_define_method(mg_audio_stream_class, "started?",  mg_audio_stream_started,    0);
+    rb_define_method(mg_audio_stream_class, "finished?", mg_audio_stream_finished,   0);
+}
+
+/* Helper function implementation */
+
+static audio_t * audio_from(VALUE self) {
+    audio_t * audio = 0;
+    TypedData_Get_Struct(self, audio_t, &audio_type, audio);
+    if (audio->mixer == 0) {
+        rb_raise(rb_eRuntimeError, "audio is closed");
+    }
+    return audio;
+}
+
+static mg_audio_sound * sound_from(VALUE self) {
+    mg_audio_sound * sound = 0;
+    TypedData_Get_Struct(self, mg_audio_sound, &sound_type, sound);
+    return sound;
+}
+
+static mg_audio_stream * stream_from(VALUE self) {
+    mg_audio_stream * stream = 0;
+    TypedData_Get_Struct(self, mg_audio_stream, &stream_type, stream);
+    return stream;
+}
+
+static VALUE send_voice_command(VALUE self, mg_audio_command_type type,
+                                VALUE voice, float gain, float pan, float rate) {
+    audio_t * audio = audio_from(self);
+    mg_audio_command command;
+
+    command.type = type;
+    command.voice = NUM2UINT(voice);
+    command.sound = 0;
+    command.stream = 0;
+    command.gain = gain;
+    command.pan = pan;
+    command.rate = rate;
+    command.loop = 0;
+
+    return mg_audio_mixer_send(audio->mixer, &command) ? Qtrue : Qfalse;
+}
+
+static void * close_mixer(void * mixer) {
+    mg_audio_mixer_free(mixer);
+    return 0;
+}
+
+static void * close_streamer(void * streamer) {
+    mg_audio_streamer_free(streamer);
+    return 0;
+}
+
+static void audio_free(void * p) {
+    audio_t * audio = p;
+    if (audio->mixer) {
+        mg_audio_mixer_free(audio->mixer);
+    }
+    if (audio->streamer) {
+        mg_audio_streamer_free(audio->streamer);
+    }
+    free(audio);
+}
+
+static void * load_sound(void * data) {
+    sound_load_t * load = data;
+    mg_mapped_file file;
+    mg_wave wave;
+    mg_audio_sound * sound;
+
+    if (!mg_mapped_file_open(&file, load->path)) {
+        load->error = "could not map sound file";
+        load->error_number = errno ? errno : EINVAL;
+        return 0;
+    }
+
+    if ((load->error = mg_wave_parse(file.data, file.size, &wave))) {
+        mg_mapped_file_close(&file);
+        return 0;
+    }
+
+    sound = calloc(1, sizeof(mg_audio_sound));
+
+    if (sound == 0 || (sound->samples = malloc(wave.frames * 2 * sizeof(float) + 1)) == 0) {
+        free(sound);
+        load->error = "unable to allocate memory for sound";
+        mg_mapped_file_close(&file);
+        return 0;
+    }
+
+    /* Convert to the mixer's native representation up front */
+    mg_wave_read_stereo(&wave, 0, wave.frames, sound->samples);
+    sound->frames = wave.frames;
+    sound->rate = wave.rate;
+    sound->references = 1;
+
+    mg_mapped_file_close(&file);
+    load->sound = sound;
+    return 0;
+}
+
+static void sound_free(void * p) {
+    mg_audio_sound_release(p);
+}
+
+static void * open_stream(void * data) {
+    stream_open_t * open = data;
+    open->stream = mg_audio_stream_open(open->path, open->rate, open->period, open->buffers,
+                                        open->loop, &open->error, &open->error_number);
+    return 0;
+}
+
+static void stream_free(void * p) {
+    mg_audio_stream_release(p);
+}
@@ -0,0 +1,156 @@
+#ifndef MG_AUDIO_H
+#define MG_AUDIO_H
+
+#include <ruby.h>
+
+/**
+ * Mg::Audio class.
+ */
+extern VALUE mg_audio_class;
+
+/**
+ * Mg::Audio::Sound class.
+ */
+extern VALUE mg_audio_sound_class;
+
+/**
+ * Mg::Audio::Stream class.
+ */
+extern VALUE mg_audio_stream_class;
+
+/**
+ * Allocates an audio object with no mixer.
+ */
+extern VALUE mg_audio_alloc(VALUE klass);
+
+/**
+ * Opens the sink and starts the mixer.
+ *
+ * The sink is one of :alsa, :null or :wav; target is the ALSA device name or
+ * the path of the WAVE file. paced determines whether the null and WAVE sinks
+ * consume frames in real time.
+ */
+extern VALUE mg_audio_start(VALUE self, VALUE sink, VALUE target, VALUE rate,
+                            VALUE period, VALUE voices, VALUE paced);
+
+/**
+ * Starts playing the sound on a new voice and returns the voice identifier,
+ * or nil if the command queue was full.
+ */
+extern VALUE mg_audio_play_sound(VALUE self, VALUE sound, VALUE gain, VALUE pan,
+                                 VALUE rate, VALUE loop);
+
+/**
+ * Opens a file for streaming, decoding the first few periods of it WITHOUT
+ * the GVL. The stream's ring holds the given number of mixer periods.
+ */
+extern VALUE mg_audio_open_stream(VALUE self, VALUE path, VALUE buffers, VALUE loop);
+
+/**
+ * Starts playing the stream on a new voice and returns the voice identifier,
+ * or nil if the command queue was full. Streams can only be played once.
+ */
+extern VALUE mg_audio_play_stream(VALUE self, VALUE stream, VALUE gain, VALUE pan);
+
+/**
+ * Stops the voice.
+ */
+extern VALUE mg_audio_stop(VALUE self, VALUE voice);
+
+/**
+ * Stops every voice.
+ */
+extern VALUE mg_audio_stop_all(VALUE self);
+
+/**
+ * Sets the gain of the voice.
+ */
+extern VALUE mg_audio_set_volume(VALUE self, VALUE voice, VALUE gain);
+
+/**
+ * Sets the stereo position of the voice, from -1 (left) to 1 (right).
+ */
+extern VALUE mg_audio_set_pan(VALUE self, VALUE voice, VALUE pan);
+
+/**
+ * Sets the playback speed of the voice.
+ */
+extern VALUE mg_audio_set_rate(VALUE self, VALUE voice, VALUE rate);
+
+/**
+ * Sets the gain applied to the final mix.
+ */
+extern VALUE mg_audio_set_master_volume(VALUE self, VALUE gain);
+
+/**
+ * Returns whether the voice is still playing.
+ */
+extern VALUE mg_audio_playing(VALUE self, VALUE voice);
+
+/**
+ * Returns the mixer's performance counters in a Hash.
+ */
+extern VALUE mg_audio_stats(VALUE self);
+
+/**
+ * Stops the mixer and closes the sink. Blocks WITHOUT the GVL until the audio
+ * threads finish.
+ */
+extern VALUE mg_audio_close(VALUE self);
+
+/**
+ * Loads a WAVE file into memory, converting it WITHOUT the GVL.
+ */
+extern VALUE mg_audio_sound_load(VALUE klass, VALUE path);
+
+/**
+ * Returns the number of frames in the sound.
+ */
+extern VALUE mg_audio_sound_frames(VALUE self);
+
+/**
+ * Returns the sample rate of the sound.
+ */
+extern VALUE mg_audio_sound_rate(VALUE self);
+
+/**
+ * Returns the number of frames in the streamed file.
+ */
+extern VALUE mg_audio_stream_frames(VALUE self);
+
+/**
+ * Returns the sample rate of the streamed file.
+ */
+extern VALUE mg_audio_stream_rate(VALUE self);
+
+/**
+ * Returns the number of frames decoded ahead of the mixer.
+ */
+extern VALUE mg_audio_stream_buffered(VALUE self);
+
+/**
+ * Returns the number of times the mixer found the stream short of frames.
+ */
+extern VALUE mg_audio_stream_underruns(VALUE self);
+
+/**
+ * Returns the number of bytes allocated for decoding the stream.
+ */
+extern VALUE mg_audio_stream_bytesize(VALUE self);
+
+/**
+ * Returns whether the stream has been played.
+ */
+extern VALUE mg_audio_stream_started(VALUE self);
+
+/**
+ * Returns whether the stream has finished playing.
+ */
+extern VALUE mg_audio_stream_finished(VALUE self);
+
+/**
+ * Initializes the Audio class.
+ */
+extern void init_mg_audio_class_under(VALUE module);
+
+#endif /* MG_AUDIO_H */
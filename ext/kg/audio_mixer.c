@@ -0,0 +1,600 @@
+#include "audio_mixer.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+/* Constant definitions */
+
+/**
+ * Number of commands the queue can hold. Must be a power of two.
+ */
+#define QUEUE_SIZE 256
+
+/**
+ * Number of mixed periods buffered between the mixer and output threads.
+ */
+#define RING_PERIODS 3
+
+/* Data structures */
+
+typedef struct {
+    unsigned int id; /** Voice identifier, zero if the slot is free. */
+    mg_audio_sound * sound;
+    mg_audio_stream * stream; /** Stream played instead of a sound. */
+    double position; /** Current frame, including the fractional part. */
+    double step; /** Frames to advance per output frame. */
+    float gain;
+    float pan;
+    float rate;
+    float left; /** Gain of the left channel, pan applied. */
+    float right; /** Gain of the right channel, pan applied. */
+    int loop;
+} voice_t;
+
+struct mg_audio_mixer {
+    mg_audio_sink * sink;
+    unsigned int rate;
+    unsigned int period;
+    unsigned int voice_count;
+    voice_t * voices;
+    unsigned int * playing; /** Voice identifiers published after each period. */
+    float master_gain;
+    float * mix; /** Mix accumulator; one period of stereo floats. */
+    float * streamed; /** Frames read from a stream; one period of stereo floats. */
+    int16_t * ring; /** RING_PERIODS periods of 16 bit stereo frames. */
+    sem_t free_periods;
+    sem_t mixed_periods;
+    mg_audio_command commands[QUEUE_SIZE];
+    unsigned int command_head; /** Next command to be read by the mixer. */
+    unsigned int command_tail; /** Next slot to be written by the sender. */
+    int running;
+    pthread_t mixer_thread;
+    pthread_t output_thread;
+    mg_audio_statistics stats;
+};
+
+/* Helper function prototypes */
+
+/**
+ * Mixer thread body. Applies queued commands and mixes one period at a time
+ * into the ring.
+ */
+static void * mix(void * data);
+
+/**
+ * Output thread body. Feeds mixed periods from the ring to the sink.
+ */
+static void * output(void * data);
+
+/**
+ * Applies all queued commands.
+ */
+static void apply_commands(mg_audio_mixer * mixer);
+
+/**
+ * Applies one command.
+ */
+static void apply_command(mg_audio_mixer * mixer, mg_audio_command * command);
+
+/**
+ * Finds the voice with the given identifier.
+ */
+static voice_t * find_voice(mg_audio_mixer * mixer, unsigned int id);
+
+/**
+ * Recomputes the channel gains and step of the voice.
+ */
+static void update_voice(mg_audio_mixer * mixer, voice_t * voice);
+
+/**
+ * Stops the voice and frees its slot.
+ */
+static void free_voice(voice_t * voice);
+
+/**
+ * Mixes one period of the voice into the accumulator. Returns zero once the
+ * voice has finished playing.
+ */
+static int mix_voice(voice_t * voice, float * out, unsigned int frames);
+
+/**
+ * Mixes one period of a streaming voice into the accumulator. Returns zero
+ * once the stream has finished playing.
+ */
+static int mix_stream(mg_audio_mixer * mixer, voice_t * voice, float * out, unsigned int frames);
+
+/**
+ * Adds the frames, scaled by the channel gains, to the accumulator.
+ */
+static void mix_frames(float * out, const float * in, size_t frames, float left, float right);
+
+/**
+ * Applies the gain to the samples and converts them to 16 bit integers,
+ * clipping samples that are out of range.
+ */
+static void convert(const float * in, int16_t * out, size_t samples, float gain);
+
+/**
+ * Returns the CPU time consumed by the calling thread, in nanoseconds.
+ */
+static uint64_t thread_time(void);
+
+/**
+ * Waits on the semaphore, retrying when interrupted by signals.
+ */
+static void wait_on(sem_t * semaphore);
+
+/**
+ * Asks for real-time scheduling for the calling thread. Failure is not an
+ * error; it just means the process lacks the privileges.
+ */
+static void request_realtime_priority(void);
+
+/* Audio mixer interface implementation */
+
+mg_audio_mixer * mg_audio_mixer_new(mg_audio_sink * sink,
+                                    unsigned int rate,
+                                    unsigned int period,
+                                    unsigned int voices,
+                                    const char ** error) {
+    mg_audio_mixer * mixer = calloc(1, sizeof(mg_audio_mixer));
+
+    if (mixer == 0 ||
+        (mixer->voices  = calloc(voices, sizeof(voice_t))) == 0 ||
+        (mixer->playing = calloc(voices, sizeof(unsigned int))) == 0 ||
+        (mixer->mix     = calloc((size_t) period * 2, sizeof(float))) == 0 ||
+        (mixer->streamed = calloc((size_t) period * 2, sizeof(float))) == 0 ||
+        (mixer->ring    = calloc((size_t) period * 2 * RING_PERIODS, sizeof(int16_t))) == 0) {
+        *error = "unable to allocate memory for audio mixer";
+        goto fail;
+    }
+
+    mixer->sink = sink;
+    mixer->rate = rate;
+    mixer->period = period;
+    mixer->voice_count = voices;
+    mixer->master_gain = 1.0f;
+    mixer->running = 1;
+
+    sem_init(&mixer->free_periods, 0, RING_PERIODS);
+    sem_init(&mixer->mixed_periods, 0, 0);
+
+    if (pthread_create(&mixer->mixer_thread, 0, mix, mixer) != 0) {
+        *error = "could not start audio mixer thread";
+        goto fail_semaphores;
+    }
+
+    if (pthread_create(&mixer->output_thread, 0, output, mixer) != 0) {
+        __atomic_store_n(&mixer->running, 0, __ATOMIC_RELEASE);
+        sem_post(&mixer->free_periods);
+        pthread_join(mixer->mixer_thread, 0);
+        *error = "could not start audio output thread";
+        goto fail_semaphores;
+    }
+
+    return mixer;
+
+fail_semaphores:
+    sem_destroy(&mixer->free_periods);
+    sem_destroy(&mixer->mixed_periods);
+fail:
+    sink->close(sink);
+    if (mixer) {
+        free(mixer->voices);
+        free(mixer->playing);
+        free(mixer->mix);
+        free(mixer->streamed);
+        free(mixer->ring);
+        free(mixer);
+    }
+    return 0;
+}
+
+int mg_audio_mixer_send(mg_audio_mixer * mixer, const mg_audio_command * command) {
+    unsigned int tail = mixer->command_tail;
+    unsigned int head = __atomic_load_n(&mixer->command_head, __ATOMIC_ACQUIRE);
+
+    /* Queue is full */
+    if (tail - head == QUEUE_SIZE) {
+        __atomic_add_fetch(&mixer->stats.dropped_commands, 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+
+    mixer->commands[tail & (QUEUE_SIZE - 1)] = *command;
+
+    /* Publish the command */
+    __atomic_store_n(&mixer->command_tail, tail + 1, __ATOMIC_RELEASE);
+    return 1;
+}
+
+int mg_audio_mixer_playing(mg_audio_mixer * mixer, unsigned int voice) {
+    unsigned int i;
+    for (i = 0; i < mixer->voice_count; ++i) {
+        if (__atomic_load_n(&mixer->playing[i], __ATOMIC_RELAXED) == voice) { return 1; }
+    }
+    return 0;
+}
+
+void mg_audio_mixer_stats(mg_audio_mixer * mixer, mg_audio_statistics * stats) {
+    stats->buffers          = __atomic_load_n(&mixer->stats.buffers,          __ATOMIC_RELAXED);
+    stats->mix_time_total   = __atomic_load_n(&mixer->stats.mix_time_total,   __ATOMIC_RELAXED);
+    stats->mix_time_max     = __atomic_load_n(&mixer->stats.mix_time_max,     __ATOMIC_RELAXED);
+    stats->mix_time_last    = __atomic_load_n(&mixer->stats.mix_time_last,    __ATOMIC_RELAXED);
+    stats->dropped_commands = __atomic_load_n(&mixer->stats.dropped_commands, __ATOMIC_RELAXED);
+    stats->active_voices    = __atomic_load_n(&mixer->stats.active_voices,    __ATOMIC_RELAXED);
+    stats->underruns        = __atomic_load_n(&mixer->sink->underruns,        __ATOMIC_RELAXED);
+    stats->stream_underruns = __atomic_load_n(&mixer->stats.stream_underruns, __ATOMIC_RELAXED);
+}
+
+void mg_audio_mixer_free(mg_audio_mixer * mixer) {
+    unsigned int i;
+
+    /* Stop both threads, waking them up in case they're waiting on each other */
+    __atomic_store_n(&mixer->running, 0, __ATOMIC_RELEASE);
+    sem_post(&mixer->free_periods);
+    sem_post(&mixer->mixed_periods);
+    pthread_join(mixer->mixer_thread, 0);
+    pthread_join(mixer->output_thread, 0);
+
+    mixer->sink->close(mixer->sink);
+
+    /* Release the sounds of playing voices and of commands never applied */
+    for (i = 0; i < mixer->voice_count; ++i) {
+        if (mixer->voices[i].id) { free_voice(&mixer->voices[i]); }
+    }
+    for (i = mixer->command_head; i != mixer->command_tail; ++i) {
+        mg_audio_command * command = &mixer->commands[i & (QUEUE_SIZE - 1)];
+        if (command->sound) { mg_audio_sound_release(command->sound); }
+        if (command->stream) { mg_audio_stream_finish(command->stream); }
+    }
+
+    sem_destroy(&mixer->free_periods);
+    sem_destroy(&mixer->mixed_periods);
+    free(mixer->voices);
+    free(mixer->playing);
+    free(mixer->mix);
+    free(mixer->streamed);
+    free(mixer->ring);
+    free(mixer);
+}
+
+mg_audio_sound * mg_audio_sound_retain(mg_audio_sound * sound) {
+    __atomic_add_fetch(&sound->references, 1, __ATOMIC_RELAXED);
+    return sound;
+}
+
+void mg_audio_sound_release(mg_audio_sound * sound) {
+    if (__atomic_sub_fetch(&sound->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        free(sound->samples);
+        free(sound);
+    }
+}
+
+/* Helper function implementation */
+
+static void * mix(void * data) {
+    mg_audio_mixer * mixer = data;
+    unsigned int slot = 0, i, active;
+    uint64_t start, elapsed;
+
+    request_realtime_priority();
+
+    for (;;) {
+        /* Wait for the output thread to free a period */
+        wait_on(&mixer->free_periods);
+
+        if (!__atomic_load_n(&mixer->running, __ATOMIC_ACQUIRE)) { break; }
+
+        start = thread_time();
+
+        apply_commands(mixer);
+
+        memset(mixer->mix, 0, (size_t) mixer->period * 2 * sizeof(float));
+
+        for (i = 0, active = 0; i < mixer->voice_count; ++i) {
+            voice_t * voice = &mixer->voices[i];
+
+            if (voice->id && (voice->stream ? mix_stream(mixer, voice, mixer->mix, mixer->period)
+                                            : mix_voice(voice, mixer->mix, mixer->period))) {
+                ++active;
+            } else if (voice->id) {
+                /* The voice finished; free its slot */
+                free_voice(voice);
+            }
+
+            __atomic_store_n(&mixer->playing[i], voice->id, __ATOMIC_RELAXED);
+        }
+
+        convert(mixer->mix, mixer->ring + (size_t) slot * mixer->period * 2,
+                (size_t) mixer->period * 2, mixer->master_gain);
+
+        elapsed = thread_time() - start;
+
+        /* Update the counters */
+        __atomic_store_n(&mixer->stats.mix_time_last, elapsed, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mixer->stats.mix_time_total, elapsed, __ATOMIC_RELAXED);
+        if (elapsed > mixer->stats.mix_time_max) {
+            __atomic_store_n(&mixer->stats.mix_time_max, elapsed, __ATOMIC_RELAXED);
+        }
+        __atomic_store_n(&mixer->stats.active_voices, active, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&mixer->stats.buffers, 1, __ATOMIC_RELAXED);
+
+        /* Hand the period to the output thread */
+        slot = (slot + 1) % RING_PERIODS;
+        sem_post(&mixer->mixed_periods);
+    }
+
+    return 0;
+}
+
+static void * output(void * data) {
+    mg_audio_mixer * mixer = data;
+    unsigned int slot = 0;
+    int sink_ok = 1;
+
+    request_realtime_priority();
+
+    for (;;) {
+        /* Wait for the mixer to produce a period */
+        wait_on(&mixer->mixed_periods);
+
+        if (!__atomic_load_n(&mixer->running, __ATOMIC_ACQUIRE)) { break; }
+
+        /* A failed sink keeps draining the ring so the mixer doesn't stall */
+        if (sink_ok) {
+            sink_ok = mixer->sink->write(mixer->sink,
+                                         mixer->ring + (size_t) slot * mixer->period * 2,
+                                         mixer->period);
+        }
+
+        slot = (slot + 1) % RING_PERIODS;
+        sem_post(&mixer->free_periods);
+    }
+
+    return 0;
+}
+
+static void apply_commands(mg_audio_mixer * mixer) {
+    unsigned int head = mixer->command_head;
+    unsigned int tail = __atomic_load_n(&mixer->command_tail, __ATOMIC_ACQUIRE);
+
+    for (; head != tail; ++head) {
+        apply_command(mixer, &mixer->commands[head & (QUEUE_SIZE - 1)]);
+    }
+
+    /* Give the slots back to the sender */
+    __atomic_store_n(&mixer->command_head, head, __ATOMIC_RELEASE);
+}
+
+static void apply_command(mg_audio_mixer * mixer, mg_audio_command * command) {
+    voice_t * voice;
+    unsigned int i;
+
+    switch (command->type) {
+        case MG_AUDIO_COMMAND_PLAY: {
+            /* Find a free voice; the sound is dropped if there is none */
+            voice = find_voice(mixer, 0);
+            if (voice == 0) {
+                if (command->sound) { mg_audio_sound_release(command->sound); }
+                if (command->stream) { mg_audio_stream_finish(command->stream); }
+                break;
+            }
+            voice->id = command->voice;
+            voice->sound = command->sound;
+            voice->stream = command->stream;
+            voice->position = 0;
+            voice->gain = command->gain;
+            voice->pan = command->pan;
+            voice->rate = command->rate;
+            voice->loop = command->loop;
+            update_voice(mixer, voice);
+            break;
+        }
+        case MG_AUDIO_COMMAND_STOP: {
+            if ((voice = find_voice(mixer, command->voice))) {
+                free_voice(voice);
+            }
+            break;
+        }
+        case MG_AUDIO_COMMAND_STOP_ALL: {
+            for (i = 0; i < mixer->voice_count; ++i) {
+                voice = &mixer->voices[i];
+                if (voice->id) { free_voice(voice); }
+            }
+            break;
+        }
+        case MG_AUDIO_COMMAND_GAIN: {
+            if ((voice = find_voice(mixer, command->voice))) {
+                voice->gain = command->gain;
+                update_voice(mixer, voice);
+            }
+            break;
+        }
+        case MG_AUDIO_COMMAND_PAN: {
+            if ((voice = find_voice(mixer, command->voice))) {
+                voice->pan = command->pan;
+                update_voice(mixer, voice);
+            }
+            break;
+        }
+        case MG_AUDIO_COMMAND_RATE: {
+            if ((voice = find_voice(mixer, command->voice))) {
+                voice->rate = command->rate;
+                update_voice(mixer, voice);
+            }
+            break;
+        }
+        case MG_AUDIO_COMMAND_MASTER_GAIN: {
+            mixer->master_gain = command->gain;
+            break;
+        }
+    }
+}
+
+static voice_t * find_voice(mg_audio_mixer * mixer, unsigned int id) {
+    unsigned int i;
+    for (i = 0; i < mixer->voice_count; ++i) {
+        if (mixer->voices[i].id == id) { return &mixer->voices[i]; }
+    }
+    return 0;
+}
+
+static void update_voice(mg_audio_mixer * mixer, voice_t * voice) {
+    /* Constant power panning */
+    float angle = (voice->pan + 1.0f) * (float) M_PI / 4.0f;
+    voice->left  = voice->gain * cosf(angle);
+    voice->right = voice->gain * sinf(angle);
+    /* Streams are converted to the mixer's rate as they are decoded */
+    if (voice->sound) {
+        voice->step = (double) voice->sound->rate / mixer->rate * voice->rate;
+    }
+}
+
+static void free_voice(voice_t * voice) {
+    if (voice->sound) { mg_audio_sound_release(voice->sound); }
+    if (voice->stream) { mg_audio_stream_finish(voice->stream); }
+    voice->sound = 0;
+    voice->stream = 0;
+    voice->id = 0;
+}
+
+static int mix_voice(voice_t * voice, float * out, unsigned int frames) {
+    const mg_audio_sound * sound = voice->sound;
+    const float * samples = sound->samples;
+    unsigned int i;
+
+    if (sound->frames == 0) { return 0; }
+
+    /* Playing at the sound's own rate from a whole frame: no resampling */
+    if (voice->step == 1.0 && voice->position == (double) (size_t) voice->position) {
+        size_t position = (size_t) voice->position, done = 0;
+
+        while (done < frames) {
+            size_t count = sound->frames - position;
+            if (count > frames - done) { count = frames - done; }
+
+            mix_frames(out + done * 2, samples + position * 2, count, voice->left, voice->right);
+            position += count;
+            done += count;
+
+            if (position >= sound->frames) {
+                if (!voice->loop) { return 0; }
+                position = 0;
+            }
+        }
+
+        voice->position = (double) position;
+        return 1;
+    }
+
+    /* Linear interpolation between neighbouring frames */
+    for (i = 0; i < frames; ++i, out += 2) {
+        size_t index, next;
+        float fraction, l, r;
+
+        if (voice->position >= (double) sound->frames) {
+            if (!voice->loop) { return 0; }
+            voice->position -= (double) sound->frames;
+        }
+
+        index = (size_t) voice->position;
+        next = index + 1 < sound->frames ? index + 1 : (voice->loop ? 0 : index);
+        fraction = (float) (voice->position - (double) index);
+
+        l = samples[index * 2]     + (samples[next * 2]     - samples[index * 2])     * fraction;
+        r = samples[index * 2 + 1] + (samples[next * 2 + 1] - samples[index * 2 + 1]) * fraction;
+
+        out[0] += l * voice->left;
+        out[1] += r * voice->right;
+
+        voice->position += voice->step;
+    }
+
+    return 1;
+}
+
+static int mix_stream(mg_audio_mixer * mixer, voice_t * voice, float * out, unsigned int frames) {
+    int finished, underrun;
+    size_t count = mg_audio_stream_read(voice->stream, mixer->streamed, frames,
+                                        &finished, &underrun);
+
+    if (finished) { return 0; }
+
+    /* Frames that didn't arrive in time are left silent */
+    if (underrun) {
+        __atomic_add_fetch(&mixer->stats.stream_underruns, 1, __ATOMIC_RELAXED);
+    }
+
+    mix_frames(out, mixer->streamed, count, voice->left, voice->right);
+    return 1;
+}
+
+static void mix_frames(float * out, const float * in, size_t frames, float left, float right) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    /* Two stereo frames per vector */
+    __m128 gain = _mm_setr_ps(left, right, left, right);
+    for (; i + 2 <= frames; i += 2) {
+        __m128 o = _mm_loadu_ps(out + i * 2);
+        __m128 s = _mm_loadu_ps(in + i * 2);
+        _mm_storeu_ps(out + i * 2, _mm_add_ps(o, _mm_mul_ps(s, gain)));
+    }
+#endif
+
+    for (; i < frames; ++i) {
+        out[i * 2]     += in[i * 2]     * left;
+        out[i * 2 + 1] += in[i * 2 + 1] * right;
+    }
+}
+
+static void convert(const float * in, int16_t * out, size_t samples, float gain) {
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    /* Eight samples per iteration; packing saturates to the 16 bit range */
+    __m128 scale = _mm_set1_ps(gain * 32767.0f);
+    __m128 min = _mm_set1_ps(-32768.0f), max = _mm_set1_ps(32767.0f);
+    for (; i + 8 <= samples; i += 8) {
+        __m128 a = _mm_mul_ps(_mm_loadu_ps(in + i),     scale);
+        __m128 b = _mm_mul_ps(_mm_loadu_ps(in + i + 4), scale);
+        a = _mm_min_ps(_mm_max_ps(a, min), max);
+        b = _mm_min_ps(_mm_max_ps(b, min), max);
+        _mm_storeu_si128((__m128i *) (out + i),
+                         _mm_packs_epi32(_mm_cvtps_epi32(a), _mm_cvtps_epi32(b)));
+    }
+#endif
+
+    for (; i < samples; ++i) {
+        float v = in[i] * gain * 32767.0f;
+        if (v >  32767.0f) { v =  32767.0f; }
+        if (v < -32768.0f) { v = -32768.0f; }
+        out[i] = (int16_t) lrintf(v);
+    }
+}
+
+static uint64_t thread_time(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void wait_on(sem_t * semaphore) {
+    while (sem_wait(semaphore) != 0 && errno == EINTR);
+}
+
+static void request_realtime_priority(void) {
+    struct sched_param parameters;
+    parameters.sched_priority = sched_get_priority_min(SCHED_FIFO);
+    pthread_setschedparam(pthread_self(), SCHED_FIFO, &parameters);
+}
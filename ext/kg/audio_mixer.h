@@ -0,0 +1,119 @@
+#ifndef MG_AUDIO_MIXER_H
+#define MG_AUDIO_MIXER_H
+
+#include "audio_sink.h"
+#include "audio_stream.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Sound held entirely in memory as interleaved stereo floats. Reference
+ * counted, since voices keep playing sounds alive.
+ */
+typedef struct {
+    float * samples; /** frames * 2 samples. */
+    size_t frames; /** Number of stereo frames. */
+    unsigned int rate; /** Frames per second. */
+    unsigned int references; /** Updated atomically. */
+} mg_audio_sound;
+
+/**
+ * Kinds of commands understood by the mixer.
+ */
+typedef enum {
+    MG_AUDIO_COMMAND_PLAY,
+    MG_AUDIO_COMMAND_STOP,
+    MG_AUDIO_COMMAND_STOP_ALL,
+    MG_AUDIO_COMMAND_GAIN,
+    MG_AUDIO_COMMAND_PAN,
+    MG_AUDIO_COMMAND_RATE,
+    MG_AUDIO_COMMAND_MASTER_GAIN
+} mg_audio_command_type;
+
+/**
+ * Command sent to the mixer thread.
+ */
+typedef struct {
+    mg_audio_command_type type;
+    unsigned int voice; /** Identifier of the voice the command applies to. */
+    mg_audio_sound * sound; /** Sound to play; the command owns a reference. */
+    mg_audio_stream * stream; /** Stream to play instead of a sound. */
+    float gain; /** Linear gain. */
+    float pan; /** Stereo position, -1 (left) to 1 (right). */
+    float rate; /** Playback speed, 1 being the sound's own rate. */
+    int loop; /** Whether the sound loops. */
+} mg_audio_command;
+
+/**
+ * Mixer performance counters.
+ */
+typedef struct {
+    uint64_t buffers; /** Periods mixed so far. */
+    uint64_t mix_time_total; /** Thread CPU time spent mixing, in nanoseconds. */
+    uint64_t mix_time_max; /** Longest time spent mixing one period. */
+    uint64_t mix_time_last; /** Time spent mixing the last period. */
+    uint64_t dropped_commands; /** Commands rejected because the queue was full. */
+    unsigned long underruns; /** Underruns reported by the sink. */
+    uint64_t stream_underruns; /** Periods in which a stream was short of frames. */
+    unsigned int active_voices; /** Voices that were playing in the last period. */
+} mg_audio_statistics;
+
+/**
+ * Real-time mixer. Mixes voices on its own thread and hands the result to an
+ * output thread that feeds the sink; neither thread ever takes the Ruby GVL.
+ */
+typedef struct mg_audio_mixer mg_audio_mixer;
+
+/**
+ * Starts a mixer that mixes up to the given number of voices, one period of
+ * frames at a time, and feeds the sink, which it takes ownership of.
+ *
+ * Returns zero and sets the error message on failure; the sink is closed.
+ */
+extern mg_audio_mixer * mg_audio_mixer_new(mg_audio_sink * sink,
+                                           unsigned int rate,
+                                           unsigned int period,
+                                           unsigned int voices,
+                                           const char ** error);
+
+/**
+ * Queues a command for the mixer thread without locking. Commands must be
+ * sent from one thread at a time.
+ *
+ * Returns a non-zero value if the command was queued, zero if the queue was
+ * full; in that case the caller keeps ownership of the command's sound.
+ *
+ * Streams played by the mixer are marked finished once the mixer is done with
+ * them, even if the command is never applied.
+ */
+extern int mg_audio_mixer_send(mg_audio_mixer * mixer, const mg_audio_command * command);
+
+/**
+ * Returns whether the voice with the given identifier is still playing, as of
+ * the last mixed period.
+ */
+extern int mg_audio_mixer_playing(mg_audio_mixer * mixer, unsigned int voice);
+
+/**
+ * Copies the mixer's performance counters.
+ */
+extern void mg_audio_mixer_stats(mg_audio_mixer * mixer, mg_audio_statistics * stats);
+
+/**
+ * Stops the mixer and output threads, closes the sink and frees the mixer.
+ * Blocks until the threads finish.
+ */
+extern void mg_audio_mixer_free(mg_audio_mixer * mixer);
+
+/**
+ * Acquires a reference to the sound.
+ */
+extern mg_audio_sound * mg_audio_sound_retain(mg_audio_sound * sound);
+
+/**
+ * Releases a reference to the sound, freeing it when none are left.
+ */
+extern void mg_audio_sound_release(mg_audio_sound * sound);
+
+#endif /* MG_AUDIO_MIXER_H */
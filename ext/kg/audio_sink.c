@@ -0,0 +1,210 @@
+#include "audio_sink.h"
+
+#include "wave.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#if defined(MG_HAVE_ALSA)
+    #include <alsa/asoundlib.h>
+#endif
+
+/* Data structures */
+
+/**
+ * Keeps writes in step with the wall clock.
+ */
+typedef struct {
+    unsigned int rate;
+    int paced;
+    int started;
+    struct timespec deadline;
+} pacer_t;
+
+typedef struct {
+    mg_audio_sink sink;
+    pacer_t pacer;
+} null_sink_t;
+
+typedef struct {
+    mg_audio_sink sink;
+    pacer_t pacer;
+    FILE * file;
+    unsigned long frames;
+} wav_sink_t;
+
+/* Helper function prototypes */
+
+/**
+ * Blocks until the given number of frames would have finished playing.
+ */
+static void pace(pacer_t * pacer, unsigned int count);
+
+static int null_write(mg_audio_sink * sink, const int16_t * frames, unsigned int count);
+static void null_close(mg_audio_sink * sink);
+static int wav_write(mg_audio_sink * sink, const int16_t * frames, unsigned int count);
+static void wav_close(mg_audio_sink * sink);
+
+/* Audio sink interface implementation */
+
+mg_audio_sink * mg_audio_sink_open_null(unsigned int rate, int paced) {
+    null_sink_t * s = calloc(1, sizeof(null_sink_t));
+    if (s == 0) { return 0; }
+    s->sink.write = null_write;
+    s->sink.close = null_close;
+    s->pacer.rate = rate;
+    s->pacer.paced = paced;
+    return &s->sink;
+}
+
+mg_audio_sink * mg_audio_sink_open_wav(const char * path, unsigned int rate, int paced) {
+    unsigned char header[MG_WAVE_HEADER_SIZE];
+    wav_sink_t * s = calloc(1, sizeof(wav_sink_t));
+
+    if (s == 0) { return 0; }
+
+    s->file = fopen(path, "wb");
+
+    if (s->file == 0) {
+        free(s);
+        return 0;
+    }
+
+    /* Reserve room for the header; it's rewritten with the real size on close */
+    mg_wave_write_header(header, rate, 0);
+    fwrite(header, 1, sizeof(header), s->file);
+
+    s->sink.write = wav_write;
+    s->sink.close = wav_close;
+    s->pacer.rate = rate;
+    s->pacer.paced = paced;
+    return &s->sink;
+}
+
+/* Helper function implementation */
+
+static void pace(pacer_t * pacer, unsigned int count) {
+    struct timespec now;
+
+    if (!pacer->paced) { return; }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    /* Start over if this is the first write or we fell far behind */
+    if (!pacer->started || now.tv_sec > pacer->deadline.tv_sec + 1) {
+        pacer->deadline = now;
+        pacer->started = 1;
+    }
+
+    pacer->deadline.tv_nsec += (long) ((unsigned long long) count * 1000000000ULL / pacer->rate);
+    while (pacer->deadline.tv_nsec >= 1000000000L) {
+        pacer->deadline.tv_nsec -= 1000000000L;
+        ++pacer->deadline.tv_sec;
+    }
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &pacer->deadline, 0) == EINTR);
+}
+
+static int null_write(mg_audio_sink * sink, const int16_t * frames, unsigned int count) {
+    null_sink_t * s = (null_sink_t *) sink;
+    pace(&s->pacer, count);
+    return 1;
+}
+
+static void null_close(mg_audio_sink * sink) {
+    free(sink);
+}
+
+static int wav_write(mg_audio_sink * sink, const int16_t * frames, unsigned int count) {
+    wav_sink_t * s = (wav_sink_t *) sink;
+
+    /* WAVE data is little endian, like the hosts Mg runs on */
+    if (fwrite(frames, 4, count, s->file) != count) { return 0; }
+
+    s->frames += count;
+    pace(&s->pacer, count);
+    return 1;
+}
+
+static void wav_close(mg_audio_sink * sink) {
+    wav_sink_t * s = (wav_sink_t *) sink;
+    unsigned char header[MG_WAVE_HEADER_SIZE];
+
+    mg_wave_write_header(header, s->pacer.rate, (uint32_t) s->frames);
+
+    if (fseek(s->file, 0, SEEK_SET) == 0) {
+        fwrite(header, 1, sizeof(header), s->file);
+    }
+
+    fclose(s->file);
+    free(s);
+}
+
+#if defined(MG_HAVE_ALSA)
+
+typedef struct {
+    mg_audio_sink sink;
+    snd_pcm_t * pcm;
+} alsa_sink_t;
+
+static int alsa_write(mg_audio_sink * sink, const int16_t * frames, unsigned int count) {
+    alsa_sink_t * s = (alsa_sink_t *) sink;
+
+    while (count > 0) {
+        snd_pcm_sframes_t written = snd_pcm_writei(s->pcm, frames, count);
+
+        if (written < 0) {
+            /* The device ran dry; count it and start it again */
+            if (written == -EPIPE) { ++sink->underruns; }
+            if (snd_pcm_recover(s->pcm, (int) written, 1) < 0) { return 0; }
+            continue;
+        }
+
+        frames += written * 2;
+        count -= written;
+    }
+
+    return 1;
+}
+
+static void alsa_close(mg_audio_sink * sink) {
+    alsa_sink_t * s = (alsa_sink_t *) sink;
+    snd_pcm_drain(s->pcm);
+    snd_pcm_close(s->pcm);
+    free(s);
+}
+
+mg_audio_sink * mg_audio_sink_open_alsa(const char * device, unsigned int rate,
+                                        unsigned int period, unsigned int periods) {
+    alsa_sink_t * s = calloc(1, sizeof(alsa_sink_t));
+    unsigned int latency = (unsigned int) ((unsigned long long) period * periods * 1000000ULL / rate);
+
+    if (s == 0) { return 0; }
+
+    if (snd_pcm_open(&s->pcm, device, SND_PCM_STREAM_PLAYBACK, 0) < 0) {
+        free(s);
+        return 0;
+    }
+
+    if (snd_pcm_set_params(s->pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED,
+                           2, rate, 1, latency) < 0) {
+        snd_pcm_close(s->pcm);
+        free(s);
+        return 0;
+    }
+
+    s->sink.write = alsa_write;
+    s->sink.close = alsa_close;
+    return &s->sink;
+}
+
+#else
+
+mg_audio_sink * mg_audio_sink_open_alsa(const char * device, unsigned int rate,
+                                        unsigned int period, unsigned int periods) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef MG_AUDIO_SINK_H
+#define MG_AUDIO_SINK_H
+
+#include <stdint.h>
+
+/**
+ * Destination of the mixer's output. Sinks consume interleaved 16 bit stereo
+ * frames and are driven from the audio output thread, WITHOUT the Ruby GVL.
+ */
+typedef struct mg_audio_sink {
+    /**
+     * Plays the frames, blocking until the sink can accept more. Returns a
+     * non-zero value on success, zero if the sink failed for good.
+     */
+    int (*write)(struct mg_audio_sink * sink, const int16_t * frames, unsigned int count);
+
+    /**
+     * Flushes and closes the sink and frees it.
+     */
+    void (*close)(struct mg_audio_sink * sink);
+
+    unsigned long underruns; /** Times the device ran out of frames to play. */
+} mg_audio_sink;
+
+/**
+ * Opens a sink that discards its input. If paced is non-zero, writes block as
+ * long as playing the frames would take, just like a real device.
+ */
+extern mg_audio_sink * mg_audio_sink_open_null(unsigned int rate, int paced);
+
+/**
+ * Opens a sink that writes a 16 bit stereo WAVE file at the given path. If
+ * paced is non-zero, writes block as long as playing the frames would take.
+ */
+extern mg_audio_sink * mg_audio_sink_open_wav(const char * path, unsigned int rate, int paced);
+
+/**
+ * Opens the named ALSA playback device with a buffer of the given number of
+ * periods. Returns zero if ALSA support was not compiled in or the device
+ * could not be configured.
+ */
+extern mg_audio_sink * mg_audio_sink_open_alsa(const char * device, unsigned int rate,
+                                               unsigned int period, unsigned int periods);
+
+#endif /* MG_AUDIO_SINK_H */
@@ -0,0 +1,532 @@
+#include "audio_stream.h"
+
+#include "mapped_file.h"
+#include "qoa.h"
+#include "wave.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <time.h>
+
+/* Data structures */
+
+typedef enum {
+    STREAM_IDLE,
+    STREAM_PLAYING,
+    STREAM_FINISHED
+} stream_state_t;
+
+typedef enum {
+    CODEC_WAVE,
+    CODEC_QOA
+} codec_t;
+
+struct mg_audio_stream {
+    mg_mapped_file file;
+    codec_t codec;
+    mg_wave wave;
+    mg_qoa qoa;
+    size_t position; /** Next WAVE frame or byte offset of the next QOA frame. */
+    size_t discarded; /** Bytes at the start of the file dropped from memory. */
+    size_t frames; /** Frames in the file. */
+    unsigned int rate; /** Sample rate of the file. */
+    unsigned int chunk; /** Frames decoded at a time; one mixer period. */
+    int loop;
+
+    /* Decoded frames at the file's rate, not yet resampled */
+    float * source;
+    size_t source_frames;
+    size_t source_position;
+    int16_t * scratch; /** Decoded QOA frame. */
+
+    /* Linear resampler state */
+    double step; /** Source frames per output frame. */
+    double phase; /** Position between the current and next frames. */
+    float current[2];
+    float next[2];
+    int primed;
+    int exhausted; /** No more source frames. */
+
+    /* Ring of resampled frames, written by the streamer and read by the mixer */
+    float * ring;
+    size_t capacity; /** Frames the ring holds. */
+    size_t written; /** Frames written so far, updated atomically. */
+    size_t consumed; /** Frames read so far, updated atomically. */
+    int ended; /** Set once the last frame has been written. */
+
+    int state; /** stream_state_t, updated atomically. */
+    unsigned long underruns;
+    unsigned int references;
+    sem_t * wake; /** Streamer to notify after frames are consumed. */
+};
+
+struct mg_audio_streamer {
+    pthread_t thread;
+    pthread_mutex_t lock; /** Protects the pending list. */
+    sem_t wake;
+    long interval; /** Longest time between refills, in nanoseconds. */
+    int running;
+    mg_audio_stream ** streams; /** Streams owned by the streamer thread. */
+    size_t count;
+    size_t allocated;
+    mg_audio_stream ** pending; /** Streams waiting to be picked up. */
+    size_t pending_count;
+    size_t pending_allocated;
+};
+
+/* Helper function prototypes */
+
+/**
+ * Streamer thread body. Tops up the rings of all streams whenever the mixer
+ * consumes frames, dropping streams that are no longer needed.
+ */
+static void * decode_ahead(void * data);
+
+/**
+ * Decodes and resamples frames into the ring until it's full or the end of the
+ * stream is reached.
+ */
+static void fill(mg_audio_stream * stream);
+
+/**
+ * Produces up to count resampled frames. Returns fewer only at the end.
+ */
+static size_t resample(mg_audio_stream * stream, float * output, size_t count);
+
+/**
+ * Fetches the next source frame, decoding another chunk if needed and
+ * rewinding looping streams. Returns zero at the end.
+ */
+static int pull(mg_audio_stream * stream, float frame[2]);
+
+/**
+ * Decodes the next chunk of the file into the source buffer. Returns zero at
+ * the end of the file.
+ */
+static int decode(mg_audio_stream * stream);
+
+/**
+ * Appends an item to a growable array of streams.
+ */
+static int append(mg_audio_stream *** array, size_t * count, size_t * allocated,
+                  mg_audio_stream * stream);
+
+/**
+ * Returns whether the streamer can drop the stream: either the mixer is done
+ * with it or it was never played and only the streamer references it.
+ */
+static int droppable(mg_audio_stream * stream);
+
+/* Audio stream interface implementation */
+
+mg_audio_stream * mg_audio_stream_open(const char * path,
+                                       unsigned int rate,
+                                       unsigned int period,
+                                       unsigned int buffers,
+                                       int loop,
+                                       const char ** error,
+                                       int * error_number) {
+    mg_audio_stream * stream = calloc(1, sizeof(mg_audio_stream));
+    size_t source_capacity;
+
+    if (stream == 0) {
+        *error = "unable to allocate memory for audio stream";
+        return 0;
+    }
+
+    if (!mg_mapped_file_open_sequential(&stream->file, path)) {
+        *error = "could not map audio stream file";
+        *error_number = errno ? errno : EINVAL;
+        free(stream);
+        return 0;
+    }
+
+    /* Recognize the codec */
+    if (stream->file.size >= 4 && memcmp(stream->file.data, "qoaf", 4) == 0) {
+        stream->codec = CODEC_QOA;
+        *error = mg_qoa_parse(stream->file.data, stream->file.size, &stream->qoa);
+        stream->frames = stream->qoa.samples;
+        stream->rate = stream->qoa.rate;
+        stream->position = MG_QOA_FILE_HEADER_SIZE;
+        source_capacity = MG_QOA_FRAME_SAMPLES;
+    } else {
+        stream->codec = CODEC_WAVE;
+        *error = mg_wave_parse(stream->file.data, stream->file.size, &stream->wave);
+        stream->frames = stream->wave.frames;
+        stream->rate = stream->wave.rate;
+        source_capacity = period;
+    }
+
+    if (*error) {
+        mg_mapped_file_close(&stream->file);
+        free(stream);
+        return 0;
+    }
+
+    stream->chunk = period;
+    stream->loop = loop;
+    stream->step = (double) stream->rate / rate;
+    stream->capacity = (size_t) period * buffers;
+    stream->references = 1;
+
+    if ((stream->source = malloc(source_capacity * 2 * sizeof(float))) == 0 ||
+        (stream->ring = malloc(stream->capacity * 2 * sizeof(float))) == 0 ||
+        (stream->codec == CODEC_QOA &&
+         (stream->scratch = malloc((size_t) MG_QOA_FRAME_SAMPLES * stream->qoa.channels *
+                                   sizeof(int16_t))) == 0)) {
+        *error = "unable to allocate memory for audio stream";
+        mg_audio_stream_release(stream);
+        return 0;
+    }
+
+    /* Decode ahead so playback starts without waiting for the streamer */
+    fill(stream);
+    return stream;
+}
+
+int mg_audio_stream_start(mg_audio_stream * stream) {
+    int expected = STREAM_IDLE;
+    return __atomic_compare_exchange_n(&stream->state, &expected, STREAM_PLAYING, 0,
+                                       __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+void mg_audio_stream_cancel(mg_audio_stream * stream) {
+    __atomic_store_n(&stream->state, STREAM_IDLE, __ATOMIC_RELEASE);
+}
+
+void mg_audio_stream_finish(mg_audio_stream * stream) {
+    __atomic_store_n(&stream->state, STREAM_FINISHED, __ATOMIC_RELEASE);
+    if (stream->wake) { sem_post(stream->wake); }
+}
+
+size_t mg_audio_stream_read(mg_audio_stream * stream, float * output,
+                            size_t count, int * finished, int * underrun) {
+    size_t consumed = stream->consumed;
+    size_t written = __atomic_load_n(&stream->written, __ATOMIC_ACQUIRE);
+    size_t available = written - consumed, offset, first;
+
+    *finished = 0;
+    *underrun = 0;
+
+    if (available < count) {
+        if (__atomic_load_n(&stream->ended, __ATOMIC_ACQUIRE) &&
+            written == __atomic_load_n(&stream->written, __ATOMIC_ACQUIRE)) {
+            /* Everything was written; whatever is left is the tail */
+            *finished = available == 0;
+        } else {
+            /* The streamer fell behind */
+            *underrun = 1;
+            __atomic_add_fetch(&stream->underruns, 1, __ATOMIC_RELAXED);
+        }
+        count = available;
+    }
+
+    /* Copy the frames, which may wrap around the end of the ring */
+    offset = consumed % stream->capacity;
+    first = stream->capacity - offset;
+    if (first > count) { first = count; }
+    memcpy(output, stream->ring + offset * 2, first * 2 * sizeof(float));
+    memcpy(output + first * 2, stream->ring, (count - first) * 2 * sizeof(float));
+
+    /* Give the space back to the streamer */
+    __atomic_store_n(&stream->consumed, consumed + count, __ATOMIC_RELEASE);
+    if (count > 0 && stream->wake) { sem_post(stream->wake); }
+
+    return count;
+}
+
+void mg_audio_stream_stats(mg_audio_stream * stream, mg_audio_stream_statistics * stats) {
+    int state;
+
+    stats->frames = stream->frames;
+    stats->rate = stream->rate;
+    stats->buffered = __atomic_load_n(&stream->written, __ATOMIC_ACQUIRE) -
+                      __atomic_load_n(&stream->consumed, __ATOMIC_ACQUIRE);
+    stats->underruns = __atomic_load_n(&stream->underruns, __ATOMIC_RELAXED);
+    state = __atomic_load_n(&stream->state, __ATOMIC_ACQUIRE);
+    stats->started = state != STREAM_IDLE;
+    stats->finished = state == STREAM_FINISHED;
+
+    /* The ring and the decoding buffers; the mapping is paged in and out */
+    stats->bytesize = sizeof(mg_audio_stream) + stream->capacity * 2 * sizeof(float);
+    if (stream->codec == CODEC_QOA) {
+        stats->bytesize += (size_t) MG_QOA_FRAME_SAMPLES * 2 * sizeof(float);
+        stats->bytesize += (size_t) MG_QOA_FRAME_SAMPLES * stream->qoa.channels * sizeof(int16_t);
+    } else {
+        stats->bytesize += (size_t) stream->chunk * 2 * sizeof(float);
+    }
+}
+
+void mg_audio_stream_release(mg_audio_stream * stream) {
+    if (__atomic_sub_fetch(&stream->references, 1, __ATOMIC_ACQ_REL) == 0) {
+        mg_mapped_file_close(&stream->file);
+        free(stream->source);
+        free(stream->scratch);
+        free(stream->ring);
+        free(stream);
+    }
+}
+
+/* Audio streamer interface implementation */
+
+mg_audio_streamer * mg_audio_streamer_new(unsigned int rate, unsigned int period) {
+    mg_audio_streamer * streamer = calloc(1, sizeof(mg_audio_streamer));
+
+    if (streamer == 0) { return 0; }
+
+    streamer->interval = (long) ((unsigned long long) period * 1000000000ULL / rate);
+    streamer->running = 1;
+    pthread_mutex_init(&streamer->lock, 0);
+    sem_init(&streamer->wake, 0, 0);
+
+    if (pthread_create(&streamer->thread, 0, decode_ahead, streamer) != 0) {
+        sem_destroy(&streamer->wake);
+        pthread_mutex_destroy(&streamer->lock);
+        free(streamer);
+        return 0;
+    }
+
+    return streamer;
+}
+
+int mg_audio_streamer_add(mg_audio_streamer * streamer, mg_audio_stream * stream) {
+    int added;
+
+    pthread_mutex_lock(&streamer->lock);
+    added = append(&streamer->pending, &streamer->pending_count,
+                   &streamer->pending_allocated, stream);
+    if (added) {
+        __atomic_add_fetch(&stream->references, 1, __ATOMIC_RELAXED);
+        stream->wake = &streamer->wake;
+    }
+    pthread_mutex_unlock(&streamer->lock);
+
+    if (added) { sem_post(&streamer->wake); }
+    return added;
+}
+
+void mg_audio_streamer_free(mg_audio_streamer * streamer) {
+    size_t i;
+
+    __atomic_store_n(&streamer->running, 0, __ATOMIC_RELEASE);
+    sem_post(&streamer->wake);
+    pthread_join(streamer->thread, 0);
+
+    for (i = 0; i < streamer->count; ++i) {
+        streamer->streams[i]->wake = 0;
+        mg_audio_stream_release(streamer->streams[i]);
+    }
+    for (i = 0; i < streamer->pending_count; ++i) {
+        streamer->pending[i]->wake = 0;
+        mg_audio_stream_release(streamer->pending[i]);
+    }
+
+    sem_destroy(&streamer->wake);
+    pthread_mutex_destroy(&streamer->lock);
+    free(streamer->streams);
+    free(streamer->pending);
+    free(streamer);
+}
+
+/* Helper function implementation */
+
+static void * decode_ahead(void * data) {
+    mg_audio_streamer * streamer = data;
+    struct timespec deadline;
+    size_t i, kept;
+
+    for (;;) {
+        /* Sleep until the mixer consumes frames, or for a period at most */
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += streamer->interval;
+        while (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_nsec -= 1000000000L;
+            ++deadline.tv_sec;
+        }
+        while (sem_timedwait(&streamer->wake, &deadline) != 0 && errno == EINTR);
+
+        if (!__atomic_load_n(&streamer->running, __ATOMIC_ACQUIRE)) { break; }
+
+        /* Take over new streams */
+        pthread_mutex_lock(&streamer->lock);
+        for (i = 0; i < streamer->pending_count; ++i) {
+            if (!append(&streamer->streams, &streamer->count, &streamer->allocated,
+                        streamer->pending[i])) {
+                break;
+            }
+        }
+        memmove(streamer->pending, streamer->pending + i,
+                (streamer->pending_count - i) * sizeof(mg_audio_stream *));
+        streamer->pending_count -= i;
+        pthread_mutex_unlock(&streamer->lock);
+
+        /* Top up the rings, dropping the streams that are done */
+        for (i = 0, kept = 0; i < streamer->count; ++i) {
+            mg_audio_stream * s = streamer->streams[i];
+
+            if (droppable(s)) {
+                s->wake = 0;
+                mg_audio_stream_release(s);
+                continue;
+            }
+
+            fill(s);
+            streamer->streams[kept++] = s;
+        }
+        streamer->count = kept;
+    }
+
+    return 0;
+}
+
+static void fill(mg_audio_stream * stream) {
+    size_t written = stream->written;
+
+    while (!stream->ended) {
+        size_t consumed = __atomic_load_n(&stream->consumed, __ATOMIC_ACQUIRE);
+        size_t space = stream->capacity - (written - consumed);
+        size_t offset = written % stream->capacity, count, produced;
+
+        /* Work a period at a time, like the mixer */
+        if (space < stream->chunk) { break; }
+        count = stream->chunk;
+        if (count > stream->capacity - offset) { count = stream->capacity - offset; }
+
+        produced = resample(stream, stream->ring + offset * 2, count);
+        written += produced;
+
+        /* Publish the frames */
+        __atomic_store_n(&stream->written, written, __ATOMIC_RELEASE);
+
+        if (produced < count) {
+            __atomic_store_n(&stream->ended, 1, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+static size_t resample(mg_audio_stream * stream, float * output, size_t count) {
+    size_t i;
+
+    if (!stream->primed) {
+        stream->primed = 1;
+        if (!pull(stream, stream->current)) {
+            stream->exhausted = 1;
+            return 0;
+        }
+        if (!pull(stream, stream->next)) {
+            stream->exhausted = 1;
+            memcpy(stream->next, stream->current, sizeof(stream->next));
+        }
+    }
+
+    for (i = 0; i < count; ++i, output += 2) {
+        float fraction;
+
+        /* Advance to the source frames surrounding the output frame */
+        while (stream->phase >= 1.0) {
+            if (stream->exhausted) { return i; }
+            memcpy(stream->current, stream->next, sizeof(stream->current));
+            if (!pull(stream, stream->next)) {
+                /* Hold the last frame until it has played */
+                stream->exhausted = 1;
+            }
+            stream->phase -= 1.0;
+        }
+
+        fraction = (float) stream->phase;
+        output[0] = stream->current[0] + (stream->next[0] - stream->current[0]) * fraction;
+        output[1] = stream->current[1] + (stream->next[1] - stream->current[1]) * fraction;
+        stream->phase += stream->step;
+    }
+
+    return count;
+}
+
+static int pull(mg_audio_stream * stream, float frame[2]) {
+    if (stream->source_position == stream->source_frames) {
+        if (!decode(stream)) {
+            if (!stream->loop) { return 0; }
+
+            /* Start over from the first frame */
+            stream->position = stream->codec == CODEC_QOA ? MG_QOA_FILE_HEADER_SIZE : 0;
+            stream->discarded = 0;
+            if (!decode(stream)) { return 0; }
+        }
+    }
+
+    frame[0] = stream->source[stream->source_position * 2];
+    frame[1] = stream->source[stream->source_position * 2 + 1];
+    ++stream->source_position;
+    return 1;
+}
+
+static int decode(mg_audio_stream * stream) {
+    size_t end, i, count = 0;
+    unsigned int samples = 0, channels;
+
+    switch (stream->codec) {
+        case CODEC_WAVE: {
+            count = stream->wave.frames - stream->position;
+            if (count > stream->chunk) { count = stream->chunk; }
+            if (count == 0) { return 0; }
+
+            mg_wave_read_stereo(&stream->wave, stream->position, count, stream->source);
+            stream->position += count;
+            end = (size_t) (stream->wave.data - stream->file.data) +
+                  stream->position * stream->wave.frame_size;
+            break;
+        }
+        case CODEC_QOA: {
+            size_t size = mg_qoa_decode_frame(stream->file.data, stream->file.size,
+                                              stream->position, &stream->qoa,
+                                              stream->scratch, &samples);
+            if (size == 0) { return 0; }
+
+            stream->position += size;
+            end = stream->position;
+            count = samples;
+
+            /* Mono is duplicated into both channels; channels beyond the second are dropped */
+            channels = stream->qoa.channels;
+            for (i = 0; i < count; ++i) {
+                const int16_t * frame = stream->scratch + i * channels;
+                stream->source[i * 2]     = frame[0] / 32768.0f;
+                stream->source[i * 2 + 1] = frame[channels > 1 ? 1 : 0] / 32768.0f;
+            }
+            break;
+        }
+        default:
+            return 0;
+    }
+
+    stream->source_frames = count;
+    stream->source_position = 0;
+
+    /* Decoded data won't be needed again until the stream loops */
+    stream->discarded = mg_mapped_file_discard(&stream->file, stream->discarded, end);
+    return 1;
+}
+
+static int append(mg_audio_stream *** array, size_t * count, size_t * allocated,
+                  mg_audio_stream * stream) {
+    if (*count == *allocated) {
+        size_t size = *allocated ? *allocated * 2 : 8;
+        mg_audio_stream ** grown = realloc(*array, size * sizeof(mg_audio_stream *));
+        if (grown == 0) { return 0; }
+        *array = grown;
+        *allocated = size;
+    }
+    (*array)[(*count)++] = stream;
+    return 1;
+}
+
+static int droppable(mg_audio_stream * stream) {
+    int state = __atomic_load_n(&stream->state, __ATOMIC_ACQUIRE);
+    return state == STREAM_FINISHED ||
+           (state == STREAM_IDLE && __atomic_load_n(&stream->references, __ATOMIC_ACQUIRE) == 1);
+}
@@ -0,0 +1,107 @@
+#ifndef MG_AUDIO_STREAM_H
+#define MG_AUDIO_STREAM_H
+
+#include <stddef.h>
+
+/**
+ * Sound decoded incrementally from a memory mapped WAVE or QOA file.
+ *
+ * A background streamer thread decodes the file, converting it to the mixer's
+ * rate, into a ring of a few mixer periods that the mixer thread drains. The
+ * memory used by a stream is bounded by the size of that ring, no matter how
+ * long the file is. Reference counted, since both the Ruby object and the
+ * streamer keep it alive.
+ */
+typedef struct mg_audio_stream mg_audio_stream;
+
+/**
+ * Description and counters of a stream.
+ */
+typedef struct {
+    size_t frames; /** Frames in the file, at the file's own rate. */
+    unsigned int rate; /** Sample rate of the file. */
+    size_t buffered; /** Frames decoded but not yet mixed. */
+    unsigned long underruns; /** Times the mixer found the ring short of frames. */
+    size_t bytesize; /** Memory allocated for decoding, in bytes. */
+    int started; /** Whether the stream is playing or has finished playing. */
+    int finished; /** Whether the mixer is done with the stream. */
+} mg_audio_stream_statistics;
+
+/**
+ * Background thread that keeps streams' rings full.
+ */
+typedef struct mg_audio_streamer mg_audio_streamer;
+
+/**
+ * Maps and parses the file and decodes enough of it to fill the ring, which
+ * holds the given number of periods of frames at the given rate.
+ *
+ * Does not require the Ruby GVL. Returns zero on failure, setting the error
+ * message; error_number is set to errno if the file could not be mapped.
+ */
+extern mg_audio_stream * mg_audio_stream_open(const char * path,
+                                              unsigned int rate,
+                                              unsigned int period,
+                                              unsigned int buffers,
+                                              int loop,
+                                              const char ** error,
+                                              int * error_number);
+
+/**
+ * Marks an idle stream as playing. Returns zero if it is already playing or
+ * has finished; streams can only be played once.
+ */
+extern int mg_audio_stream_start(mg_audio_stream * stream);
+
+/**
+ * Marks a stream that could not be played as idle again.
+ */
+extern void mg_audio_stream_cancel(mg_audio_stream * stream);
+
+/**
+ * Marks the stream as finished. Called by the mixer once it no longer uses the
+ * stream, which lets the streamer drop it.
+ */
+extern void mg_audio_stream_finish(mg_audio_stream * stream);
+
+/**
+ * Copies up to count buffered stereo frames. Called by the mixer thread; never
+ * blocks.
+ *
+ * Returns the number of frames copied. Sets finished if the end of the stream
+ * was reached, and underrun if the streamer fell behind; underruns are counted.
+ */
+extern size_t mg_audio_stream_read(mg_audio_stream * stream, float * output,
+                                   size_t count, int * finished, int * underrun);
+
+/**
+ * Copies the stream's description and counters.
+ */
+extern void mg_audio_stream_stats(mg_audio_stream * stream, mg_audio_stream_statistics * stats);
+
+/**
+ * Releases a reference to the stream, freeing it when none are left.
+ */
+extern void mg_audio_stream_release(mg_audio_stream * stream);
+
+/**
+ * Starts a streamer thread that wakes up at least once per period of frames
+ * at the given rate. Returns zero on failure.
+ */
+extern mg_audio_streamer * mg_audio_streamer_new(unsigned int rate, unsigned int period);
+
+/**
+ * Hands the stream to the streamer, which acquires a reference to it and
+ * keeps it decoding until it finishes.
+ *
+ * Returns zero if memory could not be allocated.
+ */
+extern int mg_audio_streamer_add(mg_audio_streamer * streamer, mg_audio_stream * stream);
+
+/**
+ * Stops the streamer thread, releases its streams and frees it. Streams must
+ * no longer be read by a mixer.
+ */
+extern void mg_audio_streamer_free(mg_audio_streamer * streamer);
+
+#endif /* MG_AUDIO_STREAM_H */
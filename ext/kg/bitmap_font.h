@@ -0,0 +1,22 @@
+#ifndef MG_BITMAP_FONT_H
+#define MG_BITMAP_FONT_H
+
+/**
+ * First and last characters of the built-in font.
+ */
+#define MG_BITMAP_FONT_FIRST 0x20
+#define MG_BITMAP_FONT_LAST  0x7E
+
+/**
+ * Size of the built-in font's glyphs, in pixels.
+ */
+#define MG_BITMAP_FONT_SIZE 8
+
+/**
+ * Printable ASCII characters, 8 by 8 pixels each, one byte per row from the
+ * top. The lowest bit is the leftmost pixel. The bottom row is below the
+ * baseline.
+ */
+extern const unsigned char mg_bitmap_font[MG_BITMAP_FONT_LAST - MG_BITMAP_FONT_FIRST + 1][MG_BITMAP_FONT_SIZE];
+
+#endif /* MG_BITMAP_FONT_H */
@@ -0,0 +1,317 @@
+#include "canvas.h"
+
+#include "font.h"
+#include "image.h"
+#include "raster.h"
+#include "window.h"
+
+#include <stdlib.h>
+
+#include <ruby.h>
+#include <ruby/thread.h>
+
+VALUE mg_canvas_class;
+
+/* Data structures */
+
+typedef struct canvas_struct {
+    mg_raster * raster; /** Commands waiting to be drawn. */
+    VALUE target; /** Window or image drawn into. */
+    VALUE retained; /** Images and fonts the recorded commands read, kept alive until drawn. */
+    int rendering; /** Whether the commands are being drawn WITHOUT the GVL. */
+} canvas_t;
+
+/**
+ * Render request, carried across the GVL release.
+ */
+typedef struct render_struct {
+    canvas_t * canvas;
+    mg_raster_target target;
+    mg_damage damage;
+} render_t;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the canvas encapsulated by the Ruby object, ready to record
+ * commands. Raises a Ruby exception if it's being drawn.
+ */
+static canvas_t * canvas_from(VALUE self);
+
+/**
+ * Raises a Ruby exception if a command could not be recorded.
+ */
+static void check_recorded(int recorded);
+
+/**
+ * Draws the commands.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * render(void * data);
+
+/**
+ * Marks the target and what the commands read.
+ */
+static void canvas_mark(void * p);
+
+/**
+ * Frees the commands and the canvas.
+ */
+static void canvas_free(void * p);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::Canvas objects.
+ */
+static const rb_data_type_t canvas_type = {
+    "Mg::Canvas",
+    { canvas_mark, canvas_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Canvas interface implementation */
+
+VALUE mg_canvas_alloc(VALUE klass) {
+    canvas_t * canvas = calloc(1, sizeof(canvas_t));
+
+    if (canvas == 0 || (canvas->raster = mg_raster_new()) == 0) {
+        free(canvas);
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for canvas");
+    }
+
+    canvas->target = Qnil;
+    canvas->retained = rb_ary_new();
+    return TypedData_Wrap_Struct(klass, &canvas_type, canvas);
+}
+
+VALUE mg_canvas_setup(VALUE self, VALUE target) {
+    canvas_t * canvas = canvas_from(self);
+
+    if (!rb_obj_is_kind_of(target, mg_window_class) && !rb_obj_is_kind_of(target, mg_image_class)) {
+        rb_raise(rb_eTypeError, "canvas target must be a Mg::Window or a Mg::Image");
+    }
+
+    canvas->target = target;
+    return self;
+}
+
+VALUE mg_canvas_target(VALUE self) {
+    canvas_t * canvas = 0;
+    TypedData_Get_Struct(self, canvas_t, &canvas_type, canvas);
+    return canvas->target;
+}
+
+VALUE mg_canvas_clear(VALUE self, VALUE color) {
+    canvas_t * canvas = canvas_from(self);
+    check_recorded(mg_raster_clear(canvas->raster, NUM2UINT(color)));
+    return self;
+}
+
+VALUE mg_canvas_fill_rect(VALUE self, VALUE x, VALUE y, VALUE w, VALUE h, VALUE color) {
+    canvas_t * canvas = canvas_from(self);
+    check_recorded(mg_raster_fill_rect(canvas->raster, NUM2INT(x), NUM2INT(y),
+                                       NUM2INT(w), NUM2INT(h), NUM2UINT(color)));
+    return self;
+}
+
+VALUE mg_canvas_stroke_rect(VALUE self, VALUE x, VALUE y, VALUE w, VALUE h,
+                            VALUE color, VALUE width) {
+    canvas_t * canvas = canvas_from(self);
+    check_recorded(mg_raster_stroke_rect(canvas->raster, NUM2INT(x), NUM2INT(y),
+                                         NUM2INT(w), NUM2INT(h), NUM2INT(width),
+                                         NUM2UINT(color)));
+    return self;
+}
+
+VALUE mg_canvas_line(VALUE self, VALUE x0, VALUE y0, VALUE x1, VALUE y1,
+                     VALUE color, VALUE width) {
+    canvas_t * canvas = canvas_from(self);
+    check_recorded(mg_raster_line(canvas->raster, NUM2DBL(x0), NUM2DBL(y0),
+                                  NUM2DBL(x1), NUM2DBL(y1), NUM2DBL(width), NUM2UINT(color)));
+    return self;
+}
+
+VALUE mg_canvas_fill_circle(VALUE self, VALUE x, VALUE y, VALUE radius, VALUE color) {
+    canvas_t * canvas = canvas_from(self);
+    check_recorded(mg_raster_fill_circle(canvas->raster, NUM2DBL(x), NUM2DBL(y),
+                                         NUM2DBL(radius), NUM2UINT(color)));
+    return self;
+}
+
+VALUE mg_canvas_stroke_circle(VALUE self, VALUE x, VALUE y, VALUE radius,
+                              VALUE color, VALUE width) {
+    canvas_t * canvas = canvas_from(self);
+    check_recorded(mg_raster_stroke_circle(canvas->raster, NUM2DBL(x), NUM2DBL(y),
+                                           NUM2DBL(radius), NUM2DBL(width), NUM2UINT(color)));
+    return self;
+}
+
+VALUE mg_canvas_blit(VALUE self, VALUE image, VALUE x, VALUE y, VALUE alpha) {
+    canvas_t * canvas = canvas_from(self);
+
+    if (!rb_obj_is_kind_of(image, mg_image_class)) {
+        rb_raise(rb_eTypeError, "only a Mg::Image can be drawn");
+    }
+
+    /* Tiles are drawn in parallel; reading pixels another tile writes would race */
+    if (image == canvas->target) {
+        rb_raise(rb_eArgError, "an image can't be drawn into itself");
+    }
+
+    check_recorded(mg_raster_blit(canvas->raster, mg_image_from(image),
+                                  NUM2INT(x), NUM2INT(y), NUM2UINT(alpha)));
+    rb_ary_push(canvas->retained, image);
+    return self;
+}
+
+VALUE mg_canvas_text(VALUE self, VALUE font, VALUE text, VALUE x, VALUE y, VALUE color) {
+    canvas_t * canvas = canvas_from(self);
+
+    if (!rb_obj_is_kind_of(font, mg_font_class)) {
+        rb_raise(rb_eTypeError, "text can only be drawn with a Mg::Font");
+    }
+
+    check_recorded(mg_raster_text(canvas->raster, mg_font_from(font), mg_font_layout(font, text),
+                                  NUM2INT(x), NUM2INT(y), NUM2UINT(color)));
+    rb_ary_push(canvas->retained, font);
+    return self;
+}
+
+VALUE mg_canvas_set_clip(VALUE self, VALUE x, VALUE y, VALUE w, VALUE h) {
+    canvas_t * canvas = canvas_from(self);
+    mg_raster_clip(canvas->raster, NUM2INT(x), NUM2INT(y), NUM2INT(w), NUM2INT(h));
+    return self;
+}
+
+VALUE mg_canvas_reset_clip(VALUE self) {
+    canvas_t * canvas = canvas_from(self);
+    mg_raster_unclip(canvas->raster);
+    return self;
+}
+
+VALUE mg_canvas_flush(VALUE self) {
+    canvas_t * canvas = canvas_from(self);
+    VALUE target = canvas->target;
+    render_t request;
+    unsigned int i;
+
+    if (mg_raster_count(canvas->raster) == 0) { return self; }
+
+    request.canvas = canvas;
+
+    if (rb_obj_is_kind_of(target, mg_window_class)) {
+        request.target.pixels = mg_window_pixels(target, &request.target.width,
+                                                 &request.target.height, &request.target.format);
+    } else {
+        mg_image * image = mg_image_from(target);
+        request.target.pixels = image->pixels;
+        request.target.width = image->width;
+        request.target.height = image->height;
+        request.target.format = image->format;
+    }
+
+    request.target.stride = (size_t) request.target.width * 4;
+    mg_damage_reset(&request.damage, request.target.width, request.target.height);
+
+    /* Fonts hold off growing their atlases while it's being read */
+    for (i = 0; i < (unsigned int) RARRAY_LEN(canvas->retained); ++i) {
+        VALUE font = RARRAY_AREF(canvas->retained, i);
+        if (rb_obj_is_kind_of(font, mg_font_class)) { mg_font_begin_read(font); }
+    }
+
+    /* Drawing can't be interrupted, but it doesn't need to hold the GVL */
+    canvas->rendering = 1;
+    rb_thread_call_without_gvl(render, &request, 0, 0);
+
+    for (i = 0; i < (unsigned int) RARRAY_LEN(canvas->retained); ++i) {
+        VALUE font = RARRAY_AREF(canvas->retained, i);
+        if (rb_obj_is_kind_of(font, mg_font_class)) { mg_font_end_read(font); }
+    }
+    rb_ary_clear(canvas->retained);
+
+    if (rb_obj_is_kind_of(target, mg_window_class)) {
+        for (i = 0; i < request.damage.count; ++i) {
+            mg_rect * r = &request.damage.rects[i];
+            rb_funcall(target, rb_intern("damage"), 4,
+                       INT2FIX(r->x), INT2FIX(r->y), INT2FIX(r->width), INT2FIX(r->height));
+        }
+    }
+
+    return self;
+}
+
+VALUE mg_canvas_discard(VALUE self) {
+    canvas_t * canvas = canvas_from(self);
+    mg_raster_reset(canvas->raster);
+    rb_ary_clear(canvas->retained);
+    return self;
+}
+
+VALUE mg_canvas_pending(VALUE self) {
+    canvas_t * canvas = 0;
+    TypedData_Get_Struct(self, canvas_t, &canvas_type, canvas);
+    return UINT2NUM(mg_raster_count(canvas->raster));
+}
+
+void init_mg_canvas_class_under(VALUE module) {
+    mg_canvas_class = rb_define_class_under(module, "Canvas", rb_cObject);
+    rb_define_const(mg_canvas_class, "TILE_SIZE", INT2FIX(MG_RASTER_TILE_SIZE));
+    rb_define_alloc_func(mg_canvas_class, mg_canvas_alloc);
+    rb_define_private_method(mg_canvas_class, "setup",              mg_canvas_setup,         1);
+    rb_define_private_method(mg_canvas_class, "draw_stroke_rect",   mg_canvas_stroke_rect,   6);
+    rb_define_private_method(mg_canvas_class, "draw_line",          mg_canvas_line,          6);
+    rb_define_private_method(mg_canvas_class, "draw_stroke_circle", mg_canvas_stroke_circle, 5);
+    rb_define_private_method(mg_canvas_class, "draw_image",         mg_canvas_blit,          4);
+    rb_define_private_method(mg_canvas_class, "set_clip",           mg_canvas_set_clip,      4);
+    rb_define_private_method(mg_canvas_class, "reset_clip",         mg_canvas_reset_clip,    0);
+    rb_define_method(mg_canvas_class, "target",      mg_canvas_target,      0);
+    rb_define_method(mg_canvas_class, "clear",       mg_canvas_clear,       1);
+    rb_define_method(mg_canvas_class, "fill_rect",   mg_canvas_fill_rect,   5);
+    rb_define_method(mg_canvas_class, "fill_circle", mg_canvas_fill_circle, 4);
+    rb_define_method(mg_canvas_class, "text",        mg_canvas_text,        5);
+    rb_define_method(mg_canvas_class, "flush",       mg_canvas_flush,       0);
+    rb_define_method(mg_canvas_class, "discard",     mg_canvas_discard,     0);
+    rb_define_method(mg_canvas_class, "pending",     mg_canvas_pending,     0);
+}
+
+/* Helper function implementation */
+
+static canvas_t * canvas_from(VALUE self) {
+    canvas_t * canvas = 0;
+    TypedData_Get_Struct(self, canvas_t, &canvas_type, canvas);
+
+    /* Another thread is drawing the commands */
+    if (canvas->rendering) {
+        rb_raise(rb_eRuntimeError, "canvas is being drawn");
+    }
+
+    return canvas;
+}
+
+static void check_recorded(int recorded) {
+    if (!recorded) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for canvas command");
+    }
+}
+
+static void * render(void * data) {
+    render_t * request = data;
+    mg_raster_render(request->canvas->raster, &request->target, &request->damage);
+    request->canvas->rendering = 0;
+    return 0;
+}
+
+static void canvas_mark(void * p) {
+    canvas_t * canvas = p;
+    rb_gc_mark(canvas->target);
+    rb_gc_mark(canvas->retained);
+}
+
+static void canvas_free(void * p) {
+    canvas_t * canvas = p;
+    mg_raster_free(canvas->raster);
+    free(canvas);
+}
@@ -0,0 +1,107 @@
+#ifndef MG_CANVAS_H
+#define MG_CANVAS_H
+
+#include <ruby.h>
+
+/**
+ * Mg::Canvas class.
+ */
+extern VALUE mg_canvas_class;
+
+/**
+ * Allocates a canvas with no commands.
+ */
+extern VALUE mg_canvas_alloc(VALUE klass);
+
+/**
+ * Sets what the canvas draws into: the framebuffer of a Mg::Window or the
+ * pixels of a Mg::Image.
+ */
+extern VALUE mg_canvas_setup(VALUE self, VALUE target);
+
+/**
+ * Returns the window or image drawn into.
+ */
+extern VALUE mg_canvas_target(VALUE self);
+
+/**
+ * Replaces everything within the clip rectangle, or the whole target, with
+ * the color, without blending. Colors are integers in 0xRRGGBBAA form.
+ */
+extern VALUE mg_canvas_clear(VALUE self, VALUE color);
+
+/**
+ * Fills the rectangle with the color.
+ */
+extern VALUE mg_canvas_fill_rect(VALUE self, VALUE x, VALUE y, VALUE w, VALUE h, VALUE color);
+
+/**
+ * Draws the outline of the rectangle inside it. Wrapped by
+ * Mg::Canvas#stroke_rect.
+ */
+extern VALUE mg_canvas_stroke_rect(VALUE self, VALUE x, VALUE y, VALUE w, VALUE h,
+                                   VALUE color, VALUE width);
+
+/**
+ * Draws a line between the points. Wrapped by Mg::Canvas#line.
+ */
+extern VALUE mg_canvas_line(VALUE self, VALUE x0, VALUE y0, VALUE x1, VALUE y1,
+                            VALUE color, VALUE width);
+
+/**
+ * Fills the circle with the color.
+ */
+extern VALUE mg_canvas_fill_circle(VALUE self, VALUE x, VALUE y, VALUE radius, VALUE color);
+
+/**
+ * Draws the outline of the circle, centered on it. Wrapped by
+ * Mg::Canvas#stroke_circle.
+ */
+extern VALUE mg_canvas_stroke_circle(VALUE self, VALUE x, VALUE y, VALUE radius,
+                                     VALUE color, VALUE width);
+
+/**
+ * Draws the Mg::Image with its top left corner at x, y, blended by its own
+ * alpha scaled by the given one. Wrapped by Mg::Canvas#blit.
+ */
+extern VALUE mg_canvas_blit(VALUE self, VALUE image, VALUE x, VALUE y, VALUE alpha);
+
+/**
+ * Draws the text with the Mg::Font, its top left corner at x, y. Layouts are
+ * cached by the font, so drawing the same text again only copies its glyphs.
+ */
+extern VALUE mg_canvas_text(VALUE self, VALUE font, VALUE text, VALUE x, VALUE y, VALUE color);
+
+/**
+ * Restricts the commands that follow to the rectangle.
+ */
+extern VALUE mg_canvas_set_clip(VALUE self, VALUE x, VALUE y, VALUE w, VALUE h);
+
+/**
+ * Lets the commands that follow draw anywhere.
+ */
+extern VALUE mg_canvas_reset_clip(VALUE self);
+
+/**
+ * Draws the recorded commands into the target WITHOUT the GVL, splitting the
+ * work across the worker pool. Parts of a window that were drawn are marked
+ * as damaged, ready for Mg::Window#present.
+ */
+extern VALUE mg_canvas_flush(VALUE self);
+
+/**
+ * Discards the recorded commands without drawing them.
+ */
+extern VALUE mg_canvas_discard(VALUE self);
+
+/**
+ * Returns the number of commands waiting to be drawn.
+ */
+extern VALUE mg_canvas_pending(VALUE self);
+
+/**
+ * Initializes the Canvas class.
+ */
+extern void init_mg_canvas_class_under(VALUE module);
+
+#endif /* MG_CANVAS_H */
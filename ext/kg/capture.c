@@ -0,0 +1,519 @@
+#include "capture.h"
+
+#include "image_decoder.h"
+#include "readback.h"
+#include "worker_pool.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#if defined(MG_HAVE_PNG)
+    #include <png.h>
+#endif
+
+/* Data structures */
+
+/**
+ * Encoded frame waiting for the frames before it to be written.
+ */
+typedef struct encoded_struct {
+    uint64_t sequence;
+    unsigned char * data; /** Encoded bytes, or 0 if encoding failed. */
+    size_t size;
+    struct encoded_struct * next;
+} encoded_t;
+
+/**
+ * Frame handed to the worker pool. Once encoded, it waits in line as is.
+ */
+typedef struct {
+    encoded_t frame;
+    mg_capture * capture;
+    mg_image * image;
+} job_t;
+
+struct mg_capture {
+    mg_readback * readback;
+    mg_capture_format format;
+    mg_pixel_format pixel_format;
+    int fd; /** Duplicated stream, or -1 when writing files. */
+    char * directory;
+    unsigned int queue;
+    pthread_mutex_t lock;
+    pthread_cond_t idle; /** Signaled whenever a frame is written out. */
+    uint64_t next_sequence; /** Sequence number of the next frame encoded. */
+    uint64_t next_write; /** Sequence number of the next frame written. */
+    unsigned int encoding; /** Frames handed to the worker pool, not yet written. */
+    int writing; /** Whether a worker is writing frames out. */
+    encoded_t * done; /** Encoded frames out of order, by sequence number. */
+    mg_capture_stats stats;
+};
+
+/* Helper function prototypes */
+
+/**
+ * Hands the image to the worker pool, or drops it if the encoders are full.
+ */
+static void submit(mg_capture * capture, mg_image * image);
+
+/**
+ * Encodes the frame and writes out every frame that's next in line.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void encode_frame(void * data);
+
+/**
+ * Encodes the image into a newly allocated buffer. Returns zero on failure.
+ */
+static unsigned char * encode(mg_capture * capture, mg_image * image, size_t * size);
+
+/**
+ * Converts the image to 8 bit 4:2:0 YCbCr with BT.601 studio swing, after
+ * the Y4M frame marker.
+ */
+static unsigned char * encode_y4m(mg_image * image, size_t * size);
+
+/**
+ * Copies the pixels, converting them to the given format.
+ */
+static unsigned char * encode_raw(mg_image * image, mg_pixel_format format, size_t * size);
+
+/**
+ * Compresses the image into a PNG file.
+ */
+static unsigned char * encode_png(mg_image * image, size_t * size);
+
+/**
+ * Writes the frame to the stream or its own file. Returns zero on success,
+ * errno otherwise.
+ */
+static int write_frame(mg_capture * capture, encoded_t * frame);
+
+/**
+ * Writes all of the data, waiting for non-blocking descriptors to become
+ * writable. Returns zero on success, errno otherwise.
+ */
+static int write_all(int fd, const unsigned char * data, size_t size);
+
+/**
+ * Waits for the encoders to write every frame out.
+ */
+static void wait_idle(mg_capture * capture);
+
+/**
+ * Frees the capture once nothing references it anymore.
+ */
+static void capture_free(mg_capture * capture);
+
+/**
+ * Frees the image returned by the readback ring.
+ */
+static void image_free(mg_image * image);
+
+/* Capture interface implementation */
+
+mg_capture * mg_capture_new(const mg_capture_options * options, const char ** error) {
+    mg_capture * capture = calloc(1, sizeof(mg_capture));
+
+    if (capture == 0) {
+        *error = "unable to allocate memory for capture";
+        return 0;
+    }
+
+    pthread_mutex_init(&capture->lock, 0);
+    pthread_cond_init(&capture->idle, 0);
+
+#if !defined(MG_HAVE_PNG)
+    if (options->format == MG_CAPTURE_PNG) {
+        capture_free(capture);
+        *error = "PNG support is not available";
+        return 0;
+    }
+#endif
+
+    capture->format = options->format;
+    capture->pixel_format = options->pixel_format;
+    capture->queue = options->queue;
+    capture->fd = -1;
+
+    if (options->directory) {
+        capture->directory = strdup(options->directory);
+        if (capture->directory == 0) {
+            capture_free(capture);
+            *error = "unable to allocate memory for capture";
+            return 0;
+        }
+    } else if ((capture->fd = fcntl(options->fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        capture_free(capture);
+        *error = "could not duplicate capture file descriptor";
+        return 0;
+    }
+
+    /* Read back in BGRA, which GL implementations transfer fastest */
+    capture->readback = mg_readback_new(options->width, options->height, options->buffers,
+                                        MG_PIXEL_FORMAT_BGRA, error);
+    if (capture->readback == 0) {
+        capture_free(capture);
+        return 0;
+    }
+
+    if (capture->format == MG_CAPTURE_Y4M && capture->fd >= 0) {
+        char header[128];
+        int length = snprintf(header, sizeof(header), "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n",
+                              options->width, options->height, options->rate);
+        if (write_all(capture->fd, (unsigned char *) header, length) != 0) {
+            mg_readback_free(capture->readback);
+            capture->readback = 0;
+            capture_free(capture);
+            *error = "could not write capture stream header";
+            return 0;
+        }
+        capture->stats.bytes += length;
+    }
+
+    return capture;
+}
+
+void mg_capture_frame(mg_capture * capture) {
+    mg_readback * readback = capture->readback;
+
+    /* Collect the reads that have completed without waiting for any */
+    while (mg_readback_ready(readback)) {
+        submit(capture, mg_readback_finish(readback));
+    }
+
+    pthread_mutex_lock(&capture->lock);
+    ++capture->stats.frames;
+    pthread_mutex_unlock(&capture->lock);
+
+    /* Every buffer is still being read into; the GPU is behind */
+    if (!mg_readback_start(readback)) {
+        pthread_mutex_lock(&capture->lock);
+        ++capture->stats.dropped;
+        pthread_mutex_unlock(&capture->lock);
+    }
+}
+
+mg_capture_stats mg_capture_get_stats(mg_capture * capture) {
+    mg_capture_stats stats;
+
+    pthread_mutex_lock(&capture->lock);
+    stats = capture->stats;
+    stats.pending = capture->encoding + mg_readback_pending(capture->readback);
+    pthread_mutex_unlock(&capture->lock);
+
+    return stats;
+}
+
+mg_capture_stats mg_capture_stop(mg_capture * capture) {
+    mg_capture_stats stats;
+
+    /* The last frames are worth waiting for */
+    while (mg_readback_pending(capture->readback) > 0) {
+        mg_image * image = mg_readback_finish(capture->readback);
+
+        pthread_mutex_lock(&capture->lock);
+        while (capture->encoding >= capture->queue) {
+            pthread_cond_wait(&capture->idle, &capture->lock);
+        }
+        pthread_mutex_unlock(&capture->lock);
+
+        submit(capture, image);
+    }
+
+    wait_idle(capture);
+    stats = capture->stats;
+
+    mg_readback_free(capture->readback);
+    capture->readback = 0;
+    capture_free(capture);
+
+    return stats;
+}
+
+void mg_capture_discard(mg_capture * capture) {
+    wait_idle(capture);
+    mg_readback_discard(capture->readback);
+    capture->readback = 0;
+    capture_free(capture);
+}
+
+/* Helper function implementation */
+
+static void submit(mg_capture * capture, mg_image * image) {
+    job_t * job = 0;
+
+    pthread_mutex_lock(&capture->lock);
+
+    if (image == 0 || capture->stats.error || capture->encoding >= capture->queue ||
+            (job = malloc(sizeof(job_t))) == 0) {
+        ++capture->stats.dropped;
+        pthread_mutex_unlock(&capture->lock);
+        if (image) { image_free(image); }
+        return;
+    }
+
+    job->frame.sequence = capture->next_sequence++;
+    job->frame.data = 0;
+    job->frame.size = 0;
+    job->capture = capture;
+    job->image = image;
+    ++capture->encoding;
+
+    pthread_mutex_unlock(&capture->lock);
+
+    /* The sequence number is taken; the frame must reach the writer */
+    if (!mg_worker_pool_submit(encode_frame, job)) {
+        encode_frame(job);
+    }
+}
+
+static void encode_frame(void * data) {
+    job_t * job = data;
+    mg_capture * capture = job->capture;
+    encoded_t * frame = &job->frame;
+    encoded_t ** p;
+
+    frame->data = encode(capture, job->image, &frame->size);
+    image_free(job->image);
+    job->image = 0;
+
+    pthread_mutex_lock(&capture->lock);
+
+    /* Keep encoded frames sorted so that they come out in order */
+    for (p = &capture->done; *p && (*p)->sequence < frame->sequence; p = &(*p)->next);
+    frame->next = *p;
+    *p = frame;
+
+    /* Only one worker writes at a time; the others leave their frames */
+    if (!capture->writing) {
+        capture->writing = 1;
+
+        while (capture->done && capture->done->sequence == capture->next_write) {
+            encoded_t * next = capture->done;
+            int error = 0;
+
+            capture->done = next->next;
+            pthread_mutex_unlock(&capture->lock);
+
+            if (next->data && !capture->stats.error) {
+                error = write_frame(capture, next);
+            }
+
+            pthread_mutex_lock(&capture->lock);
+
+            if (next->data == 0 || capture->stats.error) {
+                ++capture->stats.dropped;
+            } else if (error) {
+                capture->stats.error = error;
+                ++capture->stats.dropped;
+            } else {
+                ++capture->stats.written;
+                capture->stats.bytes += next->size;
+            }
+
+            ++capture->next_write;
+            --capture->encoding;
+            pthread_cond_broadcast(&capture->idle);
+
+            /* The frame is the first member of its job */
+            free(next->data);
+            free(next);
+        }
+
+        capture->writing = 0;
+    }
+
+    pthread_mutex_unlock(&capture->lock);
+}
+
+static unsigned char * encode(mg_capture * capture, mg_image * image, size_t * size) {
+    switch (capture->format) {
+        case MG_CAPTURE_Y4M: return encode_y4m(image, size);
+        case MG_CAPTURE_RAW: return encode_raw(image, capture->pixel_format, size);
+        case MG_CAPTURE_PNG: return encode_png(image, size);
+    }
+    return 0;
+}
+
+static unsigned char * encode_y4m(mg_image * image, size_t * size) {
+    static const char marker[] = "FRAME\n";
+    unsigned int width = image->width, height = image->height;
+    unsigned int chroma_width = (width + 1) / 2, chroma_height = (height + 1) / 2;
+    size_t luma = (size_t) width * height, chroma = (size_t) chroma_width * chroma_height;
+    mg_pixel_layout layout = mg_pixel_format_layout(image->format);
+    unsigned char * data, * y, * u, * v;
+    unsigned int i, j;
+
+    *size = sizeof(marker) - 1 + luma + 2 * chroma;
+    data = malloc(*size);
+    if (data == 0) { return 0; }
+
+    memcpy(data, marker, sizeof(marker) - 1);
+    y = data + sizeof(marker) - 1;
+    u = y + luma;
+    v = u + chroma;
+
+    for (j = 0; j < height; ++j) {
+        const unsigned char * p = image->pixels + (size_t) j * width * 4;
+        for (i = 0; i < width; ++i, p += 4) {
+            int r = p[layout.r], g = p[layout.g], b = p[layout.b];
+            y[(size_t) j * width + i] = (unsigned char) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+        }
+    }
+
+    /* Average each 2x2 block for the chroma planes */
+    for (j = 0; j < chroma_height; ++j) {
+        for (i = 0; i < chroma_width; ++i) {
+            unsigned int x0 = 2 * i, y0 = 2 * j;
+            unsigned int x1 = x0 + 1 < width ? x0 + 1 : x0, y1 = y0 + 1 < height ? y0 + 1 : y0;
+            const unsigned char * p00 = image->pixels + ((size_t) y0 * width + x0) * 4;
+            const unsigned char * p01 = image->pixels + ((size_t) y0 * width + x1) * 4;
+            const unsigned char * p10 = image->pixels + ((size_t) y1 * width + x0) * 4;
+            const unsigned char * p11 = image->pixels + ((size_t) y1 * width + x1) * 4;
+            int r = (p00[layout.r] + p01[layout.r] + p10[layout.r] + p11[layout.r] + 2) / 4;
+            int g = (p00[layout.g] + p01[layout.g] + p10[layout.g] + p11[layout.g] + 2) / 4;
+            int b = (p00[layout.b] + p01[layout.b] + p10[layout.b] + p11[layout.b] + 2) / 4;
+            u[(size_t) j * chroma_width + i] = (unsigned char) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            v[(size_t) j * chroma_width + i] = (unsigned char) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+    }
+
+    return data;
+}
+
+static unsigned char * encode_raw(mg_image * image, mg_pixel_format format, size_t * size) {
+    size_t count = (size_t) image->width * image->height, i;
+    mg_pixel_layout from = mg_pixel_format_layout(image->format);
+    mg_pixel_layout to = mg_pixel_format_layout(format);
+    unsigned char * data;
+
+    *size = count * 4;
+    data = malloc(*size);
+    if (data == 0) { return 0; }
+
+    if (format == image->format) {
+        memcpy(data, image->pixels, *size);
+        return data;
+    }
+
+    for (i = 0; i < count; ++i) {
+        const unsigned char * p = image->pixels + i * 4;
+        mg_pixel_store(data + i * 4, to, p[from.r], p[from.g], p[from.b], p[from.a]);
+    }
+
+    return data;
+}
+
+#if defined(MG_HAVE_PNG)
+
+static unsigned char * encode_png(mg_image * image, size_t * size) {
+    static const png_uint_32 formats[] = {
+        PNG_FORMAT_RGBA, /* MG_PIXEL_FORMAT_RGBA */
+        PNG_FORMAT_BGRA, /* MG_PIXEL_FORMAT_BGRA */
+        PNG_FORMAT_ARGB, /* MG_PIXEL_FORMAT_ARGB */
+        PNG_FORMAT_ABGR  /* MG_PIXEL_FORMAT_ABGR */
+    };
+    png_image png;
+    png_alloc_size_t length = 0;
+    unsigned char * data;
+
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+    png.width = image->width;
+    png.height = image->height;
+    png.format = formats[image->format];
+
+    /* Find out how large the file will be, then write it */
+    if (!png_image_write_to_memory(&png, 0, &length, 0, image->pixels, 0, 0)) {
+        return 0;
+    }
+
+    data = malloc(length);
+    if (data == 0) { return 0; }
+
+    if (!png_image_write_to_memory(&png, data, &length, 0, image->pixels, 0, 0)) {
+        free(data);
+        return 0;
+    }
+
+    *size = length;
+    return data;
+}
+
+#else
+
+static unsigned char * encode_png(mg_image * image, size_t * size) {
+    return 0;
+}
+
+#endif
+
+static int write_frame(mg_capture * capture, encoded_t * frame) {
+    char path[PATH_MAX];
+    int fd, error;
+
+    if (capture->fd >= 0) {
+        return write_all(capture->fd, frame->data, frame->size);
+    }
+
+    snprintf(path, sizeof(path), "%s/%06llu.png",
+             capture->directory, (unsigned long long) frame->sequence);
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) { return errno; }
+
+    error = write_all(fd, frame->data, frame->size);
+    if (close(fd) != 0 && error == 0) { error = errno; }
+    return error;
+}
+
+static int write_all(int fd, const unsigned char * data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+
+        if (written < 0) {
+            if (errno == EINTR) { continue; }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd writable = { fd, POLLOUT, 0 };
+                poll(&writable, 1, -1);
+                continue;
+            }
+            return errno;
+        }
+
+        data += written;
+        size -= written;
+    }
+
+    return 0;
+}
+
+static void wait_idle(mg_capture * capture) {
+    pthread_mutex_lock(&capture->lock);
+    while (capture->encoding > 0) {
+        pthread_cond_wait(&capture->idle, &capture->lock);
+    }
+    pthread_mutex_unlock(&capture->lock);
+}
+
+static void capture_free(mg_capture * capture) {
+    if (capture->fd >= 0) { close(capture->fd); }
+    free(capture->directory);
+    pthread_cond_destroy(&capture->idle);
+    pthread_mutex_destroy(&capture->lock);
+    free(capture);
+}
+
+static void image_free(mg_image * image) {
+    mg_image_free(image);
+    free(image);
+}
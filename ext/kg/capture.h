@@ -0,0 +1,85 @@
+#ifndef MG_CAPTURE_H
+#define MG_CAPTURE_H
+
+#include "pixel_format.h"
+
+#include <stdint.h>
+
+/**
+ * Container the captured frames are encoded into.
+ */
+typedef enum {
+    MG_CAPTURE_Y4M, /** YUV4MPEG2 stream with 4:2:0 chroma. */
+    MG_CAPTURE_RAW, /** Frames of 32 bit pixels back to back, top row first. */
+    MG_CAPTURE_PNG  /** One PNG per frame. */
+} mg_capture_format;
+
+/**
+ * Describes where and how frames are recorded.
+ */
+typedef struct {
+    unsigned int width, height; /** Size of the area read back. */
+    mg_capture_format format;
+    mg_pixel_format pixel_format; /** Layout of raw frames. */
+    unsigned int rate; /** Frames per second stated in the Y4M header. */
+    int fd; /** Stream written to; duplicated, so the caller may close it. */
+    const char * directory; /** PNG files are written here instead, if not 0. */
+    unsigned int buffers; /** Reads in flight on the GPU. */
+    unsigned int queue; /** Frames being encoded or waiting to be written. */
+} mg_capture_options;
+
+/**
+ * Counters of a capture.
+ */
+typedef struct {
+    uint64_t frames; /** Frames offered to the capture. */
+    uint64_t written; /** Frames encoded and written out. */
+    uint64_t dropped; /** Frames skipped because the GPU or encoders fell behind. */
+    uint64_t bytes; /** Bytes written out. */
+    unsigned int pending; /** Frames read back or encoded but not yet written. */
+    int error; /** errno of the first failed write, zero if none. */
+} mg_capture_stats;
+
+/**
+ * Pipeline that records what's rendered without stalling the renderer. Frames
+ * are read back through a ring of pixel buffer objects, converted and encoded
+ * on the worker pool and written out in order. When any stage is full the
+ * frame is dropped instead of waited for, so memory use stays bounded.
+ *
+ * Except where noted, functions must be called with the OpenGL context that
+ * renders the frames current. None of them require the Ruby GVL.
+ */
+typedef struct mg_capture mg_capture;
+
+/**
+ * Starts a capture and writes the stream header, if any.
+ *
+ * Returns zero and sets the error message on failure.
+ */
+extern mg_capture * mg_capture_new(const mg_capture_options * options, const char ** error);
+
+/**
+ * Captures the frame in the current read framebuffer. Call it right before
+ * swapping buffers. Reads that have completed since the last call are handed
+ * to the encoders.
+ */
+extern void mg_capture_frame(mg_capture * capture);
+
+/**
+ * Returns the capture's counters. Doesn't require the context.
+ */
+extern mg_capture_stats mg_capture_get_stats(mg_capture * capture);
+
+/**
+ * Finishes every pending read, waits for the encoders to write them out and
+ * frees the capture. Returns the final counters.
+ */
+extern mg_capture_stats mg_capture_stop(mg_capture * capture);
+
+/**
+ * Discards pending reads, waits for the encoders and frees the capture.
+ * Doesn't require the context, for when it's about to be destroyed.
+ */
+extern void mg_capture_discard(mg_capture * capture);
+
+#endif /* MG_CAPTURE_H */
@@ -0,0 +1,412 @@
+#include "clock.h"
+
+#include "mg.h"
+#include "window.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+
+#include <ruby.h>
+#include <ruby/thread.h>
+
+VALUE mg_clock_class;
+
+/* Data structures */
+
+typedef struct clock_struct {
+    int timer; /** timerfd that expires once per frame, or -1. */
+    int wake; /** eventfd written to interrupt the wait, or -1. */
+    int running; /** Whether run should keep going. Set from any thread. */
+    uint64_t step; /** Simulated time per tick, in nanoseconds. */
+    uint64_t frame; /** Real time per frame, in nanoseconds. */
+    unsigned int max_ticks; /** Most ticks run per frame. */
+    uint64_t deadline; /** When the next frame is due. */
+    uint64_t previous; /** When the previous frame started. */
+    uint64_t accumulator; /** Real time not yet simulated. */
+    double alpha; /** Interpolation factor of the last frame. */
+    uint64_t ticks; /** Ticks run so far. */
+    uint64_t frames; /** Frames run so far. */
+    uint64_t overruns; /** Frames skipped because the previous ones ran late. */
+    uint64_t dropped_ticks; /** Ticks discarded to catch up with real time. */
+    uint64_t lateness_max; /** Longest delay between a deadline and its frame. */
+    uint64_t lateness_total;
+} clock_data_t;
+
+/**
+ * File descriptors waited on by run, and which of them became ready.
+ */
+typedef struct wait_struct {
+    VALUE self;
+    clock_data_t * clock;
+    int display; /** Display connection, or -1. */
+    int timer_ready;
+    int display_ready;
+} wait_t;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the clock encapsulated by the Ruby object.
+ */
+static clock_data_t * clock_from(VALUE self);
+
+/**
+ * Closes the clock's file descriptors and frees it.
+ */
+static void clock_free(void * p);
+
+/**
+ * Returns the time of CLOCK_MONOTONIC in nanoseconds.
+ */
+static uint64_t now(void);
+
+/**
+ * Arms the timer to expire every frame, starting one frame from now.
+ */
+static int arm(clock_data_t * clock);
+
+/**
+ * Waits until the timer expires, the display is readable or the wait is
+ * interrupted.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * wait_for_events(void * data);
+
+/**
+ * Unblocking function for wait_for_events.
+ */
+static void interrupt_wait(void * data);
+
+/**
+ * Runs the ticks due and the frame, given the number of timer expirations.
+ */
+static void advance(VALUE self, clock_data_t * clock, uint64_t expirations);
+
+/**
+ * Calls the handler stored in the instance variable, if any.
+ */
+static void call_handler(VALUE self, const char * handler, int argc, VALUE * argv);
+
+/**
+ * Body of run; waits and advances until stopped.
+ */
+static VALUE run_loop(VALUE data);
+
+/**
+ * Disarms the timer and marks the clock stopped, even if a handler raised.
+ */
+static VALUE stop_loop(VALUE self);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::Clock objects.
+ */
+static const rb_data_type_t clock_type = {
+    "Mg::Clock",
+    { 0, clock_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Clock interface implementation */
+
+VALUE mg_clock_alloc(VALUE klass) {
+    clock_data_t * clock = calloc(1, sizeof(clock_data_t));
+    if (clock == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for clock");
+    }
+    clock->timer = clock->wake = -1;
+    return TypedData_Wrap_Struct(klass, &clock_type, clock);
+}
+
+VALUE mg_clock_setup(VALUE self, VALUE tick_rate, VALUE frame_rate, VALUE max_ticks) {
+    clock_data_t * clock = 0;
+    double ticks, frames;
+
+    TypedData_Get_Struct(self, clock_data_t, &clock_type, clock);
+
+    Check_Type(max_ticks, T_FIXNUM);
+
+    ticks = NUM2DBL(tick_rate);
+    frames = NUM2DBL(frame_rate);
+
+    if (!(ticks > 0) || !(frames > 0) || FIX2INT(max_ticks) < 1) {
+        rb_raise(rb_eArgError, "rates and max ticks must be positive");
+    }
+
+    if (clock->timer >= 0) {
+        rb_raise(rb_eRuntimeError, "clock is already set up");
+    }
+
+    clock->step = (uint64_t) (1e9 / ticks);
+    clock->frame = (uint64_t) (1e9 / frames);
+    clock->max_ticks = FIX2UINT(max_ticks);
+
+    if (clock->step == 0 || clock->frame == 0) {
+        rb_raise(rb_eArgError, "rates must be at most one per nanosecond");
+    }
+
+    clock->timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (clock->timer < 0) {
+        rb_sys_fail("timerfd_create");
+    }
+
+    clock->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (clock->wake < 0) {
+        rb_sys_fail("eventfd");
+    }
+
+    return self;
+}
+
+VALUE mg_clock_run(VALUE self, VALUE dispatch) {
+    clock_data_t * clock = clock_from(self);
+    wait_t wait;
+
+    if (clock->running) {
+        rb_raise(rb_eRuntimeError, "clock is already running");
+    }
+
+    wait.self = self;
+    wait.clock = clock;
+    wait.display = RTEST(dispatch) ? FIX2INT(mg_window_display_fd(mg_module)) : -1;
+
+    if (!arm(clock)) {
+        rb_sys_fail("timerfd_settime");
+    }
+
+    clock->running = 1;
+    rb_ensure(run_loop, (VALUE) &wait, stop_loop, self);
+    return self;
+}
+
+VALUE mg_clock_stop(VALUE self) {
+    clock_data_t * clock = clock_from(self);
+    uint64_t one = 1;
+
+    __atomic_store_n(&clock->running, 0, __ATOMIC_RELAXED);
+
+    /* Wake run up if it's waiting */
+    if (write(clock->wake, &one, sizeof(one)) < 0) {
+        /* The counter is already set; run will wake up */
+    }
+
+    return Qnil;
+}
+
+VALUE mg_clock_running(VALUE self) {
+    return __atomic_load_n(&clock_from(self)->running, __ATOMIC_RELAXED) ? Qtrue : Qfalse;
+}
+
+VALUE mg_clock_alpha(VALUE self) {
+    return DBL2NUM(clock_from(self)->alpha);
+}
+
+VALUE mg_clock_stats(VALUE self) {
+    clock_data_t * clock = clock_from(self);
+    VALUE hash = rb_hash_new();
+    double average = 0;
+
+    if (clock->frames > 0) {
+        average = (double) clock->lateness_total / clock->frames / 1e9;
+    }
+
+    /* Times are reported in seconds, like Process.clock_gettime */
+    rb_hash_aset(hash, ID2SYM(rb_intern("ticks")),            ULL2NUM(clock->ticks));
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")),           ULL2NUM(clock->frames));
+    rb_hash_aset(hash, ID2SYM(rb_intern("overruns")),         ULL2NUM(clock->overruns));
+    rb_hash_aset(hash, ID2SYM(rb_intern("dropped_ticks")),    ULL2NUM(clock->dropped_ticks));
+    rb_hash_aset(hash, ID2SYM(rb_intern("lateness_max")),     DBL2NUM(clock->lateness_max / 1e9));
+    rb_hash_aset(hash, ID2SYM(rb_intern("lateness_average")), DBL2NUM(average));
+    return hash;
+}
+
+void init_mg_clock_class_under(VALUE module) {
+    mg_clock_class = rb_define_class_under(module, "Clock", rb_cObject);
+    rb_define_alloc_func(mg_clock_class, mg_clock_alloc);
+    rb_define_private_method(mg_clock_class, "setup",     mg_clock_setup, 3);
+    rb_define_private_method(mg_clock_class, "run_clock", mg_clock_run,   1);
+    rb_define_method(mg_clock_class, "stop",     mg_clock_stop,    0);
+    rb_define_method(mg_clock_class, "running?", mg_clock_running, 0);
+    rb_define_method(mg_clock_class, "alpha",    mg_clock_alpha,   0);
+    rb_define_method(mg_clock_class, "stats",    mg_clock_stats,   0);
+}
+
+/* Helper function implementation */
+
+static clock_data_t * clock_from(VALUE self) {
+    clock_data_t * clock = 0;
+    TypedData_Get_Struct(self, clock_data_t, &clock_type, clock);
+    if (clock->timer < 0) {
+        rb_raise(rb_eRuntimeError, "clock is not set up");
+    }
+    return clock;
+}
+
+static void clock_free(void * p) {
+    clock_data_t * clock = (clock_data_t *) p;
+    if (clock->timer >= 0) { close(clock->timer); }
+    if (clock->wake >= 0) { close(clock->wake); }
+    free(clock);
+}
+
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + (uint64_t) t.tv_nsec;
+}
+
+static int arm(clock_data_t * clock) {
+    struct itimerspec spec;
+
+    clock->previous = now();
+    clock->deadline = clock->previous + clock->frame;
+    clock->accumulator = 0;
+
+    /* Absolute deadlines keep frames from drifting */
+    spec.it_value.tv_sec = (time_t) (clock->deadline / 1000000000ULL);
+    spec.it_value.tv_nsec = (long) (clock->deadline % 1000000000ULL);
+    spec.it_interval.tv_sec = (time_t) (clock->frame / 1000000000ULL);
+    spec.it_interval.tv_nsec = (long) (clock->frame % 1000000000ULL);
+
+    return timerfd_settime(clock->timer, TFD_TIMER_ABSTIME, &spec, 0) == 0;
+}
+
+static void * wait_for_events(void * data) {
+    wait_t * wait = data;
+    struct pollfd fds[3];
+    nfds_t count = 2;
+
+    fds[0].fd = wait->clock->timer;
+    fds[0].events = POLLIN;
+    fds[1].fd = wait->clock->wake;
+    fds[1].events = POLLIN;
+
+    if (wait->display >= 0) {
+        fds[2].fd = wait->display;
+        fds[2].events = POLLIN;
+        ++count;
+    }
+
+    wait->timer_ready = wait->display_ready = 0;
+
+    if (poll(fds, count, -1) > 0) {
+        wait->timer_ready = (fds[0].revents & POLLIN) != 0;
+        wait->display_ready = count > 2 && fds[2].revents != 0;
+    }
+
+    return 0;
+}
+
+static void interrupt_wait(void * data) {
+    wait_t * wait = data;
+    uint64_t one = 1;
+
+    if (write(wait->clock->wake, &one, sizeof(one)) < 0) {
+        /* The counter is already set; the wait will end */
+    }
+}
+
+static void advance(VALUE self, clock_data_t * clock, uint64_t expirations) {
+    uint64_t time = now(), elapsed, lateness;
+    unsigned int ticks = 0;
+    VALUE args[2];
+
+    /* Expirations beyond the first are frames that were never run */
+    clock->overruns += expirations - 1;
+    clock->deadline += (expirations - 1) * clock->frame;
+
+    lateness = time > clock->deadline ? time - clock->deadline : 0;
+    if (lateness > clock->lateness_max) { clock->lateness_max = lateness; }
+    clock->lateness_total += lateness;
+    clock->deadline += clock->frame;
+
+    elapsed = time - clock->previous;
+    clock->previous = time;
+    clock->accumulator += elapsed;
+
+    /* Simulate the elapsed time in fixed steps */
+    args[0] = DBL2NUM(clock->step / 1e9);
+    while (clock->accumulator >= clock->step && clock->running) {
+        if (ticks == clock->max_ticks) {
+            /* Too far behind to catch up; let the simulation slow down */
+            clock->dropped_ticks += clock->accumulator / clock->step;
+            clock->accumulator %= clock->step;
+            break;
+        }
+        call_handler(self, "@tick_handler", 1, args);
+        clock->accumulator -= clock->step;
+        ++clock->ticks;
+        ++ticks;
+    }
+
+    if (!clock->running) { return; }
+
+    /* Render the state between the last tick and the next */
+    clock->alpha = (double) clock->accumulator / clock->step;
+    args[0] = DBL2NUM(clock->alpha);
+    args[1] = DBL2NUM(elapsed / 1e9);
+    call_handler(self, "@frame_handler", 2, args);
+    ++clock->frames;
+}
+
+static void call_handler(VALUE self, const char * handler, int argc, VALUE * argv) {
+    VALUE proc = rb_iv_get(self, handler);
+    if (!NIL_P(proc)) {
+        rb_funcallv(proc, rb_intern("call"), argc, argv);
+    }
+}
+
+static VALUE run_loop(VALUE data) {
+    wait_t * wait = (wait_t *) data;
+    clock_data_t * clock = wait->clock;
+    VALUE self = wait->self;
+    uint64_t expirations, count;
+
+    while (clock->running) {
+        /* Xlib may have read events ahead; handle them before waiting */
+        if (wait->display >= 0) {
+            mg_window_dispatch_pending(mg_module);
+        }
+
+        if (!clock->running) { break; }
+
+        rb_thread_call_without_gvl(wait_for_events, wait, interrupt_wait, wait);
+
+        /* Reset the wake up counter and let Ruby raise or run trap handlers */
+        if (read(clock->wake, &count, sizeof(count)) < 0) {
+            /* Nothing was written */
+        }
+        rb_thread_check_ints();
+
+        if (wait->timer_ready &&
+            read(clock->timer, &expirations, sizeof(expirations)) == sizeof(expirations) &&
+            expirations > 0) {
+            advance(self, clock, expirations);
+        }
+    }
+
+    return Qnil;
+}
+
+static VALUE stop_loop(VALUE self) {
+    clock_data_t * clock = 0;
+    struct itimerspec spec;
+
+    TypedData_Get_Struct(self, clock_data_t, &clock_type, clock);
+
+    memset(&spec, 0, sizeof(spec));
+    timerfd_settime(clock->timer, 0, &spec, 0);
+    clock->running = 0;
+    return Qnil;
+}
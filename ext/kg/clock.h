@@ -0,0 +1,60 @@
+#ifndef MG_CLOCK_H
+#define MG_CLOCK_H
+
+#include <ruby.h>
+
+/**
+ * Mg::Clock class.
+ */
+extern VALUE mg_clock_class;
+
+/**
+ * Allocates a clock with no timer.
+ */
+extern VALUE mg_clock_alloc(VALUE klass);
+
+/**
+ * Creates the clock's timer. Ticks happen tick_rate times per second of
+ * simulated time and frames frame_rate times per second of real time; at most
+ * max_ticks ticks are run per frame.
+ */
+extern VALUE mg_clock_setup(VALUE self, VALUE tick_rate, VALUE frame_rate, VALUE max_ticks);
+
+/**
+ * Runs the clock until it's stopped, calling the tick handler with the fixed
+ * time step and the frame handler with the interpolation factor and the real
+ * time elapsed since the previous frame.
+ *
+ * Waits for the timer WITHOUT the GVL. If dispatch is true, also waits for
+ * the display connection and calls Mg.dispatch_pending when it's readable.
+ */
+extern VALUE mg_clock_run(VALUE self, VALUE dispatch);
+
+/**
+ * Makes the clock return from run after the current tick or frame. May be
+ * called from a handler or another thread.
+ */
+extern VALUE mg_clock_stop(VALUE self);
+
+/**
+ * Returns whether the clock is running.
+ */
+extern VALUE mg_clock_running(VALUE self);
+
+/**
+ * Returns the interpolation factor of the last frame: how far the simulation
+ * is between the last tick and the next, from 0 to 1.
+ */
+extern VALUE mg_clock_alpha(VALUE self);
+
+/**
+ * Returns the clock's counters in a Hash.
+ */
+extern VALUE mg_clock_stats(VALUE self);
+
+/**
+ * Initializes the Clock class.
+ */
+extern void init_mg_clock_class_under(VALUE module);
+
+#endif /* MG_CLOCK_H */
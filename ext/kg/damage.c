@@ -0,0 +1,97 @@
+#include "damage.h"
+
+/* Helper function prototypes */
+
+/**
+ * Returns whether the rectangles overlap or touch.
+ */
+static int touching(const mg_rect * a, const mg_rect * b);
+
+/**
+ * Grows the rectangle to also cover the other one.
+ */
+static void unite(mg_rect * a, const mg_rect * b);
+
+/* Damage interface implementation */
+
+void mg_damage_reset(mg_damage * damage, int width, int height) {
+    damage->width = width;
+    damage->height = height;
+    damage->count = 0;
+}
+
+void mg_damage_add(mg_damage * damage, int x, int y, int width, int height) {
+    mg_rect rect;
+    unsigned int i;
+
+    /* Clip to the surface */
+    if (x < 0) { width += x; x = 0; }
+    if (y < 0) { height += y; y = 0; }
+    if (width > damage->width - x) { width = damage->width - x; }
+    if (height > damage->height - y) { height = damage->height - y; }
+    if (width <= 0 || height <= 0) { return; }
+
+    rect.x = x;
+    rect.y = y;
+    rect.width = width;
+    rect.height = height;
+
+    /* Absorb every rectangle the new one touches, until none is left */
+    for (i = 0; i < damage->count; ) {
+        if (touching(&rect, &damage->rects[i])) {
+            unite(&rect, &damage->rects[i]);
+            damage->rects[i] = damage->rects[--damage->count];
+            i = 0;
+        } else {
+            ++i;
+        }
+    }
+
+    /* Too fragmented to be worth pushing piece by piece */
+    if (damage->count == MG_DAMAGE_MAX_RECTS) {
+        for (i = 0; i < damage->count; ++i) {
+            unite(&rect, &damage->rects[i]);
+        }
+        damage->count = 0;
+    }
+
+    damage->rects[damage->count++] = rect;
+}
+
+void mg_damage_add_all(mg_damage * damage) {
+    mg_damage_add(damage, 0, 0, damage->width, damage->height);
+}
+
+uint64_t mg_damage_area(const mg_damage * damage) {
+    uint64_t area = 0;
+    unsigned int i;
+
+    for (i = 0; i < damage->count; ++i) {
+        area += (uint64_t) damage->rects[i].width * damage->rects[i].height;
+    }
+
+    return area;
+}
+
+int mg_damage_full(const mg_damage * damage) {
+    return mg_damage_area(damage) == (uint64_t) damage->width * damage->height;
+}
+
+/* Helper function implementation */
+
+static int touching(const mg_rect * a, const mg_rect * b) {
+    return a->x <= b->x + b->width  && b->x <= a->x + a->width &&
+           a->y <= b->y + b->height && b->y <= a->y + a->height;
+}
+
+static void unite(mg_rect * a, const mg_rect * b) {
+    int right = a->x + a->width, bottom = a->y + a->height;
+
+    if (b->x + b->width > right) { right = b->x + b->width; }
+    if (b->y + b->height > bottom) { bottom = b->y + b->height; }
+    if (b->x < a->x) { a->x = b->x; }
+    if (b->y < a->y) { a->y = b->y; }
+
+    a->width = right - a->x;
+    a->height = bottom - a->y;
+}
@@ -0,0 +1,55 @@
+#ifndef MG_DAMAGE_H
+#define MG_DAMAGE_H
+
+#include <stdint.h>
+
+/**
+ * Most rectangles a damage region holds before collapsing into their bounds.
+ */
+#define MG_DAMAGE_MAX_RECTS 16
+
+/**
+ * Axis aligned rectangle; the origin is the top left corner.
+ */
+typedef struct {
+    int x, y;
+    int width, height;
+} mg_rect;
+
+/**
+ * Parts of a width by height surface that changed since it was last
+ * presented. Overlapping rectangles are merged as they're added, so no pixel
+ * is counted or pushed twice.
+ */
+typedef struct {
+    int width, height; /** Size of the surface the rectangles are clipped to. */
+    unsigned int count;
+    mg_rect rects[MG_DAMAGE_MAX_RECTS];
+} mg_damage;
+
+/**
+ * Empties the region and sets the size of the surface.
+ */
+extern void mg_damage_reset(mg_damage * damage, int width, int height);
+
+/**
+ * Adds the rectangle to the region, clipped to the surface.
+ */
+extern void mg_damage_add(mg_damage * damage, int x, int y, int width, int height);
+
+/**
+ * Adds the whole surface to the region.
+ */
+extern void mg_damage_add_all(mg_damage * damage);
+
+/**
+ * Returns the number of pixels in the region.
+ */
+extern uint64_t mg_damage_area(const mg_damage * damage);
+
+/**
+ * Returns whether the region covers the whole surface.
+ */
+extern int mg_damage_full(const mg_damage * damage);
+
+#endif /* MG_DAMAGE_H */
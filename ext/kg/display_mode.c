@@ -6,6 +6,8 @@
 
 #include <ruby.h>
 
+VALUE mg_display_mode_class;
+
 VALUE mg_display_mode_get_current_mode(VALUE klass) {
     return mg_native_display_mode_get_current_mode(klass);
 }
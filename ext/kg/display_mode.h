@@ -6,7 +6,7 @@
 /**
  * DisplayMode class.
  */
-VALUE mg_display_mode_class;
+extern VALUE mg_display_mode_class;
 
 /**
  * Returns the display mode that's currently in use.
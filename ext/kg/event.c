@@ -4,12 +4,50 @@
 
 #include <stdio.h>
 
+/* Keyboard key symbols */
+
+VALUE mg_event_keyboard_key_a_symbol;
+VALUE mg_event_keyboard_key_b_symbol;
+VALUE mg_event_keyboard_key_c_symbol;
+VALUE mg_event_keyboard_key_d_symbol;
+VALUE mg_event_keyboard_key_e_symbol;
+VALUE mg_event_keyboard_key_f_symbol;
+VALUE mg_event_keyboard_key_g_symbol;
+VALUE mg_event_keyboard_key_h_symbol;
+VALUE mg_event_keyboard_key_i_symbol;
+VALUE mg_event_keyboard_key_j_symbol;
+VALUE mg_event_keyboard_key_k_symbol;
+VALUE mg_event_keyboard_key_l_symbol;
+VALUE mg_event_keyboard_key_m_symbol;
+VALUE mg_event_keyboard_key_n_symbol;
+VALUE mg_event_keyboard_key_o_symbol;
+VALUE mg_event_keyboard_key_p_symbol;
+VALUE mg_event_keyboard_key_q_symbol;
+VALUE mg_event_keyboard_key_r_symbol;
+VALUE mg_event_keyboard_key_s_symbol;
+VALUE mg_event_keyboard_key_t_symbol;
+VALUE mg_event_keyboard_key_u_symbol;
+VALUE mg_event_keyboard_key_v_symbol;
+VALUE mg_event_keyboard_key_w_symbol;
+VALUE mg_event_keyboard_key_x_symbol;
+VALUE mg_event_keyboard_key_y_symbol;
+VALUE mg_event_keyboard_key_z_symbol;
+VALUE mg_event_keyboard_key_unsupported_symbol;
+
 /* Event handler method IDs */
 
 static ID mg_event_window_close_handler;
 static ID mg_event_keyboard_key_press_handler;
 static ID mg_event_keyboard_key_release_handler;
 static ID call;
+static ID arity;
+
+/* Keyboard key and mouse button indexes, by symbol ID */
+
+static st_table * keyboard_key_indexes;
+static ID mouse_button_left;
+static ID mouse_button_middle;
+static ID mouse_button_right;
 
 /* Helper function prototypes */
 
@@ -24,8 +62,39 @@ static void mg_event_init_sym(VALUE *, const char *);
  */
 static VALUE mg_event_call_handler(VALUE window, ID handler, VALUE args);
 
+/**
+ * Returns whether the handler can be called with the given number of
+ * arguments. Blocks ignore extra arguments; lambdas and methods may not.
+ */
+static int mg_event_handler_accepts(VALUE handler, long count);
+
 /* Event interface implementation */
 
+int mg_event_keyboard_key_index(VALUE key) {
+    st_data_t index;
+    if (SYMBOL_P(key) && st_lookup(keyboard_key_indexes, (st_data_t) SYM2ID(key), &index)) {
+        return (int) index;
+    }
+    return -1;
+}
+
+int mg_event_mouse_button_index(VALUE button) {
+    ID id;
+
+    /* Buttons are numbered from 1, as in X */
+    if (FIXNUM_P(button)) {
+        return FIX2LONG(button) > 0 && FIX2LONG(button) < 32 ? FIX2INT(button) : -1;
+    }
+
+    if (!SYMBOL_P(button)) { return -1; }
+
+    id = SYM2ID(button);
+    if (id == mouse_button_left)   { return 1; }
+    if (id == mouse_button_middle) { return 2; }
+    if (id == mouse_button_right)  { return 3; }
+    return -1;
+}
+
 VALUE mg_event_call_close_handler(VALUE window) {
     return mg_event_call_handler(window,
                                  mg_event_window_close_handler,
@@ -33,6 +102,14 @@ VALUE mg_event_call_close_handler(VALUE window) {
 }
 
 VALUE mg_event_call_key_press_handler(VALUE window, VALUE args) {
+    VALUE handler = rb_ivar_get(window, mg_event_keyboard_key_press_handler);
+
+    /* The repeat flag came later; handlers written before it don't get it */
+    if (!NIL_P(handler) && RB_TYPE_P(args, T_ARRAY) && RARRAY_LEN(args) > 1 &&
+        !mg_event_handler_accepts(handler, RARRAY_LEN(args))) {
+        args = rb_ary_new_from_values(1, RARRAY_CONST_PTR(args));
+    }
+
     return mg_event_call_handler(window,
                                  mg_event_keyboard_key_press_handler,
                                  args);
@@ -45,11 +122,15 @@ VALUE mg_event_call_key_release_handler(VALUE window, VALUE args) {
 }
 
 void init_mg_window_events() {
+    VALUE * keys[MG_EVENT_KEYBOARD_KEY_COUNT];
+    int i;
+
     /* Define event handler instance variable and method IDs */
     mg_event_window_close_handler = rb_intern("@close_handler");
     mg_event_keyboard_key_press_handler = rb_intern("@key_press_handler");
     mg_event_keyboard_key_release_handler = rb_intern("@key_release_handler");
     call = rb_intern("call");
+    arity = rb_intern("arity");
 
     /* Initialize keyboard key symbols */
     mg_event_init_sym(&mg_event_keyboard_key_a_symbol, "a");
@@ -81,6 +162,43 @@ void init_mg_window_events() {
 
     /* Special symbols */
     mg_event_init_sym(&mg_event_keyboard_key_unsupported_symbol, "unsupported");
+
+    /* Index the keys so that their state can be looked up in constant time */
+    keys[0]  = &mg_event_keyboard_key_a_symbol;
+    keys[1]  = &mg_event_keyboard_key_b_symbol;
+    keys[2]  = &mg_event_keyboard_key_c_symbol;
+    keys[3]  = &mg_event_keyboard_key_d_symbol;
+    keys[4]  = &mg_event_keyboard_key_e_symbol;
+    keys[5]  = &mg_event_keyboard_key_f_symbol;
+    keys[6]  = &mg_event_keyboard_key_g_symbol;
+    keys[7]  = &mg_event_keyboard_key_h_symbol;
+    keys[8]  = &mg_event_keyboard_key_i_symbol;
+    keys[9]  = &mg_event_keyboard_key_j_symbol;
+    keys[10] = &mg_event_keyboard_key_k_symbol;
+    keys[11] = &mg_event_keyboard_key_l_symbol;
+    keys[12] = &mg_event_keyboard_key_m_symbol;
+    keys[13] = &mg_event_keyboard_key_n_symbol;
+    keys[14] = &mg_event_keyboard_key_o_symbol;
+    keys[15] = &mg_event_keyboard_key_p_symbol;
+    keys[16] = &mg_event_keyboard_key_q_symbol;
+    keys[17] = &mg_event_keyboard_key_r_symbol;
+    keys[18] = &mg_event_keyboard_key_s_symbol;
+    keys[19] = &mg_event_keyboard_key_t_symbol;
+    keys[20] = &mg_event_keyboard_key_u_symbol;
+    keys[21] = &mg_event_keyboard_key_v_symbol;
+    keys[22] = &mg_event_keyboard_key_w_symbol;
+    keys[23] = &mg_event_keyboard_key_x_symbol;
+    keys[24] = &mg_event_keyboard_key_y_symbol;
+    keys[25] = &mg_event_keyboard_key_z_symbol;
+
+    keyboard_key_indexes = st_init_numtable();
+    for (i = 0; i < MG_EVENT_KEYBOARD_KEY_COUNT; ++i) {
+        st_insert(keyboard_key_indexes, (st_data_t) SYM2ID(*keys[i]), (st_data_t) i);
+    }
+
+    mouse_button_left   = rb_intern("left");
+    mouse_button_middle = rb_intern("middle");
+    mouse_button_right  = rb_intern("right");
 }
 
 /* Helper function implementation */
@@ -93,6 +211,22 @@ static void mg_event_init_sym(VALUE * constant, const char * symbol) {
     rb_global_variable(constant);
 }
 
+static int mg_event_handler_accepts(VALUE handler, long count) {
+    int required;
+
+    if (rb_obj_is_proc(handler)) {
+        if (!rb_proc_lambda_p(handler)) { return 1; }
+        required = rb_proc_arity(handler);
+    } else if (rb_respond_to(handler, arity)) {
+        required = NUM2INT(rb_funcall(handler, arity, 0));
+    } else {
+        return 1;
+    }
+
+    /* Negative arities count the required arguments, then allow any more */
+    return required < 0 ? -required - 1 <= count : required == count;
+}
+
 static VALUE mg_event_call_handler(VALUE window, ID handler, VALUE args) {
     VALUE proc;
     proc = rb_ivar_get(window, handler);
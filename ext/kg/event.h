@@ -5,36 +5,54 @@
 
 /* Keyboard key symbols */
 
-VALUE mg_event_keyboard_key_a_symbol;
-VALUE mg_event_keyboard_key_b_symbol;
-VALUE mg_event_keyboard_key_c_symbol;
-VALUE mg_event_keyboard_key_d_symbol;
-VALUE mg_event_keyboard_key_e_symbol;
-VALUE mg_event_keyboard_key_f_symbol;
-VALUE mg_event_keyboard_key_g_symbol;
-VALUE mg_event_keyboard_key_h_symbol;
-VALUE mg_event_keyboard_key_i_symbol;
-VALUE mg_event_keyboard_key_j_symbol;
-VALUE mg_event_keyboard_key_k_symbol;
-VALUE mg_event_keyboard_key_l_symbol;
-VALUE mg_event_keyboard_key_m_symbol;
-VALUE mg_event_keyboard_key_n_symbol;
-VALUE mg_event_keyboard_key_o_symbol;
-VALUE mg_event_keyboard_key_p_symbol;
-VALUE mg_event_keyboard_key_q_symbol;
-VALUE mg_event_keyboard_key_r_symbol;
-VALUE mg_event_keyboard_key_s_symbol;
-VALUE mg_event_keyboard_key_t_symbol;
-VALUE mg_event_keyboard_key_u_symbol;
-VALUE mg_event_keyboard_key_v_symbol;
-VALUE mg_event_keyboard_key_w_symbol;
-VALUE mg_event_keyboard_key_x_symbol;
-VALUE mg_event_keyboard_key_y_symbol;
-VALUE mg_event_keyboard_key_z_symbol;
-VALUE mg_event_keyboard_key_unsupported_symbol;
+extern VALUE mg_event_keyboard_key_a_symbol;
+extern VALUE mg_event_keyboard_key_b_symbol;
+extern VALUE mg_event_keyboard_key_c_symbol;
+extern VALUE mg_event_keyboard_key_d_symbol;
+extern VALUE mg_event_keyboard_key_e_symbol;
+extern VALUE mg_event_keyboard_key_f_symbol;
+extern VALUE mg_event_keyboard_key_g_symbol;
+extern VALUE mg_event_keyboard_key_h_symbol;
+extern VALUE mg_event_keyboard_key_i_symbol;
+extern VALUE mg_event_keyboard_key_j_symbol;
+extern VALUE mg_event_keyboard_key_k_symbol;
+extern VALUE mg_event_keyboard_key_l_symbol;
+extern VALUE mg_event_keyboard_key_m_symbol;
+extern VALUE mg_event_keyboard_key_n_symbol;
+extern VALUE mg_event_keyboard_key_o_symbol;
+extern VALUE mg_event_keyboard_key_p_symbol;
+extern VALUE mg_event_keyboard_key_q_symbol;
+extern VALUE mg_event_keyboard_key_r_symbol;
+extern VALUE mg_event_keyboard_key_s_symbol;
+extern VALUE mg_event_keyboard_key_t_symbol;
+extern VALUE mg_event_keyboard_key_u_symbol;
+extern VALUE mg_event_keyboard_key_v_symbol;
+extern VALUE mg_event_keyboard_key_w_symbol;
+extern VALUE mg_event_keyboard_key_x_symbol;
+extern VALUE mg_event_keyboard_key_y_symbol;
+extern VALUE mg_event_keyboard_key_z_symbol;
+extern VALUE mg_event_keyboard_key_unsupported_symbol;
+
+/**
+ * Number of keyboard keys whose state is tracked. Keys are indexed in
+ * alphabetical order of their symbols.
+ */
+#define MG_EVENT_KEYBOARD_KEY_COUNT 26
 
 /* Event interface */
 
+/**
+ * Returns the index of the keyboard key identified by the symbol, or -1 if
+ * the key isn't supported.
+ */
+extern int mg_event_keyboard_key_index(VALUE key);
+
+/**
+ * Returns the number of the mouse button identified by the symbol or integer,
+ * or -1 if the button isn't supported.
+ */
+extern int mg_event_mouse_button_index(VALUE button);
+
 /**
  * Calls the window's close event handler with the given arguments.
  */
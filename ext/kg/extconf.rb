@@ -3,12 +3,48 @@ require 'rbconfig'
 
 libs = %w(GL GLU).each { |lib| have_library lib }
 
+have_library 'pthread'
+
+have_func 'rb_ext_ractor_safe', 'ruby.h'
+have_header 'ruby/io/buffer.h'
+
+$defs << '-DMG_HAVE_PNG' if have_header('png.h') && have_library('png')
+$defs << '-DMG_HAVE_ALSA' if have_header('alsa/asoundlib.h') && have_library('asound')
+$defs << '-DMG_HAVE_EGL' if have_header('EGL/egl.h') && have_library('EGL')
+$defs << '-DMG_HAVE_FREETYPE' if pkg_config('freetype2') && have_header('ft2build.h')
+
 case RbConfig::CONFIG['host_os']
   when /linux/
     $defs << '-DMG_PLATFORM_LINUX'
     if have_library 'X11'
       $defs << '-DMG_PLATFORM_LINUX_X11'
       have_library 'Xrandr'
+      if have_header('X11/Xcursor/Xcursor.h') && have_library('Xcursor')
+        $defs << '-DMG_HAVE_XCURSOR'
+      end
+      if have_header('X11/Xlib-xcb.h') && have_library('X11-xcb') && have_library('xcb')
+        $defs << '-DMG_HAVE_XCB'
+        if have_header('xcb/randr.h') && have_library('xcb-randr')
+          $defs << '-DMG_HAVE_XCB_RANDR'
+        end
+        if have_header('xcb/present.h') && have_library('xcb-present') &&
+           have_header('xcb/xfixes.h') && have_library('xcb-xfixes')
+          $defs << '-DMG_HAVE_XCB_PRESENT'
+        end
+        if have_header('xcb/shm.h') && have_library('xcb-shm')
+          $defs << '-DMG_HAVE_XCB_SHM'
+          if have_header('xcb/damage.h') && have_library('xcb-damage') &&
+             have_header('xcb/xfixes.h') && have_library('xcb-xfixes')
+            $defs << '-DMG_HAVE_XCB_DAMAGE'
+          end
+        end
+      end
+      if have_header('X11/extensions/XInput2.h') && have_library('Xi')
+        $defs << '-DMG_HAVE_XINPUT2'
+      end
+      if have_header('X11/extensions/XShm.h', 'X11/Xlib.h') && have_library('Xext')
+        $defs << '-DMG_HAVE_XSHM'
+      end
     end
   when /win/
     $defs << '-DMG_PLATFORM_WINDOWS'
@@ -0,0 +1,21 @@
+#include "extension.h"
+
+#include <string.h>
+
+/* Extension interface implementation */
+
+int mg_has_extension(const char * extensions, const char * extension) {
+    size_t length = strlen(extension);
+    const char * p = extensions;
+
+    if (extensions == 0 || length == 0) { return 0; }
+
+    while ((p = strstr(p, extension)) != 0) {
+        if ((p == extensions || p[-1] == ' ') && (p[length] == ' ' || p[length] == '\0')) {
+            return 1;
+        }
+        p += length;
+    }
+
+    return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef MG_EXTENSION_H
+#define MG_EXTENSION_H
+
+/**
+ * Returns whether the list of extensions, as returned by glGetString,
+ * glXQueryExtensionsString or eglQueryString, contains the named one. Names
+ * are separated by spaces and may be prefixes of each other, so only whole
+ * names match. The list may be null.
+ */
+extern int mg_has_extension(const char * extensions, const char * extension);
+
+#endif /* MG_EXTENSION_H */
@@ -0,0 +1,469 @@
+#include "font.h"
+
+#include "gl_state.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+
+#include <ruby.h>
+#include <ruby/encoding.h>
+#include <ruby/thread.h>
+
+#include <GL/gl.h>
+
+VALUE mg_font_class;
+
+/* Data structures */
+
+typedef struct {
+    const void * context; /** Context the texture belongs to. */
+    uint64_t state; /** Identifier of the context's state cache, or 0 if it has none. */
+    GLuint name; /** Texture name, or 0 until uploaded. */
+    unsigned int first, end; /** Atlas rows changed since the last upload, end exclusive. */
+    int resized; /** Whether the whole atlas must be uploaded. */
+} atlas_texture_t;
+
+typedef struct font_struct {
+    mg_glyph_cache * cache; /** Glyphs and layouts, or 0 until set up. */
+    atlas_texture_t * textures; /** Atlas texture of each context drawn into. */
+    size_t texture_count;
+    size_t texture_capacity;
+    pthread_mutex_t lock;
+    pthread_cond_t idle; /** Signaled when the last reader is done. */
+    unsigned int readers; /** Renders reading the atlas WITHOUT the GVL. */
+} font_t;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the font encapsulated by the Ruby object. Raises a Ruby exception
+ * if it wasn't set up.
+ */
+static font_t * font_from(VALUE self);
+
+/**
+ * Returns the atlas texture of the context current on the calling thread, or
+ * zero if nothing was drawn in it. Contexts don't share objects, so each one
+ * gets a texture of its own.
+ */
+static atlas_texture_t * find_texture(font_t * font, mg_gl_state * gl);
+
+/**
+ * Returns the atlas texture of the current context, adding one to upload if
+ * there is none. Raises a Ruby exception if out of memory.
+ */
+static atlas_texture_t * texture_for(font_t * font, mg_gl_state * gl);
+
+/**
+ * Deletes the texture from the current context, which must be its own, and
+ * forgets it.
+ */
+static void delete_texture(font_t * font, atlas_texture_t * texture, mg_gl_state * gl);
+
+/**
+ * Marks the atlas rows that changed since the last call in every texture.
+ */
+static void take_dirty(font_t * font);
+
+/**
+ * Brings the atlas texture up to date with the atlas, uploading only the rows
+ * that changed, and leaves it bound. Changes the unpack alignment, which the
+ * caller restores.
+ */
+static void upload_atlas(font_t * font, atlas_texture_t * texture, mg_gl_state * gl);
+
+/**
+ * Waits, without the GVL, until no render reads the atlas. Readers only start
+ * with the GVL held, so none can until the caller releases it again.
+ */
+static void wait_for_readers(font_t * font);
+
+/**
+ * Blocks until the font has no readers. Called WITHOUT the GVL.
+ */
+static void * wait_idle(void * data);
+
+/**
+ * Frees the glyph cache and the font, deleting the texture of the context
+ * current on the calling thread. The textures of other contexts can't be
+ * deleted without them, and go away along with them.
+ */
+static void font_free(void * p);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::Font objects.
+ */
+static const rb_data_type_t font_type = {
+    "Mg::Font",
+    { 0, font_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Font interface implementation */
+
+VALUE mg_font_alloc(VALUE klass) {
+    font_t * font = calloc(1, sizeof(font_t));
+
+    if (font == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for font");
+    }
+
+    pthread_mutex_init(&font->lock, 0);
+    pthread_cond_init(&font->idle, 0);
+    return TypedData_Wrap_Struct(klass, &font_type, font);
+}
+
+VALUE mg_font_setup(VALUE self, VALUE path, VALUE size) {
+    font_t * font = 0;
+    mg_glyph_cache * cache = 0;
+    const char * error;
+    int pixels = NUM2INT(size);
+    TypedData_Get_Struct(self, font_t, &font_type, font);
+
+    if (!NIL_P(path)) {
+        FilePathValue(path);
+        if (!mg_glyph_cache_has_freetype()) {
+            rb_raise(rb_eNotImpError, "font files require FreeType, which mg was built without");
+        }
+    }
+
+    if (pixels <= 0) {
+        rb_raise(rb_eArgError, "font size must be positive");
+    }
+
+    error = mg_glyph_cache_open(NIL_P(path) ? 0 : RSTRING_PTR(path), pixels, &cache);
+    if (error) {
+        if (NIL_P(path)) { rb_raise(rb_eRuntimeError, "%s", error); }
+        rb_raise(rb_eRuntimeError, "%s: %s", error, RSTRING_PTR(path));
+    }
+
+    wait_for_readers(font);
+    mg_glyph_cache_free(font->cache);
+    font->cache = cache;
+    return self;
+}
+
+mg_glyph_cache * mg_font_from(VALUE self) {
+    return font_from(self)->cache;
+}
+
+const mg_text_layout * mg_font_layout(VALUE self, VALUE text) {
+    font_t * font = font_from(self);
+    const mg_text_layout * layout;
+
+    StringValue(text);
+    text = rb_str_conv_enc(text, rb_enc_get(text), rb_utf8_encoding());
+
+    /* Laying out may grow the atlas, moving it */
+    wait_for_readers(font);
+    layout = mg_glyph_cache_layout(font->cache, RSTRING_PTR(text), RSTRING_LEN(text));
+    if (layout == 0) {
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for text layout");
+    }
+
+    return layout;
+}
+
+void mg_font_begin_read(VALUE self) {
+    font_t * font = font_from(self);
+    pthread_mutex_lock(&font->lock);
+    ++font->readers;
+    pthread_mutex_unlock(&font->lock);
+}
+
+void mg_font_end_read(VALUE self) {
+    font_t * font = font_from(self);
+    pthread_mutex_lock(&font->lock);
+    if (--font->readers == 0) {
+        pthread_cond_broadcast(&font->idle);
+    }
+    pthread_mutex_unlock(&font->lock);
+}
+
+VALUE mg_font_freetype_p(VALUE klass) {
+    return mg_glyph_cache_has_freetype() ? Qtrue : Qfalse;
+}
+
+VALUE mg_font_size(VALUE self) {
+    return UINT2NUM(mg_glyph_cache_size(font_from(self)->cache));
+}
+
+VALUE mg_font_ascent(VALUE self) {
+    return INT2NUM(mg_glyph_cache_ascent(font_from(self)->cache));
+}
+
+VALUE mg_font_line_height(VALUE self) {
+    return INT2NUM(mg_glyph_cache_line_height(font_from(self)->cache));
+}
+
+VALUE mg_font_measure(VALUE self, VALUE text) {
+    const mg_text_layout * layout = mg_font_layout(self, text);
+    return rb_ary_new_from_args(2, INT2NUM(layout->width), INT2NUM(layout->height));
+}
+
+VALUE mg_font_draw_text(VALUE self, VALUE text, VALUE x, VALUE y, VALUE color) {
+    font_t * font = font_from(self);
+    const mg_text_layout * layout = mg_font_layout(self, text);
+    /* Converted up front, since raising between the pushes and pops below
+     * would leave the GL stacks unbalanced */
+    double left = NUM2DBL(x), top = NUM2DBL(y);
+    uint32_t rgba = NUM2UINT(color);
+    mg_gl_state * gl = mg_gl_state_current();
+    atlas_texture_t * texture;
+    unsigned int atlas_height;
+
+    if (layout->count == 0) { return self; }
+
+    texture = texture_for(font, gl);
+    mg_glyph_cache_atlas(font->cache, &atlas_height);
+
+    /* Everything changed below is put back, since the caller's GL code can't
+     * know what text drawing touches */
+    mg_gl_push_attrib(gl, GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_TEXTURE_BIT |
+                          GL_CURRENT_BIT | GL_TRANSFORM_BIT);
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT | GL_CLIENT_PIXEL_STORE_BIT);
+
+    upload_atlas(font, texture, gl);
+    mg_gl_enable(gl, GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+    mg_gl_enable(gl, GL_BLEND);
+    mg_gl_blend_func(gl, GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glColor4ub(rgba >> 24, rgba >> 16, rgba >> 8, rgba);
+
+    /* Layouts keep atlas positions in pixels, so they survive the atlas growing */
+    glMatrixMode(GL_TEXTURE);
+    glPushMatrix();
+    glLoadIdentity();
+    glScalef(1.0f / MG_GLYPH_ATLAS_WIDTH, 1.0f / atlas_height, 1.0f);
+
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+    glTranslated(left, top, 0.0);
+
+    /* The whole string in one draw */
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+    glVertexPointer(2, GL_FLOAT, 4 * sizeof(float), layout->vertices);
+    glTexCoordPointer(2, GL_FLOAT, 4 * sizeof(float), layout->vertices + 2);
+    glDrawArrays(GL_QUADS, 0, layout->count * 4);
+
+    glPopMatrix();
+    glMatrixMode(GL_TEXTURE);
+    glPopMatrix();
+
+    glPopClientAttrib();
+    mg_gl_pop_attrib(gl);
+    return self;
+}
+
+VALUE mg_font_texture(VALUE self) {
+    font_t * font = font_from(self);
+    atlas_texture_t * texture = find_texture(font, mg_gl_state_current());
+    return texture && texture->name ? UINT2NUM(texture->name) : Qnil;
+}
+
+VALUE mg_font_release(VALUE self) {
+    font_t * font = font_from(self);
+    mg_gl_state * gl = mg_gl_state_current();
+    atlas_texture_t * texture = find_texture(font, gl);
+
+    /* The next draw uploads the whole atlas into a new one */
+    if (texture) { delete_texture(font, texture, gl); }
+
+    return self;
+}
+
+VALUE mg_font_stats(VALUE self) {
+    font_t * font = font_from(self);
+    VALUE hash = rb_hash_new();
+    mg_glyph_cache_stats stats;
+    unsigned int atlas_height;
+
+    mg_glyph_cache_get_stats(font->cache, &stats);
+    mg_glyph_cache_atlas(font->cache, &atlas_height);
+
+    rb_hash_aset(hash, ID2SYM(rb_intern("glyphs")),        UINT2NUM(stats.glyphs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("layouts")),       UINT2NUM(stats.layouts));
+    rb_hash_aset(hash, ID2SYM(rb_intern("layout_hits")),   ULL2NUM(stats.layout_hits));
+    rb_hash_aset(hash, ID2SYM(rb_intern("layout_misses")), ULL2NUM(stats.layout_misses));
+    rb_hash_aset(hash, ID2SYM(rb_intern("atlas_resets")),  UINT2NUM(stats.resets));
+    rb_hash_aset(hash, ID2SYM(rb_intern("atlas_height")),  UINT2NUM(atlas_height));
+
+    return hash;
+}
+
+void init_mg_font_class_under(VALUE module) {
+    mg_font_class = rb_define_class_under(module, "Font", rb_cObject);
+    rb_define_alloc_func(mg_font_class, mg_font_alloc);
+    rb_define_singleton_method(mg_font_class, "freetype?", mg_font_freetype_p, 0);
+    rb_define_private_method(mg_font_class, "setup",     mg_font_setup,     2);
+    rb_define_private_method(mg_font_class, "draw_text", mg_font_draw_text, 4);
+    rb_define_method(mg_font_class, "size",        mg_font_size,        0);
+    rb_define_method(mg_font_class, "ascent",      mg_font_ascent,      0);
+    rb_define_method(mg_font_class, "line_height", mg_font_line_height, 0);
+    rb_define_method(mg_font_class, "measure",     mg_font_measure,     1);
+    rb_define_method(mg_font_class, "texture",     mg_font_texture,     0);
+    rb_define_method(mg_font_class, "release",     mg_font_release,     0);
+    rb_define_method(mg_font_class, "stats",       mg_font_stats,       0);
+}
+
+/* Helper function implementation */
+
+static font_t * font_from(VALUE self) {
+    font_t * font = 0;
+    TypedData_Get_Struct(self, font_t, &font_type, font);
+
+    if (font->cache == 0) {
+        rb_raise(rb_eRuntimeError, "font was not set up");
+    }
+
+    return font;
+}
+
+static atlas_texture_t * find_texture(font_t * font, mg_gl_state * gl) {
+    const void * context = mg_gl_current_context();
+    uint64_t state = gl ? mg_gl_state_id(gl) : 0;
+    size_t i;
+
+    if (context == 0) { return 0; }
+
+    /* A destroyed context's handle may be reused, but not its cache's identifier */
+    for (i = 0; i < font->texture_count; ++i) {
+        if (font->textures[i].context == context && font->textures[i].state == state) {
+            return &font->textures[i];
+        }
+    }
+
+    return 0;
+}
+
+static atlas_texture_t * texture_for(font_t * font, mg_gl_state * gl) {
+    atlas_texture_t * texture = find_texture(font, gl);
+
+    if (texture) { return texture; }
+
+    if (mg_gl_current_context() == 0) {
+        rb_raise(rb_eRuntimeError, "text can't be drawn without a current GL context");
+    }
+
+    if (font->texture_count == font->texture_capacity) {
+        size_t capacity = font->texture_capacity ? font->texture_capacity * 2 : 2;
+        atlas_texture_t * grown = realloc(font->textures, capacity * sizeof(atlas_texture_t));
+        if (grown == 0) {
+            rb_raise(rb_eRuntimeError, "unable to allocate memory for font texture");
+        }
+        font->textures = grown;
+        font->texture_capacity = capacity;
+    }
+
+    texture = &font->textures[font->texture_count++];
+    texture->context = mg_gl_current_context();
+    texture->state = gl ? mg_gl_state_id(gl) : 0;
+    texture->name = 0;
+    texture->first = texture->end = 0;
+    texture->resized = 1;
+    return texture;
+}
+
+static void delete_texture(font_t * font, atlas_texture_t * texture, mg_gl_state * gl) {
+    if (texture->name) { mg_gl_delete_textures(gl, 1, &texture->name); }
+    *texture = font->textures[--font->texture_count];
+}
+
+static void take_dirty(font_t * font) {
+    unsigned int first, count;
+    int resized;
+    size_t i;
+
+    if (!mg_glyph_cache_take_dirty(font->cache, &first, &count, &resized)) { return; }
+
+    for (i = 0; i < font->texture_count; ++i) {
+        atlas_texture_t * texture = &font->textures[i];
+
+        if (resized) {
+            texture->resized = 1;
+        } else if (texture->first == texture->end) {
+            texture->first = first;
+            texture->end = first + count;
+        } else {
+            if (first < texture->first) { texture->first = first; }
+            if (first + count > texture->end) { texture->end = first + count; }
+        }
+    }
+}
+
+static void upload_atlas(font_t * font, atlas_texture_t * texture, mg_gl_state * gl) {
+    unsigned int height;
+    const unsigned char * atlas = mg_glyph_cache_atlas(font->cache, &height);
+
+    take_dirty(font);
+
+    if (texture->name == 0) {
+        glGenTextures(1, &texture->name);
+        mg_gl_bind_texture(gl, GL_TEXTURE_2D, texture->name);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    } else {
+        mg_gl_bind_texture(gl, GL_TEXTURE_2D, texture->name);
+        if (!texture->resized && texture->first == texture->end) { return; }
+    }
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    if (texture->resized) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA8, MG_GLYPH_ATLAS_WIDTH, height, 0,
+                     GL_ALPHA, GL_UNSIGNED_BYTE, atlas);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, texture->first,
+                        MG_GLYPH_ATLAS_WIDTH, texture->end - texture->first,
+                        GL_ALPHA, GL_UNSIGNED_BYTE,
+                        atlas + (size_t) texture->first * MG_GLYPH_ATLAS_WIDTH);
+    }
+
+    texture->resized = 0;
+    texture->first = texture->end = 0;
+}
+
+static void wait_for_readers(font_t * font) {
+    unsigned int readers;
+
+    for (;;) {
+        pthread_mutex_lock(&font->lock);
+        readers = font->readers;
+        pthread_mutex_unlock(&font->lock);
+
+        if (readers == 0) { return; }
+
+        rb_thread_call_without_gvl(wait_idle, font, 0, 0);
+    }
+}
+
+static void * wait_idle(void * data) {
+    font_t * font = data;
+
+    pthread_mutex_lock(&font->lock);
+    while (font->readers > 0) {
+        pthread_cond_wait(&font->idle, &font->lock);
+    }
+    pthread_mutex_unlock(&font->lock);
+    return 0;
+}
+
+static void font_free(void * p) {
+    font_t * font = p;
+    mg_gl_state * gl = mg_gl_state_current();
+    atlas_texture_t * texture = find_texture(font, gl);
+
+    if (texture) { delete_texture(font, texture, gl); }
+
+    mg_glyph_cache_free(font->cache);
+    pthread_cond_destroy(&font->idle);
+    pthread_mutex_destroy(&font->lock);
+    free(font->textures);
+    free(font);
+}
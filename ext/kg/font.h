@@ -0,0 +1,106 @@
+#ifndef MG_FONT_H
+#define MG_FONT_H
+
+#include "glyph_cache.h"
+
+#include <ruby.h>
+
+/**
+ * Mg::Font class.
+ */
+extern VALUE mg_font_class;
+
+/**
+ * Allocates a font with no glyphs.
+ */
+extern VALUE mg_font_alloc(VALUE klass);
+
+/**
+ * Opens the font file at the given path with FreeType, or the built-in bitmap
+ * font if the path is nil, at the given size in pixels.
+ */
+extern VALUE mg_font_setup(VALUE self, VALUE path, VALUE size);
+
+/**
+ * Returns the glyph cache encapsulated by the Ruby object.
+ */
+extern mg_glyph_cache * mg_font_from(VALUE self);
+
+/**
+ * Returns the layout of the Ruby string, converted to UTF-8 if needed. The
+ * layout is valid until the font lays out other text. Waits for renders
+ * reading the atlas to finish first.
+ */
+extern const mg_text_layout * mg_font_layout(VALUE self, VALUE text);
+
+/**
+ * Marks a render reading the atlas WITHOUT the GVL as started, so that the
+ * font holds off laying out text, which may move the atlas, until it's done.
+ * Must be called with the GVL.
+ */
+extern void mg_font_begin_read(VALUE self);
+
+/**
+ * Marks the render as done, letting layouts waiting for it go ahead.
+ */
+extern void mg_font_end_read(VALUE self);
+
+/**
+ * Returns whether font files can be opened, which requires FreeType.
+ */
+extern VALUE mg_font_freetype_p(VALUE klass);
+
+/**
+ * Returns the size of the font in pixels.
+ */
+extern VALUE mg_font_size(VALUE self);
+
+/**
+ * Returns the distance from the top of a line to its baseline.
+ */
+extern VALUE mg_font_ascent(VALUE self);
+
+/**
+ * Returns the distance between the baselines of consecutive lines.
+ */
+extern VALUE mg_font_line_height(VALUE self);
+
+/**
+ * Returns the width and height of the text's box in an array.
+ */
+extern VALUE mg_font_measure(VALUE self, VALUE text);
+
+/**
+ * Draws the text with its top left corner at x, y in the GL context that's
+ * current on the calling thread, as one batch of textured quads. Units are
+ * those of the current projection; with one unit per pixel and y pointing
+ * down, glyphs map to pixels exactly. GL state is left as it was found.
+ * Wrapped by Mg::Font#draw.
+ */
+extern VALUE mg_font_draw_text(VALUE self, VALUE text, VALUE x, VALUE y, VALUE color);
+
+/**
+ * Returns the name of the atlas texture in the GL context that's current on
+ * the calling thread, or nil if nothing was drawn in it yet. Each context the
+ * font draws into gets a texture of its own.
+ */
+extern VALUE mg_font_texture(VALUE self);
+
+/**
+ * Deletes the atlas texture from the GL context that's current on the calling
+ * thread. Drawing into it again creates a new one. Textures of other contexts
+ * are kept.
+ */
+extern VALUE mg_font_release(VALUE self);
+
+/**
+ * Returns a hash of glyph and layout cache counters.
+ */
+extern VALUE mg_font_stats(VALUE self);
+
+/**
+ * Initializes the Font class.
+ */
+extern void init_mg_font_class_under(VALUE module);
+
+#endif /* MG_FONT_H */
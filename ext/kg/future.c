@@ -0,0 +1,225 @@
+#include "future.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#include <ruby.h>
+#include <ruby/thread.h>
+
+VALUE mg_future_class;
+
+/* Data structures */
+
+typedef enum {
+    PENDING,
+    RESOLVED,
+    REJECTED
+} state_t;
+
+struct mg_future {
+    pthread_mutex_t lock;
+    pthread_cond_t completed;
+    unsigned int references;
+    state_t state;
+    void * result; /** Native result, until converted. */
+    char * error; /** Error message if the future was rejected. */
+    VALUE value; /** Converted Ruby value, or Qundef. */
+    int interrupted; /** Set by the unblocking function. */
+    mg_future_converter converter;
+    mg_future_destructor destructor;
+};
+
+/* Helper function prototypes */
+
+/**
+ * Completes the future with the given state and releases a reference.
+ */
+static void complete(mg_future * future, state_t state, void * result, char * error);
+
+/**
+ * Blocks until the future completes or the wait is interrupted.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * wait_for_completion(void * data);
+
+/**
+ * Unblocking function that interrupts wait_for_completion.
+ */
+static void interrupt_wait(void * data);
+
+/**
+ * Marks the converted Ruby value.
+ */
+static void mark(void * p);
+
+/**
+ * Releases the Ruby object's reference.
+ */
+static void release(void * p);
+
+/**
+ * Returns the future encapsulated by the Ruby object.
+ */
+static mg_future * mg_future_from(VALUE self);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::Future objects. Releasing a reference never waits
+ * for the job, so it's done during the sweep.
+ */
+static const rb_data_type_t future_type = {
+    "Mg::Future",
+    { mark, release, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Future interface implementation */
+
+mg_future * mg_future_new(mg_future_converter converter,
+                          mg_future_destructor destructor) {
+    mg_future * future = malloc(sizeof(mg_future));
+    if (future == 0) { return 0; }
+    pthread_mutex_init(&future->lock, 0);
+    pthread_cond_init(&future->completed, 0);
+    future->references = 1;
+    future->state = PENDING;
+    future->result = 0;
+    future->error = 0;
+    future->value = Qundef;
+    future->interrupted = 0;
+    future->converter = converter;
+    future->destructor = destructor;
+    return future;
+}
+
+void mg_future_resolve(mg_future * future, void * result) {
+    complete(future, RESOLVED, result, 0);
+}
+
+void mg_future_reject(mg_future * future, const char * message) {
+    complete(future, REJECTED, 0, strdup(message));
+}
+
+mg_future * mg_future_retain(mg_future * future) {
+    pthread_mutex_lock(&future->lock);
+    ++future->references;
+    pthread_mutex_unlock(&future->lock);
+    return future;
+}
+
+void mg_future_release(mg_future * future) {
+    unsigned int references;
+
+    pthread_mutex_lock(&future->lock);
+    references = --future->references;
+    pthread_mutex_unlock(&future->lock);
+
+    if (references > 0) { return; }
+
+    /* Free a result that nobody asked for */
+    if (future->result && future->destructor) {
+        future->destructor(future->result);
+    }
+
+    free(future->error);
+    pthread_cond_destroy(&future->completed);
+    pthread_mutex_destroy(&future->lock);
+    free(future);
+}
+
+VALUE mg_future_wrap(mg_future * future) {
+    return TypedData_Wrap_Struct(mg_future_class, &future_type, mg_future_retain(future));
+}
+
+VALUE mg_future_value(VALUE self) {
+    mg_future * future = mg_future_from(self);
+
+    /* Wait for the future to complete, handling interrupts as they come */
+    for (;;) {
+        future->interrupted = 0;
+        rb_thread_call_without_gvl(wait_for_completion, future,
+                                   interrupt_wait,      future);
+        if (future->state != PENDING) { break; }
+        rb_thread_check_ints();
+    }
+
+    if (future->state == REJECTED) {
+        rb_raise(rb_eRuntimeError, "%s", future->error);
+    }
+
+    /* Convert the result the first time the value is requested */
+    if (future->value == Qundef) {
+        future->value = future->converter(future->result);
+        future->result = 0;
+    }
+
+    return future->value;
+}
+
+VALUE mg_future_ready(VALUE self) {
+    mg_future * future = mg_future_from(self);
+    state_t state;
+    pthread_mutex_lock(&future->lock);
+    state = future->state;
+    pthread_mutex_unlock(&future->lock);
+    return state != PENDING ? Qtrue : Qfalse;
+}
+
+void init_mg_future_class_under(VALUE module) {
+    mg_future_class = rb_define_class_under(module, "Future", rb_cObject);
+    rb_undef_alloc_func(mg_future_class);
+    rb_define_method(mg_future_class, "value",  mg_future_value, 0);
+    rb_define_method(mg_future_class, "ready?", mg_future_ready, 0);
+}
+
+/* Helper function implementation */
+
+static void complete(mg_future * future, state_t state, void * result, char * error) {
+    pthread_mutex_lock(&future->lock);
+    future->state = state;
+    future->result = result;
+    future->error = error;
+    pthread_cond_broadcast(&future->completed);
+    pthread_mutex_unlock(&future->lock);
+    mg_future_release(future);
+}
+
+static void * wait_for_completion(void * data) {
+    mg_future * future = data;
+    pthread_mutex_lock(&future->lock);
+    while (future->state == PENDING && !future->interrupted) {
+        pthread_cond_wait(&future->completed, &future->lock);
+    }
+    pthread_mutex_unlock(&future->lock);
+    return 0;
+}
+
+static void interrupt_wait(void * data) {
+    mg_future * future = data;
+    pthread_mutex_lock(&future->lock);
+    future->interrupted = 1;
+    pthread_cond_broadcast(&future->completed);
+    pthread_mutex_unlock(&future->lock);
+}
+
+static void mark(void * p) {
+    mg_future * future = p;
+    if (future->value != Qundef) {
+        rb_gc_mark(future->value);
+    }
+}
+
+static void release(void * p) {
+    mg_future_release(p);
+}
+
+static mg_future * mg_future_from(VALUE self) {
+    mg_future * future = 0;
+    TypedData_Get_Struct(self, mg_future, &future_type, future);
+    return future;
+}
@@ -0,0 +1,77 @@
+#ifndef MG_FUTURE_H
+#define MG_FUTURE_H
+
+#include <ruby.h>
+
+/**
+ * Result of a computation that runs outside of the Ruby GVL.
+ */
+typedef struct mg_future mg_future;
+
+/**
+ * Converts the native result into a Ruby object, taking ownership of it.
+ * Called WITH the Ruby GVL, at most once per future.
+ */
+typedef VALUE (*mg_future_converter)(void * result);
+
+/**
+ * Frees a native result that was never converted into a Ruby object.
+ */
+typedef void (*mg_future_destructor)(void * result);
+
+/**
+ * Mg::Future class.
+ */
+extern VALUE mg_future_class;
+
+/**
+ * Creates a pending future. The caller holds one reference to it, which should
+ * be handed to whoever resolves it.
+ */
+extern mg_future * mg_future_new(mg_future_converter converter,
+                                 mg_future_destructor destructor);
+
+/**
+ * Completes the future with the given native result and releases the
+ * caller's reference. Does not require the Ruby GVL.
+ */
+extern void mg_future_resolve(mg_future * future, void * result);
+
+/**
+ * Fails the future with the given error message, which is copied, and releases
+ * the caller's reference. Does not require the Ruby GVL.
+ */
+extern void mg_future_reject(mg_future * future, const char * message);
+
+/**
+ * Acquires an additional reference to the future.
+ */
+extern mg_future * mg_future_retain(mg_future * future);
+
+/**
+ * Releases a reference to the future, freeing it when none are left.
+ */
+extern void mg_future_release(mg_future * future);
+
+/**
+ * Wraps the future in a Mg::Future Ruby object, which holds its own reference.
+ */
+extern VALUE mg_future_wrap(mg_future * future);
+
+/**
+ * Blocks until the future completes, without holding the GVL, and returns its
+ * value. Raises the future's error if it failed.
+ */
+extern VALUE mg_future_value(VALUE self);
+
+/**
+ * Returns whether the future has completed.
+ */
+extern VALUE mg_future_ready(VALUE self);
+
+/**
+ * Initializes the Future class.
+ */
+extern void init_mg_future_class_under(VALUE module);
+
+#endif /* MG_FUTURE_H */
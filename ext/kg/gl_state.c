@@ -0,0 +1,473 @@
+#include "gl_state.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#if defined(MG_PLATFORM_LINUX_X11)
+    #include <GL/glx.h>
+#endif
+
+#if defined(MG_HAVE_EGL)
+    #include <EGL/egl.h>
+#endif
+
+/* Constant definitions */
+
+#define MAX_ATTRIB_DEPTH 16
+
+/* Bits of the tracked state; enabled capabilities use the same ones */
+#define PROGRAM         (1u << 0)
+#define ACTIVE_TEXTURE  (1u << 1)
+#define BLEND_FUNC      (1u << 2)
+#define BLEND           (1u << 3)
+#define DEPTH_TEST      (1u << 4)
+#define STENCIL_TEST    (1u << 5)
+#define CULL_FACE       (1u << 6)
+#define SCISSOR_TEST    (1u << 7)
+#define TEXTURE(unit)   (1u << (8 + (unit)))
+#define TEXTURING(unit) (1u << (8 + MG_GL_STATE_TEXTURE_UNITS + (unit)))
+
+#define ALL_TEXTURES  (TEXTURE(MG_GL_STATE_TEXTURE_UNITS) - TEXTURE(0))
+#define ALL_TEXTURING (TEXTURING(MG_GL_STATE_TEXTURE_UNITS) - TEXTURING(0))
+
+/* Data structures */
+
+typedef struct {
+    GLuint program;
+    unsigned int active; /** Index of the active texture unit. */
+    GLuint textures[MG_GL_STATE_TEXTURE_UNITS]; /** 2D texture bound to each unit. */
+    GLenum blend_source, blend_destination;
+    uint32_t enabled; /** Bit of each enabled capability. */
+    uint32_t known; /** Bit of each state whose value is known. */
+} shadow_t;
+
+typedef struct {
+    GLbitfield mask;
+    shadow_t shadow; /** Tracked state when the groups were pushed. */
+} attrib_t;
+
+struct mg_gl_state {
+    const void * context;
+    uint64_t id; /** Number of the cache, counting from one. */
+    shadow_t shadow;
+    attrib_t attribs[MAX_ATTRIB_DEPTH];
+    unsigned int depth;
+    mg_gl_state_stats stats;
+};
+
+/* Registry of state caches by context */
+
+static pthread_mutex_t registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static mg_gl_state ** registry;
+static size_t registry_count, registry_capacity;
+static unsigned int registry_generation; /** Bumped when a cache goes away. */
+static uint64_t registry_id; /** Number of the last cache created. */
+
+/* Last lookup of each thread; contexts rarely change between calls */
+static __thread const void * cached_context;
+static __thread mg_gl_state * cached_state;
+static __thread unsigned int cached_generation;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the bits of tracked state whose value can be relied on. Outside of
+ * attribute scopes nothing can, since the application may have made raw GL
+ * calls since Mg last looked.
+ */
+static inline uint32_t trusted(const mg_gl_state * state) {
+    return state->depth > 0 ? state->shadow.known : 0;
+}
+
+/**
+ * Returns the bit of the capability in the current state, or zero if it
+ * isn't tracked.
+ */
+static uint32_t capability_bit(const mg_gl_state * state, GLenum capability);
+
+/**
+ * Sets or clears the capability, unless it already is.
+ */
+static void set_capability(mg_gl_state * state, GLenum capability, int enabled);
+
+/**
+ * Copies the given bits of tracked state from the saved copy.
+ */
+static void restore(shadow_t * shadow, const shadow_t * saved, uint32_t bits);
+
+/**
+ * Returns the bits of tracked state covered by the attribute groups.
+ */
+static uint32_t attrib_bits(GLbitfield mask);
+
+/**
+ * Unbinds the textures from every unit of the shadow copy, as deleting them
+ * does.
+ */
+static void unbind_textures(shadow_t * shadow, GLsizei count, const GLuint * textures);
+
+/* GL state interface implementation */
+
+mg_gl_state * mg_gl_state_new(const void * context) {
+    mg_gl_state * state = calloc(1, sizeof(mg_gl_state));
+
+    if (state == 0) { return 0; }
+
+    state->context = context;
+
+    /* Nothing is known until the first attribute scope sets it */
+    state->shadow.blend_source = GL_ONE;
+    state->shadow.blend_destination = GL_ZERO;
+
+    pthread_mutex_lock(&registry_lock);
+
+    if (registry_count == registry_capacity) {
+        size_t capacity = registry_capacity ? registry_capacity * 2 : 4;
+        mg_gl_state ** grown = realloc(registry, capacity * sizeof(mg_gl_state *));
+        if (grown == 0) {
+            pthread_mutex_unlock(&registry_lock);
+            free(state);
+            return 0;
+        }
+        registry = grown;
+        registry_capacity = capacity;
+    }
+
+    registry[registry_count++] = state;
+    state->id = ++registry_id;
+    pthread_mutex_unlock(&registry_lock);
+
+    return state;
+}
+
+void mg_gl_state_free(mg_gl_state * state) {
+    size_t i;
+
+    if (state == 0) { return; }
+
+    pthread_mutex_lock(&registry_lock);
+
+    for (i = 0; i < registry_count; ++i) {
+        if (registry[i] == state) {
+            registry[i] = registry[--registry_count];
+            break;
+        }
+    }
+
+    /* Other threads may still remember it */
+    __atomic_add_fetch(&registry_generation, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&registry_lock);
+
+    free(state);
+}
+
+mg_gl_state * mg_gl_state_current(void) {
+    const void * context = mg_gl_current_context();
+    unsigned int generation;
+    mg_gl_state * state = 0;
+    size_t i;
+
+    if (context == 0) { return 0; }
+
+    generation = __atomic_load_n(&registry_generation, __ATOMIC_ACQUIRE);
+    if (context == cached_context && generation == cached_generation) {
+        return cached_state;
+    }
+
+    pthread_mutex_lock(&registry_lock);
+
+    for (i = 0; i < registry_count; ++i) {
+        if (registry[i]->context == context) {
+            state = registry[i];
+            break;
+        }
+    }
+
+    generation = registry_generation;
+    pthread_mutex_unlock(&registry_lock);
+
+    cached_context = context;
+    cached_state = state;
+    cached_generation = generation;
+    return state;
+}
+
+uint64_t mg_gl_state_id(const mg_gl_state * state) {
+    return state->id;
+}
+
+const void * mg_gl_current_context(void) {
+    const void * context = 0;
+
+#if defined(MG_PLATFORM_LINUX_X11)
+    context = glXGetCurrentContext();
+#endif
+
+#if defined(MG_HAVE_EGL)
+    if (context == 0) { context = eglGetCurrentContext(); }
+#endif
+
+    return context;
+}
+
+void mg_gl_state_invalidate(mg_gl_state * state) {
+    unsigned int i;
+
+    if (state == 0) { return; }
+
+    state->shadow.known = 0;
+    for (i = 0; i < state->depth; ++i) {
+        state->attribs[i].shadow.known = 0;
+    }
+}
+
+void mg_gl_state_get_stats(const mg_gl_state * state, mg_gl_state_stats * stats) {
+    *stats = state->stats;
+}
+
+void mg_gl_use_program(mg_gl_state * state, GLuint program) {
+    if (state) {
+        shadow_t * shadow = &state->shadow;
+
+        if ((trusted(state) & PROGRAM) && shadow->program == program) {
+            ++state->stats.skipped;
+            return;
+        }
+
+        shadow->program = program;
+        shadow->known |= PROGRAM;
+        ++state->stats.made;
+    }
+
+    glUseProgram(program);
+}
+
+void mg_gl_active_texture(mg_gl_state * state, GLenum unit) {
+    if (state) {
+        shadow_t * shadow = &state->shadow;
+
+        if ((trusted(state) & ACTIVE_TEXTURE) && shadow->active == unit - GL_TEXTURE0) {
+            ++state->stats.skipped;
+            return;
+        }
+
+        shadow->active = unit - GL_TEXTURE0;
+        shadow->known |= ACTIVE_TEXTURE;
+        ++state->stats.made;
+    }
+
+    glActiveTexture(unit);
+}
+
+void mg_gl_bind_texture(mg_gl_state * state, GLenum target, GLuint texture) {
+    if (state) {
+        shadow_t * shadow = &state->shadow;
+
+        if (target != GL_TEXTURE_2D) {
+            /* Not tracked */
+        } else if (!(trusted(state) & ACTIVE_TEXTURE)) {
+            /* Some unit's binding changes, but which one isn't known */
+            shadow->known &= ~ALL_TEXTURES;
+        } else if (shadow->active < MG_GL_STATE_TEXTURE_UNITS) {
+            uint32_t bit = TEXTURE(shadow->active);
+
+            if ((trusted(state) & bit) && shadow->textures[shadow->active] == texture) {
+                ++state->stats.skipped;
+                return;
+            }
+
+            shadow->textures[shadow->active] = texture;
+            shadow->known |= bit;
+        }
+
+        ++state->stats.made;
+    }
+
+    glBindTexture(target, texture);
+}
+
+void mg_gl_enable(mg_gl_state * state, GLenum capability) {
+    if (state) {
+        set_capability(state, capability, 1);
+    } else {
+        glEnable(capability);
+    }
+}
+
+void mg_gl_disable(mg_gl_state * state, GLenum capability) {
+    if (state) {
+        set_capability(state, capability, 0);
+    } else {
+        glDisable(capability);
+    }
+}
+
+void mg_gl_blend_func(mg_gl_state * state, GLenum source, GLenum destination) {
+    if (state) {
+        shadow_t * shadow = &state->shadow;
+
+        if ((trusted(state) & BLEND_FUNC) &&
+            shadow->blend_source == source && shadow->blend_destination == destination) {
+            ++state->stats.skipped;
+            return;
+        }
+
+        shadow->blend_source = source;
+        shadow->blend_destination = destination;
+        shadow->known |= BLEND_FUNC;
+        ++state->stats.made;
+    }
+
+    glBlendFunc(source, destination);
+}
+
+void mg_gl_delete_textures(mg_gl_state * state, GLsizei count, const GLuint * textures) {
+    if (state) {
+        unsigned int i;
+
+        unbind_textures(&state->shadow, count, textures);
+        for (i = 0; i < state->depth; ++i) {
+            unbind_textures(&state->attribs[i].shadow, count, textures);
+        }
+    }
+
+    glDeleteTextures(count, textures);
+}
+
+void mg_gl_delete_program(mg_gl_state * state, GLuint program) {
+    if (state && state->shadow.program == program) {
+        state->shadow.known &= ~PROGRAM;
+    }
+
+    glDeleteProgram(program);
+}
+
+void mg_gl_push_attrib(mg_gl_state * state, GLbitfield mask) {
+    if (state) {
+        /* Whatever was set before may have been changed behind Mg's back */
+        if (state->depth == 0) { state->shadow.known = 0; }
+
+        if (state->depth < MAX_ATTRIB_DEPTH) {
+            attrib_t * attrib = &state->attribs[state->depth++];
+            attrib->mask = mask;
+            attrib->shadow = state->shadow;
+        } else {
+            /* GL overflows too; its pops won't match any more */
+            mg_gl_state_invalidate(state);
+        }
+    }
+
+    glPushAttrib(mask);
+}
+
+void mg_gl_pop_attrib(mg_gl_state * state) {
+    if (state) {
+        if (state->depth > 0) {
+            const attrib_t * attrib = &state->attribs[--state->depth];
+            restore(&state->shadow, &attrib->shadow, attrib_bits(attrib->mask));
+        } else {
+            mg_gl_state_invalidate(state);
+        }
+    }
+
+    glPopAttrib();
+}
+
+/* Helper function implementation */
+
+static uint32_t capability_bit(const mg_gl_state * state, GLenum capability) {
+    switch (capability) {
+        case GL_BLEND:        return BLEND;
+        case GL_DEPTH_TEST:   return DEPTH_TEST;
+        case GL_STENCIL_TEST: return STENCIL_TEST;
+        case GL_CULL_FACE:    return CULL_FACE;
+        case GL_SCISSOR_TEST: return SCISSOR_TEST;
+        case GL_TEXTURE_2D:
+            /* Texturing is enabled per unit */
+            if ((trusted(state) & ACTIVE_TEXTURE) && state->shadow.active < MG_GL_STATE_TEXTURE_UNITS) {
+                return TEXTURING(state->shadow.active);
+            }
+            return 0;
+        default:
+            return 0;
+    }
+}
+
+static void set_capability(mg_gl_state * state, GLenum capability, int enabled) {
+    shadow_t * shadow = &state->shadow;
+    uint32_t bit = capability_bit(state, capability);
+
+    if (bit && (trusted(state) & bit) && !(shadow->enabled & bit) == !enabled) {
+        ++state->stats.skipped;
+        return;
+    }
+
+    if (bit) {
+        shadow->known |= bit;
+        shadow->enabled = enabled ? shadow->enabled | bit : shadow->enabled & ~bit;
+    } else if (capability == GL_TEXTURE_2D && !(trusted(state) & ACTIVE_TEXTURE)) {
+        shadow->known &= ~ALL_TEXTURING;
+    }
+
+    ++state->stats.made;
+
+    if (enabled) {
+        glEnable(capability);
+    } else {
+        glDisable(capability);
+    }
+}
+
+static void restore(shadow_t * shadow, const shadow_t * saved, uint32_t bits) {
+    unsigned int i;
+
+    shadow->known = (shadow->known & ~bits) | (saved->known & bits);
+    shadow->enabled = (shadow->enabled & ~bits) | (saved->enabled & bits);
+
+    if (bits & PROGRAM) { shadow->program = saved->program; }
+    if (bits & ACTIVE_TEXTURE) { shadow->active = saved->active; }
+
+    if (bits & BLEND_FUNC) {
+        shadow->blend_source = saved->blend_source;
+        shadow->blend_destination = saved->blend_destination;
+    }
+
+    for (i = 0; i < MG_GL_STATE_TEXTURE_UNITS; ++i) {
+        if (bits & TEXTURE(i)) { shadow->textures[i] = saved->textures[i]; }
+    }
+}
+
+static uint32_t attrib_bits(GLbitfield mask) {
+    uint32_t bits = 0;
+
+    if (mask & GL_ENABLE_BIT) {
+        bits |= BLEND | DEPTH_TEST | STENCIL_TEST | CULL_FACE | SCISSOR_TEST | ALL_TEXTURING;
+    }
+    if (mask & GL_COLOR_BUFFER_BIT) { bits |= BLEND | BLEND_FUNC; }
+    if (mask & GL_DEPTH_BUFFER_BIT) { bits |= DEPTH_TEST; }
+    if (mask & GL_STENCIL_BUFFER_BIT) { bits |= STENCIL_TEST; }
+    if (mask & GL_POLYGON_BIT) { bits |= CULL_FACE; }
+    if (mask & GL_SCISSOR_BIT) { bits |= SCISSOR_TEST; }
+    if (mask & GL_TEXTURE_BIT) { bits |= ACTIVE_TEXTURE | ALL_TEXTURES | ALL_TEXTURING; }
+
+    return bits;
+}
+
+static void unbind_textures(shadow_t * shadow, GLsizei count, const GLuint * textures) {
+    unsigned int unit;
+    GLsizei i;
+
+    for (unit = 0; unit < MG_GL_STATE_TEXTURE_UNITS; ++unit) {
+        for (i = 0; i < count; ++i) {
+            if (textures[i] != 0 && shadow->textures[unit] == textures[i]) {
+                shadow->textures[unit] = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,135 @@
+#ifndef MG_GL_STATE_H
+#define MG_GL_STATE_H
+
+#include <stdint.h>
+
+/**
+ * Number of texture units whose 2D binding is tracked.
+ */
+#define MG_GL_STATE_TEXTURE_UNITS 8
+
+/**
+ * Counters of a GL state cache.
+ */
+typedef struct {
+    uint64_t made; /** State changes passed on to GL. */
+    uint64_t skipped; /** State changes filtered out as redundant. */
+} mg_gl_state_stats;
+
+/**
+ * Shadow copy of the GL state Mg's renderer changes, for one context. State
+ * changes that wouldn't change anything are skipped, which matters on
+ * drivers that validate every call on the CPU.
+ *
+ * Tracked: the current program, the active texture unit, the 2D texture
+ * bound to each unit, the blend function and whether blending, depth and
+ * stencil testing, face culling, scissoring and 2D texturing are enabled.
+ * Anything else goes straight to GL.
+ *
+ * The application makes GL calls of its own between Mg's, which the cache
+ * never sees. So only changes made between mg_gl_push_attrib and the
+ * matching pop are relied on; the outermost push forgets everything, and
+ * changes made outside of any scope always go to GL.
+ *
+ * Every function accepts a null state and then simply calls GL, so code
+ * drawing into contexts without a cache doesn't need to care. Code that
+ * changes tracked state behind the cache's back within a scope must
+ * invalidate it.
+ */
+typedef struct mg_gl_state mg_gl_state;
+
+/**
+ * Creates the state cache of the given context and registers it, so that
+ * mg_gl_state_current finds it. The context is only used as a key. Returns
+ * zero if out of memory.
+ */
+extern mg_gl_state * mg_gl_state_new(const void * context);
+
+/**
+ * Unregisters and frees the state cache. Doesn't require the context.
+ */
+extern void mg_gl_state_free(mg_gl_state * state);
+
+/**
+ * Returns the state cache of the context current on the calling thread, or
+ * zero if it has none.
+ */
+extern mg_gl_state * mg_gl_state_current(void);
+
+/**
+ * Returns a number identifying the cache's context. Unlike context handles,
+ * numbers are never reused once the context is gone.
+ */
+extern uint64_t mg_gl_state_id(const mg_gl_state * state);
+
+/**
+ * Returns the context current on the calling thread, from whichever API made
+ * it current, or zero.
+ */
+extern const void * mg_gl_current_context(void);
+
+/**
+ * Forgets everything, so the next change of each state is made. Call it
+ * after changing tracked state with raw GL calls within a scope.
+ */
+extern void mg_gl_state_invalidate(mg_gl_state * state);
+
+/**
+ * Stores the state cache's counters.
+ */
+extern void mg_gl_state_get_stats(const mg_gl_state * state, mg_gl_state_stats * stats);
+
+/**
+ * glUseProgram, skipped if the program is already current.
+ */
+extern void mg_gl_use_program(mg_gl_state * state, unsigned int program);
+
+/**
+ * glActiveTexture, skipped if the unit is already active.
+ */
+extern void mg_gl_active_texture(mg_gl_state * state, unsigned int unit);
+
+/**
+ * glBindTexture, skipped if the 2D texture is already bound to the active
+ * unit. Other targets aren't tracked.
+ */
+extern void mg_gl_bind_texture(mg_gl_state * state, unsigned int target, unsigned int texture);
+
+/**
+ * glEnable, skipped if the capability is already enabled.
+ */
+extern void mg_gl_enable(mg_gl_state * state, unsigned int capability);
+
+/**
+ * glDisable, skipped if the capability is already disabled.
+ */
+extern void mg_gl_disable(mg_gl_state * state, unsigned int capability);
+
+/**
+ * glBlendFunc, skipped if the factors are already those.
+ */
+extern void mg_gl_blend_func(mg_gl_state * state, unsigned int source, unsigned int destination);
+
+/**
+ * Deletes the textures, unbinding them first as GL does.
+ */
+extern void mg_gl_delete_textures(mg_gl_state * state, int count, const unsigned int * textures);
+
+/**
+ * Deletes the program. If it's current, GL keeps using it, so it is
+ * forgotten rather than changed.
+ */
+extern void mg_gl_delete_program(mg_gl_state * state, unsigned int program);
+
+/**
+ * Pushes the attribute groups like glPushAttrib, remembering the tracked
+ * state they cover so that popping restores it in the cache too.
+ */
+extern void mg_gl_push_attrib(mg_gl_state * state, unsigned int mask);
+
+/**
+ * Pops the attribute groups pushed last.
+ */
+extern void mg_gl_pop_attrib(mg_gl_state * state);
+
+#endif /* MG_GL_STATE_H */
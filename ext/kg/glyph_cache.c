@@ -0,0 +1,660 @@
+#include "glyph_cache.h"
+
+#include "bitmap_font.h"
+#include "hash.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(MG_HAVE_FREETYPE)
+    #include <ft2build.h>
+    #include FT_FREETYPE_H
+#endif
+
+/* Constant definitions */
+
+static const uint32_t replacement = 0xFFFD;
+
+/* Data structures */
+
+/**
+ * Glyph rasterized into the atlas.
+ */
+typedef struct {
+    uint32_t codepoint;
+    unsigned int index; /** FreeType glyph index, for kerning. */
+    int used;
+    int u, v, width, height;
+    int left, top; /** Offset of the bitmap from the pen, up from the baseline. */
+    int advance;
+} glyph_t;
+
+/**
+ * Cached layout and the text it was made from.
+ */
+typedef struct {
+    uint64_t hash;
+    char * text; /** Copy of the text, or 0 if the slot is empty. */
+    size_t length;
+    mg_text_layout layout;
+} layout_entry_t;
+
+/**
+ * Glyph bitmap ready to be copied into the atlas.
+ */
+typedef struct {
+    const unsigned char * rows;
+    int pitch;
+    int width, height;
+    int mono; /** Whether pixels are bits, highest first, instead of bytes. */
+    unsigned char * owned; /** Pixels to free once copied, or 0. */
+} bitmap_t;
+
+struct mg_glyph_cache {
+    unsigned int size;
+    int ascent, line_height;
+    unsigned int scale; /** Size of the built-in font's pixels, or 0 for font files. */
+#if defined(MG_HAVE_FREETYPE)
+    FT_Library library;
+    FT_Face face; /** Font file, or 0 for the built-in font. */
+#endif
+    glyph_t * glyphs; /** Open addressing table keyed by codepoint. */
+    unsigned int glyph_count, glyph_capacity;
+    layout_entry_t layouts[MG_GLYPH_CACHE_LAYOUTS * 2]; /** Open addressing table keyed by text. */
+    unsigned int layout_count;
+    unsigned char * atlas;
+    unsigned int atlas_height;
+    unsigned int shelf_x, shelf_y, shelf_height; /** Row of the atlas glyphs are being added to. */
+    unsigned int dirty_first, dirty_last;
+    int resized;
+    unsigned int generation;
+    uint64_t hits, misses;
+};
+
+/* Helper function prototypes */
+
+/**
+ * Returns the glyph of the codepoint, rasterizing it into the atlas if it's
+ * not there yet. Empties the atlas if it's full, unless that's not allowed.
+ * Returns zero if memory could not be allocated or the glyph didn't fit.
+ */
+static glyph_t * find_glyph(mg_glyph_cache * cache, uint32_t codepoint, int may_reset);
+
+/**
+ * Renders the glyph's bitmap and metrics. Returns zero on failure.
+ */
+static int render_glyph(mg_glyph_cache * cache, glyph_t * glyph, bitmap_t * bitmap);
+
+/**
+ * Finds room for a glyph of the given size in the atlas, growing it if
+ * needed. Returns zero if the atlas is full or memory could not be allocated.
+ */
+static int place(mg_glyph_cache * cache, int width, int height, int * u, int * v);
+
+/**
+ * Empties the atlas, the glyphs and the layouts.
+ */
+static void reset_atlas(mg_glyph_cache * cache);
+
+/**
+ * Frees every cached layout.
+ */
+static void clear_layouts(mg_glyph_cache * cache);
+
+/**
+ * Lays out the text. Returns zero if memory could not be allocated.
+ */
+static int build_layout(mg_glyph_cache * cache, const char * text, size_t length,
+                        int may_reset, mg_text_layout * layout);
+
+/**
+ * Decodes the UTF-8 sequence at the start of the text and stores its length.
+ */
+static uint32_t decode(const unsigned char * text, size_t length, size_t * used);
+
+/* Glyph cache interface implementation */
+
+const char * mg_glyph_cache_open(const char * path, unsigned int size, mg_glyph_cache ** cache) {
+    mg_glyph_cache * c;
+
+    if (size == 0) { return "font size must be positive"; }
+
+#if !defined(MG_HAVE_FREETYPE)
+    if (path) { return "font files require FreeType, which mg was built without"; }
+#endif
+
+    c = calloc(1, sizeof(mg_glyph_cache));
+    if (c == 0) { return "unable to allocate memory for font"; }
+
+    c->size = size;
+    c->glyph_capacity = 128;
+    c->glyphs = calloc(c->glyph_capacity, sizeof(glyph_t));
+    c->atlas_height = 128;
+    c->atlas = calloc(MG_GLYPH_ATLAS_WIDTH, c->atlas_height);
+
+    if (c->glyphs == 0 || c->atlas == 0) {
+        mg_glyph_cache_free(c);
+        return "unable to allocate memory for font";
+    }
+
+    c->shelf_x = c->shelf_y = 1;
+    c->resized = 1;
+
+#if defined(MG_HAVE_FREETYPE)
+    if (path) {
+        if (FT_Init_FreeType(&c->library) != 0) {
+            c->library = 0;
+            mg_glyph_cache_free(c);
+            return "unable to initialize FreeType";
+        }
+
+        if (FT_New_Face(c->library, path, 0, &c->face) != 0) {
+            c->face = 0;
+            mg_glyph_cache_free(c);
+            return "unable to open font file";
+        }
+
+        if (FT_Set_Pixel_Sizes(c->face, 0, size) != 0) {
+            mg_glyph_cache_free(c);
+            return "font doesn't have the requested size";
+        }
+
+        c->ascent = (c->face->size->metrics.ascender + 63) >> 6;
+        c->line_height = (c->face->size->metrics.height + 63) >> 6;
+        *cache = c;
+        return 0;
+    }
+#endif
+
+    /* The built-in font only scales to whole pixels */
+    c->scale = size / MG_BITMAP_FONT_SIZE;
+    if (c->scale == 0) { c->scale = 1; }
+    c->ascent = (MG_BITMAP_FONT_SIZE - 1) * c->scale;
+    c->line_height = MG_BITMAP_FONT_SIZE * c->scale;
+
+    *cache = c;
+    return 0;
+}
+
+void mg_glyph_cache_free(mg_glyph_cache * cache) {
+    if (cache == 0) { return; }
+
+    clear_layouts(cache);
+
+#if defined(MG_HAVE_FREETYPE)
+    if (cache->face) { FT_Done_Face(cache->face); }
+    if (cache->library) { FT_Done_FreeType(cache->library); }
+#endif
+
+    free(cache->atlas);
+    free(cache->glyphs);
+    free(cache);
+}
+
+int mg_glyph_cache_has_freetype(void) {
+#if defined(MG_HAVE_FREETYPE)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+unsigned int mg_glyph_cache_size(const mg_glyph_cache * cache) {
+    return cache->size;
+}
+
+int mg_glyph_cache_ascent(const mg_glyph_cache * cache) {
+    return cache->ascent;
+}
+
+int mg_glyph_cache_line_height(const mg_glyph_cache * cache) {
+    return cache->line_height;
+}
+
+const mg_text_layout * mg_glyph_cache_layout(mg_glyph_cache * cache,
+                                             const char * text, size_t length) {
+    uint64_t hash = mg_hash64(text, length, 0);
+    unsigned int mask = MG_GLYPH_CACHE_LAYOUTS * 2 - 1, slot, generation;
+    mg_text_layout layout;
+    layout_entry_t * entry;
+    int built;
+
+    for (slot = hash & mask; cache->layouts[slot].text; slot = (slot + 1) & mask) {
+        entry = &cache->layouts[slot];
+        if (entry->hash == hash && entry->length == length &&
+            memcmp(entry->text, text, length) == 0) {
+            ++cache->hits;
+            return &entry->layout;
+        }
+    }
+
+    ++cache->misses;
+
+    /* Glyphs placed before the atlas was emptied are gone; start over once */
+    generation = cache->generation;
+    built = build_layout(cache, text, length, 1, &layout);
+    if (built && cache->generation != generation) {
+        free(layout.quads);
+        free(layout.vertices);
+        built = build_layout(cache, text, length, 0, &layout);
+    }
+    if (!built) { return 0; }
+
+    /* Keeping the table at most half full keeps probing short */
+    if (cache->layout_count == MG_GLYPH_CACHE_LAYOUTS) { clear_layouts(cache); }
+
+    /* Emptying the atlas empties the table, so probe again */
+    for (slot = hash & mask; cache->layouts[slot].text; slot = (slot + 1) & mask);
+    entry = &cache->layouts[slot];
+
+    entry->text = malloc(length + 1);
+    if (entry->text == 0) {
+        free(layout.quads);
+        free(layout.vertices);
+        return 0;
+    }
+
+    memcpy(entry->text, text, length);
+    entry->hash = hash;
+    entry->length = length;
+    entry->layout = layout;
+    ++cache->layout_count;
+    return &entry->layout;
+}
+
+const unsigned char * mg_glyph_cache_atlas(const mg_glyph_cache * cache, unsigned int * height) {
+    *height = cache->atlas_height;
+    return cache->atlas;
+}
+
+unsigned int mg_glyph_cache_generation(const mg_glyph_cache * cache) {
+    return cache->generation;
+}
+
+int mg_glyph_cache_take_dirty(mg_glyph_cache * cache, unsigned int * first,
+                              unsigned int * count, int * resized) {
+    *resized = cache->resized;
+
+    if (cache->resized) {
+        *first = 0;
+        *count = cache->atlas_height;
+    } else if (cache->dirty_first < cache->dirty_last) {
+        *first = cache->dirty_first;
+        *count = cache->dirty_last - cache->dirty_first;
+    } else {
+        return 0;
+    }
+
+    cache->resized = 0;
+    cache->dirty_first = cache->dirty_last = 0;
+    return 1;
+}
+
+void mg_glyph_cache_get_stats(const mg_glyph_cache * cache, mg_glyph_cache_stats * stats) {
+    stats->glyphs = cache->glyph_count;
+    stats->layouts = cache->layout_count;
+    stats->layout_hits = cache->hits;
+    stats->layout_misses = cache->misses;
+    stats->resets = cache->generation;
+}
+
+/* Helper function implementation */
+
+static glyph_t * find_glyph(mg_glyph_cache * cache, uint32_t codepoint, int may_reset) {
+    unsigned int mask = cache->glyph_capacity - 1, slot;
+    glyph_t * glyph, candidate;
+    bitmap_t bitmap;
+    int x, y;
+
+    /* The built-in font draws what it lacks as one question mark */
+    if (cache->scale && (codepoint < MG_BITMAP_FONT_FIRST || codepoint > MG_BITMAP_FONT_LAST)) {
+        codepoint = '?';
+    }
+
+    slot = (codepoint * 2654435761u) & mask;
+
+    for (;; slot = (slot + 1) & mask) {
+        glyph = &cache->glyphs[slot];
+        if (!glyph->used) { break; }
+        if (glyph->codepoint == codepoint) { return glyph; }
+    }
+
+    memset(&candidate, 0, sizeof(glyph_t));
+    memset(&bitmap, 0, sizeof(bitmap_t));
+    candidate.codepoint = codepoint;
+    candidate.used = 1;
+
+    if (!render_glyph(cache, &candidate, &bitmap)) {
+        free(bitmap.owned);
+        return 0;
+    }
+
+    if (bitmap.width > 0 && bitmap.height > 0) {
+        if (!place(cache, bitmap.width, bitmap.height, &candidate.u, &candidate.v)) {
+            if (!may_reset) {
+                free(bitmap.owned);
+                return 0;
+            }
+
+            reset_atlas(cache);
+            if (!place(cache, bitmap.width, bitmap.height, &candidate.u, &candidate.v)) {
+                free(bitmap.owned);
+                return 0;
+            }
+
+            /* The table is empty now */
+            glyph = &cache->glyphs[(codepoint * 2654435761u) & mask];
+        }
+
+        for (y = 0; y < bitmap.height; ++y) {
+            const unsigned char * source = bitmap.rows + y * bitmap.pitch;
+            unsigned char * row = cache->atlas +
+                (size_t) (candidate.v + y) * MG_GLYPH_ATLAS_WIDTH + candidate.u;
+
+            if (bitmap.mono) {
+                for (x = 0; x < bitmap.width; ++x) {
+                    row[x] = (source[x >> 3] >> (7 - (x & 7)) & 1) ? 255 : 0;
+                }
+            } else {
+                memcpy(row, source, bitmap.width);
+            }
+        }
+
+        free(bitmap.owned);
+
+        if (cache->dirty_first == cache->dirty_last) {
+            cache->dirty_first = candidate.v;
+            cache->dirty_last = candidate.v + bitmap.height;
+        } else {
+            if ((unsigned int) candidate.v < cache->dirty_first) {
+                cache->dirty_first = candidate.v;
+            }
+            if ((unsigned int) candidate.v + bitmap.height > cache->dirty_last) {
+                cache->dirty_last = candidate.v + bitmap.height;
+            }
+        }
+
+        candidate.width = bitmap.width;
+        candidate.height = bitmap.height;
+    }
+
+    /* Keeping the table at most half full keeps probing short */
+    if ((cache->glyph_count + 1) * 2 > cache->glyph_capacity) {
+        unsigned int capacity = cache->glyph_capacity * 2, i;
+        glyph_t * glyphs = calloc(capacity, sizeof(glyph_t));
+        if (glyphs == 0) { return 0; }
+
+        mask = capacity - 1;
+        for (i = 0; i < cache->glyph_capacity; ++i) {
+            if (cache->glyphs[i].used) {
+                for (slot = (cache->glyphs[i].codepoint * 2654435761u) & mask;
+                     glyphs[slot].used; slot = (slot + 1) & mask);
+                glyphs[slot] = cache->glyphs[i];
+            }
+        }
+
+        free(cache->glyphs);
+        cache->glyphs = glyphs;
+        cache->glyph_capacity = capacity;
+        for (slot = (codepoint * 2654435761u) & mask; glyphs[slot].used; slot = (slot + 1) & mask);
+        glyph = &glyphs[slot];
+    }
+
+    *glyph = candidate;
+    ++cache->glyph_count;
+    return glyph;
+}
+
+static int render_glyph(mg_glyph_cache * cache, glyph_t * glyph, bitmap_t * bitmap) {
+    const unsigned char * bits;
+    unsigned int codepoint = glyph->codepoint, scale = cache->scale, row, column;
+    unsigned int top = MG_BITMAP_FONT_SIZE, bottom = 0, left = MG_BITMAP_FONT_SIZE, right = 0;
+    unsigned char * pixels;
+    int x, y;
+
+#if defined(MG_HAVE_FREETYPE)
+    if (cache->face) {
+        FT_GlyphSlot slot = cache->face->glyph;
+
+        glyph->index = FT_Get_Char_Index(cache->face, codepoint);
+        if (FT_Load_Glyph(cache->face, glyph->index, FT_LOAD_RENDER) != 0) { return 0; }
+
+        bitmap->rows = slot->bitmap.buffer;
+        bitmap->pitch = slot->bitmap.pitch;
+        bitmap->width = slot->bitmap.width;
+        bitmap->height = slot->bitmap.rows;
+        bitmap->mono = slot->bitmap.pixel_mode == FT_PIXEL_MODE_MONO;
+        glyph->left = slot->bitmap_left;
+        glyph->top = slot->bitmap_top;
+        glyph->advance = (slot->advance.x + 32) >> 6;
+
+        /* Color and bottom up bitmaps aren't coverage; keep the advance only */
+        if (bitmap->pitch < 0 || (!bitmap->mono && slot->bitmap.pixel_mode != FT_PIXEL_MODE_GRAY)) {
+            bitmap->width = bitmap->height = 0;
+        }
+
+        return 1;
+    }
+#endif
+
+    bits = mg_bitmap_font[codepoint - MG_BITMAP_FONT_FIRST];
+    glyph->advance = MG_BITMAP_FONT_SIZE * scale;
+
+    /* Only the lit part of the cell goes into the atlas */
+    for (row = 0; row < MG_BITMAP_FONT_SIZE; ++row) {
+        for (column = 0; column < MG_BITMAP_FONT_SIZE; ++column) {
+            if (bits[row] >> column & 1) {
+                if (row < top) { top = row; }
+                if (row > bottom) { bottom = row; }
+                if (column < left) { left = column; }
+                if (column > right) { right = column; }
+            }
+        }
+    }
+
+    if (top > bottom) { return 1; }
+
+    bitmap->width = (right - left + 1) * scale;
+    bitmap->height = (bottom - top + 1) * scale;
+    glyph->left = left * scale;
+    glyph->top = (MG_BITMAP_FONT_SIZE - 1 - top) * scale;
+
+    pixels = malloc((size_t) bitmap->width * bitmap->height);
+    if (pixels == 0) { return 0; }
+
+    for (y = 0; y < bitmap->height; ++y) {
+        for (x = 0; x < bitmap->width; ++x) {
+            pixels[y * bitmap->width + x] =
+                (bits[top + y / scale] >> (left + x / scale) & 1) ? 255 : 0;
+        }
+    }
+
+    bitmap->rows = bitmap->owned = pixels;
+    bitmap->pitch = bitmap->width;
+    return 1;
+}
+
+static int place(mg_glyph_cache * cache, int width, int height, int * u, int * v) {
+    /* Glyphs are a pixel apart so filtering doesn't bleed between them */
+    if (width + 2 > MG_GLYPH_ATLAS_WIDTH) { return 0; }
+
+    if (cache->shelf_x + width + 1 > MG_GLYPH_ATLAS_WIDTH) {
+        cache->shelf_x = 1;
+        cache->shelf_y += cache->shelf_height;
+        cache->shelf_height = 0;
+    }
+
+    if (cache->shelf_y + height + 1 > cache->atlas_height) {
+        unsigned int atlas_height = cache->atlas_height;
+        unsigned char * atlas;
+
+        while (cache->shelf_y + height + 1 > atlas_height) { atlas_height *= 2; }
+        if (atlas_height > MG_GLYPH_ATLAS_MAX_HEIGHT) { return 0; }
+
+        /* Rows are whole, so growing keeps every glyph where it was */
+        atlas = realloc(cache->atlas, (size_t) MG_GLYPH_ATLAS_WIDTH * atlas_height);
+        if (atlas == 0) { return 0; }
+        memset(atlas + (size_t) MG_GLYPH_ATLAS_WIDTH * cache->atlas_height, 0,
+               (size_t) MG_GLYPH_ATLAS_WIDTH * (atlas_height - cache->atlas_height));
+
+        cache->atlas = atlas;
+        cache->atlas_height = atlas_height;
+        cache->resized = 1;
+    }
+
+    *u = cache->shelf_x;
+    *v = cache->shelf_y;
+    cache->shelf_x += width + 1;
+    if ((unsigned int) height + 1 > cache->shelf_height) { cache->shelf_height = height + 1; }
+    return 1;
+}
+
+static void reset_atlas(mg_glyph_cache * cache) {
+    memset(cache->atlas, 0, (size_t) MG_GLYPH_ATLAS_WIDTH * cache->atlas_height);
+    memset(cache->glyphs, 0, cache->glyph_capacity * sizeof(glyph_t));
+    cache->glyph_count = 0;
+    cache->shelf_x = cache->shelf_y = 1;
+    cache->shelf_height = 0;
+    cache->resized = 1;
+    ++cache->generation;
+    clear_layouts(cache);
+}
+
+static void clear_layouts(mg_glyph_cache * cache) {
+    unsigned int i;
+
+    for (i = 0; i < MG_GLYPH_CACHE_LAYOUTS * 2; ++i) {
+        layout_entry_t * entry = &cache->layouts[i];
+        if (entry->text) {
+            free(entry->text);
+            free(entry->layout.quads);
+            free(entry->layout.vertices);
+            entry->text = 0;
+        }
+    }
+
+    cache->layout_count = 0;
+}
+
+static int build_layout(mg_glyph_cache * cache, const char * text, size_t length,
+                        int may_reset, mg_text_layout * layout) {
+    const unsigned char * bytes = (const unsigned char *) text;
+    int pen = 0, baseline = cache->ascent, width = 0, lines = 1;
+    unsigned int previous = 0, count = 0;
+
+    (void) previous; /* Only kerning needs it */
+    size_t capacity = length ? length : 1, used;
+    mg_glyph_quad * quads = malloc(capacity * sizeof(mg_glyph_quad));
+
+    memset(layout, 0, sizeof(mg_text_layout));
+    if (quads == 0) { return 0; }
+
+    while (length > 0) {
+        uint32_t codepoint = decode(bytes, length, &used);
+        glyph_t * glyph;
+
+        bytes += used;
+        length -= used;
+
+        if (codepoint == '\n') {
+            if (pen > width) { width = pen; }
+            pen = 0;
+            baseline += cache->line_height;
+            previous = 0;
+            ++lines;
+            continue;
+        }
+
+        if (codepoint < MG_BITMAP_FONT_FIRST) { continue; }
+
+        glyph = find_glyph(cache, codepoint, may_reset);
+        if (glyph == 0) { continue; }
+
+#if defined(MG_HAVE_FREETYPE)
+        if (cache->face && previous && FT_HAS_KERNING(cache->face)) {
+            FT_Vector kerning;
+            if (FT_Get_Kerning(cache->face, previous, glyph->index,
+                               FT_KERNING_DEFAULT, &kerning) == 0) {
+                pen += (kerning.x + 32) >> 6;
+            }
+        }
+#endif
+
+        if (glyph->width > 0) {
+            mg_glyph_quad * q = &quads[count++];
+            q->x = pen + glyph->left;
+            q->y = baseline - glyph->top;
+            q->width = glyph->width;
+            q->height = glyph->height;
+            q->u = glyph->u;
+            q->v = glyph->v;
+        }
+
+        pen += glyph->advance;
+        previous = glyph->index;
+    }
+
+    if (pen > width) { width = pen; }
+
+    layout->count = count;
+    layout->width = width;
+    layout->height = lines * cache->line_height;
+    layout->quads = quads;
+
+    if (count > 0) {
+        float * v = malloc((size_t) count * 16 * sizeof(float));
+        unsigned int i;
+
+        if (v == 0) {
+            free(quads);
+            layout->quads = 0;
+            return 0;
+        }
+
+        for (i = 0; i < count; ++i) {
+            const mg_glyph_quad * q = &quads[i];
+            float x0 = q->x, y0 = q->y, x1 = q->x + q->width, y1 = q->y + q->height;
+            float u0 = q->u, v0 = q->v, u1 = q->u + q->width, v1 = q->v + q->height;
+            float corners[16] = { x0, y0, u0, v0,  x1, y0, u1, v0,
+                                  x1, y1, u1, v1,  x0, y1, u0, v1 };
+            memcpy(v + i * 16, corners, sizeof(corners));
+        }
+
+        layout->vertices = v;
+    }
+
+    return 1;
+}
+
+static uint32_t decode(const unsigned char * text, size_t length, size_t * used) {
+    static const uint32_t smallest[5] = { 0, 0, 0x80, 0x800, 0x10000 };
+    unsigned char first = text[0];
+    uint32_t codepoint;
+    size_t size, i;
+
+    *used = 1;
+
+    if (first < 0x80) { return first; }
+    else if ((first & 0xE0) == 0xC0) { size = 2; codepoint = first & 0x1F; }
+    else if ((first & 0xF0) == 0xE0) { size = 3; codepoint = first & 0x0F; }
+    else if ((first & 0xF8) == 0xF0) { size = 4; codepoint = first & 0x07; }
+    else { return replacement; }
+
+    for (i = 1; i < size; ++i) {
+        if (i >= length || (text[i] & 0xC0) != 0x80) {
+            *used = i;
+            return replacement;
+        }
+        codepoint = codepoint << 6 | (text[i] & 0x3F);
+    }
+
+    *used = size;
+
+    /* Overlong forms, surrogates and values past Unicode */
+    if (codepoint < smallest[size] || (codepoint >= 0xD800 && codepoint <= 0xDFFF) ||
+        codepoint > 0x10FFFF) {
+        return replacement;
+    }
+
+    return codepoint;
+}
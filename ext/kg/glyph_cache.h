@@ -0,0 +1,134 @@
+#ifndef MG_GLYPH_CACHE_H
+#define MG_GLYPH_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Width of the glyph atlas, in pixels. Its height grows as glyphs are added.
+ */
+#define MG_GLYPH_ATLAS_WIDTH 512
+
+/**
+ * Height the glyph atlas may grow to before it's emptied and started over.
+ */
+#define MG_GLYPH_ATLAS_MAX_HEIGHT 2048
+
+/**
+ * Number of laid out strings kept before the layouts are discarded.
+ */
+#define MG_GLYPH_CACHE_LAYOUTS 256
+
+/**
+ * Glyph of laid out text. Positions are relative to the top left corner of
+ * the text; the atlas position is in pixels.
+ */
+typedef struct {
+    int x, y, width, height;
+    int u, v;
+} mg_glyph_quad;
+
+/**
+ * Laid out text, ready to be drawn.
+ */
+typedef struct {
+    unsigned int count; /** Number of visible glyphs. */
+    int width, height; /** Size of the text's box, which is line height tall per line. */
+    mg_glyph_quad * quads;
+    float * vertices; /** 4 vertices per glyph, x, y, u, v each, in the same units as the quads. */
+} mg_text_layout;
+
+/**
+ * Counters of a glyph cache.
+ */
+typedef struct {
+    unsigned int glyphs; /** Glyphs in the atlas. */
+    unsigned int layouts; /** Strings whose layout is cached. */
+    uint64_t layout_hits, layout_misses;
+    unsigned int resets; /** Times the atlas filled up and was emptied. */
+} mg_glyph_cache_stats;
+
+/**
+ * Glyphs of a font at one pixel size, rasterized once into a single channel
+ * coverage atlas, and the layouts of the strings drawn with them.
+ *
+ * The font is rendered by FreeType when available, or is the built-in 8x8
+ * bitmap font scaled to the nearest whole multiple of the size. Text is
+ * UTF-8; malformed sequences are replaced.
+ *
+ * None of the functions require the Ruby GVL, but the cache must only be
+ * used by one thread at a time.
+ */
+typedef struct mg_glyph_cache mg_glyph_cache;
+
+/**
+ * Opens the font file at the given path, or the built-in font if the path is
+ * 0, at the given size in pixels. Returns zero on success and stores the new
+ * cache, or a static error message on failure.
+ */
+extern const char * mg_glyph_cache_open(const char * path, unsigned int size,
+                                        mg_glyph_cache ** cache);
+
+/**
+ * Frees the cache, its atlas and its layouts.
+ */
+extern void mg_glyph_cache_free(mg_glyph_cache * cache);
+
+/**
+ * Returns whether FreeType fonts can be opened.
+ */
+extern int mg_glyph_cache_has_freetype(void);
+
+/**
+ * Returns the size of the font in pixels.
+ */
+extern unsigned int mg_glyph_cache_size(const mg_glyph_cache * cache);
+
+/**
+ * Returns the distance from the top of a line to its baseline.
+ */
+extern int mg_glyph_cache_ascent(const mg_glyph_cache * cache);
+
+/**
+ * Returns the distance between the baselines of consecutive lines.
+ */
+extern int mg_glyph_cache_line_height(const mg_glyph_cache * cache);
+
+/**
+ * Returns the layout of the text, rasterizing the glyphs it needs into the
+ * atlas. Layouts are cached by content, so laying out the same text again
+ * returns the same layout without any work. Lines are separated by newlines.
+ *
+ * The layout is valid until the next call. Returns zero if memory could not
+ * be allocated.
+ */
+extern const mg_text_layout * mg_glyph_cache_layout(mg_glyph_cache * cache,
+                                                    const char * text, size_t length);
+
+/**
+ * Returns the coverage atlas, one byte per pixel, MG_GLYPH_ATLAS_WIDTH bytes
+ * per row, and stores its height.
+ */
+extern const unsigned char * mg_glyph_cache_atlas(const mg_glyph_cache * cache,
+                                                  unsigned int * height);
+
+/**
+ * Returns the number of times the atlas was emptied. Atlas positions of
+ * layouts made before the count changed are no longer valid.
+ */
+extern unsigned int mg_glyph_cache_generation(const mg_glyph_cache * cache);
+
+/**
+ * Stores the rows of the atlas changed since the last call and marks them
+ * clean. Returns zero if nothing changed. If the atlas grew or was emptied,
+ * every row is reported and resized is set.
+ */
+extern int mg_glyph_cache_take_dirty(mg_glyph_cache * cache, unsigned int * first,
+                                     unsigned int * count, int * resized);
+
+/**
+ * Stores the counters of the cache.
+ */
+extern void mg_glyph_cache_get_stats(const mg_glyph_cache * cache, mg_glyph_cache_stats * stats);
+
+#endif /* MG_GLYPH_CACHE_H */
@@ -0,0 +1,59 @@
+#include "hash.h"
+
+#include <string.h>
+
+/* Constant definitions */
+
+static const uint64_t prime_1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t prime_2 = 0xC2B2AE3D27D4EB4FULL;
+
+/* Helper function prototypes */
+
+/**
+ * Mixes a 64 bit word into the hash state.
+ */
+static inline uint64_t mix(uint64_t h, uint64_t word) {
+    h ^= word * prime_2;
+    h = (h << 31) | (h >> 33);
+    return h * prime_1;
+}
+
+/* Hash interface implementation */
+
+uint64_t mg_hash64(const void * data, size_t size, uint64_t seed) {
+    const unsigned char * p = data;
+    uint64_t lanes[4], word;
+    size_t i, length = size;
+
+    lanes[0] = seed + prime_1;
+    lanes[1] = seed + prime_2;
+    lanes[2] = seed;
+    lanes[3] = seed - prime_1;
+
+    /* Hash 32 byte stripes in four independent lanes */
+    for (; size >= 32; size -= 32, p += 32) {
+        for (i = 0; i < 4; ++i) {
+            memcpy(&word, p + i * 8, 8);
+            lanes[i] = mix(lanes[i], word);
+        }
+    }
+
+    /* Fold the lanes together */
+    word = lanes[0] ^ mix(lanes[1], lanes[2]) ^ mix(lanes[3], length);
+
+    /* Hash the remaining words and bytes */
+    for (; size >= 8; size -= 8, p += 8) {
+        uint64_t tail;
+        memcpy(&tail, p, 8);
+        word = mix(word, tail);
+    }
+    for (; size > 0; --size, ++p) {
+        word = mix(word, *p);
+    }
+
+    /* Final avalanche */
+    word ^= word >> 33;
+    word *= prime_2;
+    word ^= word >> 29;
+    return word;
+}
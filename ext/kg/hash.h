@@ -0,0 +1,14 @@
+#ifndef MG_HASH_H
+#define MG_HASH_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Computes a fast, non-cryptographic 64 bit hash of the data, continuing from
+ * the given seed so that several buffers can be hashed together. Suitable for
+ * content-addressed cache keys, not for security.
+ */
+extern uint64_t mg_hash64(const void * data, size_t size, uint64_t seed);
+
+#endif /* MG_HASH_H */
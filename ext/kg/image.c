@@ -0,0 +1,243 @@
+#include "image.h"
+
+#include "future.h"
+#include "mapped_file.h"
+#include "worker_pool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include <ruby.h>
+#include <ruby/thread.h>
+
+VALUE mg_image_class;
+
+/* Data structures */
+
+typedef struct load_struct {
+    char * path; /** Path to the image file. */
+    mg_pixel_format format; /** Requested pixel format. */
+    mg_image * image; /** Decoded image, on success. */
+    const char * error; /** Static error message, on failure. */
+    int error_number; /** Value of errno if the file could not be mapped. */
+    mg_future * future; /** Future to complete, for asynchronous loads. */
+} load_t;
+
+/* Helper function prototypes */
+
+/**
+ * Creates a load job from the Ruby arguments.
+ */
+static load_t * load_new(int argc, VALUE * argv);
+
+/**
+ * Frees the load job.
+ */
+static void load_free(load_t * load);
+
+/**
+ * Maps the file and decodes it.
+ *
+ * This function is called WITHOUT the Ruby GVL.
+ */
+static void * load_image(void * data);
+
+/**
+ * Worker pool job that loads the image and completes the job's future.
+ */
+static void load_image_async(void * data);
+
+/**
+ * Frees the image and its pixels.
+ */
+static void image_free(void * p);
+
+/**
+ * Future converter that wraps the decoded image.
+ */
+static VALUE image_to_ruby(void * result);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::Image objects, which only own their pixels.
+ */
+static const rb_data_type_t image_type = {
+    "Mg::Image",
+    { 0, image_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Image interface implementation */
+
+VALUE mg_image_load(int argc, VALUE * argv, VALUE klass) {
+    load_t * load = load_new(argc, argv);
+    mg_image * image;
+
+    /* Decoding can't be interrupted, but it doesn't need to hold the GVL */
+    rb_thread_call_without_gvl(load_image, load, 0, 0);
+
+    image = load->image;
+
+    if (image == 0) {
+        VALUE path = rb_str_new_cstr(load->path);
+        const char * error = load->error;
+        int error_number = load->error_number;
+        load_free(load);
+        if (error_number) {
+            rb_syserr_fail_str(error_number, path);
+        }
+        rb_raise(rb_eRuntimeError, "%s: %s", error, StringValueCStr(path));
+    }
+
+    load_free(load);
+    return mg_image_wrap(image);
+}
+
+VALUE mg_image_load_async(int argc, VALUE * argv, VALUE klass) {
+    load_t * load = load_new(argc, argv);
+    VALUE future;
+
+    load->future = mg_future_new(image_to_ruby, image_free);
+
+    if (load->future == 0) {
+        load_free(load);
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for future");
+    }
+
+    /* Wrap it before the worker can complete it */
+    future = mg_future_wrap(load->future);
+
+    if (!mg_worker_pool_submit(load_image_async, load)) {
+        mg_future_reject(load->future, "could not start the worker pool");
+        load_free(load);
+    }
+
+    return future;
+}
+
+VALUE mg_image_wrap(mg_image * image) {
+    return TypedData_Wrap_Struct(mg_image_class, &image_type, image);
+}
+
+mg_image * mg_image_from(VALUE self) {
+    mg_image * image = 0;
+    TypedData_Get_Struct(self, mg_image, &image_type, image);
+    return image;
+}
+
+VALUE mg_image_width(VALUE self) {
+    return UINT2NUM(mg_image_from(self)->width);
+}
+
+VALUE mg_image_height(VALUE self) {
+    return UINT2NUM(mg_image_from(self)->height);
+}
+
+VALUE mg_image_format(VALUE self) {
+    return mg_pixel_format_to_symbol(mg_image_from(self)->format);
+}
+
+VALUE mg_image_pixels(VALUE self) {
+    mg_image * image = mg_image_from(self);
+    return rb_str_new((const char *) image->pixels,
+                      (long) image->width * image->height * 4);
+}
+
+void init_mg_image_class_under(VALUE module) {
+    mg_image_class = rb_define_class_under(module, "Image", rb_cObject);
+    rb_undef_alloc_func(mg_image_class);
+    rb_define_singleton_method(mg_image_class, "load",       mg_image_load,       -1);
+    rb_define_singleton_method(mg_image_class, "load_async", mg_image_load_async, -1);
+    rb_define_method(mg_image_class, "width",  mg_image_width,  0);
+    rb_define_method(mg_image_class, "height", mg_image_height, 0);
+    rb_define_method(mg_image_class, "format", mg_image_format, 0);
+    rb_define_method(mg_image_class, "pixels", mg_image_pixels, 0);
+}
+
+/* Helper function implementation */
+
+static load_t * load_new(int argc, VALUE * argv) {
+    VALUE path, format;
+    load_t * load;
+    mg_pixel_format pixel_format = MG_PIXEL_FORMAT_BGRA;
+
+    rb_scan_args(argc, argv, "11", &path, &format);
+
+    FilePathValue(path);
+
+    if (!NIL_P(format)) {
+        pixel_format = mg_pixel_format_from_symbol(format);
+    }
+
+    load = calloc(1, sizeof(load_t));
+
+    if (load == 0 || (load->path = strdup(StringValueCStr(path))) == 0) {
+        free(load);
+        rb_raise(rb_eRuntimeError, "unable to allocate memory for image load");
+    }
+
+    load->format = pixel_format;
+    return load;
+}
+
+static void load_free(load_t * load) {
+    free(load->path);
+    free(load);
+}
+
+static void * load_image(void * data) {
+    load_t * load = data;
+    mg_mapped_file file;
+    mg_image * image;
+
+    if (!mg_mapped_file_open(&file, load->path)) {
+        load->error = "could not map image file";
+        load->error_number = errno ? errno : EINVAL;
+        return 0;
+    }
+
+    image = malloc(sizeof(mg_image));
+
+    if (image == 0) {
+        load->error = "unable to allocate memory for image";
+    } else if ((load->error = mg_image_decode(file.data, file.size, load->format, image))) {
+        free(image);
+    } else {
+        load->image = image;
+    }
+
+    mg_mapped_file_close(&file);
+    return 0;
+}
+
+static void load_image_async(void * data) {
+    load_t * load = data;
+
+    load_image(load);
+
+    if (load->image) {
+        mg_future_resolve(load->future, load->image);
+    } else {
+        char message[512];
+        snprintf(message, sizeof(message), "%s: %s",
+                 load->error_number ? strerror(load->error_number) : load->error,
+                 load->path);
+        mg_future_reject(load->future, message);
+    }
+
+    load_free(load);
+}
+
+static void image_free(void * p) {
+    mg_image * image = p;
+    mg_image_free(image);
+    free(image);
+}
+
+static VALUE image_to_ruby(void * result) {
+    return mg_image_wrap(result);
+}
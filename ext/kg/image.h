@@ -0,0 +1,62 @@
+#ifndef MG_IMAGE_H
+#define MG_IMAGE_H
+
+#include "image_decoder.h"
+
+#include <ruby.h>
+
+/**
+ * Mg::Image class.
+ */
+extern VALUE mg_image_class;
+
+/**
+ * Loads and decodes the image file at the given path, WITHOUT holding the GVL
+ * while doing so. The optional format argument is a pixel format symbol and
+ * defaults to :bgra.
+ */
+extern VALUE mg_image_load(int argc, VALUE * argv, VALUE klass);
+
+/**
+ * Queues the image file at the given path for decoding on the worker pool and
+ * returns a Mg::Future for the resulting Mg::Image.
+ */
+extern VALUE mg_image_load_async(int argc, VALUE * argv, VALUE klass);
+
+/**
+ * Wraps the decoded image in a Mg::Image Ruby object, which takes ownership
+ * of it. The image must have been allocated with malloc.
+ */
+extern VALUE mg_image_wrap(mg_image * image);
+
+/**
+ * Returns the decoded image encapsulated by the Ruby object.
+ */
+extern mg_image * mg_image_from(VALUE self);
+
+/**
+ * Returns the width of the image.
+ */
+extern VALUE mg_image_width(VALUE self);
+
+/**
+ * Returns the height of the image.
+ */
+extern VALUE mg_image_height(VALUE self);
+
+/**
+ * Returns the pixel format of the image as a symbol.
+ */
+extern VALUE mg_image_format(VALUE self);
+
+/**
+ * Returns a copy of the image's pixels in a binary string.
+ */
+extern VALUE mg_image_pixels(VALUE self);
+
+/**
+ * Initializes the Image class.
+ */
+extern void init_mg_image_class_under(VALUE module);
+
+#endif /* MG_IMAGE_H */
@@ -0,0 +1,344 @@
+#include "image_decoder.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(MG_HAVE_PNG)
+    #include <png.h>
+#endif
+
+/* Constant definitions */
+
+/**
+ * Largest number of pixels an image may have. Keeps the pixel buffer size
+ * from overflowing and rejects absurd headers early.
+ */
+static const size_t max_pixels = 400000000;
+
+/* Helper function prototypes */
+
+/**
+ * Decodes a Quite OK Image.
+ */
+static const char * decode_qoi(const unsigned char * data, size_t size, mg_image * image);
+
+/**
+ * Decodes an uncompressed or bitfield-encoded Windows bitmap.
+ */
+static const char * decode_bmp(const unsigned char * data, size_t size, mg_image * image);
+
+/**
+ * Decodes a Portable Network Graphics image.
+ */
+static const char * decode_png(const unsigned char * data, size_t size, mg_image * image);
+
+/**
+ * Allocates the pixel buffer for an image of the given size.
+ */
+static const char * allocate(mg_image * image, unsigned int width, unsigned int height);
+
+/**
+ * Extracts the channel selected by the mask from the value and scales it to
+ * 8 bits.
+ */
+static unsigned char channel(uint32_t value, uint32_t mask);
+
+/**
+ * Reads big and little endian integers.
+ */
+static inline uint32_t be32(const unsigned char * p) {
+    return (uint32_t) p[0] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[2] << 8 | p[3];
+}
+
+static inline uint32_t le32(const unsigned char * p) {
+    return (uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 | (uint32_t) p[1] << 8 | p[0];
+}
+
+static inline uint16_t le16(const unsigned char * p) {
+    return (uint16_t) (p[1] << 8 | p[0]);
+}
+
+/* Image decoder interface implementation */
+
+const char * mg_image_decode(const unsigned char * data, size_t size,
+                             mg_pixel_format format, mg_image * image) {
+    image->width = image->height = 0;
+    image->format = format;
+    image->pixels = 0;
+
+    if (size >= 8 && memcmp(data, "\x89PNG\r\n\x1a\n", 8) == 0) {
+        return decode_png(data, size, image);
+    }
+
+    if (size >= 4 && memcmp(data, "qoif", 4) == 0) {
+        return decode_qoi(data, size, image);
+    }
+
+    if (size >= 2 && memcmp(data, "BM", 2) == 0) {
+        return decode_bmp(data, size, image);
+    }
+
+    return "unsupported image format";
+}
+
+void mg_image_free(mg_image * image) {
+    free(image->pixels);
+    image->pixels = 0;
+}
+
+/* Helper function implementation */
+
+static const char * decode_qoi(const unsigned char * data, size_t size, mg_image * image) {
+    static const size_t header_size = 14, end_marker_size = 8;
+    mg_pixel_layout layout = mg_pixel_format_layout(image->format);
+    unsigned char index[64][4], px[4] = { 0, 0, 0, 255 };
+    unsigned char * out;
+    size_t p = header_size, chunks_end, i, count;
+    unsigned int run = 0;
+    const char * error;
+
+    if (size < header_size + end_marker_size) { return "truncated QOI file"; }
+
+    /* Channel count and color space are informative; output is always RGBA */
+    if ((error = allocate(image, be32(data + 4), be32(data + 8)))) { return error; }
+
+    memset(index, 0, sizeof(index));
+    chunks_end = size - end_marker_size;
+    count = (size_t) image->width * image->height;
+    out = image->pixels;
+
+    for (i = 0; i < count; ++i, out += 4) {
+        if (run > 0) {
+            --run;
+        } else if (p < chunks_end) {
+            unsigned char b1 = data[p++];
+
+            if (b1 == 0xFE) {
+                px[0] = data[p++];
+                px[1] = data[p++];
+                px[2] = data[p++];
+            } else if (b1 == 0xFF) {
+                px[0] = data[p++];
+                px[1] = data[p++];
+                px[2] = data[p++];
+                px[3] = data[p++];
+            } else {
+                switch (b1 & 0xC0) {
+                    /* Previously seen pixel */
+                    case 0x00: {
+                        memcpy(px, index[b1], 4);
+                        break;
+                    }
+                    /* Small difference from the previous pixel */
+                    case 0x40: {
+                        px[0] += ((b1 >> 4) & 0x03) - 2;
+                        px[1] += ((b1 >> 2) & 0x03) - 2;
+                        px[2] += ( b1       & 0x03) - 2;
+                        break;
+                    }
+                    /* Difference from the previous pixel, relative to green */
+                    case 0x80: {
+                        unsigned char b2 = data[p++];
+                        int vg = (b1 & 0x3F) - 32;
+                        px[0] += vg - 8 + ((b2 >> 4) & 0x0F);
+                        px[1] += vg;
+                        px[2] += vg - 8 +  (b2       & 0x0F);
+                        break;
+                    }
+                    /* Run of the previous pixel */
+                    case 0xC0: {
+                        run = b1 & 0x3F;
+                        break;
+                    }
+                }
+            }
+
+            memcpy(index[(px[0] * 3 + px[1] * 5 + px[2] * 7 + px[3] * 11) % 64], px, 4);
+        }
+
+        mg_pixel_store(out, layout, px[0], px[1], px[2], px[3]);
+    }
+
+    return 0;
+}
+
+static const char * decode_bmp(const unsigned char * data, size_t size, mg_image * image) {
+    static const size_t file_header_size = 14;
+    mg_pixel_layout layout = mg_pixel_format_layout(image->format);
+    uint32_t offset, header_size, compression, colors;
+    uint32_t red_mask, green_mask, blue_mask, alpha_mask;
+    int32_t width, height;
+    unsigned int bpp, x, y, top_down;
+    size_t stride;
+    const unsigned char * palette = 0;
+    const char * error;
+
+    if (size < file_header_size + 40) { return "truncated BMP file"; }
+
+    offset      = le32(data + 10);
+    header_size = le32(data + 14);
+    width       = (int32_t) le32(data + 18);
+    height      = (int32_t) le32(data + 22);
+    bpp         = le16(data + 28);
+    compression = le32(data + 30);
+    colors      = le32(data + 46);
+
+    /* INT32_MIN has no positive counterpart to flip to */
+    if (header_size < 40 || width <= 0 || height == 0 || height == INT32_MIN) {
+        return "invalid BMP header";
+    }
+
+    /* Negative heights denote rows stored top to bottom */
+    top_down = height < 0;
+    if (top_down) { height = -height; }
+
+    /* Keeps the row arithmetic below from overflowing */
+    if ((size_t) width * (size_t) height > max_pixels) { return "invalid image dimensions"; }
+
+    /* Default channel masks */
+    red_mask   = 0x00FF0000;
+    green_mask = 0x0000FF00;
+    blue_mask  = 0x000000FF;
+    alpha_mask = 0;
+
+    switch (compression) {
+        /* Uncompressed */
+        case 0: {
+            if (bpp == 8) {
+                if (colors == 0 || colors > 256) { colors = 256; }
+                if (file_header_size + header_size + colors * 4 > size) {
+                    return "truncated BMP palette";
+                }
+                palette = data + file_header_size + header_size;
+            } else if (bpp != 24 && bpp != 32) {
+                return "unsupported BMP bit depth";
+            }
+            break;
+        }
+        /* Bitfields; the masks follow the 40 byte header */
+        case 3: {
+            if (bpp != 32) { return "unsupported BMP bit depth"; }
+            if (file_header_size + 52 > size) { return "truncated BMP header"; }
+            red_mask   = le32(data + file_header_size + 40);
+            green_mask = le32(data + file_header_size + 44);
+            blue_mask  = le32(data + file_header_size + 48);
+            if (header_size >= 56 && file_header_size + 56 <= size) {
+                alpha_mask = le32(data + file_header_size + 52);
+            }
+            break;
+        }
+        default: return "unsupported BMP compression";
+    }
+
+    /* Rows are padded to 4 bytes */
+    stride = (((size_t) width * bpp + 31) / 32) * 4;
+
+    if (offset > size || stride * height > size - offset) { return "truncated BMP pixel data"; }
+
+    if ((error = allocate(image, width, height))) { return error; }
+
+    for (y = 0; y < (unsigned int) height; ++y) {
+        const unsigned char * row = data + offset + stride * (top_down ? y : height - 1 - y);
+        unsigned char * out = image->pixels + (size_t) y * width * 4;
+
+        for (x = 0; x < (unsigned int) width; ++x, out += 4) {
+            switch (bpp) {
+                case 8: {
+                    const unsigned char * c = palette + (row[x] < colors ? row[x] : 0) * 4;
+                    mg_pixel_store(out, layout, c[2], c[1], c[0], 255);
+                    break;
+                }
+                case 24: {
+                    const unsigned char * c = row + x * 3;
+                    mg_pixel_store(out, layout, c[2], c[1], c[0], 255);
+                    break;
+                }
+                case 32: {
+                    uint32_t v = le32(row + x * 4);
+                    mg_pixel_store(out, layout,
+                                   channel(v, red_mask),
+                                   channel(v, green_mask),
+                                   channel(v, blue_mask),
+                                   alpha_mask ? channel(v, alpha_mask) : 255);
+                    break;
+                }
+            }
+        }
+    }
+
+    return 0;
+}
+
+#if defined(MG_HAVE_PNG)
+
+static const char * decode_png(const unsigned char * data, size_t size, mg_image * image) {
+    static const png_uint_32 formats[] = {
+        PNG_FORMAT_RGBA, /* MG_PIXEL_FORMAT_RGBA */
+        PNG_FORMAT_BGRA, /* MG_PIXEL_FORMAT_BGRA */
+        PNG_FORMAT_ARGB, /* MG_PIXEL_FORMAT_ARGB */
+        PNG_FORMAT_ABGR  /* MG_PIXEL_FORMAT_ABGR */
+    };
+    png_image png;
+    const char * error;
+
+    memset(&png, 0, sizeof(png));
+    png.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_memory(&png, data, size)) {
+        return "invalid PNG file";
+    }
+
+    /* Let libpng swizzle straight into the requested layout */
+    png.format = formats[image->format];
+
+    if ((error = allocate(image, png.width, png.height))) {
+        png_image_free(&png);
+        return error;
+    }
+
+    if (!png_image_finish_read(&png, 0, image->pixels, 0, 0)) {
+        mg_image_free(image);
+        return "could not decode PNG file";
+    }
+
+    return 0;
+}
+
+#else
+
+static const char * decode_png(const unsigned char * data, size_t size, mg_image * image) {
+    return "PNG support was not compiled in";
+}
+
+#endif
+
+static const char * allocate(mg_image * image, unsigned int width, unsigned int height) {
+    if (width == 0 || height == 0 || (size_t) width * height > max_pixels) {
+        return "invalid image dimensions";
+    }
+
+    image->pixels = malloc((size_t) width * height * 4);
+
+    if (image->pixels == 0) { return "unable to allocate memory for image"; }
+
+    image->width = width;
+    image->height = height;
+    return 0;
+}
+
+static unsigned char channel(uint32_t value, uint32_t mask) {
+    uint32_t max;
+
+    if (mask == 0) { return 0; }
+
+    /* Shift the channel down to bit zero */
+    while ((mask & 1) == 0) {
+        mask >>= 1;
+        value >>= 1;
+    }
+
+    /* Scale it to the 0-255 range */
+    max = mask;
+    return (unsigned char) (((value & mask) * 255 + max / 2) / max);
+}
@@ -0,0 +1,34 @@
+#ifndef MG_IMAGE_DECODER_H
+#define MG_IMAGE_DECODER_H
+
+#include "pixel_format.h"
+
+#include <stddef.h>
+
+/**
+ * Decoded image. Pixels are 32 bits wide, tightly packed, top row first.
+ */
+typedef struct {
+    unsigned int width; /** Width in pixels. */
+    unsigned int height; /** Height in pixels. */
+    mg_pixel_format format; /** Layout of each pixel. */
+    unsigned char * pixels; /** width * height * 4 bytes. */
+} mg_image;
+
+/**
+ * Decodes a PNG, QOI or BMP file held in memory into pixels of the given
+ * format. The file type is detected from its contents.
+ *
+ * Does not require the Ruby GVL. Returns zero on success and fills in the
+ * image, whose pixels must be released with mg_image_free. Returns a static
+ * error message on failure.
+ */
+extern const char * mg_image_decode(const unsigned char * data, size_t size,
+                                    mg_pixel_format format, mg_image * image);
+
+/**
+ * Frees the pixels of the image.
+ */
+extern void mg_image_free(mg_image * image);
+
+#endif /* MG_IMAGE_DECODER_H */
@@ -3,5 +3,11 @@
 #include "mg.h"
 
 void Init_kg(void) {
+#if defined(HAVE_RB_EXT_RACTOR_SAFE)
+    /* Let non-main Ractors call the methods defined below. Global state is
+     * either set up here and never changed, or guarded by its own lock */
+    rb_ext_ractor_safe(true);
+#endif
+
     init_mg_module();
 }
@@ -0,0 +1,78 @@
+#include "mapped_file.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* Helper function prototypes */
+
+/**
+ * Maps the file, giving the kernel the advice about how it will be read.
+ */
+static int map(mg_mapped_file * file, const char * path, int advice);
+
+/* Mapped file interface implementation */
+
+int mg_mapped_file_open(mg_mapped_file * file, const char * path) {
+    /* The whole file is about to be read */
+    return map(file, path, MADV_WILLNEED);
+}
+
+int mg_mapped_file_open_sequential(mg_mapped_file * file, const char * path) {
+    return map(file, path, MADV_SEQUENTIAL);
+}
+
+size_t mg_mapped_file_discard(mg_mapped_file * file, size_t start, size_t end) {
+    size_t page = (size_t) sysconf(_SC_PAGESIZE);
+
+    /* Round inwards to whole pages */
+    start = (start + page - 1) / page * page;
+    end = end / page * page;
+
+    if (end <= start) { return start; }
+
+    madvise((void *) (file->data + start), end - start, MADV_DONTNEED);
+    return end;
+}
+
+void mg_mapped_file_close(mg_mapped_file * file) {
+    if (file->data) {
+        munmap((void *) file->data, file->size);
+        file->data = 0;
+        file->size = 0;
+    }
+}
+
+/* Helper function implementation */
+
+static int map(mg_mapped_file * file, const char * path, int advice) {
+    struct stat st;
+    void * data;
+    int fd;
+
+    file->data = 0;
+    file->size = 0;
+
+    /* Open the file for reading */
+    fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return 0; }
+
+    /* Find out how much there is to map */
+    if (fstat(fd, &st) < 0 || st.st_size == 0) {
+        close(fd);
+        return 0;
+    }
+
+    /* Map it; the mapping stays valid after the descriptor is closed */
+    data = mmap(0, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED) { return 0; }
+
+    madvise(data, st.st_size, advice);
+
+    file->data = data;
+    file->size = st.st_size;
+    return 1;
+}
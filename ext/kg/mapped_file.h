@@ -0,0 +1,45 @@
+#ifndef MG_MAPPED_FILE_H
+#define MG_MAPPED_FILE_H
+
+#include <stddef.h>
+
+/**
+ * A read-only memory mapping of an entire file.
+ */
+typedef struct {
+    const unsigned char * data; /** Start of the mapping. */
+    size_t size; /** Size of the file in bytes. */
+} mg_mapped_file;
+
+/**
+ * Maps the file at the given path into memory.
+ *
+ * Does not require the Ruby GVL. Returns a non-zero value on success, zero
+ * otherwise; errno is left as set by the failing system call.
+ */
+extern int mg_mapped_file_open(mg_mapped_file * file, const char * path);
+
+/**
+ * Maps the file at the given path into memory for reading from start to
+ * finish, letting the kernel read ahead and drop pages behind the reader
+ * instead of prefetching the whole file.
+ *
+ * Does not require the Ruby GVL. Returns a non-zero value on success, zero
+ * otherwise; errno is left as set by the failing system call.
+ */
+extern int mg_mapped_file_open_sequential(mg_mapped_file * file, const char * path);
+
+/**
+ * Drops the pages between the given offsets from the process' memory; they
+ * are read from the file again if touched. Only whole pages are dropped.
+ *
+ * Returns the offset up to which pages were dropped.
+ */
+extern size_t mg_mapped_file_discard(mg_mapped_file * file, size_t start, size_t end);
+
+/**
+ * Unmaps the file. Safe to call on a file that failed to open.
+ */
+extern void mg_mapped_file_close(mg_mapped_file * file);
+
+#endif /* MG_MAPPED_FILE_H */
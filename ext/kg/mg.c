@@ -1,13 +1,36 @@
 #include "mg.h"
 
 #include "window.h"
+#include "asset_cache.h"
+#include "audio.h"
+#include "canvas.h"
+#include "clock.h"
 #include "display_mode.h"
+#include "event.h"
+#include "font.h"
+#include "future.h"
+#include "image.h"
+#include "offscreen.h"
+#include "program.h"
+#include "screen_capture.h"
 
 #include <ruby.h>
 
+VALUE mg_module;
+
 void init_mg_module(void) {
     mg_module = rb_define_module("Mg");
     init_mg_window_class_under(mg_module);
     init_mg_window_events();
     init_mg_display_mode_class_under(mg_module);
+    init_mg_future_class_under(mg_module);
+    init_mg_image_class_under(mg_module);
+    init_mg_asset_cache_class_under(mg_module);
+    init_mg_audio_class_under(mg_module);
+    init_mg_clock_class_under(mg_module);
+    init_mg_offscreen_class_under(mg_module);
+    init_mg_canvas_class_under(mg_module);
+    init_mg_font_class_under(mg_module);
+    init_mg_program_class_under(mg_module);
+    init_mg_screen_capture_class_under(mg_module);
 }
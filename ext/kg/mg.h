@@ -3,7 +3,10 @@
 
 #include <ruby.h>
 
-VALUE mg_module;
+/**
+ * Mg module.
+ */
+extern VALUE mg_module;
 
 extern void init_mg_module(void);
 
@@ -0,0 +1,96 @@
+#include "offscreen.h"
+
+#include "EGL_native_offscreen.h"
+#include "pixel_format.h"
+
+#include <ruby.h>
+
+VALUE mg_offscreen_class;
+
+/* Offscreen interface implementation */
+
+VALUE mg_offscreen_alloc(VALUE klass) {
+    return mg_native_offscreen_alloc(klass);
+}
+
+VALUE mg_offscreen_setup(VALUE self, VALUE width, VALUE height, VALUE buffers, VALUE format) {
+    Check_Type(width,   T_FIXNUM);
+    Check_Type(height,  T_FIXNUM);
+    Check_Type(buffers, T_FIXNUM);
+
+    if (FIX2INT(width) < 1 || FIX2INT(height) < 1 || FIX2INT(buffers) < 1) {
+        rb_raise(rb_eArgError, "size and buffer count must be positive");
+    }
+
+    mg_native_offscreen_init(self, FIX2UINT(width), FIX2UINT(height), FIX2UINT(buffers),
+                             mg_pixel_format_from_symbol(format));
+    return self;
+}
+
+VALUE mg_offscreen_make_current(VALUE self) {
+    mg_native_offscreen_make_current(self);
+    return self;
+}
+
+VALUE mg_offscreen_width(VALUE self) {
+    return UINT2NUM(mg_native_offscreen_width(self));
+}
+
+VALUE mg_offscreen_height(VALUE self) {
+    return UINT2NUM(mg_native_offscreen_height(self));
+}
+
+VALUE mg_offscreen_surfaceless(VALUE self) {
+    return mg_native_offscreen_surfaceless(self) ? Qtrue : Qfalse;
+}
+
+VALUE mg_offscreen_gl_stats(VALUE self) {
+    mg_gl_state_stats stats;
+    VALUE hash;
+
+    if (!mg_native_offscreen_gl_state_stats(self, &stats)) { return Qnil; }
+
+    hash = rb_hash_new();
+    rb_hash_aset(hash, ID2SYM(rb_intern("made")),    ULL2NUM(stats.made));
+    rb_hash_aset(hash, ID2SYM(rb_intern("skipped")), ULL2NUM(stats.skipped));
+    return hash;
+}
+
+VALUE mg_offscreen_capture(VALUE self) {
+    return mg_native_offscreen_capture(self);
+}
+
+VALUE mg_offscreen_drain(VALUE self) {
+    return mg_native_offscreen_drain(self);
+}
+
+VALUE mg_offscreen_read(VALUE self) {
+    return mg_native_offscreen_read(self);
+}
+
+VALUE mg_offscreen_close(VALUE self) {
+    mg_native_offscreen_close(self);
+    return Qnil;
+}
+
+VALUE mg_offscreen_closed(VALUE self) {
+    return mg_native_offscreen_closed(self) ? Qtrue : Qfalse;
+}
+
+void init_mg_offscreen_class_under(VALUE module) {
+    mg_offscreen_class = rb_define_class_under(module, "Offscreen", rb_cObject);
+    rb_define_alloc_func(mg_offscreen_class, mg_offscreen_alloc);
+    rb_define_private_method(mg_offscreen_class, "setup", mg_offscreen_setup, 4);
+    rb_define_method(mg_offscreen_class, "make_current", mg_offscreen_make_current, 0);
+    rb_define_method(mg_offscreen_class, "width",        mg_offscreen_width,        0);
+    rb_define_method(mg_offscreen_class, "height",       mg_offscreen_height,       0);
+    rb_define_method(mg_offscreen_class, "surfaceless?", mg_offscreen_surfaceless,  0);
+    rb_define_method(mg_offscreen_class, "gl_stats",     mg_offscreen_gl_stats,     0);
+    rb_define_method(mg_offscreen_class, "capture",      mg_offscreen_capture,      0);
+    rb_define_method(mg_offscreen_class, "drain",        mg_offscreen_drain,        0);
+    rb_define_method(mg_offscreen_class, "read",         mg_offscreen_read,         0);
+    rb_define_method(mg_offscreen_class, "close",        mg_offscreen_close,        0);
+    rb_define_method(mg_offscreen_class, "closed?",      mg_offscreen_closed,       0);
+    rb_define_alias(mg_offscreen_class, "w", "width");
+    rb_define_alias(mg_offscreen_class, "h", "height");
+}
@@ -0,0 +1,85 @@
+#ifndef MG_OFFSCREEN_H
+#define MG_OFFSCREEN_H
+
+#include <ruby.h>
+
+/**
+ * Mg::Offscreen class.
+ */
+extern VALUE mg_offscreen_class;
+
+/**
+ * Allocates memory for the offscreen target.
+ */
+extern VALUE mg_offscreen_alloc(VALUE klass);
+
+/**
+ * Creates the offscreen target's OpenGL context, a width by height
+ * framebuffer and a ring of buffers to read it back through. The format is a
+ * pixel format symbol. The context is left current on the calling thread.
+ */
+extern VALUE mg_offscreen_setup(VALUE self, VALUE width, VALUE height, VALUE buffers, VALUE format);
+
+/**
+ * Makes the offscreen target's context current on the calling thread, so that
+ * OpenGL calls render into it.
+ */
+extern VALUE mg_offscreen_make_current(VALUE self);
+
+/**
+ * Returns the width of the framebuffer.
+ */
+extern VALUE mg_offscreen_width(VALUE self);
+
+/**
+ * Returns the height of the framebuffer.
+ */
+extern VALUE mg_offscreen_height(VALUE self);
+
+/**
+ * Returns whether rendering goes into a framebuffer object instead of a
+ * pbuffer surface.
+ */
+extern VALUE mg_offscreen_surfaceless(VALUE self);
+
+/**
+ * Returns the numbers of GL state changes made and skipped as redundant by
+ * Mg's renderer in a Hash, nil if the context has no state cache.
+ */
+extern VALUE mg_offscreen_gl_stats(VALUE self);
+
+/**
+ * Starts an asynchronous read of what was rendered. Returns the Mg::Image of
+ * the oldest read if the ring was full, nil otherwise; images come out as many
+ * frames late as there are buffers.
+ */
+extern VALUE mg_offscreen_capture(VALUE self);
+
+/**
+ * Finishes every pending read and returns their images in an array, oldest
+ * first.
+ */
+extern VALUE mg_offscreen_drain(VALUE self);
+
+/**
+ * Reads what was rendered right away, stalling until rendering finishes, and
+ * returns it as a Mg::Image.
+ */
+extern VALUE mg_offscreen_read(VALUE self);
+
+/**
+ * Destroys the offscreen target's context. Pending reads are discarded.
+ */
+extern VALUE mg_offscreen_close(VALUE self);
+
+/**
+ * Returns whether the offscreen target has been closed.
+ */
+extern VALUE mg_offscreen_closed(VALUE self);
+
+/**
+ * Initializes the Offscreen class.
+ */
+extern void init_mg_offscreen_class_under(VALUE module);
+
+#endif /* MG_OFFSCREEN_H */
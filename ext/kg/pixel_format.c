@@ -0,0 +1,83 @@
+#include "pixel_format.h"
+
+#include <ruby.h>
+
+/* Helper function prototypes */
+
+/**
+ * Returns the index of the byte covered by the given 8 bit channel mask, or -1
+ * if the mask doesn't cover exactly one byte.
+ */
+static int byte_of(unsigned long mask, int big_endian);
+
+/* Pixel format interface implementation */
+
+mg_pixel_layout mg_pixel_format_layout(mg_pixel_format format) {
+    static const mg_pixel_layout layouts[] = {
+        /* r  g  b  a */
+        {  0, 1, 2, 3 }, /* MG_PIXEL_FORMAT_RGBA */
+        {  2, 1, 0, 3 }, /* MG_PIXEL_FORMAT_BGRA */
+        {  1, 2, 3, 0 }, /* MG_PIXEL_FORMAT_ARGB */
+        {  3, 2, 1, 0 }  /* MG_PIXEL_FORMAT_ABGR */
+    };
+    return layouts[format];
+}
+
+int mg_pixel_format_from_masks(unsigned long red_mask,
+                               unsigned long green_mask,
+                               unsigned long blue_mask,
+                               int big_endian,
+                               mg_pixel_format * format) {
+    int f, r, g, b;
+
+    r = byte_of(red_mask,   big_endian);
+    g = byte_of(green_mask, big_endian);
+    b = byte_of(blue_mask,  big_endian);
+
+    /* Every channel must occupy its own byte */
+    if (r < 0 || g < 0 || b < 0) { return 0; }
+
+    /* Look for the format whose byte offsets match */
+    for (f = MG_PIXEL_FORMAT_RGBA; f <= MG_PIXEL_FORMAT_ABGR; ++f) {
+        mg_pixel_layout layout = mg_pixel_format_layout(f);
+        if (layout.r == r && layout.g == g && layout.b == b) {
+            *format = f;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+VALUE mg_pixel_format_to_symbol(mg_pixel_format format) {
+    switch (format) {
+        case MG_PIXEL_FORMAT_RGBA: return ID2SYM(rb_intern("rgba"));
+        case MG_PIXEL_FORMAT_BGRA: return ID2SYM(rb_intern("bgra"));
+        case MG_PIXEL_FORMAT_ARGB: return ID2SYM(rb_intern("argb"));
+        case MG_PIXEL_FORMAT_ABGR: return ID2SYM(rb_intern("abgr"));
+    }
+    return Qnil;
+}
+
+mg_pixel_format mg_pixel_format_from_symbol(VALUE symbol) {
+    ID id;
+    Check_Type(symbol, T_SYMBOL);
+    id = SYM2ID(symbol);
+    if (id == rb_intern("rgba")) { return MG_PIXEL_FORMAT_RGBA; }
+    if (id == rb_intern("bgra")) { return MG_PIXEL_FORMAT_BGRA; }
+    if (id == rb_intern("argb")) { return MG_PIXEL_FORMAT_ARGB; }
+    if (id == rb_intern("abgr")) { return MG_PIXEL_FORMAT_ABGR; }
+    rb_raise(rb_eArgError, "unsupported pixel format: %s", rb_id2name(id));
+}
+
+/* Helper function implementation */
+
+static int byte_of(unsigned long mask, int big_endian) {
+    int byte;
+    for (byte = 0; byte < 4; ++byte) {
+        if (mask == (0xFFUL << (byte * 8))) {
+            return big_endian ? 3 - byte : byte;
+        }
+    }
+    return -1;
+}
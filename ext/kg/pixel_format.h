@@ -0,0 +1,66 @@
+#ifndef MG_PIXEL_FORMAT_H
+#define MG_PIXEL_FORMAT_H
+
+#include <ruby.h>
+
+#include <stdint.h>
+
+/**
+ * Memory layout of 32 bit pixels, named after the order of the bytes in
+ * memory.
+ */
+typedef enum {
+    MG_PIXEL_FORMAT_RGBA,
+    MG_PIXEL_FORMAT_BGRA,
+    MG_PIXEL_FORMAT_ARGB,
+    MG_PIXEL_FORMAT_ABGR
+} mg_pixel_format;
+
+/**
+ * Byte offsets of each channel within a pixel.
+ */
+typedef struct {
+    unsigned char r, g, b, a;
+} mg_pixel_layout;
+
+/**
+ * Returns the byte offsets of each channel for the given pixel format.
+ */
+extern mg_pixel_layout mg_pixel_format_layout(mg_pixel_format format);
+
+/**
+ * Finds the pixel format that matches the given channel masks and byte order.
+ * The alpha channel is assumed to occupy the byte not covered by the masks.
+ *
+ * Returns a non-zero value if a matching format was found, zero otherwise.
+ */
+extern int mg_pixel_format_from_masks(unsigned long red_mask,
+                                      unsigned long green_mask,
+                                      unsigned long blue_mask,
+                                      int big_endian,
+                                      mg_pixel_format * format);
+
+/**
+ * Converts the pixel format to its corresponding Ruby symbol.
+ */
+extern VALUE mg_pixel_format_to_symbol(mg_pixel_format format);
+
+/**
+ * Converts the Ruby symbol to its corresponding pixel format. Raises an
+ * ArgumentError if the symbol doesn't name a supported format.
+ */
+extern mg_pixel_format mg_pixel_format_from_symbol(VALUE symbol);
+
+/**
+ * Stores the given color in the pixel pointed to by p.
+ */
+static inline void mg_pixel_store(unsigned char * p, mg_pixel_layout layout,
+                                  unsigned char r, unsigned char g,
+                                  unsigned char b, unsigned char a) {
+    p[layout.r] = r;
+    p[layout.g] = g;
+    p[layout.b] = b;
+    p[layout.a] = a;
+}
+
+#endif /* MG_PIXEL_FORMAT_H */
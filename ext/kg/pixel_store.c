@@ -0,0 +1,50 @@
+#include "pixel_store.h"
+
+#include <stddef.h>
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/* Constant definitions */
+
+/**
+ * Every client pixel store parameter with its initial value.
+ */
+static const GLint defaults[][2] = {
+    { GL_PACK_SWAP_BYTES,   GL_FALSE }, { GL_UNPACK_SWAP_BYTES,   GL_FALSE },
+    { GL_PACK_LSB_FIRST,    GL_FALSE }, { GL_UNPACK_LSB_FIRST,    GL_FALSE },
+    { GL_PACK_ROW_LENGTH,   0 },        { GL_UNPACK_ROW_LENGTH,   0 },
+    { GL_PACK_IMAGE_HEIGHT, 0 },        { GL_UNPACK_IMAGE_HEIGHT, 0 },
+    { GL_PACK_SKIP_ROWS,    0 },        { GL_UNPACK_SKIP_ROWS,    0 },
+    { GL_PACK_SKIP_PIXELS,  0 },        { GL_UNPACK_SKIP_PIXELS,  0 },
+    { GL_PACK_SKIP_IMAGES,  0 },        { GL_UNPACK_SKIP_IMAGES,  0 },
+    { GL_PACK_ALIGNMENT,    4 },        { GL_UNPACK_ALIGNMENT,    4 },
+};
+
+/* Pixel store interface implementation */
+
+void mg_pixel_store_push(mg_pixel_store_state * saved) {
+    GLint pack = 0, unpack = 0;
+    size_t i;
+
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &pack);
+    glGetIntegerv(GL_PIXEL_UNPACK_BUFFER_BINDING, &unpack);
+    saved->pack_buffer = (unsigned int) pack;
+    saved->unpack_buffer = (unsigned int) unpack;
+
+    glPushClientAttrib(GL_CLIENT_PIXEL_STORE_BIT);
+    for (i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i) {
+        glPixelStorei((GLenum) defaults[i][0], defaults[i][1]);
+    }
+
+    if (pack) { glBindBuffer(GL_PIXEL_PACK_BUFFER, 0); }
+    if (unpack) { glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0); }
+}
+
+void mg_pixel_store_pop(const mg_pixel_store_state * saved) {
+    glPopClientAttrib();
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, saved->pack_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, saved->unpack_buffer);
+}
@@ -0,0 +1,26 @@
+#ifndef MG_PIXEL_STORE_H
+#define MG_PIXEL_STORE_H
+
+/**
+ * Pixel buffer bindings of the caller, put back by mg_pixel_store_pop.
+ */
+typedef struct {
+    unsigned int pack_buffer;
+    unsigned int unpack_buffer;
+} mg_pixel_store_state;
+
+/**
+ * Pushes the client pixel store state of the current GL context, resets it to
+ * GL's defaults and unbinds the pixel pack and unpack buffers, so that pixels
+ * move between GL and tightly packed client memory whatever the application
+ * set up.
+ */
+extern void mg_pixel_store_push(mg_pixel_store_state * saved);
+
+/**
+ * Pops the client pixel store state and binds the caller's pixel buffers
+ * again.
+ */
+extern void mg_pixel_store_pop(const mg_pixel_store_state * saved);
+
+#endif /* MG_PIXEL_STORE_H */
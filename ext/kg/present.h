@@ -0,0 +1,41 @@
+#ifndef MG_PRESENT_H
+#define MG_PRESENT_H
+
+#include <stdint.h>
+
+/**
+ * Number of completed frames remembered until they're asked for.
+ */
+#define MG_PRESENT_FEEDBACK_CAPACITY 64
+
+/**
+ * Counters of frames presented to a window.
+ */
+typedef struct {
+    uint64_t frames; /** Frames presented. */
+    uint64_t partial_frames; /** Frames of which only the damage was presented. */
+    uint64_t bytes; /** Bytes of pixels presented in total. */
+    uint64_t last_bytes; /** Bytes of pixels presented in the last frame. */
+} mg_present_stats;
+
+/**
+ * How a frame reached the screen.
+ */
+typedef enum {
+    MG_PRESENT_MODE_COPY, /** Copied into the window. */
+    MG_PRESENT_MODE_FLIP, /** Scanned out directly. */
+    MG_PRESENT_MODE_SKIP, /** Replaced by a later frame before it was shown. */
+    MG_PRESENT_MODE_SUBOPTIMAL_COPY /** Copied, though it could have been flipped. */
+} mg_present_mode;
+
+/**
+ * Completion of a presented frame, as reported by the display server.
+ */
+typedef struct {
+    uint32_t serial; /** Serial number of the presentation. */
+    uint64_t ust; /** System time the frame was shown, in microseconds of CLOCK_MONOTONIC. */
+    uint64_t msc; /** Vertical retrace count when the frame was shown. */
+    mg_present_mode mode;
+} mg_present_feedback;
+
+#endif /* MG_PRESENT_H */
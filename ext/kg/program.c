@@ -0,0 +1,229 @@
+#include "program.h"
+
+#include <stdlib.h>
+
+#include <ruby.h>
+
+VALUE mg_program_cache_class;
+VALUE mg_program_class;
+
+/* Data structures */
+
+typedef struct program_struct {
+    mg_program program;
+    VALUE cache; /** Mg::ProgramCache that built the program. */
+} program_t;
+
+/* Helper function prototypes */
+
+/**
+ * Returns the cache encapsulated by the Ruby object. Raises a Ruby exception
+ * if it wasn't set up.
+ */
+static mg_shader_cache * cache_from(VALUE self);
+
+/**
+ * Returns the program encapsulated by the Ruby object. Raises a Ruby
+ * exception if it was deleted.
+ */
+static program_t * program_from(VALUE self);
+
+/**
+ * Waits for the program to be built and returns its status.
+ */
+static mg_program_status finish(program_t * program);
+
+/**
+ * Keeps the program's cache alive.
+ */
+static void program_mark(void * p);
+
+/**
+ * Frees the program. Its GL objects can't be deleted without their context,
+ * so they are left to Mg::Program#delete.
+ */
+static void program_free(void * p);
+
+/**
+ * Frees the program cache, if it was set up.
+ */
+static void cache_free(void * p);
+
+/* Constant definitions */
+
+/**
+ * Ruby data type of Mg::ProgramCache objects.
+ */
+static const rb_data_type_t cache_type = {
+    "Mg::ProgramCache",
+    { 0, cache_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/**
+ * Ruby data type of Mg::Program objects.
+ */
+static const rb_data_type_t program_type = {
+    "Mg::Program",
+    { program_mark, program_free, 0 },
+    0, 0,
+    RUBY_TYPED_FREE_IMMEDIATELY
+};
+
+/* Program interface implementation */
+
+VALUE mg_program_cache_alloc(VALUE klass) {
+    return TypedData_Wrap_Struct(klass, &cache_type, 0);
+}
+
+VALUE mg_program_cache_setup(VALUE self, VALUE directory) {
+    mg_shader_cache * cache;
+    const char * error = 0;
+
+    if (!NIL_P(directory)) { FilePathValue(directory); }
+
+    cache = mg_shader_cache_new(NIL_P(directory) ? 0 : RSTRING_PTR(directory), &error);
+    if (cache == 0) {
+        rb_raise(rb_eRuntimeError, "%s", error);
+    }
+
+    mg_shader_cache_free(RTYPEDDATA_DATA(self));
+    RTYPEDDATA_DATA(self) = cache;
+    return self;
+}
+
+VALUE mg_program_cache_build(VALUE self, VALUE vertex, VALUE fragment) {
+    mg_shader_cache * cache = cache_from(self);
+    program_t * program;
+    VALUE object;
+
+    StringValue(vertex);
+    StringValue(fragment);
+
+    object = TypedData_Make_Struct(mg_program_class, program_t, &program_type, program);
+    program->cache = self;
+
+    if (!mg_shader_cache_start(cache, &program->program,
+                               RSTRING_PTR(vertex), RSTRING_LEN(vertex),
+                               RSTRING_PTR(fragment), RSTRING_LEN(fragment))) {
+        rb_raise(rb_eRuntimeError, "could not create program; is a GL context current?");
+    }
+
+    return object;
+}
+
+VALUE mg_program_cache_stats(VALUE self) {
+    mg_shader_cache_stats stats;
+    VALUE hash = rb_hash_new();
+
+    mg_shader_cache_get_stats(cache_from(self), &stats);
+
+    rb_hash_aset(hash, ID2SYM(rb_intern("binary")),    stats.binary ? Qtrue : Qfalse);
+    rb_hash_aset(hash, ID2SYM(rb_intern("parallel")),  stats.parallel ? Qtrue : Qfalse);
+    rb_hash_aset(hash, ID2SYM(rb_intern("programs")),  ULL2NUM(stats.programs));
+    rb_hash_aset(hash, ID2SYM(rb_intern("hits")),      ULL2NUM(stats.hits));
+    rb_hash_aset(hash, ID2SYM(rb_intern("misses")),    ULL2NUM(stats.misses));
+    rb_hash_aset(hash, ID2SYM(rb_intern("stored")),    ULL2NUM(stats.stored));
+    rb_hash_aset(hash, ID2SYM(rb_intern("failures")),  ULL2NUM(stats.failures));
+    rb_hash_aset(hash, ID2SYM(rb_intern("wait_time")), DBL2NUM(stats.wait_time / 1e9));
+
+    return hash;
+}
+
+VALUE mg_program_ready(VALUE self) {
+    program_t * program = program_from(self);
+    return mg_shader_cache_ready(cache_from(program->cache), &program->program) ? Qtrue : Qfalse;
+}
+
+VALUE mg_program_name(VALUE self) {
+    program_t * program = program_from(self);
+
+    if (finish(program) == MG_PROGRAM_FAILED) {
+        rb_raise(rb_eRuntimeError, "program failed to build:\n%s",
+                 program->program.log ? program->program.log : "");
+    }
+
+    return UINT2NUM(program->program.name);
+}
+
+VALUE mg_program_linked(VALUE self) {
+    return finish(program_from(self)) == MG_PROGRAM_LINKED ? Qtrue : Qfalse;
+}
+
+VALUE mg_program_log(VALUE self) {
+    program_t * program = program_from(self);
+    finish(program);
+    return program->program.log ? rb_str_new_cstr(program->program.log) : Qnil;
+}
+
+VALUE mg_program_cached(VALUE self) {
+    return program_from(self)->program.cached ? Qtrue : Qfalse;
+}
+
+VALUE mg_program_delete_objects(VALUE self) {
+    program_t * program = 0;
+    TypedData_Get_Struct(self, program_t, &program_type, program);
+    mg_program_delete(&program->program);
+    return self;
+}
+
+void init_mg_program_class_under(VALUE module) {
+    mg_program_cache_class = rb_define_class_under(module, "ProgramCache", rb_cObject);
+    rb_define_alloc_func(mg_program_cache_class, mg_program_cache_alloc);
+    rb_define_private_method(mg_program_cache_class, "setup", mg_program_cache_setup, 1);
+    rb_define_method(mg_program_cache_class, "build", mg_program_cache_build, 2);
+    rb_define_method(mg_program_cache_class, "stats", mg_program_cache_stats, 0);
+
+    mg_program_class = rb_define_class_under(module, "Program", rb_cObject);
+    rb_undef_alloc_func(mg_program_class);
+    rb_define_method(mg_program_class, "ready?",  mg_program_ready,          0);
+    rb_define_method(mg_program_class, "name",    mg_program_name,           0);
+    rb_define_method(mg_program_class, "linked?", mg_program_linked,         0);
+    rb_define_method(mg_program_class, "log",     mg_program_log,            0);
+    rb_define_method(mg_program_class, "cached?", mg_program_cached,         0);
+    rb_define_method(mg_program_class, "delete",  mg_program_delete_objects, 0);
+}
+
+/* Helper function implementation */
+
+static mg_shader_cache * cache_from(VALUE self) {
+    mg_shader_cache * cache = 0;
+    TypedData_Get_Struct(self, mg_shader_cache, &cache_type, cache);
+
+    if (cache == 0) {
+        rb_raise(rb_eRuntimeError, "program cache was not set up");
+    }
+
+    return cache;
+}
+
+static program_t * program_from(VALUE self) {
+    program_t * program = 0;
+    TypedData_Get_Struct(self, program_t, &program_type, program);
+
+    if (program->program.name == 0) {
+        rb_raise(rb_eRuntimeError, "program was deleted");
+    }
+
+    return program;
+}
+
+static mg_program_status finish(program_t * program) {
+    return mg_shader_cache_finish(cache_from(program->cache), &program->program);
+}
+
+static void program_mark(void * p) {
+    program_t * program = p;
+    rb_gc_mark(program->cache);
+}
+
+static void program_free(void * p) {
+    program_t * program = p;
+    mg_program_discard(&program->program);
+    free(program);
+}
+
+static void cache_free(void * p) {
+    mg_shader_cache_free(p);
+}
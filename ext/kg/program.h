@@ -0,0 +1,78 @@
+#ifndef MG_PROGRAM_H
+#define MG_PROGRAM_H
+
+#include "shader_cache.h"
+
+#include <ruby.h>
+
+/**
+ * Mg::ProgramCache class.
+ */
+extern VALUE mg_program_cache_class;
+
+/**
+ * Mg::Program class.
+ */
+extern VALUE mg_program_class;
+
+/**
+ * Allocates a program cache that wasn't set up.
+ */
+extern VALUE mg_program_cache_alloc(VALUE klass);
+
+/**
+ * Sets the cache up for the GL context that's current on the calling thread,
+ * keeping binaries in the given directory, or only in memory if it's nil.
+ * Wrapped by Mg::ProgramCache#initialize.
+ */
+extern VALUE mg_program_cache_setup(VALUE self, VALUE directory);
+
+/**
+ * Starts building a program from the vertex and fragment shader sources and
+ * returns a Mg::Program without waiting for it.
+ */
+extern VALUE mg_program_cache_build(VALUE self, VALUE vertex, VALUE fragment);
+
+/**
+ * Returns a hash of the cache's counters.
+ */
+extern VALUE mg_program_cache_stats(VALUE self);
+
+/**
+ * Returns whether the program can be used without waiting for the driver.
+ */
+extern VALUE mg_program_ready(VALUE self);
+
+/**
+ * Waits for the program and returns its GL name. Raises a RuntimeError with
+ * the compiler and linker messages if it failed to build.
+ */
+extern VALUE mg_program_name(VALUE self);
+
+/**
+ * Waits for the program and returns whether it was built.
+ */
+extern VALUE mg_program_linked(VALUE self);
+
+/**
+ * Waits for the program and returns the messages of a failed build, or nil.
+ */
+extern VALUE mg_program_log(VALUE self);
+
+/**
+ * Returns whether the program was loaded from its binary.
+ */
+extern VALUE mg_program_cached(VALUE self);
+
+/**
+ * Deletes the program from the GL context that's current on the calling
+ * thread.
+ */
+extern VALUE mg_program_delete_objects(VALUE self);
+
+/**
+ * Initializes the ProgramCache and Program classes.
+ */
+extern void init_mg_program_class_under(VALUE module);
+
+#endif /* MG_PROGRAM_H */
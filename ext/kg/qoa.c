@@ -0,0 +1,155 @@
+#include "qoa.h"
+
+#include <string.h>
+
+/* Constant definitions */
+
+#define SLICE_LENGTH 20
+#define LMS_LENGTH 4
+
+/**
+ * Dequantization table: round(scalefactor * dqt[q]) for every scalefactor
+ * round(pow(s + 1, 2.75)) and dqt = { 0.75, -0.75, 2.5, -2.5, 4.5, -4.5, 7, -7 }.
+ */
+static const int dequantization_table[16][8] = {
+    {    1,    -1,    3,    -3,    5,    -5,     7,     -7 },
+    {    5,    -5,   18,   -18,   32,   -32,    49,    -49 },
+    {   16,   -16,   53,   -53,   95,   -95,   147,   -147 },
+    {   34,   -34,  113,  -113,  203,  -203,   315,   -315 },
+    {   63,   -63,  210,  -210,  378,  -378,   588,   -588 },
+    {  104,  -104,  345,  -345,  621,  -621,   966,   -966 },
+    {  158,  -158,  528,  -528,  950,  -950,  1477,  -1477 },
+    {  228,  -228,  760,  -760, 1368, -1368,  2128,  -2128 },
+    {  316,  -316, 1053, -1053, 1895, -1895,  2947,  -2947 },
+    {  422,  -422, 1405, -1405, 2529, -2529,  3934,  -3934 },
+    {  548,  -548, 1828, -1828, 3290, -3290,  5117,  -5117 },
+    {  696,  -696, 2320, -2320, 4176, -4176,  6496,  -6496 },
+    {  868,  -868, 2893, -2893, 5207, -5207,  8099,  -8099 },
+    { 1064, -1064, 3548, -3548, 6386, -6386,  9933,  -9933 },
+    { 1286, -1286, 4288, -4288, 7718, -7718, 12005, -12005 },
+    { 1536, -1536, 5120, -5120, 9216, -9216, 14336, -14336 }
+};
+
+/* Data structures */
+
+typedef struct {
+    int history[LMS_LENGTH];
+    int weights[LMS_LENGTH];
+} lms_t;
+
+/* Helper function prototypes */
+
+static inline uint64_t be64(const unsigned char * p) {
+    return (uint64_t) p[0] << 56 | (uint64_t) p[1] << 48 | (uint64_t) p[2] << 40 |
+           (uint64_t) p[3] << 32 | (uint64_t) p[4] << 24 | (uint64_t) p[5] << 16 |
+           (uint64_t) p[6] << 8  | (uint64_t) p[7];
+}
+
+static inline int clamp_s16(int v) {
+    return v < -32768 ? -32768 : v > 32767 ? 32767 : v;
+}
+
+/* QOA interface implementation */
+
+const char * mg_qoa_parse(const unsigned char * file, size_t size, mg_qoa * qoa) {
+    uint64_t header;
+
+    if (size < MG_QOA_FILE_HEADER_SIZE + 8 || memcmp(file, "qoaf", 4) != 0) {
+        return "not a QOA file";
+    }
+
+    qoa->samples = (size_t) be64(file) & 0xFFFFFFFF;
+
+    /* Streaming files (zero samples) aren't supported */
+    if (qoa->samples == 0) { return "QOA file has no samples"; }
+
+    header = be64(file + MG_QOA_FILE_HEADER_SIZE);
+    qoa->channels = (unsigned int) (header >> 56) & 0xFF;
+    qoa->rate     = (unsigned int) (header >> 32) & 0xFFFFFF;
+
+    if (qoa->channels == 0 || qoa->channels > MG_QOA_MAX_CHANNELS || qoa->rate == 0) {
+        return "invalid QOA frame header";
+    }
+
+    return 0;
+}
+
+size_t mg_qoa_decode_frame(const unsigned char * file, size_t size, size_t offset,
+                           const mg_qoa * qoa, int16_t * output, unsigned int * samples) {
+    lms_t lms[MG_QOA_MAX_CHANNELS];
+    unsigned int channels, frame_samples, frame_size, slices, c, i, s;
+    const unsigned char * p;
+    uint64_t header;
+    size_t data_size;
+
+    if (offset + 8 > size) { return 0; }
+
+    header = be64(file + offset);
+    channels      = (unsigned int) (header >> 56) & 0xFF;
+    frame_samples = (unsigned int) (header >> 16) & 0xFFFF;
+    frame_size    = (unsigned int)  header        & 0xFFFF;
+
+    slices = (frame_samples + SLICE_LENGTH - 1) / SLICE_LENGTH;
+    data_size = 8 + (size_t) LMS_LENGTH * 4 * channels + (size_t) 8 * slices * channels;
+
+    /* Every frame of the file must have the same layout */
+    if (channels != qoa->channels || frame_samples == 0 ||
+        frame_samples > MG_QOA_FRAME_SAMPLES ||
+        frame_size < data_size || offset + frame_size > size) {
+        return 0;
+    }
+
+    p = file + offset + 8;
+
+    /* Predictor state */
+    for (c = 0; c < channels; ++c) {
+        uint64_t history = be64(p), weights = be64(p + 8);
+        for (i = 0; i < LMS_LENGTH; ++i) {
+            lms[c].history[i] = (int16_t) (history >> 48);
+            lms[c].weights[i] = (int16_t) (weights >> 48);
+            history <<= 16;
+            weights <<= 16;
+        }
+        p += 16;
+    }
+
+    /* Slices of 20 samples, interleaved by channel */
+    for (s = 0; s < frame_samples; s += SLICE_LENGTH) {
+        for (c = 0; c < channels; ++c) {
+            uint64_t slice = be64(p);
+            const int * dequantize = dequantization_table[(slice >> 60) & 0x0F];
+            unsigned int end = s + SLICE_LENGTH < frame_samples ? s + SLICE_LENGTH : frame_samples;
+
+            p += 8;
+            slice <<= 4;
+
+            for (i = s; i < end; ++i) {
+                int predicted = 0, residual, reconstructed, delta, k;
+
+                for (k = 0; k < LMS_LENGTH; ++k) {
+                    predicted += lms[c].weights[k] * lms[c].history[k];
+                }
+                predicted >>= 13;
+
+                residual = dequantize[(slice >> 61) & 0x07];
+                reconstructed = clamp_s16(predicted + residual);
+                slice <<= 3;
+
+                output[i * channels + c] = (int16_t) reconstructed;
+
+                /* Update the predictor */
+                delta = residual >> 4;
+                for (k = 0; k < LMS_LENGTH; ++k) {
+                    lms[c].weights[k] += lms[c].history[k] < 0 ? -delta : delta;
+                }
+                for (k = 0; k < LMS_LENGTH - 1; ++k) {
+                    lms[c].history[k] = lms[c].history[k + 1];
+                }
+                lms[c].history[LMS_LENGTH - 1] = reconstructed;
+            }
+        }
+    }
+
+    *samples = frame_samples;
+    return frame_size;
+}
@@ -0,0 +1,48 @@
+#ifndef MG_QOA_H
+#define MG_QOA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Size of the QOA file header.
+ */
+#define MG_QOA_FILE_HEADER_SIZE 8
+
+/**
+ * Largest number of samples per channel in a QOA frame.
+ */
+#define MG_QOA_FRAME_SAMPLES 5120
+
+/**
+ * Largest number of channels in a QOA file.
+ */
+#define MG_QOA_MAX_CHANNELS 8
+
+/**
+ * Description of a QOA file, taken from its header and first frame.
+ */
+typedef struct {
+    unsigned int channels;
+    unsigned int rate;
+    size_t samples; /** Samples per channel in the whole file. */
+} mg_qoa;
+
+/**
+ * Parses the header and first frame header of a QOA file held in memory.
+ *
+ * Returns zero on success or a static error message on failure.
+ */
+extern const char * mg_qoa_parse(const unsigned char * file, size_t size, mg_qoa * qoa);
+
+/**
+ * Decodes the frame at the given offset into interleaved 16 bit samples.
+ * The output must hold MG_QOA_FRAME_SAMPLES * channels samples.
+ *
+ * Returns the size of the frame in bytes, storing the number of samples per
+ * channel it held, or zero if the frame is invalid or truncated.
+ */
+extern size_t mg_qoa_decode_frame(const unsigned char * file, size_t size, size_t offset,
+                                  const mg_qoa * qoa, int16_t * output, unsigned int * samples);
+
+#endif /* MG_QOA_H */
@@ -0,0 +1,789 @@
+#include "raster.h"
+
+#include "glyph_cache.h"
+#include "worker_pool.h"
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <pthread.h>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+/* Data structures */
+
+typedef enum {
+    COMMAND_CLEAR,
+    COMMAND_RECT,
+    COMMAND_QUAD,
+    COMMAND_CIRCLE,
+    COMMAND_BLIT,
+    COMMAND_TEXT
+} command_kind;
+
+/**
+ * Recorded drawing command.
+ */
+typedef struct {
+    command_kind kind;
+    mg_rect bounds; /** Pixels the command may touch, within its clip rectangle. */
+    unsigned char r, g, b, a;
+    union {
+        struct { double x[4], y[4]; } quad; /** Convex, in either winding. */
+        struct { double x, y, outer, inner; } circle; /** Ring, or disc if inner is 0. */
+        struct { const mg_image * image; int x, y; unsigned int alpha; } blit;
+        struct {
+            const mg_glyph_cache * cache;
+            unsigned int generation; /** Of the atlas the glyphs are in. */
+            unsigned int first, count; /** Range of the glyph pool. */
+            int x, y;
+        } text;
+    } shape;
+} command_t;
+
+/**
+ * Indexes of the commands that touch a tile, in recording order.
+ */
+typedef struct {
+    uint32_t * commands;
+    unsigned int count, capacity;
+} bin_t;
+
+struct mg_raster {
+    command_t * commands;
+    unsigned int count, capacity;
+    mg_rect clip; /** Clip rectangle of new commands. */
+    int clipped; /** Whether new commands are clipped. */
+    bin_t * bins; /** One per tile, kept between renders. */
+    unsigned int bin_count;
+    mg_glyph_quad * glyphs; /** Glyphs of the text commands. */
+    unsigned int glyph_count, glyph_capacity;
+};
+
+/**
+ * Rendering shared by the calling thread and the workers helping it. Workers
+ * may get to it after every tile is drawn, so it's freed by whoever lets go
+ * of it last.
+ */
+typedef struct {
+    mg_raster * r;
+    const mg_raster_target * target;
+    mg_pixel_layout layout;
+    unsigned int columns, tiles;
+    unsigned int next; /** Next tile to draw. Updated atomically. */
+    unsigned int drawn; /** Tiles drawn so far. */
+    unsigned int references;
+    pthread_mutex_t lock;
+    pthread_cond_t finished;
+} render_t;
+
+/* Helper function prototypes */
+
+/**
+ * Appends a command with the given bounds, clipped, and stores it in command;
+ * stores 0 instead if it would draw nothing. Returns zero if memory could not
+ * be allocated.
+ */
+static int record(mg_raster * r, command_kind kind, int x, int y, int width, int height,
+                  uint32_t color, command_t ** command);
+
+/**
+ * Sorts the commands into the bins of the tiles they touch. Returns zero if
+ * memory could not be allocated.
+ */
+static int bin(mg_raster * r, const mg_raster_target * target, unsigned int columns,
+               unsigned int rows, mg_damage * damage);
+
+/**
+ * Draws tiles until none are left, then lets go of the rendering.
+ */
+static void draw_tiles(void * data);
+
+/**
+ * Lets go of the rendering, freeing it if nobody else holds it.
+ */
+static void release(render_t * render);
+
+/**
+ * Draws the command's pixels within the area.
+ */
+static void draw(const render_t * render, const command_t * c, const mg_rect * area);
+
+/**
+ * Blends the color into the text command's pixels within the area by the
+ * glyphs' coverage.
+ */
+static void draw_text(const render_t * render, const command_t * c, const mg_rect * area);
+
+/**
+ * Returns the command's color as a pixel of the target's layout with the
+ * given alpha.
+ */
+static uint32_t pack(mg_pixel_layout layout, const command_t * c, unsigned char alpha);
+
+/**
+ * Fills count pixels with the color, blending it by alpha. Opaque is the
+ * color with its alpha channel set to 255.
+ */
+static void fill_span(uint32_t * pixels, int count, uint32_t color, uint32_t opaque,
+                      unsigned int alpha);
+
+/**
+ * Fills the pixels from first to last that are within the area.
+ */
+static void fill_clipped(uint32_t * row, int first, int last, const mg_rect * area,
+                         uint32_t color, uint32_t opaque, unsigned int alpha);
+
+/**
+ * Blends count pixels of the image over the target, scaling their alpha.
+ */
+static void blit_span(uint32_t * pixels, const unsigned char * source, int count,
+                      mg_pixel_layout layout, mg_pixel_layout source_layout, unsigned int alpha);
+
+/**
+ * Blends the source over the destination by alpha, from 0 to 255.
+ */
+static inline unsigned int blend(unsigned int source, unsigned int destination,
+                                 unsigned int alpha);
+
+/**
+ * Stores in first and last the pixels of the row centered at y whose centers
+ * are inside the convex quad. Returns zero if there are none.
+ */
+static int quad_span(const command_t * c, double y, int * first, int * last);
+
+/**
+ * Stores in first and last the pixels whose centers are within the circle of
+ * the given radius on the row centered at y. Returns zero if there are none.
+ */
+static int circle_span(const command_t * c, double radius, double y, int * first, int * last);
+
+/**
+ * Intersects the rectangles, storing the result in a. Returns zero if they
+ * don't overlap.
+ */
+static int intersect(mg_rect * a, const mg_rect * b);
+
+/* Raster interface implementation */
+
+mg_raster * mg_raster_new(void) {
+    return calloc(1, sizeof(mg_raster));
+}
+
+void mg_raster_free(mg_raster * r) {
+    unsigned int i;
+    for (i = 0; i < r->bin_count; ++i) { free(r->bins[i].commands); }
+    free(r->bins);
+    free(r->commands);
+    free(r->glyphs);
+    free(r);
+}
+
+void mg_raster_reset(mg_raster * r) {
+    r->count = 0;
+    r->glyph_count = 0;
+}
+
+unsigned int mg_raster_count(const mg_raster * r) {
+    return r->count;
+}
+
+void mg_raster_clip(mg_raster * r, int x, int y, int width, int height) {
+    r->clip.x = x;
+    r->clip.y = y;
+    r->clip.width = width > 0 ? width : 0;
+    r->clip.height = height > 0 ? height : 0;
+    r->clipped = 1;
+}
+
+void mg_raster_unclip(mg_raster * r) {
+    r->clipped = 0;
+}
+
+int mg_raster_clear(mg_raster * r, uint32_t color) {
+    command_t * c;
+    /* Clipped to the target when rendered */
+    return record(r, COMMAND_CLEAR, INT_MIN / 2, INT_MIN / 2, INT_MAX, INT_MAX, color, &c);
+}
+
+int mg_raster_fill_rect(mg_raster * r, int x, int y, int width, int height, uint32_t color) {
+    command_t * c;
+    return record(r, COMMAND_RECT, x, y, width, height, color, &c);
+}
+
+int mg_raster_stroke_rect(mg_raster * r, int x, int y, int width, int height,
+                          int thickness, uint32_t color) {
+    int inner = height - 2 * thickness;
+
+    if (thickness <= 0) { return 1; }
+
+    /* Too thick to leave a hole */
+    if (2 * thickness >= width || inner <= 0) {
+        return mg_raster_fill_rect(r, x, y, width, height, color);
+    }
+
+    return mg_raster_fill_rect(r, x, y, width, thickness, color) &&
+           mg_raster_fill_rect(r, x, y + height - thickness, width, thickness, color) &&
+           mg_raster_fill_rect(r, x, y + thickness, thickness, inner, color) &&
+           mg_raster_fill_rect(r, x + width - thickness, y + thickness, thickness, inner, color);
+}
+
+int mg_raster_line(mg_raster * r, double x0, double y0, double x1, double y1,
+                   double thickness, uint32_t color) {
+    double x[4], y[4], dx, dy, length, nx, ny, left, top, right, bottom;
+    command_t * c;
+    int i;
+
+    if (thickness <= 0) { return 1; }
+
+    /* A point is drawn as a square */
+    if (x0 == x1 && y0 == y1) {
+        x0 -= thickness / 2;
+        x1 += thickness / 2;
+    }
+
+    dx = x1 - x0;
+    dy = y1 - y0;
+    length = sqrt(dx * dx + dy * dy);
+
+    /* Offsets of the edges from the center line */
+    nx = -dy / length * thickness / 2;
+    ny = dx / length * thickness / 2;
+
+    x[0] = x0 + nx; y[0] = y0 + ny;
+    x[1] = x1 + nx; y[1] = y1 + ny;
+    x[2] = x1 - nx; y[2] = y1 - ny;
+    x[3] = x0 - nx; y[3] = y0 - ny;
+
+    left = right = x[0];
+    top = bottom = y[0];
+    for (i = 1; i < 4; ++i) {
+        left = fmin(left, x[i]);
+        right = fmax(right, x[i]);
+        top = fmin(top, y[i]);
+        bottom = fmax(bottom, y[i]);
+    }
+
+    if (!record(r, COMMAND_QUAD, (int) floor(left), (int) floor(top),
+                (int) ceil(right) - (int) floor(left), (int) ceil(bottom) - (int) floor(top),
+                color, &c)) {
+        return 0;
+    }
+
+    if (c) {
+        memcpy(c->shape.quad.x, x, sizeof(x));
+        memcpy(c->shape.quad.y, y, sizeof(y));
+    }
+
+    return 1;
+}
+
+int mg_raster_fill_circle(mg_raster * r, double x, double y, double radius, uint32_t color) {
+    /* A ring as thick as its radius has no hole */
+    return mg_raster_stroke_circle(r, x, y, radius / 2, radius, color);
+}
+
+int mg_raster_stroke_circle(mg_raster * r, double x, double y, double radius,
+                            double thickness, uint32_t color) {
+    double outer = radius + thickness / 2, inner = radius - thickness / 2;
+    int left = (int) floor(x - outer), top = (int) floor(y - outer);
+    command_t * c;
+
+    if (thickness <= 0 || outer <= 0) { return 1; }
+
+    if (!record(r, COMMAND_CIRCLE, left, top,
+                (int) ceil(x + outer) - left, (int) ceil(y + outer) - top, color, &c)) {
+        return 0;
+    }
+
+    if (c) {
+        c->shape.circle.x = x;
+        c->shape.circle.y = y;
+        c->shape.circle.outer = outer;
+        c->shape.circle.inner = inner > 0 ? inner : 0;
+    }
+
+    return 1;
+}
+
+int mg_raster_blit(mg_raster * r, const mg_image * image, int x, int y, unsigned int alpha) {
+    command_t * c;
+
+    if (alpha == 0) { return 1; }
+
+    if (!record(r, COMMAND_BLIT, x, y, image->width, image->height, 0xFFFFFFFF, &c)) {
+        return 0;
+    }
+
+    if (c) {
+        c->shape.blit.image = image;
+        c->shape.blit.x = x;
+        c->shape.blit.y = y;
+        c->shape.blit.alpha = alpha > 255 ? 255 : alpha;
+    }
+
+    return 1;
+}
+
+int mg_raster_text(mg_raster * r, const mg_glyph_cache * cache, const mg_text_layout * layout,
+                   int x, int y, uint32_t color) {
+    command_t * c;
+
+    if (layout->count == 0) { return 1; }
+
+    if (r->glyph_count + layout->count > r->glyph_capacity) {
+        unsigned int capacity = r->glyph_capacity ? r->glyph_capacity : 256;
+        mg_glyph_quad * glyphs;
+        while (capacity < r->glyph_count + layout->count) { capacity *= 2; }
+        glyphs = realloc(r->glyphs, capacity * sizeof(mg_glyph_quad));
+        if (glyphs == 0) { return 0; }
+        r->glyphs = glyphs;
+        r->glyph_capacity = capacity;
+    }
+
+    if (!record(r, COMMAND_TEXT, x, y, layout->width, layout->height, color, &c)) { return 0; }
+
+    /* Copied, since the layout only lasts until the cache's next call */
+    if (c) {
+        c->shape.text.cache = cache;
+        c->shape.text.generation = mg_glyph_cache_generation(cache);
+        c->shape.text.first = r->glyph_count;
+        c->shape.text.count = layout->count;
+        c->shape.text.x = x;
+        c->shape.text.y = y;
+        memcpy(r->glyphs + r->glyph_count, layout->quads, layout->count * sizeof(mg_glyph_quad));
+        r->glyph_count += layout->count;
+    }
+
+    return 1;
+}
+
+void mg_raster_render(mg_raster * r, const mg_raster_target * target, mg_damage * damage) {
+    unsigned int columns = (target->width + MG_RASTER_TILE_SIZE - 1) / MG_RASTER_TILE_SIZE;
+    unsigned int rows = (target->height + MG_RASTER_TILE_SIZE - 1) / MG_RASTER_TILE_SIZE;
+    unsigned int helpers, i;
+    render_t * render;
+
+    if (r->count == 0 || columns == 0 || rows == 0) {
+        mg_raster_reset(r);
+        return;
+    }
+
+    render = calloc(1, sizeof(render_t));
+    if (render == 0 || !bin(r, target, columns, rows, damage)) {
+        free(render);
+        mg_raster_reset(r);
+        return;
+    }
+
+    render->r = r;
+    render->target = target;
+    render->layout = mg_pixel_format_layout(target->format);
+    render->columns = columns;
+    render->tiles = columns * rows;
+    pthread_mutex_init(&render->lock, 0);
+    pthread_cond_init(&render->finished, 0);
+
+    /* The calling thread draws too, so a busy pool only slows it down */
+    helpers = mg_worker_pool_size();
+    if (helpers > render->tiles - 1) { helpers = render->tiles - 1; }
+
+    /* Each helper holds it, and the calling thread holds it to draw and to wait */
+    render->references = helpers + 2;
+
+    for (i = 0; i < helpers; ++i) {
+        if (!mg_worker_pool_submit(draw_tiles, render)) {
+            pthread_mutex_lock(&render->lock);
+            render->references -= helpers - i;
+            pthread_mutex_unlock(&render->lock);
+            break;
+        }
+    }
+
+    draw_tiles(render);
+
+    /* Workers may still be drawing the last tiles */
+    pthread_mutex_lock(&render->lock);
+    while (render->drawn < render->tiles) {
+        pthread_cond_wait(&render->finished, &render->lock);
+    }
+    pthread_mutex_unlock(&render->lock);
+
+    release(render);
+    mg_raster_reset(r);
+}
+
+/* Helper function implementation */
+
+static int record(mg_raster * r, command_kind kind, int x, int y, int width, int height,
+                  uint32_t color, command_t ** command) {
+    mg_rect bounds = { x, y, width, height };
+    command_t * c;
+
+    *command = 0;
+
+    /* Nothing shows through a transparent color */
+    if ((color & 0xFF) == 0 && kind != COMMAND_CLEAR) { return 1; }
+
+    if (width <= 0 || height <= 0) { return 1; }
+    if (r->clipped && !intersect(&bounds, &r->clip)) { return 1; }
+
+    if (r->count == r->capacity) {
+        unsigned int capacity = r->capacity ? r->capacity * 2 : 256;
+        command_t * commands = realloc(r->commands, capacity * sizeof(command_t));
+        if (commands == 0) { return 0; }
+        r->commands = commands;
+        r->capacity = capacity;
+    }
+
+    c = &r->commands[r->count++];
+    c->kind = kind;
+    c->bounds = bounds;
+    c->r = color >> 24;
+    c->g = color >> 16;
+    c->b = color >> 8;
+    c->a = color;
+
+    *command = c;
+    return 1;
+}
+
+static int bin(mg_raster * r, const mg_raster_target * target, unsigned int columns,
+               unsigned int rows, mg_damage * damage) {
+    mg_rect whole = { 0, 0, (int) target->width, (int) target->height };
+    unsigned int tiles = columns * rows, i;
+
+    if (r->bin_count < tiles) {
+        bin_t * bins = realloc(r->bins, tiles * sizeof(bin_t));
+        if (bins == 0) { return 0; }
+        memset(bins + r->bin_count, 0, (tiles - r->bin_count) * sizeof(bin_t));
+        r->bins = bins;
+        r->bin_count = tiles;
+    }
+
+    for (i = 0; i < tiles; ++i) { r->bins[i].count = 0; }
+
+    for (i = 0; i < r->count; ++i) {
+        const command_t * c = &r->commands[i];
+        mg_rect bounds = c->bounds;
+        int opaque = c->kind == COMMAND_CLEAR || (c->kind == COMMAND_RECT && c->a == 255);
+        unsigned int column, row, first_column, last_column, first_row, last_row;
+
+        if (!intersect(&bounds, &whole)) { continue; }
+        if (damage) { mg_damage_add(damage, bounds.x, bounds.y, bounds.width, bounds.height); }
+
+        first_column = bounds.x / MG_RASTER_TILE_SIZE;
+        last_column = (bounds.x + bounds.width - 1) / MG_RASTER_TILE_SIZE;
+        first_row = bounds.y / MG_RASTER_TILE_SIZE;
+        last_row = (bounds.y + bounds.height - 1) / MG_RASTER_TILE_SIZE;
+
+        for (row = first_row; row <= last_row; ++row) {
+            for (column = first_column; column <= last_column; ++column) {
+                bin_t * b = &r->bins[row * columns + column];
+                mg_rect tile = { column * MG_RASTER_TILE_SIZE, row * MG_RASTER_TILE_SIZE,
+                                 MG_RASTER_TILE_SIZE, MG_RASTER_TILE_SIZE };
+
+                /* An opaque command hides everything under it in the tile */
+                intersect(&tile, &whole);
+                if (opaque && bounds.x <= tile.x && bounds.y <= tile.y &&
+                    bounds.x + bounds.width >= tile.x + tile.width &&
+                    bounds.y + bounds.height >= tile.y + tile.height) {
+                    b->count = 0;
+                }
+
+                if (b->count == b->capacity) {
+                    unsigned int capacity = b->capacity ? b->capacity * 2 : 16;
+                    uint32_t * commands = realloc(b->commands, capacity * sizeof(uint32_t));
+                    if (commands == 0) { return 0; }
+                    b->commands = commands;
+                    b->capacity = capacity;
+                }
+
+                b->commands[b->count++] = i;
+            }
+        }
+    }
+
+    return 1;
+}
+
+static void draw_tiles(void * data) {
+    render_t * render = data;
+    mg_raster * r = render->r;
+    unsigned int tile, drawn = 0, i;
+
+    while ((tile = __atomic_fetch_add(&render->next, 1, __ATOMIC_RELAXED)) < render->tiles) {
+        const bin_t * b = &r->bins[tile];
+        mg_rect whole = { 0, 0, (int) render->target->width, (int) render->target->height };
+        mg_rect area = { (tile % render->columns) * MG_RASTER_TILE_SIZE,
+                         (tile / render->columns) * MG_RASTER_TILE_SIZE,
+                         MG_RASTER_TILE_SIZE, MG_RASTER_TILE_SIZE };
+
+        intersect(&area, &whole);
+
+        for (i = 0; i < b->count; ++i) {
+            const command_t * c = &r->commands[b->commands[i]];
+            mg_rect clipped = area;
+            if (intersect(&clipped, &c->bounds)) { draw(render, c, &clipped); }
+        }
+
+        ++drawn;
+    }
+
+    if (drawn) {
+        pthread_mutex_lock(&render->lock);
+        render->drawn += drawn;
+        if (render->drawn == render->tiles) { pthread_cond_signal(&render->finished); }
+        pthread_mutex_unlock(&render->lock);
+    }
+
+    release(render);
+}
+
+static void release(render_t * render) {
+    unsigned int references;
+
+    pthread_mutex_lock(&render->lock);
+    references = --render->references;
+    pthread_mutex_unlock(&render->lock);
+
+    if (references == 0) {
+        pthread_cond_destroy(&render->finished);
+        pthread_mutex_destroy(&render->lock);
+        free(render);
+    }
+}
+
+static void draw(const render_t * render, const command_t * c, const mg_rect * area) {
+    const mg_raster_target * target = render->target;
+    uint32_t color = pack(render->layout, c, c->a), opaque = pack(render->layout, c, 255);
+    int y, first, last;
+
+    /* Glyph by glyph rather than row by row */
+    if (c->kind == COMMAND_TEXT) {
+        draw_text(render, c, area);
+        return;
+    }
+
+    for (y = area->y; y < area->y + area->height; ++y) {
+        uint32_t * row = (uint32_t *) (target->pixels + (size_t) y * target->stride);
+        double center = y + 0.5;
+
+        switch (c->kind) {
+        case COMMAND_CLEAR:
+            fill_span(row + area->x, area->width, color, color, 255);
+            break;
+        case COMMAND_RECT:
+            fill_span(row + area->x, area->width, color, opaque, c->a);
+            break;
+        case COMMAND_QUAD:
+            if (quad_span(c, center, &first, &last)) {
+                fill_clipped(row, first, last, area, color, opaque, c->a);
+            }
+            break;
+        case COMMAND_CIRCLE: {
+            int hole_first, hole_last;
+
+            if (!circle_span(c, c->shape.circle.outer, center, &first, &last)) { break; }
+
+            /* A ring's row is two spans, left and right of the hole */
+            if (c->shape.circle.inner > 0 &&
+                circle_span(c, c->shape.circle.inner, center, &hole_first, &hole_last)) {
+                fill_clipped(row, first, hole_first - 1, area, color, opaque, c->a);
+                fill_clipped(row, hole_last + 1, last, area, color, opaque, c->a);
+            } else {
+                fill_clipped(row, first, last, area, color, opaque, c->a);
+            }
+            break;
+        }
+        case COMMAND_TEXT:
+            break;
+        case COMMAND_BLIT: {
+            const mg_image * image = c->shape.blit.image;
+            const unsigned char * source = image->pixels +
+                ((size_t) (y - c->shape.blit.y) * image->width + (area->x - c->shape.blit.x)) * 4;
+            blit_span(row + area->x, source, area->width, render->layout,
+                      mg_pixel_format_layout(image->format), c->shape.blit.alpha);
+            break;
+        }
+        }
+    }
+}
+
+static void draw_text(const render_t * render, const command_t * c, const mg_rect * area) {
+    const mg_raster_target * target = render->target;
+    const mg_glyph_quad * glyph = render->r->glyphs + c->shape.text.first;
+    const mg_glyph_quad * end = glyph + c->shape.text.count;
+    mg_pixel_layout layout = render->layout;
+    const unsigned char * atlas;
+    unsigned int atlas_height;
+    int x, y;
+
+    /* The atlas was emptied since; its glyphs are elsewhere now */
+    if (mg_glyph_cache_generation(c->shape.text.cache) != c->shape.text.generation) { return; }
+
+    atlas = mg_glyph_cache_atlas(c->shape.text.cache, &atlas_height);
+
+    for (; glyph < end; ++glyph) {
+        mg_rect box = { c->shape.text.x + glyph->x, c->shape.text.y + glyph->y,
+                        glyph->width, glyph->height };
+
+        if (!intersect(&box, area)) { continue; }
+
+        for (y = box.y; y < box.y + box.height; ++y) {
+            unsigned char * p = target->pixels + (size_t) y * target->stride + (size_t) box.x * 4;
+            const unsigned char * coverage = atlas +
+                (size_t) (glyph->v + y - c->shape.text.y - glyph->y) * MG_GLYPH_ATLAS_WIDTH +
+                glyph->u + box.x - c->shape.text.x - glyph->x;
+
+            for (x = 0; x < box.width; ++x, p += 4) {
+                unsigned int a = (coverage[x] * c->a + 127) / 255;
+
+                if (a == 255) {
+                    mg_pixel_store(p, layout, c->r, c->g, c->b, 255);
+                } else if (a) {
+                    p[layout.r] = blend(c->r, p[layout.r], a);
+                    p[layout.g] = blend(c->g, p[layout.g], a);
+                    p[layout.b] = blend(c->b, p[layout.b], a);
+                    p[layout.a] = blend(255, p[layout.a], a);
+                }
+            }
+        }
+    }
+}
+
+static uint32_t pack(mg_pixel_layout layout, const command_t * c, unsigned char alpha) {
+    uint32_t pixel;
+    mg_pixel_store((unsigned char *) &pixel, layout, c->r, c->g, c->b, alpha);
+    return pixel;
+}
+
+static void fill_span(uint32_t * pixels, int count, uint32_t color, uint32_t opaque,
+                      unsigned int alpha) {
+    const unsigned char * source = (const unsigned char *) &opaque;
+    int i = 0;
+
+    if (alpha == 255) {
+        for (i = 0; i < count; ++i) { pixels[i] = color; }
+        return;
+    }
+
+#if defined(__SSE2__)
+    {
+        /* Four pixels at a time, 16 bits per channel: (s * a + d * (255 - a)) / 255 */
+        __m128i zero = _mm_setzero_si128();
+        __m128i s = _mm_unpacklo_epi8(_mm_set1_epi32((int) opaque), zero);
+        __m128i sa = _mm_add_epi16(_mm_mullo_epi16(s, _mm_set1_epi16(alpha)), _mm_set1_epi16(128));
+        __m128i ia = _mm_set1_epi16(255 - alpha);
+
+        for (; i + 4 <= count; i += 4) {
+            __m128i d = _mm_loadu_si128((__m128i *) (pixels + i));
+            __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia), sa);
+            __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia), sa);
+            lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+            hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+            _mm_storeu_si128((__m128i *) (pixels + i), _mm_packus_epi16(lo, hi));
+        }
+    }
+#endif
+
+    for (; i < count; ++i) {
+        unsigned char * p = (unsigned char *) (pixels + i);
+        p[0] = blend(source[0], p[0], alpha);
+        p[1] = blend(source[1], p[1], alpha);
+        p[2] = blend(source[2], p[2], alpha);
+        p[3] = blend(source[3], p[3], alpha);
+    }
+}
+
+static void fill_clipped(uint32_t * row, int first, int last, const mg_rect * area,
+                         uint32_t color, uint32_t opaque, unsigned int alpha) {
+    if (first < area->x) { first = area->x; }
+    if (last >= area->x + area->width) { last = area->x + area->width - 1; }
+    if (first <= last) { fill_span(row + first, last - first + 1, color, opaque, alpha); }
+}
+
+static void blit_span(uint32_t * pixels, const unsigned char * source, int count,
+                      mg_pixel_layout layout, mg_pixel_layout source_layout, unsigned int alpha) {
+    int i;
+
+    for (i = 0; i < count; ++i, source += 4) {
+        unsigned char * p = (unsigned char *) (pixels + i);
+        unsigned int a = (source[source_layout.a] * alpha + 127) / 255;
+
+        if (a == 255) {
+            mg_pixel_store(p, layout, source[source_layout.r], source[source_layout.g],
+                           source[source_layout.b], 255);
+        } else if (a) {
+            p[layout.r] = blend(source[source_layout.r], p[layout.r], a);
+            p[layout.g] = blend(source[source_layout.g], p[layout.g], a);
+            p[layout.b] = blend(source[source_layout.b], p[layout.b], a);
+            p[layout.a] = blend(255, p[layout.a], a);
+        }
+    }
+}
+
+static inline unsigned int blend(unsigned int source, unsigned int destination,
+                                 unsigned int alpha) {
+    unsigned int t = source * alpha + destination * (255 - alpha) + 128;
+    return (t + (t >> 8)) >> 8;
+}
+
+static int quad_span(const command_t * c, double y, int * first, int * last) {
+    double left = INFINITY, right = -INFINITY;
+    int i;
+
+    for (i = 0; i < 4; ++i) {
+        double x0 = c->shape.quad.x[i], y0 = c->shape.quad.y[i];
+        double x1 = c->shape.quad.x[(i + 1) % 4], y1 = c->shape.quad.y[(i + 1) % 4];
+        double x;
+
+        /* Edges are half open so that shared vertices count once */
+        if ((y < y0) == (y < y1)) { continue; }
+
+        x = x0 + (y - y0) * (x1 - x0) / (y1 - y0);
+        if (x < left) { left = x; }
+        if (x > right) { right = x; }
+    }
+
+    if (left >= right) { return 0; }
+
+    *first = (int) ceil(left - 0.5);
+    *last = (int) ceil(right - 0.5) - 1;
+    return *first <= *last;
+}
+
+static int circle_span(const command_t * c, double radius, double y, int * first, int * last) {
+    double dy = y - c->shape.circle.y, dx;
+
+    if (dy * dy >= radius * radius) { return 0; }
+
+    dx = sqrt(radius * radius - dy * dy);
+    *first = (int) ceil(c->shape.circle.x - dx - 0.5);
+    *last = (int) ceil(c->shape.circle.x + dx - 0.5) - 1;
+    return *first <= *last;
+}
+
+static int intersect(mg_rect * a, const mg_rect * b) {
+    long left = a->x > b->x ? a->x : b->x;
+    long top = a->y > b->y ? a->y : b->y;
+    long right = (long) a->x + a->width < (long) b->x + b->width ?
+                 (long) a->x + a->width : (long) b->x + b->width;
+    long bottom = (long) a->y + a->height < (long) b->y + b->height ?
+                  (long) a->y + a->height : (long) b->y + b->height;
+
+    if (right <= left || bottom <= top) {
+        a->width = a->height = 0;
+        return 0;
+    }
+
+    a->x = left;
+    a->y = top;
+    a->width = right - left;
+    a->height = bottom - top;
+    return 1;
+}
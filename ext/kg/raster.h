@@ -0,0 +1,139 @@
+#ifndef MG_RASTER_H
+#define MG_RASTER_H
+
+#include "damage.h"
+#include "glyph_cache.h"
+#include "image_decoder.h"
+#include "pixel_format.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Width and height of the tiles commands are sorted into.
+ */
+#define MG_RASTER_TILE_SIZE 64
+
+/**
+ * Pixels drawn into. They're 32 bits wide; rows are stride bytes apart.
+ */
+typedef struct {
+    unsigned char * pixels;
+    unsigned int width, height;
+    size_t stride;
+    mg_pixel_format format;
+} mg_raster_target;
+
+/**
+ * List of 2D drawing commands rendered by the CPU. Commands are recorded
+ * first; rendering sorts them into tiles of the target and draws the tiles in
+ * parallel on the worker pool, each tile's commands in the order they were
+ * recorded. Commands that an opaque one covers whole tiles of aren't drawn in
+ * those tiles at all.
+ *
+ * Colors are 0xRRGGBBAA. Translucent colors are blended over the target; the
+ * alpha of the result is that of the color over the target's. Coordinates
+ * are in pixels with the origin at the top left corner of the target, and
+ * pixels are drawn if their centers are inside the shape.
+ *
+ * None of the functions require the Ruby GVL.
+ */
+typedef struct mg_raster mg_raster;
+
+/**
+ * Returns a new empty command list, or zero if memory could not be allocated.
+ */
+extern mg_raster * mg_raster_new(void);
+
+/**
+ * Frees the command list.
+ */
+extern void mg_raster_free(mg_raster * r);
+
+/**
+ * Discards the recorded commands. The clip rectangle is kept.
+ */
+extern void mg_raster_reset(mg_raster * r);
+
+/**
+ * Returns the number of recorded commands.
+ */
+extern unsigned int mg_raster_count(const mg_raster * r);
+
+/**
+ * Restricts the commands recorded from now on to the rectangle.
+ */
+extern void mg_raster_clip(mg_raster * r, int x, int y, int width, int height);
+
+/**
+ * Lets the commands recorded from now on draw anywhere.
+ */
+extern void mg_raster_unclip(mg_raster * r);
+
+/*
+ * The functions below record a command. They return zero if memory could not
+ * be allocated, a non-zero value otherwise.
+ */
+
+/**
+ * Replaces everything in the clip rectangle, or the whole target, with the
+ * color. Unlike the other commands, nothing is blended.
+ */
+extern int mg_raster_clear(mg_raster * r, uint32_t color);
+
+/**
+ * Fills the rectangle.
+ */
+extern int mg_raster_fill_rect(mg_raster * r, int x, int y, int width, int height,
+                               uint32_t color);
+
+/**
+ * Draws the outline of the rectangle, thickness pixels wide, inside it.
+ */
+extern int mg_raster_stroke_rect(mg_raster * r, int x, int y, int width, int height,
+                                 int thickness, uint32_t color);
+
+/**
+ * Draws a line thickness pixels wide, with square ends at the points.
+ */
+extern int mg_raster_line(mg_raster * r, double x0, double y0, double x1, double y1,
+                          double thickness, uint32_t color);
+
+/**
+ * Fills the circle.
+ */
+extern int mg_raster_fill_circle(mg_raster * r, double x, double y, double radius,
+                                 uint32_t color);
+
+/**
+ * Draws the outline of the circle, thickness pixels wide, centered on it.
+ */
+extern int mg_raster_stroke_circle(mg_raster * r, double x, double y, double radius,
+                                   double thickness, uint32_t color);
+
+/**
+ * Draws the image with its top left corner at x, y, blending it by its own
+ * alpha scaled by the given alpha, from 0 to 255. The image must not be
+ * freed or changed until the commands are rendered or reset, and must not be
+ * the target.
+ */
+extern int mg_raster_blit(mg_raster * r, const mg_image * image, int x, int y,
+                          unsigned int alpha);
+
+/**
+ * Draws the laid out text with its top left corner at x, y, blending the
+ * color by the glyphs' coverage. The glyphs are copied, but the atlas is read
+ * when rendering, so the cache must not be freed until then. Text whose
+ * glyphs were evicted from the atlas by the time it's rendered is skipped.
+ */
+extern int mg_raster_text(mg_raster * r, const mg_glyph_cache * cache, const mg_text_layout * layout,
+                          int x, int y, uint32_t color);
+
+/**
+ * Draws the recorded commands into the target and discards them. Returns
+ * once every tile is drawn. If damage isn't 0, the parts of the target that
+ * were drawn are added to it.
+ */
+extern void mg_raster_render(mg_raster * r, const mg_raster_target * target, mg_damage * damage);
+
+#endif /* MG_RASTER_H */
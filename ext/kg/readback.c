@@ -0,0 +1,233 @@
+#include "readback.h"
+#include "pixel_store.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/* Data structures */
+
+/**
+ * One buffer of the ring.
+ */
+typedef struct {
+    GLuint buffer; /** Pixel buffer object. */
+    GLsync fence; /** Signaled once the read into the buffer completes. */
+} slot_t;
+
+struct mg_readback {
+    unsigned int width, height;
+    mg_pixel_format format;
+    size_t size; /** Bytes per image. */
+    unsigned int count; /** Number of slots. */
+    unsigned int first; /** Slot holding the oldest pending read. */
+    unsigned int pending; /** Reads started but not finished. */
+    slot_t * slots;
+};
+
+/* Helper function prototypes */
+
+/**
+ * Describes the pixel format to GL; packed types assume a little endian host.
+ */
+static void gl_format(mg_pixel_format format, GLenum * gl_format, GLenum * type);
+
+/**
+ * Allocates an image and copies the pixels into it, flipping the rows so that
+ * the top row comes first.
+ */
+static mg_image * copy_flipped(const unsigned char * pixels,
+                               unsigned int width, unsigned int height,
+                               mg_pixel_format format);
+
+/* Readback interface implementation */
+
+mg_readback * mg_readback_new(unsigned int width, unsigned int height,
+                              unsigned int count, mg_pixel_format format,
+                              const char ** error) {
+    mg_readback * readback = calloc(1, sizeof(mg_readback));
+    GLint previous = 0;
+    unsigned int i;
+
+    if (readback == 0 || (readback->slots = calloc(count, sizeof(slot_t))) == 0) {
+        free(readback);
+        *error = "unable to allocate memory for readback";
+        return 0;
+    }
+
+    readback->width = width;
+    readback->height = height;
+    readback->format = format;
+    readback->size = (size_t) width * height * 4;
+    readback->count = count;
+
+    /* Only report errors caused by creating the buffers */
+    while (glGetError() != GL_NO_ERROR);
+
+    /* Reserve storage the driver can read back into */
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previous);
+    for (i = 0; i < count; ++i) {
+        glGenBuffers(1, &readback->slots[i].buffer);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback->slots[i].buffer);
+        glBufferData(GL_PIXEL_PACK_BUFFER, readback->size, 0, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, previous);
+
+    if (glGetError() != GL_NO_ERROR) {
+        mg_readback_free(readback);
+        *error = "could not create pixel buffers; is a GL context current?";
+        return 0;
+    }
+
+    return readback;
+}
+
+int mg_readback_start(mg_readback * readback) {
+    mg_pixel_store_state store;
+    slot_t * slot;
+    GLenum format, type;
+
+    if (readback->pending == readback->count) { return 0; }
+
+    slot = &readback->slots[(readback->first + readback->pending) % readback->count];
+    gl_format(readback->format, &format, &type);
+
+    /* The read goes into the buffer; glReadPixels returns right away */
+    mg_pixel_store_push(&store);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    glReadPixels(0, 0, readback->width, readback->height, format, type, 0);
+    mg_pixel_store_pop(&store);
+
+    slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    /* Make sure the read is submitted, so that the fence can signal */
+    glFlush();
+
+    ++readback->pending;
+    return 1;
+}
+
+int mg_readback_ready(mg_readback * readback) {
+    GLint status = GL_UNSIGNALED;
+
+    if (readback->pending == 0) { return 0; }
+
+    glGetSynciv(readback->slots[readback->first].fence, GL_SYNC_STATUS, 1, 0, &status);
+    return status == GL_SIGNALED;
+}
+
+mg_image * mg_readback_finish(mg_readback * readback) {
+    slot_t * slot;
+    const unsigned char * pixels;
+    mg_image * image = 0;
+    GLint previous = 0;
+
+    if (readback->pending == 0) { return 0; }
+
+    slot = &readback->slots[readback->first];
+
+    /* By now the read has usually completed */
+    while (glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000ULL) == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(slot->fence);
+    slot->fence = 0;
+
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previous);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, slot->buffer);
+    pixels = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, readback->size, GL_MAP_READ_BIT);
+    if (pixels) {
+        image = copy_flipped(pixels, readback->width, readback->height, readback->format);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, previous);
+
+    readback->first = (readback->first + 1) % readback->count;
+    --readback->pending;
+    return image;
+}
+
+unsigned int mg_readback_pending(mg_readback * readback) {
+    return readback->pending;
+}
+
+unsigned int mg_readback_count(mg_readback * readback) {
+    return readback->count;
+}
+
+void mg_readback_free(mg_readback * readback) {
+    unsigned int i;
+
+    for (i = 0; i < readback->count; ++i) {
+        if (readback->slots[i].fence) { glDeleteSync(readback->slots[i].fence); }
+        if (readback->slots[i].buffer) { glDeleteBuffers(1, &readback->slots[i].buffer); }
+    }
+
+    mg_readback_discard(readback);
+}
+
+void mg_readback_discard(mg_readback * readback) {
+    free(readback->slots);
+    free(readback);
+}
+
+mg_image * mg_readback_read(unsigned int width, unsigned int height,
+                            mg_pixel_format format) {
+    unsigned char * pixels = malloc((size_t) width * height * 4);
+    mg_image * image = 0;
+    mg_pixel_store_state store;
+    GLenum gl_pixel_format, type;
+
+    if (pixels == 0) { return 0; }
+
+    gl_format(format, &gl_pixel_format, &type);
+    mg_pixel_store_push(&store);
+    glReadPixels(0, 0, width, height, gl_pixel_format, type, pixels);
+    mg_pixel_store_pop(&store);
+
+    image = copy_flipped(pixels, width, height, format);
+    free(pixels);
+    return image;
+}
+
+/* Helper function implementation */
+
+static void gl_format(mg_pixel_format format, GLenum * gl_format, GLenum * type) {
+    switch (format) {
+        default:
+        case MG_PIXEL_FORMAT_RGBA: *gl_format = GL_RGBA; *type = GL_UNSIGNED_BYTE;        break;
+        case MG_PIXEL_FORMAT_BGRA: *gl_format = GL_BGRA; *type = GL_UNSIGNED_BYTE;        break;
+        case MG_PIXEL_FORMAT_ARGB: *gl_format = GL_BGRA; *type = GL_UNSIGNED_INT_8_8_8_8; break;
+        case MG_PIXEL_FORMAT_ABGR: *gl_format = GL_RGBA; *type = GL_UNSIGNED_INT_8_8_8_8; break;
+    }
+}
+
+static mg_image * copy_flipped(const unsigned char * pixels,
+                               unsigned int width, unsigned int height,
+                               mg_pixel_format format) {
+    mg_image * image = malloc(sizeof(mg_image));
+    size_t stride = (size_t) width * 4;
+    unsigned int y;
+
+    if (image == 0) { return 0; }
+
+    image->pixels = malloc(stride * height);
+
+    if (image->pixels == 0) {
+        free(image);
+        return 0;
+    }
+
+    image->width = width;
+    image->height = height;
+    image->format = format;
+
+    /* GL reads bottom row first */
+    for (y = 0; y < height; ++y) {
+        memcpy(image->pixels + stride * y, pixels + stride * (height - 1 - y), stride);
+    }
+
+    return image;
+}
@@ -0,0 +1,80 @@
+#ifndef MG_READBACK_H
+#define MG_READBACK_H
+
+#include "image_decoder.h"
+#include "pixel_format.h"
+
+/**
+ * Ring of pixel buffer objects that read the framebuffer back without
+ * stalling the pipeline. Each read is copied into a buffer object and fenced;
+ * it is only mapped once the fence has signaled, several frames later.
+ *
+ * Except where noted, functions must be called with the OpenGL context that
+ * created the ring current.
+ */
+typedef struct mg_readback mg_readback;
+
+/**
+ * Creates a ring of count buffers, each large enough for a width by height
+ * image of the given format.
+ *
+ * Returns zero and sets the error message on failure.
+ */
+extern mg_readback * mg_readback_new(unsigned int width, unsigned int height,
+                                     unsigned int count, mg_pixel_format format,
+                                     const char ** error);
+
+/**
+ * Starts reading the current read framebuffer into the next free buffer.
+ *
+ * Returns zero if every buffer holds a read that hasn't been finished.
+ */
+extern int mg_readback_start(mg_readback * readback);
+
+/**
+ * Returns a non-zero value if the oldest read has completed, so that
+ * finishing it won't wait. Returns zero if it hasn't or no read is pending.
+ */
+extern int mg_readback_ready(mg_readback * readback);
+
+/**
+ * Waits for the oldest read to complete and copies it into a new image, top
+ * row first. The wait and the copy don't require the Ruby GVL.
+ *
+ * Returns zero if no read is pending or memory could not be allocated.
+ */
+extern mg_image * mg_readback_finish(mg_readback * readback);
+
+/**
+ * Returns the number of reads started but not finished.
+ */
+extern unsigned int mg_readback_pending(mg_readback * readback);
+
+/**
+ * Returns the number of buffers in the ring.
+ */
+extern unsigned int mg_readback_count(mg_readback * readback);
+
+/**
+ * Deletes the buffers and fences and frees the ring. Pending reads are
+ * discarded.
+ */
+extern void mg_readback_free(mg_readback * readback);
+
+/**
+ * Frees the ring without deleting its buffers and fences, for when they are
+ * about to be destroyed along with their context. Doesn't require the context
+ * to be current.
+ */
+extern void mg_readback_discard(mg_readback * readback);
+
+/**
+ * Reads the current read framebuffer into a new image right away, waiting for
+ * rendering to finish.
+ *
+ * Returns zero if memory could not be allocated.
+ */
+extern mg_image * mg_readback_read(unsigned int width, unsigned int height,
+                                   mg_pixel_format format);
+
+#endif /* MG_READBACK_H */
@@ -0,0 +1,149 @@
+#include "screen_capture.h"
+
+#if defined(MG_PLATFORM_LINUX) && defined(MG_PLATFORM_LINUX_X11)
+    #include "X11_native_screen_capture.h"
+#endif
+
+#include <ruby.h>
+
+#if defined(HAVE_RUBY_IO_BUFFER_H)
+    #include <ruby/io/buffer.h>
+#endif
+
+VALUE mg_screen_capture_class;
+
+/* Constant definitions */
+
+static const char * buffers_ivar = "@buffers";
+
+/* Helper function prototypes */
+
+/**
+ * Frees the IO::Buffer objects over the shared memory, so they can't be used
+ * once it's gone.
+ */
+static void release_buffers(VALUE self);
+
+/* Screen capture interface implementation */
+
+VALUE mg_screen_capture_alloc(VALUE klass) {
+    return mg_native_screen_capture_alloc(klass);
+}
+
+VALUE mg_screen_capture_setup(VALUE self, VALUE window, VALUE x, VALUE y,
+                              VALUE width, VALUE height, VALUE buffers, VALUE damage) {
+    if (NUM2INT(buffers) < 1) {
+        rb_raise(rb_eArgError, "buffer count must be positive");
+    }
+
+    if ((!NIL_P(width) && NUM2INT(width) < 1) || (!NIL_P(height) && NUM2INT(height) < 1)) {
+        rb_raise(rb_eArgError, "size must be positive");
+    }
+
+    mg_native_screen_capture_init(self, NIL_P(window) ? 0 : NUM2UINT(window),
+                                  NUM2INT(x), NUM2INT(y),
+                                  NIL_P(width) ? 0 : NUM2UINT(width),
+                                  NIL_P(height) ? 0 : NUM2UINT(height),
+                                  NUM2UINT(buffers), RTEST(damage));
+
+    rb_iv_set(self, buffers_ivar, rb_ary_new_capa(NUM2INT(buffers)));
+    return self;
+}
+
+VALUE mg_screen_capture_capture(VALUE self) {
+#if defined(HAVE_RUBY_IO_BUFFER_H)
+    unsigned char * pixels = 0;
+    int index = mg_native_screen_capture_capture(self, &pixels);
+    VALUE buffers, buffer;
+
+    if (index < 0) { return Qnil; }
+
+    /* Each segment gets one buffer, which views it for good */
+    buffers = rb_iv_get(self, buffers_ivar);
+    buffer = rb_ary_entry(buffers, index);
+
+    if (NIL_P(buffer)) {
+        size_t size = (size_t) mg_native_screen_capture_width(self) *
+                      mg_native_screen_capture_height(self) * 4;
+        buffer = rb_io_buffer_new(pixels, size, RB_IO_BUFFER_EXTERNAL | RB_IO_BUFFER_READONLY);
+        rb_ivar_set(buffer, rb_intern("@capture"), self);
+        rb_ary_store(buffers, index, buffer);
+    }
+
+    return buffer;
+#else
+    rb_raise(rb_eNotImpError, "screen capture requires IO::Buffer");
+#endif
+}
+
+VALUE mg_screen_capture_width(VALUE self) {
+    return UINT2NUM(mg_native_screen_capture_width(self));
+}
+
+VALUE mg_screen_capture_height(VALUE self) {
+    return UINT2NUM(mg_native_screen_capture_height(self));
+}
+
+VALUE mg_screen_capture_window(VALUE self) {
+    return UINT2NUM(mg_native_screen_capture_window(self));
+}
+
+VALUE mg_screen_capture_damage(VALUE self) {
+    return mg_native_screen_capture_damage(self) ? Qtrue : Qfalse;
+}
+
+VALUE mg_screen_capture_stats(VALUE self) {
+    mg_native_screen_capture_stats stats;
+    VALUE hash = rb_hash_new();
+
+    mg_native_screen_capture_get_stats(self, &stats);
+
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")),       ULL2NUM(stats.frames));
+    rb_hash_aset(hash, ID2SYM(rb_intern("unchanged")),    ULL2NUM(stats.unchanged));
+    rb_hash_aset(hash, ID2SYM(rb_intern("bytes")),        ULL2NUM(stats.bytes));
+    rb_hash_aset(hash, ID2SYM(rb_intern("capture_time")), DBL2NUM(stats.capture_time / 1e9));
+
+    return hash;
+}
+
+VALUE mg_screen_capture_close(VALUE self) {
+    release_buffers(self);
+    mg_native_screen_capture_close(self);
+    return Qnil;
+}
+
+VALUE mg_screen_capture_closed(VALUE self) {
+    return mg_native_screen_capture_closed(self) ? Qtrue : Qfalse;
+}
+
+void init_mg_screen_capture_class_under(VALUE module) {
+    mg_screen_capture_class = rb_define_class_under(module, "ScreenCapture", rb_cObject);
+    rb_define_alloc_func(mg_screen_capture_class, mg_screen_capture_alloc);
+    rb_define_private_method(mg_screen_capture_class, "setup", mg_screen_capture_setup, 7);
+    rb_define_method(mg_screen_capture_class, "capture", mg_screen_capture_capture, 0);
+    rb_define_method(mg_screen_capture_class, "width",   mg_screen_capture_width,   0);
+    rb_define_method(mg_screen_capture_class, "height",  mg_screen_capture_height,  0);
+    rb_define_method(mg_screen_capture_class, "window",  mg_screen_capture_window,  0);
+    rb_define_method(mg_screen_capture_class, "damage?", mg_screen_capture_damage,  0);
+    rb_define_method(mg_screen_capture_class, "stats",   mg_screen_capture_stats,   0);
+    rb_define_method(mg_screen_capture_class, "close",   mg_screen_capture_close,   0);
+    rb_define_method(mg_screen_capture_class, "closed?", mg_screen_capture_closed,  0);
+}
+
+/* Helper function implementation */
+
+static void release_buffers(VALUE self) {
+#if defined(HAVE_RUBY_IO_BUFFER_H)
+    VALUE buffers = rb_iv_get(self, buffers_ivar);
+    long i;
+
+    if (NIL_P(buffers)) { return; }
+
+    for (i = 0; i < RARRAY_LEN(buffers); ++i) {
+        VALUE buffer = rb_ary_entry(buffers, i);
+        if (!NIL_P(buffer)) { rb_io_buffer_free(buffer); }
+    }
+
+    rb_ary_clear(buffers);
+#endif
+}
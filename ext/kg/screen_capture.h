@@ -0,0 +1,74 @@
+#ifndef MG_SCREEN_CAPTURE_H
+#define MG_SCREEN_CAPTURE_H
+
+#include <ruby.h>
+
+/**
+ * Mg::ScreenCapture class.
+ */
+extern VALUE mg_screen_capture_class;
+
+/**
+ * Allocates memory for the screen capture.
+ */
+extern VALUE mg_screen_capture_alloc(VALUE klass);
+
+/**
+ * Connects to the display and shares buffers segments of memory with it, each
+ * holding one frame of the width by height area of the window at x, y. The
+ * window is a window identifier, or nil for the whole screen; nil sizes
+ * extend to the window's edge. Wrapped by Mg::ScreenCapture#initialize.
+ */
+extern VALUE mg_screen_capture_setup(VALUE self, VALUE window, VALUE x, VALUE y,
+                                     VALUE width, VALUE height, VALUE buffers, VALUE damage);
+
+/**
+ * Captures a frame and returns a read only IO::Buffer over the shared memory
+ * the server wrote it into, or nil if nothing changed since the last frame.
+ * Pixels are 32 bit BGRA with undefined alpha. The buffer is overwritten
+ * once as many frames as there are buffers were captured after it.
+ */
+extern VALUE mg_screen_capture_capture(VALUE self);
+
+/**
+ * Returns the width of the captured area.
+ */
+extern VALUE mg_screen_capture_width(VALUE self);
+
+/**
+ * Returns the height of the captured area.
+ */
+extern VALUE mg_screen_capture_height(VALUE self);
+
+/**
+ * Returns the identifier of the captured window.
+ */
+extern VALUE mg_screen_capture_window(VALUE self);
+
+/**
+ * Returns whether unchanged frames are skipped using the DAMAGE extension.
+ */
+extern VALUE mg_screen_capture_damage(VALUE self);
+
+/**
+ * Returns the capture counters in a Hash.
+ */
+extern VALUE mg_screen_capture_stats(VALUE self);
+
+/**
+ * Frees the shared memory and disconnects from the display. Buffers returned
+ * by #capture become invalid.
+ */
+extern VALUE mg_screen_capture_close(VALUE self);
+
+/**
+ * Returns whether the screen capture was closed.
+ */
+extern VALUE mg_screen_capture_closed(VALUE self);
+
+/**
+ * Initializes the ScreenCapture class.
+ */
+extern void init_mg_screen_capture_class_under(VALUE module);
+
+#endif /* MG_SCREEN_CAPTURE_H */
@@ -0,0 +1,377 @@
+#include "shader_cache.h"
+
+#include "extension.h"
+#include "gl_state.h"
+#include "hash.h"
+#include "mapped_file.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#ifndef GL_COMPLETION_STATUS_KHR
+    #define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+/* Constant definitions */
+
+static const char magic[4] = { 'M', 'g', 'P', 'B' };
+static const uint32_t version = 1;
+
+/* Cache file layout */
+
+/**
+ * Cache file header. Followed by the program binary.
+ */
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint64_t key; /** Hash of the sources and the driver. */
+    uint32_t format; /** Driver specific binary format. */
+    uint32_t length; /** Size of the binary in bytes. */
+} header_t;
+
+/* Data structures */
+
+struct mg_shader_cache {
+    char * directory; /** Where binaries are kept, or 0. */
+    uint64_t driver; /** Hash of the driver's vendor, renderer and version. */
+    mg_shader_cache_stats stats;
+};
+
+/* Helper function prototypes */
+
+/**
+ * Returns the monotonic time in nanoseconds.
+ */
+static uint64_t now(void);
+
+/**
+ * Writes the path of the program's cache file into the buffer.
+ */
+static void cache_path(const mg_shader_cache * cache, uint64_t key, char * path, size_t size);
+
+/**
+ * Loads the program's binary into its program object. Returns whether the
+ * driver accepted it.
+ */
+static int load_binary(mg_shader_cache * cache, mg_program * program);
+
+/**
+ * Writes the linked program's binary to a temporary file and atomically
+ * renames it into place.
+ */
+static void store_binary(mg_shader_cache * cache, const mg_program * program);
+
+/**
+ * Creates a shader object and submits its source for compilation.
+ */
+static GLuint compile(GLenum type, const char * source, size_t length);
+
+/**
+ * Appends the info log of the shader or program to the program's log.
+ */
+static void append_log(mg_program * program, const char * label, GLuint object, int shader);
+
+/* Shader cache interface implementation */
+
+mg_shader_cache * mg_shader_cache_new(const char * directory, const char ** error) {
+    static const GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION, GL_SHADING_LANGUAGE_VERSION };
+    mg_shader_cache * cache;
+    const char * extensions;
+    GLint formats = 0;
+    size_t i;
+
+    if (glGetString(GL_VERSION) == 0) {
+        *error = "could not create program cache; is a GL context current?";
+        return 0;
+    }
+
+    cache = calloc(1, sizeof(mg_shader_cache));
+    if (cache == 0 || (directory && (cache->directory = strdup(directory)) == 0)) {
+        free(cache);
+        *error = "unable to allocate memory for program cache";
+        return 0;
+    }
+
+    /* A binary only loads into the driver that produced it */
+    for (i = 0; i < sizeof(strings) / sizeof(strings[0]); ++i) {
+        const char * string = (const char *) glGetString(strings[i]);
+        if (string) { cache->driver = mg_hash64(string, strlen(string) + 1, cache->driver); }
+    }
+
+    /* Contexts without program binaries report an error and no formats */
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    while (glGetError() != GL_NO_ERROR);
+
+    cache->stats.binary = formats > 0;
+    extensions = (const char *) glGetString(GL_EXTENSIONS);
+    cache->stats.parallel = mg_has_extension(extensions, "GL_KHR_parallel_shader_compile") ||
+                            mg_has_extension(extensions, "GL_ARB_parallel_shader_compile");
+    return cache;
+}
+
+int mg_shader_cache_start(mg_shader_cache * cache, mg_program * program,
+                           const char * vertex, size_t vertex_length,
+                           const char * fragment, size_t fragment_length) {
+    uint64_t lengths[2] = { vertex_length, fragment_length };
+
+    memset(program, 0, sizeof(mg_program));
+    program->key = mg_hash64(lengths, sizeof(lengths), cache->driver ^ version);
+    program->key = mg_hash64(vertex, vertex_length, program->key);
+    program->key = mg_hash64(fragment, fragment_length, program->key);
+
+    program->name = glCreateProgram();
+    if (program->name == 0) { return 0; }
+
+    ++cache->stats.programs;
+
+    if (load_binary(cache, program)) {
+        program->cached = 1;
+        program->status = MG_PROGRAM_LINKED;
+        ++cache->stats.hits;
+        return 1;
+    }
+
+    ++cache->stats.misses;
+
+    program->vertex = compile(GL_VERTEX_SHADER, vertex, vertex_length);
+    program->fragment = compile(GL_FRAGMENT_SHADER, fragment, fragment_length);
+
+    if (program->vertex == 0 || program->fragment == 0) {
+        mg_program_delete(program);
+        return 0;
+    }
+
+    if (cache->stats.binary) {
+        glProgramParameteri(program->name, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    /* Nothing is queried here, so the driver is free to keep compiling */
+    glAttachShader(program->name, program->vertex);
+    glAttachShader(program->name, program->fragment);
+    glLinkProgram(program->name);
+    return 1;
+}
+
+int mg_shader_cache_ready(mg_shader_cache * cache, const mg_program * program) {
+    GLint done = GL_TRUE;
+
+    /* Without the extension there's no asking; finishing is as good as it gets */
+    if (program->status == MG_PROGRAM_PENDING && cache->stats.parallel) {
+        glGetProgramiv(program->name, GL_COMPLETION_STATUS_KHR, &done);
+    }
+
+    return done == GL_TRUE;
+}
+
+mg_program_status mg_shader_cache_finish(mg_shader_cache * cache, mg_program * program) {
+    GLint linked = GL_FALSE;
+    uint64_t start;
+
+    if (program->status != MG_PROGRAM_PENDING) { return program->status; }
+
+    start = now();
+    glGetProgramiv(program->name, GL_LINK_STATUS, &linked);
+    cache->stats.wait_time += now() - start;
+
+    if (linked == GL_TRUE) {
+        program->status = MG_PROGRAM_LINKED;
+        store_binary(cache, program);
+    } else {
+        program->status = MG_PROGRAM_FAILED;
+        append_log(program, "vertex shader", program->vertex, 1);
+        append_log(program, "fragment shader", program->fragment, 1);
+        append_log(program, "program", program->name, 0);
+        ++cache->stats.failures;
+    }
+
+    /* The program keeps what it needs; the shaders only take up memory */
+    glDetachShader(program->name, program->vertex);
+    glDetachShader(program->name, program->fragment);
+    glDeleteShader(program->vertex);
+    glDeleteShader(program->fragment);
+    program->vertex = program->fragment = 0;
+
+    return program->status;
+}
+
+void mg_shader_cache_get_stats(const mg_shader_cache * cache, mg_shader_cache_stats * stats) {
+    *stats = cache->stats;
+}
+
+void mg_shader_cache_free(mg_shader_cache * cache) {
+    if (cache == 0) { return; }
+    free(cache->directory);
+    free(cache);
+}
+
+void mg_program_delete(mg_program * program) {
+    if (program->vertex) { glDeleteShader(program->vertex); }
+    if (program->fragment) { glDeleteShader(program->fragment); }
+    if (program->name) { mg_gl_delete_program(mg_gl_state_current(), program->name); }
+    program->name = program->vertex = program->fragment = 0;
+    mg_program_discard(program);
+}
+
+void mg_program_discard(mg_program * program) {
+    free(program->log);
+    program->log = 0;
+}
+
+/* Helper function implementation */
+
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static void cache_path(const mg_shader_cache * cache, uint64_t key, char * path, size_t size) {
+    snprintf(path, size, "%s/%016llx.mgpb", cache->directory, (unsigned long long) key);
+}
+
+static int load_binary(mg_shader_cache * cache, mg_program * program) {
+    mg_mapped_file file;
+    const header_t * header;
+    GLint linked = GL_FALSE;
+    char path[4096];
+
+    if (cache->directory == 0 || !cache->stats.binary) { return 0; }
+
+    cache_path(cache, program->key, path, sizeof(path));
+    if (!mg_mapped_file_open(&file, path)) { return 0; }
+
+    header = (const header_t *) file.data;
+
+    /* Anything that doesn't look exactly right is treated as a miss */
+    if (file.size >= sizeof(header_t) &&
+        memcmp(header->magic, magic, sizeof(magic)) == 0 &&
+        header->version == version &&
+        header->key == program->key &&
+        header->length == file.size - sizeof(header_t)) {
+        glProgramBinary(program->name, header->format, file.data + sizeof(header_t), header->length);
+        glGetProgramiv(program->name, GL_LINK_STATUS, &linked);
+        while (glGetError() != GL_NO_ERROR);
+    }
+
+    mg_mapped_file_close(&file);
+    return linked == GL_TRUE;
+}
+
+static void store_binary(mg_shader_cache * cache, const mg_program * program) {
+    char path[4096], temporary_path[4096];
+    unsigned char * data;
+    header_t * header;
+    GLint length = 0;
+    GLsizei written_length = 0;
+    GLenum format = 0;
+    size_t size, written = 0;
+    int fd;
+
+    if (cache->directory == 0 || !cache->stats.binary) { return; }
+
+    glGetProgramiv(program->name, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) { return; }
+
+    size = sizeof(header_t) + length;
+    data = malloc(size);
+    if (data == 0) { return; }
+
+    glGetProgramBinary(program->name, length, &written_length, &format, data + sizeof(header_t));
+
+    if (glGetError() != GL_NO_ERROR || written_length <= 0) {
+        free(data);
+        return;
+    }
+
+    header = (header_t *) data;
+    memcpy(header->magic, magic, sizeof(magic));
+    header->version = version;
+    header->key = program->key;
+    header->format = format;
+    header->length = written_length;
+    size = sizeof(header_t) + written_length;
+
+    /* Processes building the same program each write their own file */
+    cache_path(cache, program->key, path, sizeof(path));
+    snprintf(temporary_path, sizeof(temporary_path), "%s/.mgpb.XXXXXX", cache->directory);
+    fd = mkstemp(temporary_path);
+
+    if (fd < 0) {
+        free(data);
+        return;
+    }
+
+    while (written < size) {
+        ssize_t n = write(fd, data + written, size - written);
+        if (n < 0) {
+            if (errno == EINTR) { continue; }
+            break;
+        }
+        written += n;
+    }
+
+    if (close(fd) != 0 || written != size || rename(temporary_path, path) != 0) {
+        unlink(temporary_path);
+    } else {
+        ++cache->stats.stored;
+    }
+
+    free(data);
+}
+
+static GLuint compile(GLenum type, const char * source, size_t length) {
+    GLuint shader = glCreateShader(type);
+    GLint size = length;
+
+    if (shader) {
+        glShaderSource(shader, 1, &source, &size);
+        glCompileShader(shader);
+    }
+
+    return shader;
+}
+
+static void append_log(mg_program * program, const char * label, GLuint object, int shader) {
+    GLint status = GL_FALSE, length = 0;
+    size_t used = program->log ? strlen(program->log) : 0, size;
+    char * log;
+
+    if (shader) {
+        glGetShaderiv(object, GL_COMPILE_STATUS, &status);
+        if (status == GL_TRUE) { return; }
+        glGetShaderiv(object, GL_INFO_LOG_LENGTH, &length);
+    } else {
+        glGetProgramiv(object, GL_INFO_LOG_LENGTH, &length);
+    }
+
+    /* Room for the label, its separator, the message and a line break */
+    size = used + strlen(label) + 2 + (length > 0 ? length : 1) + 1;
+    log = realloc(program->log, size);
+    if (log == 0) { return; }
+
+    used += sprintf(log + used, "%s: ", label);
+    log[used] = '\0';
+
+    if (length > 0) {
+        if (shader) {
+            glGetShaderInfoLog(object, length, 0, log + used);
+        } else {
+            glGetProgramInfoLog(object, length, 0, log + used);
+        }
+    }
+
+    used = strlen(log);
+    if (used > 0 && log[used - 1] != '\n') { strcpy(log + used, "\n"); }
+
+    program->log = log;
+}
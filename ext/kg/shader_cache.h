@@ -0,0 +1,111 @@
+#ifndef MG_SHADER_CACHE_H
+#define MG_SHADER_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * State of a program's build.
+ */
+typedef enum {
+    MG_PROGRAM_PENDING, /** Compiling or linking; the result wasn't looked at yet. */
+    MG_PROGRAM_LINKED,
+    MG_PROGRAM_FAILED
+} mg_program_status;
+
+/**
+ * GL program built through a shader cache.
+ */
+typedef struct {
+    unsigned int name; /** Program object. */
+    unsigned int vertex, fragment; /** Shader objects, until the program is finished. */
+    uint64_t key; /** Hash of the sources and the driver. */
+    int cached; /** Whether the program was loaded from its binary. */
+    mg_program_status status;
+    char * log; /** Compiler and linker messages of failed builds, or 0. */
+} mg_program;
+
+/**
+ * Counters of a shader cache.
+ */
+typedef struct {
+    int binary; /** Whether the driver supports program binaries. */
+    int parallel; /** Whether the driver compiles in the background. */
+    uint64_t programs; /** Programs built. */
+    uint64_t hits; /** Programs loaded from their binary. */
+    uint64_t misses; /** Programs compiled from source. */
+    uint64_t stored; /** Binaries written to disk. */
+    uint64_t failures; /** Programs that failed to compile or link. */
+    uint64_t wait_time; /** Nanoseconds spent waiting for builds to finish. */
+} mg_shader_cache_stats;
+
+/**
+ * Builds GL programs, keeping their binaries in a directory so later runs
+ * skip compilation. Binaries are keyed by a hash of the sources and of the
+ * vendor, renderer and version strings, so a driver update simply misses.
+ * Binaries the driver rejects anyway are compiled again and replaced.
+ *
+ * Builds are split in two so that many programs compile at once: starting a
+ * build submits the work without asking for its result, which is only
+ * looked at when the build is finished. With KHR_parallel_shader_compile the
+ * driver compiles on its own threads and a program can be polled until it's
+ * ready; otherwise, drivers that compile lazily still overlap the work.
+ *
+ * Functions must be called with the OpenGL context the cache was created in,
+ * or one sharing objects with it, current. None of them require the Ruby GVL.
+ */
+typedef struct mg_shader_cache mg_shader_cache;
+
+/**
+ * Creates a cache storing binaries in the given directory, or only in
+ * memory if it's 0. The directory must exist.
+ *
+ * Returns zero and sets the error message on failure.
+ */
+extern mg_shader_cache * mg_shader_cache_new(const char * directory, const char ** error);
+
+/**
+ * Starts building a program from the given vertex and fragment shader
+ * sources, loading its binary if there is a usable one.
+ *
+ * Returns zero if the GL objects couldn't be created.
+ */
+extern int mg_shader_cache_start(mg_shader_cache * cache, mg_program * program,
+                                  const char * vertex, size_t vertex_length,
+                                  const char * fragment, size_t fragment_length);
+
+/**
+ * Returns whether finishing the program won't block.
+ */
+extern int mg_shader_cache_ready(mg_shader_cache * cache, const mg_program * program);
+
+/**
+ * Waits for the program to be built and returns its status. Stores the
+ * binary of programs compiled from source. Does nothing after the first call.
+ */
+extern mg_program_status mg_shader_cache_finish(mg_shader_cache * cache, mg_program * program);
+
+/**
+ * Stores the cache's counters. Doesn't require the context.
+ */
+extern void mg_shader_cache_get_stats(const mg_shader_cache * cache,
+                                       mg_shader_cache_stats * stats);
+
+/**
+ * Frees the cache. Doesn't require the context.
+ */
+extern void mg_shader_cache_free(mg_shader_cache * cache);
+
+/**
+ * Deletes the program's GL objects and frees its log.
+ */
+extern void mg_program_delete(mg_program * program);
+
+/**
+ * Frees the program's log without deleting its GL objects, for when they
+ * are about to be destroyed along with their context. Doesn't require the
+ * context.
+ */
+extern void mg_program_discard(mg_program * program);
+
+#endif /* MG_SHADER_CACHE_H */
@@ -0,0 +1,232 @@
+#include "stream_buffer.h"
+
+#include "extension.h"
+
+#include <stdlib.h>
+#include <time.h>
+
+#define GL_GLEXT_PROTOTYPES
+
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+/* Data structures */
+
+struct mg_stream_buffer {
+    GLuint buffer;
+    int persistent; /** Whether the buffer is mapped for good. */
+    unsigned char * memory; /** Persistent mapping, or memory of the CPU for one region. */
+    size_t size, region; /** Bytes in the buffer and in each region. */
+    unsigned int frames, frame; /** Number of regions and the current one. */
+    size_t used; /** Bytes allocated in the current region. */
+    size_t flushed; /** Bytes of the current region already uploaded. */
+    GLsync * fences; /** One per region; 0 if nothing reads from it. */
+    size_t uniform_alignment;
+    mg_stream_buffer_stats stats;
+};
+
+/* Helper function prototypes */
+
+/**
+ * Binds the stream's buffer to GL_ARRAY_BUFFER and returns the buffer bound
+ * before, which the caller rebinds when done. The caller's vertex arrays may
+ * be set up from that binding.
+ */
+static GLuint bind(const mg_stream_buffer * stream);
+
+/**
+ * Returns the monotonic time in nanoseconds.
+ */
+static uint64_t now(void);
+
+/* Stream buffer interface implementation */
+
+mg_stream_buffer * mg_stream_buffer_new(size_t size, unsigned int frames, const char ** error) {
+    mg_stream_buffer * stream;
+    GLint alignment = 256;
+    GLuint previous;
+
+    if (frames == 0 || size < frames) {
+        *error = "stream buffer needs at least a byte per frame";
+        return 0;
+    }
+
+    stream = calloc(1, sizeof(mg_stream_buffer));
+    if (stream == 0 || (stream->fences = calloc(frames, sizeof(GLsync))) == 0) {
+        free(stream);
+        *error = "unable to allocate memory for stream buffer";
+        return 0;
+    }
+
+    stream->frames = frames;
+    stream->region = size / frames;
+    stream->size = stream->region * frames;
+
+    /* Only report errors caused by creating the buffer */
+    while (glGetError() != GL_NO_ERROR);
+
+    glGenBuffers(1, &stream->buffer);
+    previous = bind(stream);
+
+    if (mg_has_extension((const char *) glGetString(GL_EXTENSIONS), "GL_ARB_buffer_storage")) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, stream->size, 0, flags);
+        stream->memory = glMapBufferRange(GL_ARRAY_BUFFER, 0, stream->size, flags);
+        stream->persistent = stream->memory != 0;
+
+        /* Immutable storage can't be orphaned; start over with a mutable buffer */
+        if (!stream->persistent) {
+            glDeleteBuffers(1, &stream->buffer);
+            glGenBuffers(1, &stream->buffer);
+            glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+            while (glGetError() != GL_NO_ERROR);
+        }
+    }
+
+    if (!stream->persistent) {
+        glBufferData(GL_ARRAY_BUFFER, stream->size, 0, GL_STREAM_DRAW);
+        stream->memory = malloc(stream->region);
+    }
+
+    glBindBuffer(GL_ARRAY_BUFFER, previous);
+
+    if (stream->memory == 0 || glGetError() != GL_NO_ERROR) {
+        mg_stream_buffer_free(stream);
+        *error = "could not create stream buffer; is a GL context current?";
+        return 0;
+    }
+
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    while (glGetError() != GL_NO_ERROR);
+    stream->uniform_alignment = alignment > 0 ? alignment : 256;
+
+    stream->stats.persistent = stream->persistent;
+    stream->stats.size = stream->size;
+    stream->stats.frames = frames;
+    return stream;
+}
+
+void * mg_stream_buffer_allocate(mg_stream_buffer * stream, size_t size,
+                                 size_t alignment, size_t * offset) {
+    size_t start = (stream->used + alignment - 1) & ~(alignment - 1);
+
+    if (start > stream->region || size > stream->region - start) {
+        ++stream->stats.overflows;
+        return 0;
+    }
+
+    stream->used = start + size;
+    stream->stats.bytes += size;
+    stream->stats.frame_bytes = stream->used;
+    *offset = stream->frame * stream->region + start;
+
+    return stream->persistent ? stream->memory + *offset : stream->memory + start;
+}
+
+void mg_stream_buffer_flush(mg_stream_buffer * stream) {
+    GLuint previous;
+
+    /* Coherent mappings need nothing; the rest is uploaded where nothing was */
+    if (stream->persistent || stream->flushed == stream->used) { return; }
+
+    previous = bind(stream);
+    glBufferSubData(GL_ARRAY_BUFFER, stream->frame * stream->region + stream->flushed,
+                    stream->used - stream->flushed, stream->memory + stream->flushed);
+    glBindBuffer(GL_ARRAY_BUFFER, previous);
+
+    stream->flushed = stream->used;
+}
+
+void mg_stream_buffer_next_frame(mg_stream_buffer * stream) {
+    mg_stream_buffer_flush(stream);
+
+    if (stream->used > stream->stats.peak_frame_bytes) {
+        stream->stats.peak_frame_bytes = stream->used;
+    }
+
+    if (stream->persistent) {
+        GLsync * fence;
+
+        stream->fences[stream->frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        stream->frame = (stream->frame + 1) % stream->frames;
+        fence = &stream->fences[stream->frame];
+
+        /* Only waits if the GPU is more frames behind than there are regions */
+        if (*fence) {
+            if (glClientWaitSync(*fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+                uint64_t start = now();
+                while (glClientWaitSync(*fence, GL_SYNC_FLUSH_COMMANDS_BIT,
+                                        1000000000ULL) == GL_TIMEOUT_EXPIRED);
+                ++stream->stats.waits;
+                stream->stats.wait_time += now() - start;
+            }
+            glDeleteSync(*fence);
+            *fence = 0;
+        }
+    } else {
+        stream->frame = (stream->frame + 1) % stream->frames;
+
+        /* Wrapping around would write over ranges the GPU may still read */
+        if (stream->frame == 0) {
+            GLuint previous = bind(stream);
+            glBufferData(GL_ARRAY_BUFFER, stream->size, 0, GL_STREAM_DRAW);
+            glBindBuffer(GL_ARRAY_BUFFER, previous);
+        }
+    }
+
+    stream->used = stream->flushed = 0;
+    stream->stats.frame_bytes = 0;
+}
+
+unsigned int mg_stream_buffer_name(const mg_stream_buffer * stream) {
+    return stream->buffer;
+}
+
+size_t mg_stream_buffer_uniform_alignment(const mg_stream_buffer * stream) {
+    return stream->uniform_alignment;
+}
+
+void mg_stream_buffer_get_stats(const mg_stream_buffer * stream, mg_stream_buffer_stats * stats) {
+    *stats = stream->stats;
+}
+
+void mg_stream_buffer_free(mg_stream_buffer * stream) {
+    unsigned int i;
+
+    for (i = 0; i < stream->frames; ++i) {
+        if (stream->fences[i]) { glDeleteSync(stream->fences[i]); }
+    }
+
+    if (stream->buffer) {
+        if (stream->persistent) {
+            GLuint previous = bind(stream);
+            glUnmapBuffer(GL_ARRAY_BUFFER);
+            glBindBuffer(GL_ARRAY_BUFFER, previous);
+        }
+        glDeleteBuffers(1, &stream->buffer);
+    }
+
+    mg_stream_buffer_discard(stream);
+}
+
+void mg_stream_buffer_discard(mg_stream_buffer * stream) {
+    if (!stream->persistent) { free(stream->memory); }
+    free(stream->fences);
+    free(stream);
+}
+
+/* Helper function implementation */
+
+static GLuint bind(const mg_stream_buffer * stream) {
+    GLint previous = 0;
+
+    glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &previous);
+    glBindBuffer(GL_ARRAY_BUFFER, stream->buffer);
+    return previous;
+}
+
+static uint64_t now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
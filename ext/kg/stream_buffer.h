@@ -0,0 +1,97 @@
+#ifndef MG_STREAM_BUFFER_H
+#define MG_STREAM_BUFFER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Counters of a stream buffer.
+ */
+typedef struct {
+    int persistent; /** Whether the buffer is persistently mapped rather than orphaned. */
+    size_t size; /** Bytes in the whole buffer. */
+    unsigned int frames; /** Regions the buffer is split into. */
+    uint64_t bytes; /** Bytes allocated in total. */
+    size_t frame_bytes; /** Bytes allocated in the current frame. */
+    size_t peak_frame_bytes; /** Most bytes allocated in a single frame. */
+    uint64_t overflows; /** Allocations that didn't fit in their frame's region. */
+    uint64_t waits; /** Frames that waited for the GPU to finish with their region. */
+    uint64_t wait_time; /** Nanoseconds spent waiting. */
+} mg_stream_buffer_stats;
+
+/**
+ * GL buffer object for data that changes every frame, such as vertices and
+ * uniforms. It's split into one region per frame in flight, and allocations
+ * are bumped out of the current frame's region; nothing is allocated or
+ * reallocated after creation.
+ *
+ * With ARB_buffer_storage the buffer is mapped once, persistently and
+ * coherently, and written in place; a fence per region keeps the CPU from
+ * overwriting data the GPU hasn't read yet. Otherwise writes go to memory of
+ * the CPU and are uploaded with glBufferSubData into ranges that weren't used
+ * since the buffer was last orphaned, which it is each time the regions wrap
+ * around, so the driver never has to synchronize.
+ *
+ * Except where noted, functions must be called with the OpenGL context that
+ * created the buffer current. None of them require the Ruby GVL.
+ */
+typedef struct mg_stream_buffer mg_stream_buffer;
+
+/**
+ * Creates a buffer of the given size split into the given number of frames.
+ *
+ * Returns zero and sets the error message on failure.
+ */
+extern mg_stream_buffer * mg_stream_buffer_new(size_t size, unsigned int frames,
+                                               const char ** error);
+
+/**
+ * Allocates size bytes aligned to alignment, a power of two, in the current
+ * frame's region and stores their offset in the buffer. Returns where to
+ * write them, or zero if the region is full. Doesn't require the context.
+ */
+extern void * mg_stream_buffer_allocate(mg_stream_buffer * stream, size_t size,
+                                        size_t alignment, size_t * offset);
+
+/**
+ * Makes everything written since the last call visible to GL. Call it before
+ * drawing from the buffer.
+ */
+extern void mg_stream_buffer_flush(mg_stream_buffer * stream);
+
+/**
+ * Ends the frame: fences what was submitted from its region and moves on to
+ * the next one, waiting if the GPU is still reading it. Call it when
+ * buffers are swapped.
+ */
+extern void mg_stream_buffer_next_frame(mg_stream_buffer * stream);
+
+/**
+ * Returns the name of the GL buffer object. Doesn't require the context.
+ */
+extern unsigned int mg_stream_buffer_name(const mg_stream_buffer * stream);
+
+/**
+ * Returns the offset alignment uniform buffer ranges need.
+ */
+extern size_t mg_stream_buffer_uniform_alignment(const mg_stream_buffer * stream);
+
+/**
+ * Stores the buffer's counters. Doesn't require the context.
+ */
+extern void mg_stream_buffer_get_stats(const mg_stream_buffer * stream,
+                                       mg_stream_buffer_stats * stats);
+
+/**
+ * Deletes the buffer object and fences and frees the stream buffer.
+ */
+extern void mg_stream_buffer_free(mg_stream_buffer * stream);
+
+/**
+ * Frees the stream buffer without deleting its buffer object and fences, for
+ * when they are about to be destroyed along with their context. Doesn't
+ * require the context to be current.
+ */
+extern void mg_stream_buffer_discard(mg_stream_buffer * stream);
+
+#endif /* MG_STREAM_BUFFER_H */
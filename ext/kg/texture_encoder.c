@@ -0,0 +1,254 @@
+#include "texture_encoder.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Helper function prototypes */
+
+/**
+ * Reads the 4x4 block whose top left pixel is at (x, y) as RGBA, replicating
+ * edge pixels for blocks that cross the border of the image.
+ */
+static void read_block(const mg_image * image, unsigned int x, unsigned int y,
+                       unsigned char block[16][4]);
+
+/**
+ * Encodes the color of the block as a DXT1 block.
+ */
+static void encode_color(unsigned char block[16][4], unsigned char * output);
+
+/**
+ * Encodes the alpha of the block as a DXT5 alpha block.
+ */
+static void encode_alpha(unsigned char block[16][4], unsigned char * output);
+
+/**
+ * Packs a color into 5:6:5 bits.
+ */
+static inline uint16_t pack_565(const unsigned char * c) {
+    return (uint16_t) ((c[0] >> 3) << 11 | (c[1] >> 2) << 5 | (c[2] >> 3));
+}
+
+/**
+ * Expands a 5:6:5 color back into 8 bits per channel.
+ */
+static inline void unpack_565(uint16_t v, unsigned char * c) {
+    c[0] = (unsigned char) ((v >> 11) << 3 | (v >> 13));
+    c[1] = (unsigned char) (((v >> 5) & 0x3F) << 2 | ((v >> 9) & 0x03));
+    c[2] = (unsigned char) ((v & 0x1F) << 3 | ((v >> 2) & 0x07));
+}
+
+/* Texture encoder interface implementation */
+
+const char * mg_image_downsample(const mg_image * source, mg_image * destination) {
+    unsigned int x, y, c, width, height, x0, x1, y0, y1;
+    const unsigned char * s = source->pixels;
+    unsigned char * d;
+
+    width  = source->width  > 1 ? source->width  / 2 : 1;
+    height = source->height > 1 ? source->height / 2 : 1;
+
+    destination->pixels = malloc((size_t) width * height * 4);
+
+    if (destination->pixels == 0) { return "unable to allocate memory for mipmap"; }
+
+    destination->width = width;
+    destination->height = height;
+    destination->format = source->format;
+
+    d = destination->pixels;
+
+    for (y = 0; y < height; ++y) {
+        y0 = y * 2;
+        y1 = y0 + 1 < source->height ? y0 + 1 : y0;
+
+        for (x = 0; x < width; ++x, d += 4) {
+            x0 = x * 2;
+            x1 = x0 + 1 < source->width ? x0 + 1 : x0;
+
+            /* Every channel is averaged the same way, whatever the layout */
+            for (c = 0; c < 4; ++c) {
+                d[c] = (unsigned char) ((s[((size_t) y0 * source->width + x0) * 4 + c] +
+                                         s[((size_t) y0 * source->width + x1) * 4 + c] +
+                                         s[((size_t) y1 * source->width + x0) * 4 + c] +
+                                         s[((size_t) y1 * source->width + x1) * 4 + c] + 2) / 4);
+            }
+        }
+    }
+
+    return 0;
+}
+
+int mg_image_is_opaque(const mg_image * image) {
+    mg_pixel_layout layout = mg_pixel_format_layout(image->format);
+    size_t i, count = (size_t) image->width * image->height;
+    for (i = 0; i < count; ++i) {
+        if (image->pixels[i * 4 + layout.a] != 255) { return 0; }
+    }
+    return 1;
+}
+
+size_t mg_texture_size(mg_texture_compression compression,
+                       unsigned int width, unsigned int height) {
+    size_t blocks = (size_t) ((width + 3) / 4) * ((height + 3) / 4);
+    switch (compression) {
+        case MG_TEXTURE_COMPRESSION_DXT1: return blocks * 8;
+        case MG_TEXTURE_COMPRESSION_DXT5: return blocks * 16;
+        default: return (size_t) width * height * 4;
+    }
+}
+
+void mg_texture_compress(const mg_image * image,
+                         mg_texture_compression compression,
+                         unsigned char * output) {
+    unsigned char block[16][4];
+    unsigned int x, y;
+
+    if (compression == MG_TEXTURE_COMPRESSION_NONE) {
+        memcpy(output, image->pixels, mg_texture_size(compression, image->width, image->height));
+        return;
+    }
+
+    for (y = 0; y < image->height; y += 4) {
+        for (x = 0; x < image->width; x += 4) {
+            read_block(image, x, y, block);
+
+            if (compression == MG_TEXTURE_COMPRESSION_DXT5) {
+                encode_alpha(block, output);
+                output += 8;
+            }
+
+            encode_color(block, output);
+            output += 8;
+        }
+    }
+}
+
+/* Helper function implementation */
+
+static void read_block(const mg_image * image, unsigned int x, unsigned int y,
+                       unsigned char block[16][4]) {
+    mg_pixel_layout layout = mg_pixel_format_layout(image->format);
+    unsigned int i, j, px, py;
+
+    for (j = 0; j < 4; ++j) {
+        py = y + j < image->height ? y + j : image->height - 1;
+        for (i = 0; i < 4; ++i) {
+            const unsigned char * p;
+            px = x + i < image->width ? x + i : image->width - 1;
+            p = image->pixels + ((size_t) py * image->width + px) * 4;
+            block[j * 4 + i][0] = p[layout.r];
+            block[j * 4 + i][1] = p[layout.g];
+            block[j * 4 + i][2] = p[layout.b];
+            block[j * 4 + i][3] = p[layout.a];
+        }
+    }
+}
+
+static void encode_color(unsigned char block[16][4], unsigned char * output) {
+    unsigned char min[3] = { 255, 255, 255 }, max[3] = { 0, 0, 0 }, palette[4][3];
+    uint16_t c0, c1;
+    uint32_t indices = 0;
+    int i, c;
+
+    /* Bounding box of the block's colors */
+    for (i = 0; i < 16; ++i) {
+        for (c = 0; c < 3; ++c) {
+            if (block[i][c] < min[c]) { min[c] = block[i][c]; }
+            if (block[i][c] > max[c]) { max[c] = block[i][c]; }
+        }
+    }
+
+    /* Inset it slightly to reduce the error at the endpoints */
+    for (c = 0; c < 3; ++c) {
+        int inset = (max[c] - min[c]) / 16;
+        min[c] += inset;
+        max[c] -= inset;
+    }
+
+    c0 = pack_565(max);
+    c1 = pack_565(min);
+
+    /* The first endpoint must be greater to select the four color mode */
+    if (c0 < c1) {
+        uint16_t t = c0;
+        c0 = c1;
+        c1 = t;
+    }
+
+    if (c0 != c1) {
+        unpack_565(c0, palette[0]);
+        unpack_565(c1, palette[1]);
+
+        for (c = 0; c < 3; ++c) {
+            palette[2][c] = (unsigned char) ((2 * palette[0][c] + palette[1][c]) / 3);
+            palette[3][c] = (unsigned char) ((palette[0][c] + 2 * palette[1][c]) / 3);
+        }
+
+        /* Pick the closest palette entry for each pixel */
+        for (i = 0; i < 16; ++i) {
+            int best = 0, best_distance = 1 << 30, p;
+            for (p = 0; p < 4; ++p) {
+                int distance = 0;
+                for (c = 0; c < 3; ++c) {
+                    int d = block[i][c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint32_t) best << (i * 2);
+        }
+    }
+
+    output[0] = c0 & 0xFF;
+    output[1] = c0 >> 8;
+    output[2] = c1 & 0xFF;
+    output[3] = c1 >> 8;
+    output[4] = indices & 0xFF;
+    output[5] = (indices >> 8) & 0xFF;
+    output[6] = (indices >> 16) & 0xFF;
+    output[7] = indices >> 24;
+}
+
+static void encode_alpha(unsigned char block[16][4], unsigned char * output) {
+    unsigned char a0 = 0, a1 = 255, palette[8];
+    uint64_t indices = 0;
+    int i, p;
+
+    for (i = 0; i < 16; ++i) {
+        if (block[i][3] > a0) { a0 = block[i][3]; }
+        if (block[i][3] < a1) { a1 = block[i][3]; }
+    }
+
+    output[0] = a0;
+    output[1] = a1;
+
+    /* Eight interpolated alpha values, selected by a0 > a1 */
+    if (a0 > a1) {
+        palette[0] = a0;
+        palette[1] = a1;
+        for (p = 1; p < 7; ++p) {
+            palette[p + 1] = (unsigned char) (((7 - p) * a0 + p * a1) / 7);
+        }
+
+        for (i = 0; i < 16; ++i) {
+            int best = 0, best_distance = 256;
+            for (p = 0; p < 8; ++p) {
+                int distance = abs(block[i][3] - palette[p]);
+                if (distance < best_distance) {
+                    best_distance = distance;
+                    best = p;
+                }
+            }
+            indices |= (uint64_t) best << (i * 3);
+        }
+    }
+
+    for (i = 0; i < 6; ++i) {
+        output[2 + i] = (unsigned char) (indices >> (i * 8));
+    }
+}
@@ -0,0 +1,45 @@
+#ifndef MG_TEXTURE_ENCODER_H
+#define MG_TEXTURE_ENCODER_H
+
+#include "image_decoder.h"
+
+#include <stddef.h>
+
+/**
+ * Block compression formats for texture data.
+ */
+typedef enum {
+    MG_TEXTURE_COMPRESSION_NONE,
+    MG_TEXTURE_COMPRESSION_DXT1, /** S3TC, opaque; 8 bytes per 4x4 block. */
+    MG_TEXTURE_COMPRESSION_DXT5  /** S3TC, interpolated alpha; 16 bytes per block. */
+} mg_texture_compression;
+
+/**
+ * Computes the next level of the image's mip chain by averaging 2x2 pixel
+ * blocks. The destination's pixels must be released with mg_image_free.
+ *
+ * Returns zero on success or a static error message on failure.
+ */
+extern const char * mg_image_downsample(const mg_image * source, mg_image * destination);
+
+/**
+ * Returns whether every pixel of the image is fully opaque.
+ */
+extern int mg_image_is_opaque(const mg_image * image);
+
+/**
+ * Returns the number of bytes needed to store an image of the given size in
+ * the given format.
+ */
+extern size_t mg_texture_size(mg_texture_compression compression,
+                              unsigned int width, unsigned int height);
+
+/**
+ * Block compresses the image into the output buffer, which must be at least
+ * mg_texture_size bytes long.
+ */
+extern void mg_texture_compress(const mg_image * image,
+                                mg_texture_compression compression,
+                                unsigned char * output);
+
+#endif /* MG_TEXTURE_ENCODER_H */
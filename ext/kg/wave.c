@@ -0,0 +1,150 @@
+#include "wave.h"
+
+#include <string.h>
+
+/* Constant definitions */
+
+static const uint16_t format_pcm        = 0x0001;
+static const uint16_t format_float      = 0x0003;
+static const uint16_t format_extensible = 0xFFFE;
+
+/* Helper function prototypes */
+
+/**
+ * Reads little endian integers.
+ */
+static inline uint32_t le32(const unsigned char * p) {
+    return (uint32_t) p[3] << 24 | (uint32_t) p[2] << 16 | (uint32_t) p[1] << 8 | p[0];
+}
+
+static inline uint16_t le16(const unsigned char * p) {
+    return (uint16_t) (p[1] << 8 | p[0]);
+}
+
+/**
+ * Writes little endian integers.
+ */
+static inline void put32(unsigned char * p, uint32_t v) {
+    p[0] = v & 0xFF; p[1] = (v >> 8) & 0xFF; p[2] = (v >> 16) & 0xFF; p[3] = v >> 24;
+}
+
+static inline void put16(unsigned char * p, uint16_t v) {
+    p[0] = v & 0xFF; p[1] = v >> 8;
+}
+
+/**
+ * Reads one sample of the given channel and frame as a float in [-1, 1].
+ */
+static float sample(const mg_wave * wave, const unsigned char * frame, unsigned int channel);
+
+/* Wave interface implementation */
+
+const char * mg_wave_parse(const unsigned char * file, size_t size, mg_wave * wave) {
+    size_t p = 12;
+    int have_format = 0;
+    uint16_t format = 0, bits = 0;
+
+    if (size < 12 || memcmp(file, "RIFF", 4) != 0 || memcmp(file + 8, "WAVE", 4) != 0) {
+        return "not a RIFF WAVE file";
+    }
+
+    /* Walk the chunks until the data chunk is found */
+    while (p + 8 <= size) {
+        const unsigned char * chunk = file + p;
+        uint32_t chunk_size = le32(chunk + 4);
+        size_t available = size - p - 8;
+
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (chunk_size < 16 || chunk_size > available) { return "invalid WAVE format chunk"; }
+            format         = le16(chunk + 8);
+            wave->channels = le16(chunk + 10);
+            wave->rate     = le32(chunk + 12);
+            bits           = le16(chunk + 22);
+            if (format == format_extensible && chunk_size >= 26) {
+                format = le16(chunk + 32);
+            }
+            have_format = 1;
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            if (!have_format) { return "WAVE data chunk precedes format chunk"; }
+
+            if      (format == format_pcm   && bits == 8)  { wave->encoding = MG_WAVE_PCM_U8;  }
+            else if (format == format_pcm   && bits == 16) { wave->encoding = MG_WAVE_PCM_S16; }
+            else if (format == format_pcm   && bits == 24) { wave->encoding = MG_WAVE_PCM_S24; }
+            else if (format == format_pcm   && bits == 32) { wave->encoding = MG_WAVE_PCM_S32; }
+            else if (format == format_float && bits == 32) { wave->encoding = MG_WAVE_FLOAT32; }
+            else { return "unsupported WAVE sample format"; }
+
+            if (wave->channels == 0 || wave->rate == 0) { return "invalid WAVE format chunk"; }
+
+            /* Streams that were cut short are still playable */
+            if (chunk_size > available) { chunk_size = available; }
+
+            wave->frame_size = wave->channels * (bits / 8);
+            wave->data = chunk + 8;
+            wave->frames = chunk_size / wave->frame_size;
+            return 0;
+        }
+
+        /* Chunks are padded to an even size */
+        p += 8 + (size_t) chunk_size + (chunk_size & 1);
+    }
+
+    return "WAVE file has no data chunk";
+}
+
+void mg_wave_read_stereo(const mg_wave * wave, size_t first, size_t count, float * output) {
+    const unsigned char * frame = wave->data + first * wave->frame_size;
+    size_t i;
+
+    for (i = 0; i < count; ++i, frame += wave->frame_size, output += 2) {
+        output[0] = sample(wave, frame, 0);
+        output[1] = wave->channels > 1 ? sample(wave, frame, 1) : output[0];
+    }
+}
+
+void mg_wave_write_header(unsigned char header[MG_WAVE_HEADER_SIZE],
+                          unsigned int rate, uint32_t frames) {
+    static const uint16_t channels = 2, bits = 16;
+    uint32_t data_size = frames * channels * (bits / 8);
+
+    memcpy(header, "RIFF", 4);
+    put32(header + 4, 36 + data_size);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    put32(header + 16, 16);
+    put16(header + 20, format_pcm);
+    put16(header + 22, channels);
+    put32(header + 24, rate);
+    put32(header + 28, rate * channels * (bits / 8));
+    put16(header + 32, channels * (bits / 8));
+    put16(header + 34, bits);
+    memcpy(header + 36, "data", 4);
+    put32(header + 40, data_size);
+}
+
+/* Helper function implementation */
+
+static float sample(const mg_wave * wave, const unsigned char * frame, unsigned int channel) {
+    switch (wave->encoding) {
+        case MG_WAVE_PCM_U8: {
+            return (frame[channel] - 128) / 128.0f;
+        }
+        case MG_WAVE_PCM_S16: {
+            return (int16_t) le16(frame + channel * 2) / 32768.0f;
+        }
+        case MG_WAVE_PCM_S24: {
+            const unsigned char * p = frame + channel * 3;
+            int32_t v = (int32_t) ((uint32_t) p[2] << 24 | (uint32_t) p[1] << 16 | (uint32_t) p[0] << 8);
+            return (v >> 8) / 8388608.0f;
+        }
+        case MG_WAVE_PCM_S32: {
+            return (int32_t) le32(frame + channel * 4) / 2147483648.0f;
+        }
+        case MG_WAVE_FLOAT32: {
+            uint32_t bits = le32(frame + channel * 4);
+            float v;
+            memcpy(&v, &bits, sizeof(v));
+            return v;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#ifndef MG_WAVE_H
+#define MG_WAVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * Sample encodings found in RIFF WAVE files.
+ */
+typedef enum {
+    MG_WAVE_PCM_U8,
+    MG_WAVE_PCM_S16,
+    MG_WAVE_PCM_S24,
+    MG_WAVE_PCM_S32,
+    MG_WAVE_FLOAT32
+} mg_wave_encoding;
+
+/**
+ * Description of the audio data in a RIFF WAVE file.
+ */
+typedef struct {
+    mg_wave_encoding encoding;
+    unsigned int channels; /** Number of interleaved channels. */
+    unsigned int rate; /** Frames per second. */
+    unsigned int frame_size; /** Bytes per frame. */
+    const unsigned char * data; /** First frame of audio data. */
+    size_t frames; /** Number of complete frames. */
+} mg_wave;
+
+/**
+ * Size of the header written by mg_wave_write_header.
+ */
+#define MG_WAVE_HEADER_SIZE 44
+
+/**
+ * Parses the RIFF WAVE file held in memory. The data pointer of the result
+ * points into the given buffer.
+ *
+ * Returns zero on success or a static error message on failure.
+ */
+extern const char * mg_wave_parse(const unsigned char * file, size_t size, mg_wave * wave);
+
+/**
+ * Converts frames starting at the given index to interleaved stereo floats.
+ * Mono data is duplicated into both channels; channels beyond the second are
+ * dropped.
+ */
+extern void mg_wave_read_stereo(const mg_wave * wave, size_t first, size_t count, float * output);
+
+/**
+ * Writes a 16 bit PCM stereo header describing the given number of frames.
+ */
+extern void mg_wave_write_header(unsigned char header[MG_WAVE_HEADER_SIZE],
+                                 unsigned int rate, uint32_t frames);
+
+#endif /* MG_WAVE_H */
@@ -5,12 +5,28 @@
 #endif
 
 #include "event.h"
+#include "image.h"
+#include "pixel_format.h"
+
+#include <string.h>
 
 #include <ruby.h>
+#include <ruby/ractor.h>
+
+#if defined(HAVE_RUBY_IO_BUFFER_H)
+    #include <ruby/io/buffer.h>
+#endif
+
+VALUE mg_window_class;
 
 /* Constant definitions */
 
 static const char * evt_thr_ivar = "@event_thread";
+static const char * framebuffer_ivar = "@framebuffer";
+
+/* Whether new windows start an event thread, set per Ractor; nil means true */
+
+static rb_ractor_local_key_t start_event_threads;
 
 /* Helper function prototypes */
 
@@ -24,6 +40,33 @@ static void def_mg_window_method(const char * name, VALUE (*func)(), int argc);
  */
 static void def_mg_window_alias(const char * alias, const char * old);
 
+/**
+ * Frees the IO::Buffer over the framebuffer pixels, if any, so that it can't
+ * be used after they move.
+ */
+static void release_framebuffer(VALUE self);
+
+/**
+ * Converts the capture counters to a Ruby Hash.
+ */
+static VALUE capture_stats_to_hash(mg_capture_stats stats);
+
+/**
+ * Converts the stream buffer counters to a Ruby Hash.
+ */
+static VALUE stream_stats_to_hash(mg_stream_buffer_stats stats);
+
+/**
+ * Returns whether the symbol names the primary selection rather than the
+ * clipboard.
+ */
+static int is_primary_selection(VALUE selection);
+
+/**
+ * Returns the Ruby symbol naming how a frame was presented.
+ */
+static VALUE present_mode_to_symbol(mg_present_mode mode);
+
 /* Window interface implementation */
 
 VALUE mg_window_alloc(VALUE klass) {
@@ -38,7 +81,9 @@ VALUE mg_window_initialize(VALUE self, VALUE name, VALUE x, VALUE y, VALUE w, VA
     Check_Type(h, T_FIXNUM);
     mg_native_window_init(self, StringValueCStr(name),
                           FIX2INT(x), FIX2INT(y), FIX2INT(w), FIX2INT(h));
-    mg_window_start_event_thread(self);
+    if (mg_window_event_threads(mg_window_class) != Qfalse) {
+        mg_window_start_event_thread(self);
+    }
     return Qnil;
 }
 
@@ -66,6 +111,76 @@ VALUE mg_window_visible(VALUE self) {
     return mg_native_window_visible(self) ? Qtrue : Qfalse;
 }
 
+VALUE mg_window_pixel_format(VALUE self) {
+    return mg_native_window_pixel_format(self);
+}
+
+VALUE mg_window_key_down(VALUE self, VALUE key) {
+    int index = mg_event_keyboard_key_index(key);
+    if (index < 0) {
+        rb_raise(rb_eArgError, "unsupported key: %"PRIsVALUE, rb_inspect(key));
+    }
+    return mg_native_window_key_down(self, index) ? Qtrue : Qfalse;
+}
+
+VALUE mg_window_button_down(VALUE self, VALUE button) {
+    int index = mg_event_mouse_button_index(button);
+    if (index < 0) {
+        rb_raise(rb_eArgError, "unsupported mouse button: %"PRIsVALUE, rb_inspect(button));
+    }
+    return mg_native_window_button_down(self, index) ? Qtrue : Qfalse;
+}
+
+VALUE mg_window_pointer_position(VALUE self) {
+    return mg_native_window_pointer_position(self);
+}
+
+VALUE mg_window_pointer_delta(VALUE self) {
+    return mg_native_window_pointer_delta(self);
+}
+
+VALUE mg_window_raw_pointer(VALUE self) {
+    return mg_native_window_raw_pointer(self) ? Qtrue : Qfalse;
+}
+
+VALUE mg_window_display_fd(VALUE module) {
+    return INT2FIX(mg_native_window_connection_number());
+}
+
+VALUE mg_window_dispatch_pending(VALUE module) {
+    return UINT2NUM(mg_native_window_dispatch_pending());
+}
+
+VALUE mg_window_set_event_threads(VALUE klass, VALUE enabled) {
+    rb_ractor_local_storage_value_set(start_event_threads, RTEST(enabled) ? Qtrue : Qfalse);
+    return enabled;
+}
+
+VALUE mg_window_event_threads(VALUE klass) {
+    VALUE enabled;
+    if (!rb_ractor_local_storage_value_lookup(start_event_threads, &enabled)) {
+        return Qtrue;
+    }
+    return enabled;
+}
+
+VALUE mg_window_set_pool_size(VALUE klass, VALUE size) {
+    Check_Type(size, T_FIXNUM);
+    if (FIX2INT(size) < 0) {
+        rb_raise(rb_eArgError, "pool size must not be negative");
+    }
+    mg_native_window_set_pool_size(FIX2UINT(size));
+    return size;
+}
+
+VALUE mg_window_pool_size(VALUE klass) {
+    return UINT2NUM(mg_native_window_pool_size());
+}
+
+VALUE mg_window_pooled(VALUE klass) {
+    return UINT2NUM(mg_native_window_pooled());
+}
+
 VALUE mg_window_set_x(VALUE self, VALUE x) {
     Check_Type(x, T_FIXNUM);
     mg_native_window_set_x(self, FIX2INT(x));
@@ -143,10 +258,372 @@ VALUE mg_window_stop_event_thread(VALUE self) {
     return thread;
 }
 
+VALUE mg_window_close(VALUE self) {
+    VALUE thread = rb_iv_get(self, evt_thr_ivar);
+    int from_event_loop = thread == rb_thread_current();
+
+    if (mg_native_window_closed(self)) { return Qnil; }
+
+    /* Wait for the event loop to let go of the window, unless this is it */
+    if (!NIL_P(thread) && !from_event_loop) {
+        rb_thread_kill(thread);
+        rb_funcall(thread, rb_intern("join"), 0);
+    }
+
+    release_framebuffer(self);
+    mg_native_window_close(self, from_event_loop);
+    return Qnil;
+}
+
+VALUE mg_window_closed(VALUE self) {
+    return mg_native_window_closed(self) ? Qtrue : Qfalse;
+}
+
+VALUE mg_window_framebuffer(VALUE self) {
+#if defined(HAVE_RUBY_IO_BUFFER_H)
+    VALUE buffer;
+    unsigned int width, height;
+    int recreated;
+    unsigned char * pixels = mg_native_window_framebuffer(self, &width, &height, &recreated);
+
+    if (recreated) { release_framebuffer(self); }
+
+    buffer = rb_iv_get(self, framebuffer_ivar);
+    if (NIL_P(buffer)) {
+        buffer = rb_io_buffer_new(pixels, (size_t) width * height * 4, RB_IO_BUFFER_EXTERNAL);
+        /* The pixels belong to the window; keep it alive while they're in use */
+        rb_ivar_set(buffer, rb_intern("@window"), self);
+        rb_iv_set(self, framebuffer_ivar, buffer);
+    }
+
+    return buffer;
+#else
+    rb_raise(rb_eNotImpError, "framebuffers require IO::Buffer");
+#endif
+}
+
+unsigned char * mg_window_pixels(VALUE self, unsigned int * width, unsigned int * height,
+                                 mg_pixel_format * format) {
+    int recreated;
+    unsigned char * pixels = mg_native_window_framebuffer(self, width, height, &recreated);
+    VALUE symbol;
+
+    /* Buffers over the old pixels must not outlive them */
+    if (recreated) { release_framebuffer(self); }
+
+    symbol = mg_native_window_pixel_format(self);
+    if (NIL_P(symbol)) {
+        rb_raise(rb_eRuntimeError, "window's pixels aren't 32 bits wide");
+    }
+
+    *format = mg_pixel_format_from_symbol(symbol);
+    return pixels;
+}
+
+VALUE mg_window_damage(int argc, VALUE * argv, VALUE self) {
+    VALUE x, y, w, h;
+
+    if (rb_scan_args(argc, argv, "04", &x, &y, &w, &h) == 0) {
+        mg_native_window_damage_all(self);
+        return self;
+    }
+
+    if (argc != 4) {
+        rb_raise(rb_eArgError, "wrong number of arguments (given %d, expected 0 or 4)", argc);
+    }
+
+    mg_native_window_damage(self, NUM2INT(x), NUM2INT(y), NUM2INT(w), NUM2INT(h));
+    return self;
+}
+
+VALUE mg_window_present(VALUE self, VALUE target_msc) {
+    uint64_t target = NIL_P(target_msc) ? 0 : NUM2ULL(target_msc);
+    return ULL2NUM(mg_native_window_present(self, target));
+}
+
+VALUE mg_window_present_feedback(VALUE self) {
+    mg_present_feedback feedback[MG_PRESENT_FEEDBACK_CAPACITY];
+    unsigned int count, i;
+    VALUE frames = rb_ary_new();
+
+    count = mg_native_window_present_feedback(self, feedback, MG_PRESENT_FEEDBACK_CAPACITY);
+
+    for (i = 0; i < count; ++i) {
+        VALUE hash = rb_hash_new();
+        rb_hash_aset(hash, ID2SYM(rb_intern("serial")), UINT2NUM(feedback[i].serial));
+        rb_hash_aset(hash, ID2SYM(rb_intern("ust")),    DBL2NUM(feedback[i].ust / 1e6));
+        rb_hash_aset(hash, ID2SYM(rb_intern("msc")),    ULL2NUM(feedback[i].msc));
+        rb_hash_aset(hash, ID2SYM(rb_intern("mode")),   present_mode_to_symbol(feedback[i].mode));
+        rb_ary_push(frames, hash);
+    }
+
+    return frames;
+}
+
+VALUE mg_window_wait_msc(int argc, VALUE * argv, VALUE self) {
+    mg_present_feedback reached;
+    VALUE target_msc, hash = rb_hash_new();
+
+    rb_scan_args(argc, argv, "01", &target_msc);
+    mg_native_window_wait_msc(self, NIL_P(target_msc) ? 0 : NUM2ULL(target_msc), &reached);
+
+    rb_hash_aset(hash, ID2SYM(rb_intern("ust")), DBL2NUM(reached.ust / 1e6));
+    rb_hash_aset(hash, ID2SYM(rb_intern("msc")), ULL2NUM(reached.msc));
+    return hash;
+}
+
+VALUE mg_window_buffer_age(VALUE self) {
+    return INT2FIX(mg_native_window_buffer_age(self));
+}
+
+VALUE mg_window_present_stats(VALUE self) {
+    mg_present_stats stats = mg_native_window_present_stats(self);
+    VALUE hash = rb_hash_new();
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")),         ULL2NUM(stats.frames));
+    rb_hash_aset(hash, ID2SYM(rb_intern("partial_frames")), ULL2NUM(stats.partial_frames));
+    rb_hash_aset(hash, ID2SYM(rb_intern("bytes")),          ULL2NUM(stats.bytes));
+    rb_hash_aset(hash, ID2SYM(rb_intern("last_bytes")),     ULL2NUM(stats.last_bytes));
+    return hash;
+}
+
+VALUE mg_window_swap_buffers(VALUE self, VALUE target_msc) {
+    mg_native_window_swap_buffers(self, NIL_P(target_msc) ? 0 : NUM2ULL(target_msc));
+    return Qnil;
+}
+
+VALUE mg_window_start_capture(VALUE self, VALUE target, VALUE format, VALUE pixel_format,
+                              VALUE rate, VALUE buffers, VALUE queue) {
+    mg_capture_options options = { 0 };
+    ID id;
+
+    Check_Type(format,  T_SYMBOL);
+    Check_Type(rate,    T_FIXNUM);
+    Check_Type(buffers, T_FIXNUM);
+    Check_Type(queue,   T_FIXNUM);
+
+    id = SYM2ID(format);
+    if (id == rb_intern("y4m")) {
+        options.format = MG_CAPTURE_Y4M;
+    } else if (id == rb_intern("raw")) {
+        options.format = MG_CAPTURE_RAW;
+    } else if (id == rb_intern("png")) {
+        options.format = MG_CAPTURE_PNG;
+    } else {
+        rb_raise(rb_eArgError, "unsupported capture format");
+    }
+
+    if (FIX2INT(rate) < 1 || FIX2INT(buffers) < 1 || FIX2INT(queue) < 1) {
+        rb_raise(rb_eArgError, "rate, buffers and queue must be positive");
+    }
+
+    if (RB_TYPE_P(target, T_STRING)) {
+        if (options.format != MG_CAPTURE_PNG) {
+            rb_raise(rb_eArgError, "only PNG frames can be captured into a directory");
+        }
+        options.directory = StringValueCStr(target);
+    } else {
+        Check_Type(target, T_FIXNUM);
+        options.fd = FIX2INT(target);
+    }
+
+    options.pixel_format = mg_pixel_format_from_symbol(pixel_format);
+    options.rate = FIX2UINT(rate);
+    options.buffers = FIX2UINT(buffers);
+    options.queue = FIX2UINT(queue);
+
+    mg_native_window_start_capture(self, &options);
+    return self;
+}
+
+VALUE mg_window_stop_capture(VALUE self) {
+    mg_capture_stats stats;
+
+    if (!mg_native_window_stop_capture(self, &stats)) { return Qnil; }
+
+    if (stats.error) {
+        rb_syserr_fail(stats.error, "could not write captured frames");
+    }
+
+    return capture_stats_to_hash(stats);
+}
+
+VALUE mg_window_capture_stats(VALUE self) {
+    mg_capture_stats stats;
+    return mg_native_window_capture_stats(self, &stats) ? capture_stats_to_hash(stats) : Qnil;
+}
+
+VALUE mg_window_capturing(VALUE self) {
+    mg_capture_stats stats;
+    return mg_native_window_capture_stats(self, &stats) ? Qtrue : Qfalse;
+}
+
+VALUE mg_window_create_stream_buffer(VALUE self, VALUE size, VALUE frames) {
+    if (NUM2LL(size) <= 0 || NUM2INT(frames) <= 0) {
+        rb_raise(rb_eArgError, "size and frames must be positive");
+    }
+
+    mg_native_window_create_stream_buffer(self, NUM2SIZET(size), NUM2UINT(frames));
+    return self;
+}
+
+VALUE mg_window_stream_write(VALUE self, VALUE data, VALUE alignment) {
+    mg_stream_buffer * stream = mg_native_window_stream_buffer(self);
+    const void * bytes;
+    size_t size, align, offset;
+    void * destination;
+
+    if (SYMBOL_P(alignment) && SYM2ID(alignment) == rb_intern("uniform")) {
+        align = mg_stream_buffer_uniform_alignment(stream);
+    } else {
+        align = NUM2SIZET(alignment);
+        if (align == 0 || (align & (align - 1)) != 0) {
+            rb_raise(rb_eArgError, "alignment must be a power of two");
+        }
+    }
+
+#if defined(HAVE_RUBY_IO_BUFFER_H)
+    if (rb_obj_is_kind_of(data, rb_cIOBuffer)) {
+        rb_io_buffer_get_bytes_for_reading(data, &bytes, &size);
+    } else
+#endif
+    {
+        StringValue(data);
+        bytes = RSTRING_PTR(data);
+        size = RSTRING_LEN(data);
+    }
+
+    destination = mg_stream_buffer_allocate(stream, size, align, &offset);
+    if (destination == 0) {
+        rb_raise(rb_eRuntimeError, "stream buffer region is full for this frame");
+    }
+
+    memcpy(destination, bytes, size);
+    mg_stream_buffer_flush(stream);
+    return SIZET2NUM(offset);
+}
+
+VALUE mg_window_stream_buffer(VALUE self) {
+    return UINT2NUM(mg_stream_buffer_name(mg_native_window_stream_buffer(self)));
+}
+
+VALUE mg_window_stream_stats(VALUE self) {
+    mg_stream_buffer_stats stats;
+    return mg_native_window_stream_stats(self, &stats) ? stream_stats_to_hash(stats) : Qnil;
+}
+
+VALUE mg_window_gl_stats(VALUE self) {
+    mg_gl_state_stats stats;
+    VALUE hash;
+
+    if (!mg_native_window_gl_state_stats(self, &stats)) { return Qnil; }
+
+    hash = rb_hash_new();
+    rb_hash_aset(hash, ID2SYM(rb_intern("made")),    ULL2NUM(stats.made));
+    rb_hash_aset(hash, ID2SYM(rb_intern("skipped")), ULL2NUM(stats.skipped));
+    return hash;
+}
+
+VALUE mg_window_xid(VALUE self) {
+    return ULONG2NUM(mg_native_window_xid(self));
+}
+
+VALUE mg_window_invalidate_gl_state(VALUE self) {
+    mg_native_window_invalidate_gl_state(self);
+    return self;
+}
+
+VALUE mg_window_define_cursor(VALUE self, VALUE image, VALUE x, VALUE y) {
+    mg_image * pixels;
+    unsigned int hot_x, hot_y;
+
+    if (NIL_P(image)) {
+        mg_native_window_reset_cursor(self);
+        return self;
+    }
+
+    if (!rb_obj_is_kind_of(image, mg_image_class)) {
+        rb_raise(rb_eTypeError, "cursor must be a Mg::Image");
+    }
+
+    pixels = mg_image_from(image);
+    hot_x = NUM2UINT(x);
+    hot_y = NUM2UINT(y);
+
+    if (pixels->width == 0 || pixels->height == 0) {
+        rb_raise(rb_eArgError, "cursor image is empty");
+    }
+    if (hot_x >= pixels->width || hot_y >= pixels->height) {
+        rb_raise(rb_eArgError, "hotspot must be inside the cursor image");
+    }
+
+    mg_native_window_set_cursor(self, pixels->pixels, pixels->format,
+                                pixels->width, pixels->height, hot_x, hot_y);
+    RB_GC_GUARD(image);
+    return self;
+}
+
+VALUE mg_window_write_clipboard(VALUE self, VALUE selection, VALUE types, VALUE data) {
+    const char * names[MG_WINDOW_CLIPBOARD_TYPES];
+    int primary = is_primary_selection(selection);
+    VALUE copies;
+    long i, count;
+
+    Check_Type(types, T_ARRAY);
+    count = RARRAY_LEN(types);
+
+    if (count < 1 || count > MG_WINDOW_CLIPBOARD_TYPES) {
+        rb_raise(rb_eArgError, "between 1 and %d types must be offered", MG_WINDOW_CLIPBOARD_TYPES);
+    }
+
+    /* Nothing may change the names and bytes while they're used without the GVL */
+    copies = rb_ary_new_capa(count);
+    for (i = 0; i < count; ++i) {
+        VALUE type = RARRAY_AREF(types, i);
+        type = rb_str_new_cstr(StringValueCStr(type));
+        rb_ary_push(copies, type);
+        names[i] = RSTRING_PTR(type);
+    }
+    data = rb_str_new_frozen(StringValue(data));
+
+    mg_native_window_set_clipboard(self, primary, names, (int) count,
+                                   RSTRING_PTR(data), RSTRING_LEN(data));
+    RB_GC_GUARD(data);
+    RB_GC_GUARD(copies);
+    return self;
+}
+
+VALUE mg_window_read_clipboard(VALUE self, VALUE selection, VALUE type, VALUE fd, VALUE text,
+                               VALUE timeout) {
+    int primary = is_primary_selection(selection);
+    VALUE future;
+
+    type = rb_str_new_cstr(StringValueCStr(type));
+    future = mg_native_window_get_clipboard(self, primary, RSTRING_PTR(type),
+                                            NIL_P(fd) ? -1 : NUM2INT(fd), RTEST(text),
+                                            NUM2UINT(timeout));
+    RB_GC_GUARD(type);
+    return future;
+}
+
+VALUE mg_window_clipboard_stats(VALUE self) {
+    mg_clipboard_stats stats;
+    VALUE hash = rb_hash_new();
+
+    mg_native_window_clipboard_stats(self, &stats);
+
+    rb_hash_aset(hash, ID2SYM(rb_intern("sent")),     ULL2NUM(stats.sent));
+    rb_hash_aset(hash, ID2SYM(rb_intern("received")), ULL2NUM(stats.received));
+    rb_hash_aset(hash, ID2SYM(rb_intern("chunks")),   ULL2NUM(stats.chunks));
+    rb_hash_aset(hash, ID2SYM(rb_intern("refused")),  ULL2NUM(stats.refused));
+    return hash;
+}
+
 void init_mg_window_class_under(VALUE module) {
     /* Initialize the native windowing system */
     mg_native_window_system_init();
 
+    start_event_threads = rb_ractor_local_storage_value_newkey();
+
     /* Define Mg::Window class */
     mg_window_class = rb_define_class_under(module, "Window", rb_cObject);
 
@@ -161,6 +638,12 @@ void init_mg_window_class_under(VALUE module) {
     def_mg_window_method("height",             mg_window_h,                  0);
     def_mg_window_method("title",              mg_window_title,              0);
     def_mg_window_method("visible?",           mg_window_visible,            0);
+    def_mg_window_method("pixel_format",       mg_window_pixel_format,       0);
+    def_mg_window_method("key_down?",          mg_window_key_down,           1);
+    def_mg_window_method("button_down?",       mg_window_button_down,        1);
+    def_mg_window_method("pointer_position",   mg_window_pointer_position,   0);
+    def_mg_window_method("pointer_delta",      mg_window_pointer_delta,      0);
+    def_mg_window_method("raw_pointer?",       mg_window_raw_pointer,        0);
     def_mg_window_method("x=",                 mg_window_set_x,              1);
     def_mg_window_method("y=",                 mg_window_set_y,              1);
     def_mg_window_method("width=",             mg_window_set_w,              1);
@@ -170,6 +653,44 @@ void init_mg_window_class_under(VALUE module) {
     def_mg_window_method("fullscreen=",        mg_window_set_fullscreen,     1);
     def_mg_window_method("start_event_thread", mg_window_start_event_thread, 0);
     def_mg_window_method("stop_event_thread",  mg_window_stop_event_thread,  0);
+    def_mg_window_method("close",              mg_window_close,              0);
+    def_mg_window_method("closed?",            mg_window_closed,             0);
+    def_mg_window_method("framebuffer",        mg_window_framebuffer,        0);
+    def_mg_window_method("damage",             mg_window_damage,            -1);
+    def_mg_window_method("present_feedback",   mg_window_present_feedback,   0);
+    def_mg_window_method("wait_msc",           mg_window_wait_msc,          -1);
+    def_mg_window_method("buffer_age",         mg_window_buffer_age,         0);
+    def_mg_window_method("present_stats",      mg_window_present_stats,      0);
+    def_mg_window_method("stop_capture",       mg_window_stop_capture,       0);
+    def_mg_window_method("capture_stats",      mg_window_capture_stats,      0);
+    def_mg_window_method("capturing?",         mg_window_capturing,          0);
+    def_mg_window_method("stream_buffer",      mg_window_stream_buffer,      0);
+    def_mg_window_method("stream_stats",       mg_window_stream_stats,       0);
+    def_mg_window_method("gl_stats",           mg_window_gl_stats,           0);
+    def_mg_window_method("invalidate_gl_state", mg_window_invalidate_gl_state, 0);
+    def_mg_window_method("xid",                mg_window_xid,                0);
+    def_mg_window_method("clipboard_stats",    mg_window_clipboard_stats,    0);
+
+    /* Define the private methods wrapped by the Ruby library */
+    rb_define_private_method(mg_window_class, "start_capture_to", mg_window_start_capture, 6);
+    rb_define_private_method(mg_window_class, "present_frame",    mg_window_present,       1);
+    rb_define_private_method(mg_window_class, "swap_frame",       mg_window_swap_buffers,  1);
+    rb_define_private_method(mg_window_class, "setup_stream_buffer", mg_window_create_stream_buffer, 2);
+    rb_define_private_method(mg_window_class, "write_stream",        mg_window_stream_write,         2);
+    rb_define_private_method(mg_window_class, "define_cursor",       mg_window_define_cursor,        3);
+    rb_define_private_method(mg_window_class, "write_clipboard",     mg_window_write_clipboard,      3);
+    rb_define_private_method(mg_window_class, "read_clipboard",      mg_window_read_clipboard,       5);
+
+    /* Define the class methods */
+    rb_define_singleton_method(mg_window_class, "pool_size=",     mg_window_set_pool_size,     1);
+    rb_define_singleton_method(mg_window_class, "pool_size",      mg_window_pool_size,         0);
+    rb_define_singleton_method(mg_window_class, "pooled",         mg_window_pooled,            0);
+    rb_define_singleton_method(mg_window_class, "event_threads=", mg_window_set_event_threads, 1);
+    rb_define_singleton_method(mg_window_class, "event_threads?", mg_window_event_threads,     0);
+
+    /* Define the module functions for driving windows from another loop */
+    rb_define_singleton_method(module, "display_fd",       mg_window_display_fd,       0);
+    rb_define_singleton_method(module, "dispatch_pending", mg_window_dispatch_pending, 0);
 
     /* Define aliases */
     def_mg_window_alias("name", "title");
@@ -188,3 +709,58 @@ static void def_mg_window_method(const char * name, VALUE (*func)(), int argc) {
 static void def_mg_window_alias(const char * alias, const char * old) {
     rb_define_alias(mg_window_class, alias, old);
 }
+
+static void release_framebuffer(VALUE self) {
+#if defined(HAVE_RUBY_IO_BUFFER_H)
+    VALUE buffer = rb_iv_get(self, framebuffer_ivar);
+    if (!NIL_P(buffer)) {
+        rb_io_buffer_free(buffer);
+        rb_iv_set(self, framebuffer_ivar, Qnil);
+    }
+#endif
+}
+
+static VALUE capture_stats_to_hash(mg_capture_stats stats) {
+    VALUE hash = rb_hash_new();
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")),  ULL2NUM(stats.frames));
+    rb_hash_aset(hash, ID2SYM(rb_intern("written")), ULL2NUM(stats.written));
+    rb_hash_aset(hash, ID2SYM(rb_intern("dropped")), ULL2NUM(stats.dropped));
+    rb_hash_aset(hash, ID2SYM(rb_intern("bytes")),   ULL2NUM(stats.bytes));
+    rb_hash_aset(hash, ID2SYM(rb_intern("pending")), UINT2NUM(stats.pending));
+    return hash;
+}
+
+static VALUE stream_stats_to_hash(mg_stream_buffer_stats stats) {
+    VALUE hash = rb_hash_new();
+    rb_hash_aset(hash, ID2SYM(rb_intern("persistent")),       stats.persistent ? Qtrue : Qfalse);
+    rb_hash_aset(hash, ID2SYM(rb_intern("size")),             SIZET2NUM(stats.size));
+    rb_hash_aset(hash, ID2SYM(rb_intern("frames")),           UINT2NUM(stats.frames));
+    rb_hash_aset(hash, ID2SYM(rb_intern("bytes")),            ULL2NUM(stats.bytes));
+    rb_hash_aset(hash, ID2SYM(rb_intern("frame_bytes")),      SIZET2NUM(stats.frame_bytes));
+    rb_hash_aset(hash, ID2SYM(rb_intern("peak_frame_bytes")), SIZET2NUM(stats.peak_frame_bytes));
+    rb_hash_aset(hash, ID2SYM(rb_intern("overflows")),        ULL2NUM(stats.overflows));
+    rb_hash_aset(hash, ID2SYM(rb_intern("waits")),            ULL2NUM(stats.waits));
+    rb_hash_aset(hash, ID2SYM(rb_intern("wait_time")),        DBL2NUM(stats.wait_time / 1e9));
+    return hash;
+}
+
+static int is_primary_selection(VALUE selection) {
+    ID id;
+
+    Check_Type(selection, T_SYMBOL);
+    id = SYM2ID(selection);
+
+    if (id == rb_intern("primary")) { return 1; }
+    if (id == rb_intern("clipboard")) { return 0; }
+
+    rb_raise(rb_eArgError, "unsupported selection: %"PRIsVALUE, rb_inspect(selection));
+}
+
+static VALUE present_mode_to_symbol(mg_present_mode mode) {
+    switch (mode) {
+    case MG_PRESENT_MODE_FLIP:            return ID2SYM(rb_intern("flip"));
+    case MG_PRESENT_MODE_SKIP:            return ID2SYM(rb_intern("skip"));
+    case MG_PRESENT_MODE_SUBOPTIMAL_COPY: return ID2SYM(rb_intern("suboptimal_copy"));
+    default:                              return ID2SYM(rb_intern("copy"));
+    }
+}
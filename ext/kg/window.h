@@ -1,12 +1,14 @@
 #ifndef MG_WINDOW_H
 #define MG_WINDOW_H
 
+#include "pixel_format.h"
+
 #include <ruby.h>
 
 /**
  * Mg::Window class.
  */
-VALUE mg_window_class;
+extern VALUE mg_window_class;
 
 /**
  * Allocates memory for the native window.
@@ -48,6 +50,82 @@ extern VALUE mg_window_title(VALUE self);
  */
 extern VALUE mg_window_visible(VALUE self);
 
+/**
+ * Returns the layout of the window's pixels as a pixel format symbol, suitable
+ * for decoding images into.
+ */
+extern VALUE mg_window_pixel_format(VALUE self);
+
+/**
+ * Returns whether the key identified by the symbol is being held down.
+ */
+extern VALUE mg_window_key_down(VALUE self, VALUE key);
+
+/**
+ * Returns whether the mouse button is being held down. Buttons are identified
+ * by number or as :left, :middle or :right.
+ */
+extern VALUE mg_window_button_down(VALUE self, VALUE button);
+
+/**
+ * Returns the position of the pointer within the window as [x, y]. Positions
+ * have subpixel precision when XInput2 is available.
+ */
+extern VALUE mg_window_pointer_position(VALUE self);
+
+/**
+ * Returns the pointer motion accumulated since the last call as [dx, dy] and
+ * resets it. Meant to be read once per frame.
+ */
+extern VALUE mg_window_pointer_delta(VALUE self);
+
+/**
+ * Returns whether pointer motion is unaccelerated raw input from XInput2.
+ */
+extern VALUE mg_window_raw_pointer(VALUE self);
+
+/**
+ * Returns the file descriptor of the display connection shared by all
+ * windows, for waiting on it with IO.select or a Fiber scheduler.
+ */
+extern VALUE mg_window_display_fd(VALUE module);
+
+/**
+ * Handles the pending events of every window that has no event thread,
+ * calling its handlers, without blocking. Returns the number of events
+ * handled.
+ */
+extern VALUE mg_window_dispatch_pending(VALUE module);
+
+/**
+ * Sets whether new windows start an event thread. Applications that call
+ * Mg.dispatch_pending themselves turn them off. The setting is kept per
+ * Ractor.
+ */
+extern VALUE mg_window_set_event_threads(VALUE klass, VALUE enabled);
+
+/**
+ * Returns whether new windows created by the current Ractor start an event
+ * thread.
+ */
+extern VALUE mg_window_event_threads(VALUE klass);
+
+/**
+ * Sets the number of windows created ahead of time, in the background, so
+ * that new windows can be shown without waiting for the X server.
+ */
+extern VALUE mg_window_set_pool_size(VALUE klass, VALUE size);
+
+/**
+ * Returns the number of windows created ahead of time.
+ */
+extern VALUE mg_window_pool_size(VALUE klass);
+
+/**
+ * Returns the number of windows ready to be handed out.
+ */
+extern VALUE mg_window_pooled(VALUE klass);
+
 /**
  * Sets the X coordinate of the window.
  */
@@ -108,6 +186,196 @@ extern VALUE mg_window_start_event_thread(VALUE self);
  */
 VALUE mg_window_stop_event_thread(VALUE self);
 
+/**
+ * Stops the event thread and destroys the window. The window can't be used
+ * afterwards. May be called from an event handler.
+ */
+extern VALUE mg_window_close(VALUE self);
+
+/**
+ * Returns whether the window was closed.
+ */
+extern VALUE mg_window_closed(VALUE self);
+
+/**
+ * Returns the pixels drawn by the CPU as an IO::Buffer, creating them or
+ * resizing them to match the window. The buffer is freed when the pixels
+ * move, so call this again each frame. Pixels are in the window's pixel
+ * format, tightly packed, top row first.
+ */
+extern VALUE mg_window_framebuffer(VALUE self);
+
+/**
+ * Returns the framebuffer pixels for native code to draw into, creating them
+ * or resizing them to match the window, and stores their size and format.
+ * IO::Buffers over pixels that moved are freed. Raises a Ruby exception if
+ * the window's pixels aren't 32 bits wide.
+ */
+extern unsigned char * mg_window_pixels(VALUE self, unsigned int * width, unsigned int * height,
+                                        mg_pixel_format * format);
+
+/**
+ * Marks the rectangle at x, y with the given width and height as changed
+ * since the last frame was presented, or the whole window when called
+ * without arguments.
+ */
+extern VALUE mg_window_damage(int argc, VALUE * argv, VALUE self);
+
+/**
+ * Pushes the damaged parts of the framebuffer to the window WITHOUT the GVL,
+ * or all of it if nothing was marked, and returns the number of bytes pushed.
+ * Unless target_msc is nil, the frame waits for that vertical retrace.
+ * Wrapped by Mg::Window#present.
+ */
+extern VALUE mg_window_present(VALUE self, VALUE target_msc);
+
+/**
+ * Returns the frames completed since the last call in an Array of Hashes,
+ * oldest first: serial, ust, the time the frame was shown in seconds of the
+ * monotonic clock, msc, the vertical retrace count then, and mode, one of
+ * :copy, :flip, :skip and :suboptimal_copy. Frames are only reported through
+ * the Present extension.
+ */
+extern VALUE mg_window_present_feedback(VALUE self);
+
+/**
+ * Waits WITHOUT the GVL until the vertical retrace count reaches the target,
+ * or for the next retrace if none is given, and returns the time and count
+ * reached in a Hash with ust and msc.
+ */
+extern VALUE mg_window_wait_msc(int argc, VALUE * argv, VALUE self);
+
+/**
+ * Returns how many frames ago the back buffer's contents were presented, so
+ * that only what changed since then has to be drawn again. Returns zero if
+ * they're unknown and everything must be drawn.
+ */
+extern VALUE mg_window_buffer_age(VALUE self);
+
+/**
+ * Returns the counters of frames presented in a Hash: frames, partial frames,
+ * and bytes presented in total and in the last frame.
+ */
+extern VALUE mg_window_present_stats(VALUE self);
+
+/**
+ * Presents the frame WITHOUT the GVL. If the window is being captured, the
+ * frame is read back first. If only part of the window was damaged and GLX
+ * can present part of the back buffer, only that part is; otherwise the
+ * buffers are swapped. Unless target_msc is nil, the frame waits for that
+ * vertical retrace. Wrapped by Mg::Window#swap_buffers.
+ */
+extern VALUE mg_window_swap_buffers(VALUE self, VALUE target_msc);
+
+/**
+ * Starts capturing every frame swapped. The target is a file descriptor, or
+ * for PNG a directory the frames are written into. The format is :y4m, :raw
+ * or :png; raw frames use the given pixel format. The window's context must
+ * be current on the calling thread.
+ */
+extern VALUE mg_window_start_capture(VALUE self, VALUE target, VALUE format, VALUE pixel_format,
+                                     VALUE rate, VALUE buffers, VALUE queue);
+
+/**
+ * Stops capturing, waiting WITHOUT the GVL for the frames still in flight to
+ * be written, and returns the final counters in a Hash. Returns nil if the
+ * window wasn't being captured. Raises a SystemCallError if a write failed.
+ */
+extern VALUE mg_window_stop_capture(VALUE self);
+
+/**
+ * Returns the counters of the running capture in a Hash, nil if the window
+ * isn't being captured.
+ */
+extern VALUE mg_window_capture_stats(VALUE self);
+
+/**
+ * Returns whether the window is being captured.
+ */
+extern VALUE mg_window_capturing(VALUE self);
+
+/**
+ * Creates the buffer per-frame vertex and uniform data is streamed through in
+ * the window's context, size bytes split into one region per frame in
+ * flight. Wrapped by Mg::Window#create_stream_buffer.
+ */
+extern VALUE mg_window_create_stream_buffer(VALUE self, VALUE size, VALUE frames);
+
+/**
+ * Copies the String or IO::Buffer into the current frame's region of the
+ * stream buffer and returns its offset in the buffer. The alignment is a
+ * power of two or :uniform. Raises a RuntimeError if the region is full.
+ * Wrapped by Mg::Window#stream_write.
+ */
+extern VALUE mg_window_stream_write(VALUE self, VALUE data, VALUE alignment);
+
+/**
+ * Returns the name of the stream buffer's GL buffer object.
+ */
+extern VALUE mg_window_stream_buffer(VALUE self);
+
+/**
+ * Returns the counters of the stream buffer in a Hash, nil if there is none.
+ */
+extern VALUE mg_window_stream_stats(VALUE self);
+
+/**
+ * Returns the numbers of GL state changes made and skipped as redundant by
+ * Mg's renderer in a Hash, nil if the window has no state cache.
+ */
+extern VALUE mg_window_gl_stats(VALUE self);
+
+/**
+ * Forgets the GL state cached for the window's context. Call it after
+ * changing textures, programs, blending or capabilities with raw GL calls
+ * between Mg's own drawing.
+ */
+extern VALUE mg_window_invalidate_gl_state(VALUE self);
+
+/**
+ * Returns the identifier of the window on the display server, for tools
+ * such as Mg::ScreenCapture.
+ */
+extern VALUE mg_window_xid(VALUE self);
+
+/**
+ * Shows the Mg::Image as the mouse pointer over the window, with the hotspot
+ * at x, y. The display server draws the pointer, so it moves independently
+ * of the frame rate. Cursors are cached by contents, so an animation may set
+ * its frames over and over. A nil image restores the default pointer.
+ * Wrapped by Mg::Window#set_cursor.
+ */
+extern VALUE mg_window_define_cursor(VALUE self, VALUE image, VALUE x, VALUE y);
+
+/**
+ * Largest number of types the clipboard contents can be offered as.
+ */
+#define MG_WINDOW_CLIPBOARD_TYPES 16
+
+/**
+ * Puts a copy of the String on the :clipboard or :primary selection, offered
+ * as each of the type names in the Array. Other clients' requests are
+ * answered by the event loop, streaming large contents in chunks. Wrapped by
+ * Mg::Window#set_clipboard.
+ */
+extern VALUE mg_window_write_clipboard(VALUE self, VALUE selection, VALUE types, VALUE data);
+
+/**
+ * Asks for the :clipboard or :primary selection as the named type and returns
+ * a Mg::Future of its contents, which the event loop streams in without
+ * blocking. With a file descriptor, the contents are written to it as they
+ * arrive. The future is rejected if the owner stays silent for timeout
+ * milliseconds. Wrapped by Mg::Window#get_clipboard.
+ */
+extern VALUE mg_window_read_clipboard(VALUE self, VALUE selection, VALUE type, VALUE fd, VALUE text,
+                                      VALUE timeout);
+
+/**
+ * Returns the numbers of bytes sent and received through the clipboard, of
+ * incremental chunks and of refused requests in a Hash.
+ */
+extern VALUE mg_window_clipboard_stats(VALUE self);
+
 /**
  * Ruby Window class initialization.
  */
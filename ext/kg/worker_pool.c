@@ -0,0 +1,128 @@
+#include "worker_pool.h"
+
+#include <stdlib.h>
+
+#include <pthread.h>
+#include <unistd.h>
+
+/* Data structures */
+
+typedef struct job_struct {
+    mg_worker_pool_job function;
+    void * data;
+    struct job_struct * next;
+} job_t;
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t available;
+    job_t * head;
+    job_t * tail;
+    unsigned int size;
+    int started;
+} pool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0, 0, 0, 0 };
+
+/* Helper function prototypes */
+
+/**
+ * Starts the worker threads. Must be called with the pool lock held.
+ */
+static int start_workers(void);
+
+/**
+ * Worker thread body. Runs queued jobs forever.
+ */
+static void * work(void * unused);
+
+/* Worker pool interface implementation */
+
+int mg_worker_pool_submit(mg_worker_pool_job function, void * data) {
+    job_t * job = malloc(sizeof(job_t));
+
+    if (job == 0) { return 0; }
+
+    job->function = function;
+    job->data = data;
+    job->next = 0;
+
+    pthread_mutex_lock(&pool.lock);
+
+    /* Lazily start the workers */
+    if (!pool.started && !start_workers()) {
+        pthread_mutex_unlock(&pool.lock);
+        free(job);
+        return 0;
+    }
+
+    /* Append the job to the queue */
+    if (pool.tail) {
+        pool.tail->next = job;
+    } else {
+        pool.head = job;
+    }
+    pool.tail = job;
+
+    /* Wake up one idle worker */
+    pthread_cond_signal(&pool.available);
+    pthread_mutex_unlock(&pool.lock);
+
+    return 1;
+}
+
+unsigned int mg_worker_pool_size(void) {
+    unsigned int size;
+    pthread_mutex_lock(&pool.lock);
+    if (!pool.started) { start_workers(); }
+    size = pool.size;
+    pthread_mutex_unlock(&pool.lock);
+    return size;
+}
+
+/* Helper function implementation */
+
+static int start_workers(void) {
+    pthread_attr_t attributes;
+    pthread_t thread;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned int i;
+
+    if (cpus < 1) { cpus = 1; }
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+
+    for (i = 0; i < (unsigned int) cpus; ++i) {
+        if (pthread_create(&thread, &attributes, work, 0) != 0) { break; }
+    }
+
+    pthread_attr_destroy(&attributes);
+
+    pool.size = i;
+    pool.started = i > 0;
+    return pool.started;
+}
+
+static void * work(void * unused) {
+    job_t * job;
+
+    for (;;) {
+        pthread_mutex_lock(&pool.lock);
+
+        /* Sleep until there's something to do */
+        while (pool.head == 0) {
+            pthread_cond_wait(&pool.available, &pool.lock);
+        }
+
+        /* Dequeue the next job */
+        job = pool.head;
+        pool.head = job->next;
+        if (pool.head == 0) { pool.tail = 0; }
+
+        pthread_mutex_unlock(&pool.lock);
+
+        job->function(job->data);
+        free(job);
+    }
+
+    return 0;
+}
@@ -0,0 +1,24 @@
+#ifndef MG_WORKER_POOL_H
+#define MG_WORKER_POOL_H
+
+/**
+ * Function executed by a worker thread. Called WITHOUT the Ruby GVL, so it
+ * must not touch any Ruby object or call into the Ruby API.
+ */
+typedef void (*mg_worker_pool_job)(void * data);
+
+/**
+ * Queues the job for execution on the process-wide worker pool. The pool is
+ * started the first time a job is submitted and has one thread per online CPU.
+ *
+ * Returns a non-zero value if the job was queued, zero if the pool could not
+ * be started or memory could not be allocated.
+ */
+extern int mg_worker_pool_submit(mg_worker_pool_job job, void * data);
+
+/**
+ * Returns the number of threads in the worker pool.
+ */
+extern unsigned int mg_worker_pool_size(void);
+
+#endif /* MG_WORKER_POOL_H */
@@ -8,6 +8,21 @@ module Mg
     File.join Mg.root, 'lib'
   end
 
+  # The display connection shared by all windows, for waiting on with
+  # IO.select or under a Fiber scheduler. Xlib may read events ahead, so
+  # dispatch before every wait:
+  #
+  #   Mg::Window.event_threads = false
+  #   loop do
+  #     Mg.dispatch_pending
+  #     Mg.display_io.wait_readable
+  #   end
+  #
+  # Each Ractor gets an IO of its own, kept in Ractor-local storage.
+  def self.display_io
+    Ractor.current[:mg_display_io] ||= IO.for_fd display_fd, autoclose: false
+  end
+
 end
 
 # Require native extension
@@ -15,4 +30,13 @@ require File.join Mg.lib, 'mg', 'kg'
 
 # Require core library
 require File.join Mg.lib, 'mg', 'display_mode'
+require File.join Mg.lib, 'mg', 'image'
+require File.join Mg.lib, 'mg', 'asset_cache'
+require File.join Mg.lib, 'mg', 'audio'
+require File.join Mg.lib, 'mg', 'canvas'
+require File.join Mg.lib, 'mg', 'clock'
+require File.join Mg.lib, 'mg', 'font'
+require File.join Mg.lib, 'mg', 'offscreen'
+require File.join Mg.lib, 'mg', 'program_cache'
+require File.join Mg.lib, 'mg', 'screen_capture'
 require File.join Mg.lib, 'mg', 'window'
@@ -0,0 +1,26 @@
+class Mg::AssetCache
+
+  attr_reader :directory, :format, :compression
+
+  def initialize(directory, format: :bgra, mipmaps: false, compression: nil)
+    @directory, @format, @mipmaps, @compression = directory, format, mipmaps, compression
+    Dir.mkdir directory unless File.directory? directory
+  end
+
+  def mipmaps?
+    @mipmaps
+  end
+
+  def fetch(path)
+    self.class.fetch_entry directory, path, format, mipmaps?, compression
+  end
+
+  def fetch_async(path)
+    self.class.fetch_entry_async directory, path, format, mipmaps?, compression
+  end
+
+  def fetch_all(paths)
+    paths.map { |path| fetch_async path }.map!(&:value)
+  end
+
+end
@@ -0,0 +1,42 @@
+class Mg::Audio
+
+  attr_reader :sink, :rate, :period
+
+  def initialize(sink: :alsa, device: nil, path: nil, rate: 48000, period: 256, voices: 32, paced: true)
+    @sink, @rate, @period = sink, rate, period
+    start sink, (sink == :wav ? path : device), rate, period, voices, paced
+  end
+
+  def play(sound, gain: 1.0, pan: 0.0, rate: 1.0, loop: false)
+    if Stream === sound
+      play_stream sound, gain, pan
+    else
+      play_sound sound, gain, pan, rate, loop
+    end
+  end
+
+  def stream(path, buffers: 4, loop: false)
+    open_stream path, buffers, loop
+  end
+
+  def period_duration
+    period.fdiv rate
+  end
+
+  class Sound
+
+    def duration
+      frames.fdiv rate
+    end
+
+  end
+
+  class Stream
+
+    def duration
+      frames.fdiv rate
+    end
+
+  end
+
+end
@@ -0,0 +1,53 @@
+class Mg::Canvas
+
+  # Records 2D drawing commands for a window's framebuffer or an image. Nothing
+  # is drawn until #flush, which draws every command in native code, tile by
+  # tile, on all cores. Colors are integers in 0xRRGGBBAA form.
+  #
+  #   canvas = Mg::Canvas.new window
+  #   canvas.clear 0x202020FF
+  #   canvas.fill_rect 10, 10, 200, 100, 0x3366CC80
+  #   canvas.line 0, 0, 320, 240, 0xFFFFFFFF, width: 2
+  #   canvas.text font, 'Hello', 16, 16, 0xFFFFFFFF
+  #   canvas.flush
+  #   window.present
+  def initialize(target)
+    setup target
+  end
+
+  def stroke_rect(x, y, w, h, color, width: 1)
+    draw_stroke_rect x, y, w, h, color, width
+  end
+
+  def line(x0, y0, x1, y1, color, width: 1)
+    draw_line x0, y0, x1, y1, color, width
+  end
+
+  def stroke_circle(x, y, radius, color, width: 1)
+    draw_stroke_circle x, y, radius, color, width
+  end
+
+  def blit(image, x, y, alpha: 255)
+    draw_image image, x, y, alpha
+  end
+
+  # Restricts the commands that follow to the rectangle. Given a block, the
+  # previous clip rectangle is restored after it.
+  def clip(x, y, w, h)
+    previous, @clip = @clip, [x, y, w, h]
+    set_clip x, y, w, h
+    return self unless block_given?
+    begin
+      yield self
+    ensure
+      @clip = previous
+      previous ? set_clip(*previous) : reset_clip
+    end
+  end
+
+  def unclip
+    @clip = nil
+    reset_clip
+  end
+
+end
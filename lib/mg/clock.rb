@@ -0,0 +1,26 @@
+class Mg::Clock
+
+  attr_reader :tick_rate, :frame_rate
+
+  def initialize(tick_rate: 120, frame_rate: 60, max_ticks: 8)
+    @tick_rate, @frame_rate = tick_rate, frame_rate
+    setup tick_rate, frame_rate, max_ticks
+  end
+
+  def on_tick &block
+    @tick_handler = block
+  end
+
+  def on_frame &block
+    @frame_handler = block
+  end
+
+  def run(dispatch: !Mg::Window.event_threads?)
+    run_clock dispatch
+  end
+
+  def step
+    1.fdiv tick_rate
+  end
+
+end
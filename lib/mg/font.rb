@@ -0,0 +1,20 @@
+class Mg::Font
+
+  # Glyphs of a font at one size, rasterized once into an atlas texture.
+  # Layouts are cached per string, so text that doesn't change costs one draw
+  # call per frame and no layout work. Without a path, or without FreeType,
+  # the built-in 8x8 bitmap font is used, scaled by whole pixels. Drawing
+  # leaves GL state as it found it.
+  #
+  #   font = Mg::Font.new 'DejaVuSans.ttf', size: 18
+  #   glOrtho 0, width, height, 0, -1, 1
+  #   font.draw "Score: #{score}", 10, 10, 0xFFFFFFFF
+  def initialize(path = nil, size: 16)
+    setup path, size
+  end
+
+  def draw(text, x, y, color = 0xFFFFFFFF)
+    draw_text text, x, y, color
+  end
+
+end
@@ -0,0 +1,15 @@
+class Mg::Image
+
+  def self.load_all(paths, format = :bgra)
+    paths.map { |path| load_async path, format }.map!(&:value)
+  end
+
+  def size
+    [width, height]
+  end
+
+  def to_s
+    "#{width}x#{height} #{format}"
+  end
+
+end
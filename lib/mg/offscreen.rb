@@ -0,0 +1,17 @@
+# Renders without a display server. GL calls made on the thread that created
+# the target, or after make_current, draw into it.
+#
+#   target = Mg::Offscreen.new 640, 480
+#   frames.each do |frame|
+#     draw frame
+#     image = target.capture
+#     save image if image
+#   end
+#   target.drain.each { |image| save image }
+class Mg::Offscreen
+
+  def initialize(width, height, buffers: 3, format: :bgra)
+    setup width, height, buffers, format
+  end
+
+end
@@ -0,0 +1,32 @@
+require 'fileutils'
+
+class Mg::ProgramCache
+
+  # Builds GL programs in the current context, keeping their binaries on disk
+  # so later runs skip compiling. Binaries are keyed by the sources and the
+  # driver; a driver update recompiles once. Pass nil to keep nothing.
+  #
+  # Start every build before using any program, so the driver compiles them
+  # all at once instead of one at a time:
+  #
+  #   cache = Mg::ProgramCache.new
+  #   sky, mesh = cache.build_all [[sky_vs, sky_fs], [mesh_vs, mesh_fs]]
+  #   glUseProgram mesh.name  # raises with the compiler's log if it failed
+  def self.default_directory
+    File.join ENV.fetch('XDG_CACHE_HOME') { File.join Dir.home, '.cache' }, 'mg', 'programs'
+  end
+
+  attr_reader :directory
+
+  def initialize(directory = self.class.default_directory)
+    @directory = directory
+    FileUtils.mkdir_p directory if directory
+    setup directory
+  end
+
+  # Starts every build, then waits for all of them.
+  def build_all(sources)
+    sources.map { |vertex, fragment| build vertex, fragment }.each(&:linked?)
+  end
+
+end
@@ -0,0 +1,19 @@
+# Samples the screen, or a window, at video rates. The display server writes
+# each frame straight into memory shared with Mg, and frames come out as
+# read only IO::Buffer views of it, BGRA with undefined alpha. With damage,
+# frames where nothing changed are skipped and #capture returns nil.
+#
+#   capture = Mg::ScreenCapture.new
+#   loop do
+#     frame = capture.capture
+#     encode frame if frame  # valid until buffers more frames are captured
+#     sleep 1.0 / 60
+#   end
+class Mg::ScreenCapture
+
+  def initialize(window = nil, x: 0, y: 0, width: nil, height: nil, buffers: 2, damage: true)
+    window = window.xid if window.respond_to? :xid
+    setup window, x, y, width, height, buffers, damage
+  end
+
+end
@@ -12,6 +12,111 @@ class Mg::Window
     self.visible = false
   end
 
+  # Presents the OpenGL frame. With target_msc, the frame waits for that
+  # vertical retrace count; see #wait_msc and #present_feedback.
+  def swap_buffers(target_msc: nil)
+    swap_frame target_msc
+  end
+
+  # Pushes the damaged parts of the framebuffer to the window, at the vertical
+  # retrace target_msc if given. Returns the number of bytes pushed.
+  #
+  #   now = window.wait_msc
+  #   window.present target_msc: now[:msc] + 2
+  #   window.present_feedback  # => [{ serial: ..., ust: ..., msc: ..., mode: :flip }]
+  def present(target_msc: nil)
+    present_frame target_msc
+  end
+
+  # Records every frame swapped from now on, without stalling rendering. The
+  # target is an IO or a file name; PNG frames may also go into a directory.
+  # Frames the GPU or encoders can't keep up with are dropped and counted.
+  #
+  #   window.start_capture IO.popen(%w(ffmpeg -i - out.mp4), 'w')
+  #   loop { draw; window.swap_buffers }
+  #   window.stop_capture  # => { frames: 600, written: 598, dropped: 2, ... }
+  def start_capture(target, format: :y4m, rate: 60, pixel_format: :bgra, buffers: 3, queue: 8)
+    options = [format, pixel_format, rate, buffers, queue]
+    if target.is_a?(String) && File.directory?(target)
+      start_capture_to target, *options
+    elsif target.is_a?(String)
+      File.open(target, 'wb') { |file| start_capture_to file.fileno, *options }
+    else
+      target.flush
+      start_capture_to target.fileno, *options
+    end
+  end
+
+  # Creates a buffer for vertex and uniform data that changes every frame,
+  # split into one region per frame in flight. Data written during a frame
+  # stays valid until the GPU is done with it; no allocation happens per frame.
+  #
+  #   window.create_stream_buffer size: 8 << 20
+  #   offset = window.stream_write vertices.pack('f*')
+  #   glBindBuffer GL_ARRAY_BUFFER, window.stream_buffer
+  #   glVertexPointer 2, GL_FLOAT, 0, offset
+  def create_stream_buffer(size: 4 << 20, frames: 3)
+    setup_stream_buffer size, frames
+  end
+
+  # Copies a String or IO::Buffer into the current frame's region and returns
+  # its offset in #stream_buffer. Use alignment: :uniform for uniform blocks.
+  def stream_write(data, alignment: 4)
+    write_stream data, alignment
+  end
+
+  # Shows a Mg::Image as the mouse pointer over the window, with the hotspot at
+  # the given pixel. The X server draws and moves it, so it keeps up with the
+  # mouse however slowly frames are rendered. Images are cached by contents;
+  # setting animation frames repeatedly creates nothing new. nil restores the
+  # default pointer.
+  #
+  #   window.set_cursor Mg::Image.load('crosshair.png'), hotspot: [15, 15]
+  def set_cursor(image, hotspot: [0, 0])
+    define_cursor image, *hotspot
+  end
+
+  def cursor=(image)
+    set_cursor image
+  end
+
+  # Type names text is offered as and asked for.
+  TEXT_TYPES = Ractor.make_shareable %w(UTF8_STRING text/plain;charset=utf-8)
+
+  # Puts a copy of data on the clipboard, or the primary selection, offered as
+  # the given type names; :text stands for the usual text types. The event
+  # loop answers other clients, streaming large contents in chunks.
+  #
+  #   window.set_clipboard File.binread('shot.png'), type: 'image/png'
+  def set_clipboard(data, type: :text, selection: :clipboard)
+    types = Array(type).flat_map { |name| name == :text ? TEXT_TYPES : name.to_s }
+    write_clipboard selection, types.uniq, data
+  end
+
+  def clipboard=(text)
+    set_clipboard text
+  end
+
+  # Asks for the clipboard, or the primary selection, as the given type and
+  # returns a Mg::Future of its contents: a String, or nil if there is nothing
+  # of that type. The event loop reads it in without blocking; with
+  # Mg::Window.event_threads off, keep calling Mg.dispatch_pending meanwhile.
+  # Given an IO, the contents are written to it as they arrive and the future
+  # resolves with their size. The future is rejected if the owner stays silent
+  # for timeout seconds, before answering or between chunks.
+  #
+  #   File.open('dump.csv', 'wb') { |file| window.get_clipboard(type: 'text/csv', io: file).value }
+  def get_clipboard(type: :text, selection: :clipboard, io: nil, timeout: 5)
+    io&.flush
+    text = type == :text
+    read_clipboard selection, text ? TEXT_TYPES.first : type.to_s, io&.fileno, text,
+                   (timeout * 1000).ceil
+  end
+
+  # Sets the handler of the event. Key press handlers that take a second
+  # argument are also told whether the press is an auto repeat:
+  #
+  #   window.on_key_press { |key, repeat| jump if key == :space && !repeat }
   SUPPORTED_EVENTS.each do |event|
     class_eval <<-METHOD
       def on_#{event} &block
@@ -0,0 +1,39 @@
+require 'minitest/autorun'
+require 'fiddle'
+require 'mg'
+
+module Mg::Test
+
+  # Windows need an X server; CI runs the suite under Xvfb:
+  #
+  #   xvfb-run -a rake test
+  def require_display
+    skip 'no X display' unless ENV['DISPLAY']
+  end
+
+  GL = Fiddle.dlopen 'libGL.so.1'
+
+  # Looks a GL function up, for state Mg doesn't expose.
+  def gl(name, arguments, result = Fiddle::TYPE_VOID)
+    Fiddle::Function.new GL[name], arguments, result
+  end
+
+  def gl_integer(name)
+    value = [0].pack 'l'
+    gl('glGetIntegerv', [Fiddle::TYPE_INT, Fiddle::TYPE_VOIDP]).call name, value
+    value.unpack1 'l'
+  end
+
+  # Clears the current context's color buffer, standing in for rendering.
+  def gl_clear(r, g, b, a = 1)
+    @gl_clear_color ||= Fiddle::Function.new GL['glClearColor'], [Fiddle::TYPE_FLOAT] * 4, Fiddle::TYPE_VOID
+    @gl_clear ||= Fiddle::Function.new GL['glClear'], [Fiddle::TYPE_INT], Fiddle::TYPE_VOID
+    @gl_clear_color.call r, g, b, a
+    @gl_clear.call 0x4000
+  end
+
+  def monotonic
+    Process.clock_gettime Process::CLOCK_MONOTONIC
+  end
+
+end
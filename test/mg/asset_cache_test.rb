@@ -0,0 +1,77 @@
+require 'helper'
+require 'tmpdir'
+
+class Mg::AssetCacheTest < Minitest::Test
+
+  include Mg::Test
+
+  TEXTURE_2D = 0x0DE1
+  TEXTURE_BINDING_2D = 0x8069
+  UNPACK_ALIGNMENT = 0x0CF5
+  UNPACK_ROW_LENGTH = 0x0CF2
+  RGBA = 0x1908
+  UNSIGNED_BYTE = 0x1401
+
+  PIXELS = [[10, 20, 30, 255], [40, 50, 60, 255], [70, 80, 90, 255]]
+
+  def setup
+    @directory = Dir.mktmpdir
+    @path = File.join @directory, 'image.qoi'
+    header = ['qoif', 3, 1, 4, 0].pack 'a4NNCC'
+    body = PIXELS.map { |pixel| [0xFF, *pixel].pack 'C5' }.join
+    File.binwrite @path, header + body + "\0" * 7 + "\1"
+    @cache = Mg::AssetCache.new File.join(@directory, 'cache'), format: :rgba
+  end
+
+  def teardown
+    @target&.close
+    FileUtils.remove_entry @directory
+  end
+
+  def offscreen
+    @target = Mg::Offscreen.new 4, 4, format: :rgba
+  rescue NotImplementedError, RuntimeError => error
+    skip error.message
+  end
+
+  def test_entries_are_stored_then_hit
+    entry = @cache.fetch @path
+    refute entry.hit?
+    assert_equal [3, 1, :rgba, 1], [entry.width, entry.height, entry.format, entry.levels]
+
+    entry = @cache.fetch @path
+    assert entry.hit?
+    assert_equal 3 * 4, entry.bytesize
+  end
+
+  def test_asynchronous_fetches_resolve_futures
+    entries = @cache.fetch_all [@path, @path]
+    assert_equal [3, 3], entries.map(&:width)
+  end
+
+  def test_upload_leaves_the_callers_state_alone
+    offscreen
+    entry = @cache.fetch @path
+
+    texture = [0].pack 'L'
+    gl('glGenTextures', [Fiddle::TYPE_INT, Fiddle::TYPE_VOIDP]).call 1, texture
+    texture = texture.unpack1 'L'
+    gl('glBindTexture', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call TEXTURE_2D, texture
+    gl('glPixelStorei', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call UNPACK_ALIGNMENT, 1
+    gl('glPixelStorei', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call UNPACK_ROW_LENGTH, 7
+
+    uploaded = entry.upload
+
+    refute_equal texture, uploaded
+    assert_equal texture, gl_integer(TEXTURE_BINDING_2D)
+    assert_equal 1, gl_integer(UNPACK_ALIGNMENT)
+    assert_equal 7, gl_integer(UNPACK_ROW_LENGTH)
+
+    # The caller's row length didn't skew the upload
+    gl('glBindTexture', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call TEXTURE_2D, uploaded
+    pixels = "\0" * 3 * 4
+    gl('glGetTexImage', [Fiddle::TYPE_INT] * 4 + [Fiddle::TYPE_VOIDP]).call TEXTURE_2D, 0, RGBA, UNSIGNED_BYTE, pixels
+    assert_equal PIXELS.flatten, pixels.bytes
+  end
+
+end
@@ -0,0 +1,170 @@
+require 'helper'
+require 'tmpdir'
+
+class Mg::CanvasTest < Minitest::Test
+
+  include Mg::Test
+
+  TILE = Mg::Canvas::TILE_SIZE
+
+  def setup
+    @directory = Dir.mktmpdir
+  end
+
+  def teardown
+    FileUtils.remove_entry @directory
+  end
+
+  # Writes a QOI file of the given RGBA pixels and loads it.
+  def image(width, height, format = :rgba, pixel = [0, 0, 0, 255])
+    path = File.join @directory, "#{width}x#{height}.qoi"
+    header = ['qoif', width, height, 4, 0].pack 'a4NNCC'
+    body = ([0xFF, *pixel].pack('C5') * (width * height))
+    File.binwrite path, header + body + "\0" * 7 + "\1"
+    Mg::Image.load path, format
+  end
+
+  def pixel(image, x, y)
+    image.pixels.byteslice((y * image.width + x) * 4, 4).bytes
+  end
+
+  def assert_pixel(expected, image, x, y, delta = 0)
+    actual = pixel image, x, y
+    message = "pixel at #{x},#{y} is #{actual}, expected #{expected}"
+    assert expected.zip(actual).all? { |e, a| (e - a).abs <= delta }, message
+  end
+
+  def test_nothing_is_drawn_until_flush
+    target = image 8, 8
+    canvas = Mg::Canvas.new target
+    canvas.clear 0x102030FF
+    assert_equal 1, canvas.pending
+    assert_pixel [0, 0, 0, 255], target, 0, 0
+
+    canvas.flush
+    assert_equal 0, canvas.pending
+    assert_pixel [16, 32, 48, 255], target, 7, 7
+  end
+
+  def test_discard_drops_commands
+    target = image 8, 8
+    canvas = Mg::Canvas.new target
+    canvas.clear 0xFFFFFFFF
+    canvas.discard
+    assert_equal 0, canvas.pending
+    canvas.flush
+    assert_pixel [0, 0, 0, 255], target, 0, 0
+  end
+
+  def test_fill_rect_covers_exactly_its_pixels
+    target = image 16, 16
+    Mg::Canvas.new(target).fill_rect(2, 3, 4, 5, 0xFF0000FF).flush
+    assert_pixel [255, 0, 0, 255], target, 2, 3
+    assert_pixel [255, 0, 0, 255], target, 5, 7
+    assert_pixel [0, 0, 0, 255], target, 1, 3
+    assert_pixel [0, 0, 0, 255], target, 6, 3
+    assert_pixel [0, 0, 0, 255], target, 2, 8
+  end
+
+  def test_translucent_colors_blend
+    target = image 4, 4
+    Mg::Canvas.new(target).fill_rect(0, 0, 4, 4, 0xFF000080).flush
+    assert_pixel [128, 0, 0, 255], target, 1, 1, 1
+  end
+
+  def test_bgra_targets_store_blue_first
+    target = image 4, 4, :bgra
+    Mg::Canvas.new(target).clear(0x11223344).flush
+    assert_equal [0x33, 0x22, 0x11], pixel(target, 0, 0).first(3)
+  end
+
+  def test_commands_span_tiles
+    target = image TILE * 2 + 10, TILE + 10
+    canvas = Mg::Canvas.new target
+    canvas.clear 0x000000FF
+    canvas.fill_rect TILE - 1, TILE - 1, TILE + 2, 2, 0x00FF00FF
+    canvas.flush
+    assert_pixel [0, 255, 0, 255], target, TILE - 1, TILE - 1
+    assert_pixel [0, 255, 0, 255], target, TILE, TILE
+    assert_pixel [0, 255, 0, 255], target, TILE * 2, TILE
+    assert_pixel [0, 0, 0, 255], target, TILE * 2 + 1, TILE
+    assert_pixel [0, 0, 0, 255], target, TILE - 1, TILE + 1
+  end
+
+  def test_clip_restricts_and_restores
+    target = image 16, 16
+    canvas = Mg::Canvas.new target
+    canvas.clip(4, 4, 4, 4) { canvas.fill_rect 0, 0, 16, 16, 0xFFFFFFFF }
+    canvas.fill_rect 12, 12, 2, 2, 0x0000FFFF
+    canvas.flush
+    assert_pixel [255, 255, 255, 255], target, 4, 4
+    assert_pixel [255, 255, 255, 255], target, 7, 7
+    assert_pixel [0, 0, 0, 255], target, 3, 4
+    assert_pixel [0, 0, 0, 255], target, 8, 8
+    assert_pixel [0, 0, 255, 255], target, 12, 12
+  end
+
+  def test_lines_and_circles
+    target = image 32, 32
+    canvas = Mg::Canvas.new target
+    canvas.line 0, 10, 31, 10, 0xFFFFFFFF, width: 2
+    canvas.fill_circle 20, 20, 4, 0xFF0000FF
+    canvas.stroke_circle 8, 24, 5, 0x0000FFFF
+    canvas.flush
+    assert_pixel [255, 255, 255, 255], target, 16, 10
+    assert_pixel [0, 0, 0, 255], target, 16, 14
+    assert_pixel [255, 0, 0, 255], target, 20, 20
+    assert_pixel [0, 0, 0, 255], target, 20, 26
+    assert_pixel [0, 0, 0, 255], target, 8, 24
+  end
+
+  def test_blit_copies_images_with_alpha
+    target = image 8, 8
+    sprite = image 2, 2, :rgba, [255, 255, 255, 255]
+    canvas = Mg::Canvas.new target
+    canvas.blit sprite, 1, 1
+    canvas.blit sprite, 5, 5, alpha: 128
+    canvas.flush
+    assert_pixel [255, 255, 255, 255], target, 2, 2
+    assert_pixel [0, 0, 0, 255], target, 3, 3
+    assert_pixel [128, 128, 128, 255], target, 5, 5, 1
+  end
+
+  def test_text_is_drawn_from_the_font_atlas
+    target = image 64, 16
+    font = Mg::Font.new size: 8
+    canvas = Mg::Canvas.new target
+    canvas.text font, 'Hi', 0, 0, 0xFFFFFFFF
+    canvas.flush
+    lit = target.pixels.each_byte.each_slice(4).count { |r, g, b, a| r > 128 }
+    assert_operator lit, :>, 0
+    assert_operator lit, :<, 16 * 8 / 2
+  end
+
+  # Laying out new glyphs grows and moves the atlas, which flushes on other
+  # threads are reading without the GVL; layouts wait for them.
+  def test_layouts_wait_for_flushes_reading_the_atlas
+    font = Mg::Font.new size: 32
+    canvases = 4.times.map { Mg::Canvas.new image(512, 512) }
+    layouts = Thread.new do
+      (0x20..0x2FF).each { |codepoint| font.measure codepoint.chr(Encoding::UTF_8) * 4 }
+    end
+
+    20.times do
+      canvases.each do |canvas|
+        canvas.text font, 'The quick brown fox', 0, 0, 0xFFFFFFFF
+        canvas.flush
+      end
+    end
+
+    layouts.join
+    assert_operator font.stats[:atlas_height], :>, 0
+  end
+
+  def test_invalid_targets
+    target = image 4, 4
+    assert_raises(ArgumentError) { Mg::Canvas.new(target).blit target, 0, 0 }
+    assert_raises(TypeError) { Mg::Canvas.new 'image' }
+  end
+
+end
@@ -0,0 +1,62 @@
+require 'helper'
+require 'tmpdir'
+
+class Mg::CaptureTest < Minitest::Test
+
+  include Mg::Test
+
+  WIDTH, HEIGHT = 64, 32
+
+  def setup
+    require_display
+    @window = Mg::Window.new 'capture', 0, 0, WIDTH, HEIGHT
+    @window.show
+  end
+
+  def teardown
+    @window&.close
+  end
+
+  def test_y4m_stream_holds_every_written_frame
+    Dir.mktmpdir do |directory|
+      path = File.join directory, 'frames.y4m'
+      @window.start_capture path, rate: 30
+      assert @window.capturing?
+
+      6.times do |i|
+        gl_clear i.odd? ? 1 : 0, i.odd? ? 1 : 0, i.odd? ? 1 : 0
+        @window.swap_buffers
+      end
+      stats = @window.stop_capture
+      refute @window.capturing?
+
+      assert_equal 6, stats[:frames]
+      assert_equal stats[:frames], stats[:written] + stats[:dropped]
+      assert_operator stats[:written], :>, 0
+
+      data = File.binread path
+      header = "YUV4MPEG2 W#{WIDTH} H#{HEIGHT} F30:1 Ip A1:1 C420jpeg\n"
+      frame = "FRAME\n".bytesize + WIDTH * HEIGHT * 3 / 2
+      assert data.start_with?(header)
+      assert_equal header.bytesize + stats[:written] * frame, data.bytesize
+      assert_equal stats[:bytes], data.bytesize
+
+      lumas = stats[:written].times.map { |i| data.getbyte header.bytesize + i * frame + 6 }
+      assert lumas.all? { |luma| luma < 8 || luma > 247 }
+    end
+  end
+
+  def test_io_targets_are_left_open
+    reader, writer = IO.pipe
+    @window.start_capture writer
+    gl_clear 0, 0, 0
+    @window.swap_buffers
+    @window.stop_capture
+    refute writer.closed?
+    writer.close
+    assert reader.read.start_with?('YUV4MPEG2')
+  ensure
+    reader&.close
+  end
+
+end
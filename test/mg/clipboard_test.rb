@@ -0,0 +1,133 @@
+require 'helper'
+require 'rbconfig'
+require 'tmpdir'
+
+class Mg::ClipboardTest < Minitest::Test
+
+  include Mg::Test
+
+  TYPE = 'application/x-mg-test'
+
+  # Larger than a single property, so other clients get it through INCR.
+  DATA = Random.new(1).bytes 3 * 1024 * 1024
+
+  LIB = File.expand_path '../../lib', __dir__
+
+  # Owns the clipboard from another process until its input is closed.
+  OWNER = <<~'RUBY'
+    require 'mg'
+    window = Mg::Window.new 'clipboard owner', 0, 0, 16, 16
+    window.set_clipboard File.binread(ARGV[0]), type: ARGV[1]
+    $stdout.puts 'ready'
+    $stdout.flush
+    if Mg::Window.event_threads?
+      $stdin.read
+    else
+      Mg.dispatch_pending until IO.select [$stdin], nil, nil, 0.001
+    end
+    window.close
+  RUBY
+
+  # Owns the clipboard from another process, but never handles its events.
+  SILENT_OWNER = <<~'RUBY'
+    require 'mg'
+    Mg::Window.event_threads = false
+    window = Mg::Window.new 'silent clipboard owner', 0, 0, 16, 16
+    window.set_clipboard 'never sent'
+    $stdout.puts 'ready'
+    $stdout.flush
+    $stdin.read
+    window.close
+  RUBY
+
+  def setup
+    require_display
+    @window = Mg::Window.new 'clipboard', 0, 0, 16, 16
+  end
+
+  def teardown
+    @window&.close
+    if @owner
+      @owner_input.close
+      Process.wait @owner
+    end
+    FileUtils.remove_entry @directory if @directory
+  end
+
+  def spawn_owner(script = OWNER)
+    @directory = Dir.mktmpdir
+    path = File.join @directory, 'data'
+    File.binwrite path, DATA
+
+    @owner_input, input = IO.pipe
+    output, @owner_output = IO.pipe
+    @owner = Process.spawn RbConfig.ruby, *$LOAD_PATH.flat_map { |dir| ['-I', dir] },
+                           '-e', script, path, TYPE, in: @owner_input, out: @owner_output
+    @owner_input.close
+    @owner_output.close
+    @owner_input = input
+    assert_equal "ready\n", output.gets
+  end
+
+  # Waits for the future, running the event loop when it has no thread.
+  def wait(future)
+    deadline = monotonic + 10
+    until future.ready? || monotonic > deadline
+      Mg.dispatch_pending unless Mg::Window.event_threads?
+      sleep 0.001
+    end
+    assert future.ready?, 'the selection never arrived'
+    future.value
+  end
+
+  def test_large_selections_of_other_clients_arrive_whole
+    spawn_owner
+    contents = wait @window.get_clipboard(type: TYPE)
+    assert_equal DATA.bytesize, contents.bytesize
+    assert_equal DATA, contents
+    assert_operator @window.clipboard_stats[:chunks], :>, 1
+  end
+
+  def test_large_selections_of_other_clients_stream_to_ios
+    spawn_owner
+    reader, writer = IO.pipe
+    future = @window.get_clipboard type: TYPE, io: writer
+    writer.close
+    assert_equal DATA, reader.read.b
+    assert_equal DATA.bytesize, wait(future)
+  end
+
+  def test_own_selections_stream_to_ios_without_waiting_for_readers
+    @window.set_clipboard DATA, type: TYPE
+    reader, writer = IO.pipe
+    # Far more than the pipe holds, yet nothing reads it until it returns
+    future = @window.get_clipboard type: TYPE, io: writer
+    writer.close
+    refute future.ready?
+    assert_equal DATA, reader.read.b
+    assert_equal DATA.bytesize, wait(future)
+  end
+
+  def test_silent_owners_time_out
+    spawn_owner SILENT_OWNER
+    first = @window.get_clipboard timeout: 0.2
+    # Queued behind the first, it's only held up until that one times out
+    second = @window.get_clipboard type: TYPE, timeout: 0.2
+    error = assert_raises(RuntimeError) { wait first }
+    assert_match(/did not answer/, error.message)
+    assert_raises(RuntimeError) { wait second }
+  end
+
+  def test_missing_types_are_nil
+    @window.set_clipboard 'text'
+    assert_nil wait(@window.get_clipboard(type: TYPE))
+  end
+
+  def test_text_round_trips_as_utf8
+    @window.clipboard = 'ação'
+    text = wait @window.get_clipboard
+    assert_equal 'ação', text
+    assert_equal Encoding::UTF_8, text.encoding
+  end
+
+end
@@ -0,0 +1,68 @@
+require 'helper'
+
+class Mg::ClockTest < Minitest::Test
+
+  include Mg::Test
+
+  def test_ticks_at_fixed_rate_between_frames
+    clock = Mg::Clock.new tick_rate: 120, frame_rate: 60
+    ticks, alphas = 0, []
+    clock.on_tick { |dt| ticks += 1 }
+    clock.on_frame { |alpha, dt| alphas << alpha; clock.stop if alphas.size == 30 }
+
+    start = monotonic
+    clock.run dispatch: false
+    elapsed = monotonic - start
+
+    assert_in_delta 0.5, elapsed, 0.25
+    assert_in_delta 60, ticks, 8
+    assert alphas.all? { |alpha| alpha >= 0 && alpha < 1 }
+    assert_equal 30, clock.stats[:frames]
+    refute clock.running?
+  end
+
+  def test_step_is_tick_period
+    assert_in_delta 1.0 / 120, Mg::Clock.new(tick_rate: 120).step, 1e-12
+  end
+
+  def test_slow_frames_overrun_and_cap_ticks
+    clock = Mg::Clock.new tick_rate: 1000, frame_rate: 100, max_ticks: 4
+    frames = 0
+    clock.on_frame do
+      frames += 1
+      sleep 0.025 if frames == 3
+      clock.stop if frames == 10
+    end
+    clock.run dispatch: false
+
+    stats = clock.stats
+    assert_operator stats[:overruns], :>=, 1
+    assert_operator stats[:dropped_ticks], :>, 0
+    assert_operator stats[:ticks], :<=, 4 * frames
+  end
+
+  def test_stop_from_another_thread
+    clock = Mg::Clock.new
+    Thread.new { sleep 0.1; clock.stop }
+    clock.run dispatch: false
+    refute clock.running?
+    assert_operator clock.stats[:frames], :>, 0
+  end
+
+  def test_handler_exceptions_stop_the_clock
+    clock = Mg::Clock.new
+    clock.on_tick { raise 'boom' }
+    error = assert_raises(RuntimeError) { clock.run dispatch: false }
+    assert_equal 'boom', error.message
+    refute clock.running?
+  end
+
+  def test_thread_raise_interrupts_the_wait
+    clock = Mg::Clock.new frame_rate: 1
+    thread = Thread.new { clock.run dispatch: false rescue $!.class }
+    sleep 0.1
+    thread.raise IOError
+    assert_equal IOError, thread.join(2)&.value
+  end
+
+end
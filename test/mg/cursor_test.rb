@@ -0,0 +1,49 @@
+require 'helper'
+require 'tmpdir'
+
+class Mg::CursorTest < Minitest::Test
+
+  include Mg::Test
+
+  def setup
+    require_display
+    @directory = Dir.mktmpdir
+    @window = Mg::Window.new 'cursor', 0, 0, 64, 32
+    @window.show
+  end
+
+  def teardown
+    @window&.close
+    FileUtils.remove_entry @directory if @directory
+  end
+
+  # Writes a QOI file of opaque white pixels and loads it.
+  def image(width, height)
+    path = File.join @directory, "#{width}x#{height}.qoi"
+    header = ['qoif', width, height, 4, 0].pack 'a4NNCC'
+    body = [0xFF, 255, 255, 255, 255].pack('C5') * (width * height)
+    File.binwrite path, header + body + "\0" * 7 + "\1"
+    Mg::Image.load path, :bgra
+  end
+
+  def test_cursors_can_be_set_and_reset
+    cursor = image 16, 16
+    begin
+      @window.set_cursor cursor, hotspot: [8, 8]
+    rescue NotImplementedError => error
+      skip error.message
+    end
+    # The same image again is reused
+    @window.set_cursor cursor, hotspot: [8, 8]
+    @window.cursor = nil
+  end
+
+  def test_hotspots_must_be_inside_the_image
+    assert_raises(ArgumentError) { @window.set_cursor image(4, 4), hotspot: [4, 0] }
+  end
+
+  def test_cursors_must_be_images
+    assert_raises(TypeError) { @window.cursor = 'arrow' }
+  end
+
+end
@@ -0,0 +1,66 @@
+require 'helper'
+
+class Mg::DamageTest < Minitest::Test
+
+  include Mg::Test
+
+  WIDTH, HEIGHT = 64, 32
+
+  def setup
+    require_display
+    @window = Mg::Window.new 'damage', 0, 0, WIDTH, HEIGHT
+    @window.show
+    @framebuffer = @window.framebuffer
+  rescue NotImplementedError => error
+    skip error.message
+  end
+
+  def teardown
+    @window&.close
+  end
+
+  def test_framebuffer_covers_the_window
+    assert_equal WIDTH * HEIGHT * 4, @framebuffer.size
+  end
+
+  def test_undamaged_frames_are_pushed_whole
+    assert_equal WIDTH * HEIGHT * 4, @window.present
+    assert_equal 0, @window.present_stats[:partial_frames]
+  end
+
+  def test_only_damaged_rectangles_are_pushed
+    @window.present
+    @window.damage 4, 4, 8, 8
+    @window.damage 40, 20, 2, 2
+    assert_equal (8 * 8 + 2 * 2) * 4, @window.present
+
+    stats = @window.present_stats
+    assert_equal 2, stats[:frames]
+    assert_equal 1, stats[:partial_frames]
+    assert_equal (WIDTH * HEIGHT + 8 * 8 + 2 * 2) * 4, stats[:bytes]
+  end
+
+  def test_damage_is_clipped_to_the_window
+    @window.damage(-4, -4, 8, 8)
+    assert_equal 4 * 4 * 4, @window.present
+    @window.damage WIDTH - 2, HEIGHT - 2, 100, 100
+    assert_equal 2 * 2 * 4, @window.present
+  end
+
+  def test_touching_rectangles_are_merged
+    @window.damage 0, 0, 10, 10
+    @window.damage 10, 5, 10, 10
+    assert_equal 20 * 15 * 4, @window.present
+  end
+
+  def test_damage_is_cleared_by_presenting
+    @window.damage 0, 0, 4, 4
+    @window.present
+    assert_equal WIDTH * HEIGHT * 4, @window.present
+  end
+
+  def test_damage_needs_all_four_coordinates
+    assert_raises(ArgumentError) { @window.damage 0, 0 }
+  end
+
+end
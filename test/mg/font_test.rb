@@ -0,0 +1,108 @@
+require 'helper'
+
+class Mg::FontTest < Minitest::Test
+
+  include Mg::Test
+
+  ATTRIB_STACK_DEPTH = 0x0BB0
+  CLIENT_ATTRIB_STACK_DEPTH = 0x0BB1
+  MODELVIEW_STACK_DEPTH = 0x0BA3
+
+  def setup
+    @font = Mg::Font.new size: 16
+  end
+
+  # Maps one unit to one pixel, y pointing down.
+  def ortho(width, height)
+    gl('glMatrixMode', [Fiddle::TYPE_INT]).call 0x1701
+    gl('glLoadIdentity', []).call
+    gl('glOrtho', [Fiddle::TYPE_DOUBLE] * 6).call 0, width, height, 0, -1, 1
+    gl('glMatrixMode', [Fiddle::TYPE_INT]).call 0x1700
+  end
+
+  def offscreen
+    target = Mg::Offscreen.new 64, 24, format: :rgba
+    ortho 64, 24
+    gl_clear 0, 0, 0
+    target
+  rescue NotImplementedError, RuntimeError => error
+    skip error.message
+  end
+
+  # Whether glyphs were drawn: some pixels of the text's box are lit, but not
+  # all of them as with an incomplete texture.
+  def glyphs?(image, text)
+    width, height = @font.measure text
+    lit = image.pixels.each_byte.each_slice(4).count { |r, g, b, a| r > 128 }
+    lit > 0 && lit < width * height / 2
+  end
+
+  def test_bitmap_font_metrics
+    assert_equal 16, @font.size
+    assert_equal 16, @font.line_height
+    assert_equal [80, 32], @font.measure("Hi\nthere")
+    assert_equal [0, 16], @font.measure('')
+  end
+
+  def test_layouts_are_cached
+    3.times { @font.measure 'cached' }
+    stats = @font.stats
+    assert_equal 1, stats[:layouts]
+    assert_equal 2, stats[:layout_hits]
+  end
+
+  def test_invalid_sizes
+    assert_raises(ArgumentError) { Mg::Font.new size: 0 }
+  end
+
+  def test_each_context_gets_its_own_texture
+    first = offscreen
+    @font.draw 'Hi', 2, 2
+    assert glyphs?(first.read, 'Hi')
+    refute_nil @font.texture
+
+    second = offscreen
+    assert_nil @font.texture
+    @font.draw 'Hi', 2, 2
+    assert glyphs?(second.read, 'Hi')
+
+    first.make_current
+    gl_clear 0, 0, 0
+    @font.draw 'ok', 2, 2
+    assert glyphs?(first.read, 'ok')
+  ensure
+    second&.close
+    first&.close
+  end
+
+  def test_bad_arguments_raise_before_touching_gl
+    target = offscreen
+    depths = [ATTRIB_STACK_DEPTH, CLIENT_ATTRIB_STACK_DEPTH, MODELVIEW_STACK_DEPTH]
+    before = depths.map { |depth| gl_integer depth }
+
+    assert_raises(TypeError) { @font.draw 'hi', 'a', 0 }
+    assert_raises(TypeError) { @font.draw 'hi', 0, 0, color: 'white' }
+    assert_equal before, depths.map { |depth| gl_integer depth }
+
+    @font.draw 'Hi', 2, 2
+    assert glyphs?(target.read, 'Hi')
+  ensure
+    target&.close
+  end
+
+  def test_release_deletes_the_current_context_texture
+    first = offscreen
+    @font.draw 'Hi', 2, 2
+    second = offscreen
+    @font.draw 'Hi', 2, 2
+
+    @font.release
+    assert_nil @font.texture
+    first.make_current
+    refute_nil @font.texture
+  ensure
+    second&.close
+    first&.close
+  end
+
+end
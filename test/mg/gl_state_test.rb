@@ -0,0 +1,68 @@
+require 'helper'
+
+# The state cache is exercised through font drawing, the main user of it.
+class Mg::GLStateTest < Minitest::Test
+
+  include Mg::Test
+
+  TEXTURE_2D = 0x0DE1
+  BLEND = 0x0BE2
+  TEXTURE_BINDING_2D = 0x8069
+
+  def setup
+    @target = Mg::Offscreen.new 64, 24, format: :rgba
+    @font = Mg::Font.new size: 16
+    gl('glMatrixMode', [Fiddle::TYPE_INT]).call 0x1701
+    gl('glOrtho', [Fiddle::TYPE_DOUBLE] * 6).call 0, 64, 24, 0, -1, 1
+    gl('glMatrixMode', [Fiddle::TYPE_INT]).call 0x1700
+  rescue NotImplementedError, RuntimeError => error
+    skip error.message
+  end
+
+  def teardown
+    @target&.close
+  end
+
+  def enabled?(capability)
+    gl('glIsEnabled', [Fiddle::TYPE_INT], Fiddle::TYPE_CHAR).call(capability) != 0
+  end
+
+  def bound_texture
+    gl_integer TEXTURE_BINDING_2D
+  end
+
+  def lit_pixels
+    @target.read.pixels.each_byte.each_slice(4).count { |r, g, b, a| r > 128 }
+  end
+
+  def test_drawing_leaves_state_as_found
+    @font.draw 'Hi', 0, 0
+    refute enabled?(TEXTURE_2D)
+    refute enabled?(BLEND)
+    assert_equal 0, bound_texture
+  end
+
+  def test_raw_calls_between_draws_are_seen
+    @font.draw 'Hi', 0, 0
+    expected = lit_pixels
+    assert_operator expected, :>, 0
+
+    # Changes the cache can't see; a cache trusting its copy would skip
+    # binding the atlas and enabling texturing, and draw solid quads
+    gl('glEnable', [Fiddle::TYPE_INT]).call TEXTURE_2D
+    gl('glBindTexture', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call TEXTURE_2D, 0
+    gl('glDisable', [Fiddle::TYPE_INT]).call TEXTURE_2D
+    gl_clear 0, 0, 0
+
+    @font.draw 'Hi', 0, 0
+    assert_equal expected, lit_pixels
+  end
+
+  def test_changes_are_counted
+    @font.draw 'Hi', 0, 0
+    stats = @target.gl_stats
+    assert_operator stats[:made], :>, 0
+    assert_equal 0, stats[:skipped]
+  end
+
+end
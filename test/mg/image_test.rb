@@ -0,0 +1,122 @@
+require 'helper'
+require 'tmpdir'
+
+class Mg::ImageTest < Minitest::Test
+
+  include Mg::Test
+
+  def setup
+    @directory = Dir.mktmpdir
+  end
+
+  def teardown
+    FileUtils.remove_entry @directory
+  end
+
+  def write(name, bytes)
+    path = File.join @directory, name
+    File.binwrite path, bytes
+    path
+  end
+
+  # A QOI file of the given RGBA pixels, each as a full RGBA chunk.
+  def qoi(width, height, pixels)
+    header = ['qoif', width, height, 4, 0].pack 'a4NNCC'
+    body = pixels.map { |pixel| [0xFF, *pixel].pack 'C5' }.join
+    write 'image.qoi', header + body + "\0" * 7 + "\1"
+  end
+
+  # A BMP file with the given height field and raw, already padded rows.
+  def bmp(width, height, bpp, rows, palette: '')
+    offset = 14 + 40 + palette.bytesize
+    file_header = ['BM', offset + rows.bytesize, 0, offset].pack 'a2VVV'
+    info_header = [40, width, height, 1, bpp, 0, rows.bytesize, 0, 0, palette.bytesize / 4, 0].pack 'VVVvvVVVVVV'
+    write 'image.bmp', file_header + info_header + palette + rows
+  end
+
+  def test_qoi_pixels_are_stored_in_the_requested_format
+    path = qoi 2, 1, [[10, 20, 30, 40], [50, 60, 70, 80]]
+
+    rgba = Mg::Image.load path, :rgba
+    assert_equal [2, 1], rgba.size
+    assert_equal [10, 20, 30, 40, 50, 60, 70, 80], rgba.pixels.bytes
+
+    bgra = Mg::Image.load path, :bgra
+    assert_equal :bgra, bgra.format
+    assert_equal [30, 20, 10, 40, 70, 60, 50, 80], bgra.pixels.bytes
+  end
+
+  def test_bottom_up_bmp_rows_are_flipped
+    # Two rows of one BGR pixel each, padded to 4 bytes; the bottom row comes first
+    path = bmp 1, 2, 24, [1, 2, 3, 0, 4, 5, 6, 0].pack('C*')
+    image = Mg::Image.load path, :rgba
+    assert_equal [6, 5, 4, 255, 3, 2, 1, 255], image.pixels.bytes
+  end
+
+  def test_top_down_bmp_rows_are_kept
+    path = bmp 1, -2, 32, [1, 2, 3, 9, 4, 5, 6, 9].pack('C*')
+    image = Mg::Image.load path, :rgba
+    assert_equal [3, 2, 1, 255, 6, 5, 4, 255], image.pixels.bytes
+  end
+
+  def test_palette_bmp_colors_are_looked_up
+    palette = [0, 0, 255, 0, 0, 255, 0, 0].pack 'C*'
+    path = bmp 2, 1, 8, [1, 0, 0, 0].pack('C*'), palette: palette
+    image = Mg::Image.load path, :rgba
+    assert_equal [0, 255, 0, 255, 255, 0, 0, 255], image.pixels.bytes
+  end
+
+  def test_bmp_heights_without_a_positive_counterpart_are_rejected
+    path = bmp 1, -2**31, 32, [0, 0, 0, 0].pack('C*')
+    error = assert_raises(RuntimeError) { Mg::Image.load path }
+    assert_match(/invalid BMP header/, error.message)
+  end
+
+  def test_absurd_dimensions_are_rejected
+    path = bmp 2**31 - 1, -(2**31 - 1), 32, [0, 0, 0, 0].pack('C*')
+    error = assert_raises(RuntimeError) { Mg::Image.load path }
+    assert_match(/invalid image dimensions/, error.message)
+
+    header = ['qoif', 2**32 - 1, 2**32 - 1, 4, 0].pack 'a4NNCC'
+    path = write 'huge.qoi', header + "\0" * 7 + "\1"
+    assert_raises(RuntimeError) { Mg::Image.load path }
+  end
+
+  def test_truncated_files_are_rejected
+    path = bmp 4, 4, 32, [0, 0, 0, 0].pack('C*')
+    error = assert_raises(RuntimeError) { Mg::Image.load path }
+    assert_match(/truncated BMP pixel data/, error.message)
+  end
+
+  def test_unknown_formats_are_rejected
+    path = write 'image.txt', 'not an image'
+    error = assert_raises(RuntimeError) { Mg::Image.load path }
+    assert_match(/unsupported image format/, error.message)
+  end
+
+  def test_missing_files_raise_system_errors
+    assert_raises(Errno::ENOENT) { Mg::Image.load File.join(@directory, 'missing.qoi') }
+  end
+
+  def test_asynchronous_loads_resolve_futures
+    path = qoi 1, 1, [[1, 2, 3, 4]]
+    future = Mg::Image.load_async path, :rgba
+    assert_kind_of Mg::Future, future
+    image = future.value
+    assert future.ready?
+    assert_equal [1, 2, 3, 4], image.pixels.bytes
+  end
+
+  def test_failed_asynchronous_loads_raise_on_value
+    path = write 'image.txt', 'not an image'
+    future = Mg::Image.load_async path
+    assert_raises(RuntimeError) { future.value }
+  end
+
+  def test_many_images_load_in_parallel
+    paths = 16.times.map { |i| write "#{i}.qoi", File.binread(qoi(1, 1, [[i, i, i, 255]])) }
+    images = Mg::Image.load_all paths, :rgba
+    assert_equal 16.times.map { |i| [i, i, i, 255] }, images.map { |image| image.pixels.bytes }
+  end
+
+end
@@ -0,0 +1,112 @@
+require 'helper'
+
+class Mg::InputTest < Minitest::Test
+
+  include Mg::Test
+
+  KEY_PRESS, KEY_RELEASE = 2, 3
+  KEY_PRESS_MASK, KEY_RELEASE_MASK = 1 << 0, 1 << 1
+  XK_A = 0x61
+
+  def setup
+    require_display
+    @x11 = Fiddle.dlopen 'libX11.so.6'
+    @display = x('XOpenDisplay', [Fiddle::TYPE_VOIDP], Fiddle::TYPE_VOIDP).call nil
+    @window = Mg::Window.new 'input', 0, 0, 64, 32
+    @window.show
+    @events = Thread::Queue.new
+  end
+
+  def teardown
+    @window&.close
+    x('XCloseDisplay', [Fiddle::TYPE_VOIDP]).call @display if @display
+  end
+
+  def x(name, arguments, result = Fiddle::TYPE_VOID)
+    Fiddle::Function.new @x11[name], arguments, result
+  end
+
+  # Sends a synthetic key event for the A key to the window, as another
+  # client would.
+  def send_key(type, time, window = @window.xid)
+    root = x('XDefaultRootWindow', [Fiddle::TYPE_VOIDP], Fiddle::TYPE_LONG).call @display
+    keycode = x('XKeysymToKeycode', [Fiddle::TYPE_VOIDP, Fiddle::TYPE_LONG], Fiddle::TYPE_CHAR).call @display, XK_A
+    # XKeyEvent on LP64, padded to the size of XEvent
+    event = [type, 0, 1, @display.to_i, window, root, 0, time,
+             0, 0, 0, 0, 0, keycode & 0xFF, 1].pack('i x4 Q i x4 Q Q Q Q Q i i i i I I i x4')
+    event += "\0" * (192 - event.bytesize)
+    mask = type == KEY_PRESS ? KEY_PRESS_MASK : KEY_RELEASE_MASK
+    x('XSendEvent', [Fiddle::TYPE_VOIDP, Fiddle::TYPE_LONG, Fiddle::TYPE_INT, Fiddle::TYPE_LONG, Fiddle::TYPE_VOIDP],
+      Fiddle::TYPE_INT).call @display, window, 0, mask, event
+    x('XFlush', [Fiddle::TYPE_VOIDP], Fiddle::TYPE_INT).call @display
+  end
+
+  def next_event
+    deadline = monotonic + 2
+    until !@events.empty? || monotonic > deadline
+      Mg.dispatch_pending unless Mg::Window.event_threads?
+      sleep 0.005
+    end
+    @events.pop timeout: 0
+  end
+
+  def test_block_handlers_are_told_about_repeats
+    @window.on_key_press { |key, repeat| @events << [key, repeat] }
+    send_key KEY_PRESS, 1000
+    assert_equal [:a, false], next_event
+    send_key KEY_PRESS, 1100
+    assert_equal [:a, true], next_event
+    assert @window.key_down?(:a)
+  end
+
+  def test_lambda_handlers_taking_only_the_key_still_work
+    events = @events
+    @window.on_key_press(&->(key) { events << key })
+    send_key KEY_PRESS, 1000
+    assert_equal :a, next_event
+  end
+
+  def test_method_handlers_taking_only_the_key_still_work
+    @window.on_key_press(&method(:pressed))
+    send_key KEY_PRESS, 1000
+    assert_equal :a, next_event
+  end
+
+  def test_releases_clear_held_keys
+    @window.on_key_release { |key| @events << [:release, key] }
+    send_key KEY_PRESS, 1000
+    send_key KEY_RELEASE, 1200
+    assert_equal [:release, :a], next_event
+    refute @window.key_down?(:a)
+  end
+
+  def test_other_ractors_windows_are_left_to_them
+    ractor = Ractor.new do
+      Mg::Window.event_threads = false
+      window = Mg::Window.new 'ractor', 0, 0, 64, 32
+      window.show
+      keys = []
+      window.on_key_press { |key| keys << key }
+      Ractor.yield window.xid
+      Ractor.receive
+      deadline = Process.clock_gettime(Process::CLOCK_MONOTONIC) + 2
+      until !keys.empty? || Process.clock_gettime(Process::CLOCK_MONOTONIC) > deadline
+        Mg.dispatch_pending
+        sleep 0.005
+      end
+      window.close
+      keys
+    end
+
+    send_key KEY_PRESS, 1000, ractor.take
+    # Dispatching here must leave the event queued for the Ractor
+    10.times { Mg.dispatch_pending; sleep 0.005 }
+    ractor.send :dispatch
+    assert_equal [:a], ractor.take
+  end
+
+  def pressed(key)
+    @events << key
+  end
+
+end
@@ -0,0 +1,90 @@
+require 'helper'
+
+class Mg::OffscreenTest < Minitest::Test
+
+  include Mg::Test
+
+  PIXEL_PACK_BUFFER = 0x88EB
+  PIXEL_PACK_BUFFER_BINDING = 0x88ED
+  PACK_ALIGNMENT = 0x0D05
+  PACK_ROW_LENGTH = 0x0D02
+
+  def setup
+    @target = Mg::Offscreen.new 64, 32, format: :rgba
+  rescue NotImplementedError, RuntimeError => error
+    skip error.message
+  end
+
+  def teardown
+    @target&.close
+  end
+
+  def test_size
+    assert_equal [64, 32], [@target.width, @target.height]
+  end
+
+  def test_read_returns_the_frame
+    gl_clear 1, 0, 0, 1
+    image = @target.read
+    assert_equal [64, 32, :rgba], [image.width, image.height, image.format]
+    assert_equal 64 * 32 * 4, image.pixels.bytesize
+    assert_equal [255, 0, 0, 255], image.pixels[0, 4].bytes
+    assert_equal [255, 0, 0, 255], image.pixels[-4, 4].bytes
+  end
+
+  def test_captures_complete_in_order
+    images = []
+    5.times do |i|
+      gl_clear i * 51 / 255.0, 0, 0, 1
+      image = @target.capture
+      images << image if image
+    end
+    images.concat @target.drain
+
+    assert_equal 5, images.size
+    assert_equal [0, 51, 102, 153, 204], images.map { |image| image.pixels.getbyte 0 }
+  end
+
+  def test_bgra_swaps_red_and_blue
+    target = Mg::Offscreen.new 8, 8, format: :bgra
+    gl_clear 1, 0, 0, 1
+    assert_equal [0, 0, 255, 255], target.read.pixels[0, 4].bytes
+  ensure
+    target&.close
+  end
+
+  def test_make_current_switches_targets
+    other = Mg::Offscreen.new 8, 8
+    gl_clear 0, 1, 0, 1
+    @target.make_current
+    gl_clear 0, 0, 1, 1
+    assert_equal [0, 0, 255, 255], @target.read.pixels[0, 4].bytes
+  ensure
+    other&.close
+  end
+
+  def test_reads_ignore_and_keep_the_callers_pixel_store
+    pack_buffer = [0].pack 'L'
+    gl('glGenBuffers', [Fiddle::TYPE_INT, Fiddle::TYPE_VOIDP]).call 1, pack_buffer
+    pack_buffer = pack_buffer.unpack1 'L'
+    gl('glBindBuffer', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call PIXEL_PACK_BUFFER, pack_buffer
+    gl('glPixelStorei', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call PACK_ALIGNMENT, 8
+    gl('glPixelStorei', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call PACK_ROW_LENGTH, 100
+
+    gl_clear 0, 1, 0, 1
+    [@target.read, (@target.capture; @target.drain.last)].each do |image|
+      assert_equal [0, 255, 0, 255] * (64 * 32), image.pixels.bytes
+    end
+
+    assert_equal pack_buffer, gl_integer(PIXEL_PACK_BUFFER_BINDING)
+    assert_equal 8, gl_integer(PACK_ALIGNMENT)
+    assert_equal 100, gl_integer(PACK_ROW_LENGTH)
+  end
+
+  def test_closed_targets_raise
+    @target.close
+    assert @target.closed?
+    assert_raises(RuntimeError) { @target.read }
+  end
+
+end
@@ -0,0 +1,64 @@
+require 'helper'
+
+# Xvfb supports Present with a simulated retrace, which is enough to check
+# that frames are scheduled and reported; how they look is not checked.
+class Mg::PresentTest < Minitest::Test
+
+  include Mg::Test
+
+  MODES = %i(copy flip skip suboptimal_copy)
+
+  def setup
+    require_display
+    @window = Mg::Window.new 'present', 0, 0, 64, 32
+    @window.show
+    @now = @window.wait_msc
+  rescue NotImplementedError => error
+    skip error.message
+  end
+
+  def teardown
+    @window&.close
+  end
+
+  # Without MIT-SHM pixmaps, framebuffers are pushed with plain image
+  # requests, which report nothing.
+  def pixmap_feedback
+    feedback = @window.present_feedback
+    skip 'framebuffer presented without shared memory pixmaps' if feedback.empty?
+    feedback
+  end
+
+  def test_wait_msc_reaches_the_target
+    assert_operator @now[:msc], :>, 0
+    reached = @window.wait_msc @now[:msc] + 2
+    assert_operator reached[:msc], :>=, @now[:msc] + 2
+    assert_operator reached[:ust], :>, @now[:ust]
+  end
+
+  def test_framebuffer_frames_complete_at_the_target
+    @window.framebuffer
+    assert_equal 64 * 32 * 4, @window.present(target_msc: @now[:msc] + 2)
+    @window.wait_msc @now[:msc] + 3
+
+    feedback = pixmap_feedback
+    assert_equal 1, feedback.size
+    assert_operator feedback.first[:msc], :>=, @now[:msc] + 2
+    assert_includes MODES, feedback.first[:mode]
+  end
+
+  def test_feedback_keeps_presentation_order
+    @window.framebuffer
+    3.times do
+      @window.damage 0, 0, 8, 8
+      @window.present
+    end
+    @window.wait_msc
+
+    serials = pixmap_feedback.map { |frame| frame[:serial] }
+    assert_equal 3, serials.size
+    assert_equal serials.sort, serials
+    assert_empty @window.present_feedback
+  end
+
+end
@@ -0,0 +1,137 @@
+require 'helper'
+require 'tmpdir'
+
+class Mg::ProgramTest < Minitest::Test
+
+  include Mg::Test
+
+  VERTEX = <<~GLSL
+    #version 110
+    void main() { gl_Position = gl_Vertex; }
+  GLSL
+
+  FRAGMENT = <<~GLSL
+    #version 110
+    void main() { gl_FragColor = vec4(1.0, 0.5, 0.25, 1.0); }
+  GLSL
+
+  def setup
+    @target = Mg::Offscreen.new 4, 4
+    @directory = Dir.mktmpdir
+  rescue NotImplementedError, RuntimeError => error
+    skip error.message
+  end
+
+  def teardown
+    @target&.close
+    FileUtils.remove_entry @directory if @directory
+  end
+
+  def cache
+    Mg::ProgramCache.new @directory
+  end
+
+  def binaries
+    Dir[File.join(@directory, '*.mgpb')]
+  end
+
+  def require_binaries(cache)
+    skip 'the driver has no program binary formats' unless cache.stats[:binary]
+  end
+
+  def test_first_builds_miss_and_store_their_binary
+    first = cache
+    program = first.build VERTEX, FRAGMENT
+    assert program.linked?
+    refute program.cached?
+    assert_operator program.name, :>, 0
+    assert_nil program.log
+
+    stats = first.stats
+    assert_equal [1, 0, 1], stats.values_at(:programs, :hits, :misses)
+    if stats[:binary]
+      assert_equal 1, stats[:stored]
+      assert_equal 1, binaries.size
+    end
+  end
+
+  def test_later_builds_hit_the_binary
+    cache.build(VERTEX, FRAGMENT).linked?
+    second = cache
+    require_binaries second
+
+    program = second.build VERTEX, FRAGMENT
+    assert program.cached?
+    assert program.linked?
+    assert_equal [1, 0], second.stats.values_at(:hits, :misses)
+  end
+
+  def test_different_sources_miss
+    cache.build(VERTEX, FRAGMENT).linked?
+    second = cache
+    program = second.build VERTEX, FRAGMENT.sub('0.25', '0.75')
+    refute program.cached?
+    assert program.linked?
+  end
+
+  def test_rejected_binaries_are_rebuilt_and_replaced
+    first = cache
+    require_binaries first
+    first.build(VERTEX, FRAGMENT).linked?
+    path = binaries.first
+
+    # Keep the header, so only the driver can tell
+    bytes = File.binread path
+    File.binwrite path, bytes[0, 24] + "\xFF".b * (bytes.bytesize - 24)
+
+    second = cache
+    program = second.build VERTEX, FRAGMENT
+    refute program.cached?
+    assert program.linked?
+    assert_equal [0, 1, 1], second.stats.values_at(:hits, :misses, :stored)
+    refute_equal File.binread(path)[24..], "\xFF".b * (bytes.bytesize - 24)
+
+    assert cache.build(VERTEX, FRAGMENT).cached?
+  end
+
+  def test_truncated_binaries_miss
+    first = cache
+    require_binaries first
+    first.build(VERTEX, FRAGMENT).linked?
+    File.truncate binaries.first, 10
+
+    program = cache.build VERTEX, FRAGMENT
+    refute program.cached?
+    assert program.linked?
+  end
+
+  def test_failed_builds_keep_the_log
+    failing = cache
+    program = failing.build VERTEX, "#version 110\nvoid main() { gl_FragColor = nope; }\n"
+    refute program.linked?
+    assert_match(/fragment shader/, program.log)
+    error = assert_raises(RuntimeError) { program.name }
+    assert_match(/nope/, error.message)
+    assert_equal 1, failing.stats[:failures]
+    assert_empty binaries
+  end
+
+  def test_build_all_starts_every_build_first
+    programs = cache.build_all [[VERTEX, FRAGMENT], [VERTEX, FRAGMENT.sub('0.5', '0.6')]]
+    assert programs.all?(&:linked?)
+    assert programs.all?(&:ready?)
+  end
+
+  def test_memory_only_caches_store_nothing
+    memory = Mg::ProgramCache.new nil
+    assert memory.build(VERTEX, FRAGMENT).linked?
+    assert_equal 0, memory.stats[:stored]
+  end
+
+  def test_deleted_programs_raise
+    program = cache.build VERTEX, FRAGMENT
+    program.delete
+    assert_raises(RuntimeError) { program.name }
+  end
+
+end
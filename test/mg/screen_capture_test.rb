@@ -0,0 +1,84 @@
+require 'helper'
+
+class Mg::ScreenCaptureTest < Minitest::Test
+
+  include Mg::Test
+
+  WIDTH, HEIGHT = 64, 32
+
+  def setup
+    require_display
+    @window = Mg::Window.new 'screen capture', 0, 0, WIDTH, HEIGHT
+    @window.show
+    @framebuffer = @window.framebuffer
+  rescue NotImplementedError => error
+    skip error.message
+  end
+
+  def teardown
+    @capture&.close
+    @window&.close
+  end
+
+  def capture(**options)
+    @capture = Mg::ScreenCapture.new @window, **options
+  rescue NotImplementedError => error
+    skip error.message
+  end
+
+  # Fills the window with the color through its framebuffer.
+  def fill(r, g, b)
+    pixel = @window.pixel_format == :rgba ? [r, g, b, 255] : [b, g, r, 255]
+    @framebuffer.set_string pixel.pack('C4') * (WIDTH * HEIGHT)
+    @window.present
+  end
+
+  # Captures until a frame comes out, since damage arrives asynchronously.
+  def next_frame
+    deadline = monotonic + 2
+    until (frame = @capture.capture) || monotonic > deadline
+      sleep 0.01
+    end
+    frame
+  end
+
+  def test_frames_hold_the_window_contents
+    fill 10, 20, 30
+    capture damage: false
+
+    assert_equal [WIDTH, HEIGHT], [@capture.width, @capture.height]
+    assert_equal @window.xid, @capture.window
+
+    frame = @capture.capture
+    assert_equal WIDTH * HEIGHT * 4, frame.size
+    assert_equal [30, 20, 10], frame.get_string(0, 3).bytes
+    assert_equal [30, 20, 10], frame.get_string(frame.size - 4, 3).bytes
+  end
+
+  def test_frames_are_read_only
+    fill 0, 0, 0
+    frame = capture(damage: false).capture
+    assert frame.readonly?
+  end
+
+  def test_unchanged_frames_are_skipped_with_damage
+    fill 0, 0, 0
+    capture damage: true
+    skip 'the X Server has no DAMAGE extension' unless @capture.damage?
+
+    refute_nil next_frame
+    assert_nil @capture.capture
+
+    fill 255, 255, 255
+    frame = next_frame
+    refute_nil frame
+    assert_equal [255, 255, 255], frame.get_string(0, 3).bytes
+  end
+
+  def test_closed_captures
+    capture damage: false
+    @capture.close
+    assert @capture.closed?
+  end
+
+end
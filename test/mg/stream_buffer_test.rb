@@ -0,0 +1,74 @@
+require 'helper'
+
+class Mg::StreamBufferTest < Minitest::Test
+
+  include Mg::Test
+
+  ARRAY_BUFFER = 0x8892
+  ARRAY_BUFFER_BINDING = 0x8894
+
+  def setup
+    require_display
+    @window = Mg::Window.new 'stream buffer', 0, 0, 64, 32
+    @window.create_stream_buffer size: 4096, frames: 2
+  end
+
+  def teardown
+    @window&.close
+  end
+
+  def gl(name, arguments, result = Fiddle::TYPE_VOID)
+    Fiddle::Function.new GL[name], arguments, result
+  end
+
+  def array_buffer_binding
+    binding = [0].pack 'l'
+    gl('glGetIntegerv', [Fiddle::TYPE_INT, Fiddle::TYPE_VOIDP]).call ARRAY_BUFFER_BINDING, binding
+    binding.unpack1 'l'
+  end
+
+  def bind_new_buffer
+    name = [0].pack 'L'
+    gl('glGenBuffers', [Fiddle::TYPE_INT, Fiddle::TYPE_VOIDP]).call 1, name
+    name = name.unpack1 'L'
+    gl('glBindBuffer', [Fiddle::TYPE_INT, Fiddle::TYPE_INT]).call ARRAY_BUFFER, name
+    name
+  end
+
+  def test_regions_are_allocated_in_order
+    assert_equal 0, @window.stream_write('a' * 10)
+    assert_equal 12, @window.stream_write('b' * 4)
+    assert_equal 16, @window.stream_write('c')
+    assert_equal 17, @window.stream_stats[:frame_bytes]
+  end
+
+  def test_each_frame_writes_to_its_own_region
+    @window.stream_write 'x' * 8
+    @window.swap_buffers
+    assert_equal 2048, @window.stream_write('y' * 8)
+    @window.swap_buffers
+    assert_equal 0, @window.stream_write('z' * 8)
+  end
+
+  def test_full_regions_raise
+    @window.stream_write 'x' * 2048
+    assert_raises(RuntimeError) { @window.stream_write 'y' }
+    assert_equal 1, @window.stream_stats[:overflows]
+  end
+
+  def test_alignment_must_be_a_power_of_two
+    assert_raises(ArgumentError) { @window.stream_write 'x', alignment: 3 }
+    assert_raises(ArgumentError) { @window.stream_write 'x', alignment: 0 }
+  end
+
+  def test_caller_buffer_binding_is_kept
+    buffer = bind_new_buffer
+    @window.stream_write 'x' * 64
+    assert_equal buffer, array_buffer_binding
+    @window.swap_buffers
+    @window.stream_write 'y' * 64
+    @window.swap_buffers
+    assert_equal buffer, array_buffer_binding
+  end
+
+end
@@ -0,0 +1,44 @@
+require 'helper'
+
+class Mg::WindowTest < Minitest::Test
+
+  include Mg::Test
+
+  def setup
+    require_display
+    @window = Mg::Window.new 'window', 10, 20, 64, 32
+  end
+
+  def teardown
+    @window&.close
+  end
+
+  def test_geometry
+    assert_equal [64, 32], [@window.width, @window.height]
+    @window.width = 80
+    @window.height = 40
+    deadline = monotonic + 2
+    sleep 0.01 until [@window.width, @window.height] == [80, 40] || monotonic > deadline
+    assert_equal [80, 40], [@window.width, @window.height]
+  end
+
+  def test_visibility
+    refute @window.visible?
+    @window.show
+    assert @window.visible?
+    @window.hide
+    refute @window.visible?
+  end
+
+  def test_pixel_format_describes_the_visual
+    format = @window.pixel_format
+    assert_includes [nil, :rgba, :bgra, :argb, :abgr], format
+  end
+
+  def test_closed_windows_raise
+    @window.close
+    assert @window.closed?
+    assert_raises(RuntimeError) { @window.width }
+  end
+
+end